@@ -408,6 +408,32 @@ static inline int pte_present(pte_t a)
 	return pte_flags(a) & (_PAGE_PRESENT | _PAGE_PROTNONE);
 }
 
+#ifdef CONFIG_NUMA_BALANCING
+/*
+ * NUMA hinting PTEs are PROT_NONE PTEs in a VMA that is accessible:
+ * any access faults while pte_present() still holds, so the rest of
+ * the VM keeps treating the page as mapped.  A real PROT_NONE VMA
+ * never gets as far as the fault handler.
+ */
+static inline int pte_numa(pte_t pte)
+{
+	return (pte_flags(pte) & (_PAGE_PROTNONE | _PAGE_PRESENT)) ==
+		_PAGE_PROTNONE;
+}
+
+static inline pte_t pte_mknuma(pte_t pte)
+{
+	pte = pte_set_flags(pte, _PAGE_PROTNONE);
+	return pte_clear_flags(pte, _PAGE_PRESENT);
+}
+
+static inline pte_t pte_mknonnuma(pte_t pte)
+{
+	pte = pte_clear_flags(pte, _PAGE_PROTNONE);
+	return pte_set_flags(pte, _PAGE_PRESENT | _PAGE_ACCESSED);
+}
+#endif
+
 static inline int pte_hidden(pte_t pte)
 {
 	return pte_flags(pte) & _PAGE_HIDDEN;
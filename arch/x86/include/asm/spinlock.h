@@ -96,6 +96,11 @@ static inline int __ticket_spin_is_contended(arch_spinlock_t *lock)
 	return (__ticket_t)(tmp.tail - tmp.head) > 1;
 }
 
+static __always_inline int arch_spin_value_unlocked(arch_spinlock_t lock)
+{
+	return lock.tickets.head == lock.tickets.tail;
+}
+
 #ifndef CONFIG_PARAVIRT_SPINLOCKS
 
 static inline int arch_spin_is_locked(arch_spinlock_t *lock)
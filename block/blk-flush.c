@@ -69,8 +69,10 @@
 #include <linux/bio.h>
 #include <linux/blkdev.h>
 #include <linux/gfp.h>
+#include <linux/blk-mq.h>
 
 #include "blk.h"
+#include "blk-mq.h"
 
 /* FLUSH/FUA sequences */
 enum {
@@ -126,6 +128,39 @@ static void blk_flush_restore_request(struct request *rq)
 	rq->end_io = rq->flush.saved_end_io;
 }
 
+static void mq_flush_run(struct work_struct *work)
+{
+	struct request *rq;
+
+	rq = container_of(work, struct request, mq_flush_work);
+
+	blk_mq_insert_request(rq->q, rq, false, true);
+}
+
+/*
+ * Put @rq on the dispatch queue.  blk-mq queues can't be run from the
+ * (possibly hardirq) completion context the flush machinery runs in, so
+ * the insertion is punted to kblockd there.
+ *
+ * Returns %true if the request_fn queue needs to be kicked.
+ */
+static bool blk_flush_queue_rq(struct request *rq, bool add_front)
+{
+	struct request_queue *q = rq->q;
+
+	if (q->mq_ops) {
+		INIT_WORK(&rq->mq_flush_work, mq_flush_run);
+		kblockd_schedule_work(q, &rq->mq_flush_work);
+		return false;
+	}
+
+	if (add_front)
+		list_add(&rq->queuelist, &q->queue_head);
+	else
+		list_add_tail(&rq->queuelist, &q->queue_head);
+	return true;
+}
+
 /**
  * blk_flush_complete_seq - complete flush sequence
  * @rq: FLUSH/FUA request being sequenced
@@ -139,7 +174,8 @@ static void blk_flush_restore_request(struct request *rq)
  * spin_lock_irq(q->queue_lock)
  *
  * RETURNS:
- * %true if requests were added to the dispatch queue, %false otherwise.
+ * %true if requests were added to the dispatch queue of a request_fn
+ * queue, %false otherwise.
  */
 static bool blk_flush_complete_seq(struct request *rq, unsigned int seq,
 				   int error)
@@ -167,8 +203,7 @@ static bool blk_flush_complete_seq(struct request *rq, unsigned int seq,
 
 	case REQ_FSEQ_DATA:
 		list_move_tail(&rq->flush.list, &q->flush_data_in_flight);
-		list_add(&rq->queuelist, &q->queue_head);
-		queued = true;
+		queued = blk_flush_queue_rq(rq, true);
 		break;
 
 	case REQ_FSEQ_DONE:
@@ -181,7 +216,10 @@ static bool blk_flush_complete_seq(struct request *rq, unsigned int seq,
 		BUG_ON(!list_empty(&rq->queuelist));
 		list_del_init(&rq->flush.list);
 		blk_flush_restore_request(rq);
-		__blk_end_request_all(rq, error);
+		if (q->mq_ops)
+			blk_mq_end_io(rq, error);
+		else
+			__blk_end_request_all(rq, error);
 		break;
 
 	default:
@@ -194,15 +232,23 @@ static bool blk_flush_complete_seq(struct request *rq, unsigned int seq,
 static void flush_end_io(struct request *flush_rq, int error)
 {
 	struct request_queue *q = flush_rq->q;
-	struct list_head *running = &q->flush_queue[q->flush_running_idx];
+	struct list_head *running;
 	bool queued = false;
 	struct request *rq, *n;
+	unsigned long flags = 0;
 
+	/* blk-mq completions don't hold the queue lock */
+	if (q->mq_ops)
+		spin_lock_irqsave(q->queue_lock, flags);
+
+	running = &q->flush_queue[q->flush_running_idx];
 	BUG_ON(q->flush_pending_idx == q->flush_running_idx);
 
 	/* account completion of the flush request */
 	q->flush_running_idx ^= 1;
-	elv_completed_request(q, flush_rq);
+
+	if (!q->mq_ops)
+		elv_completed_request(q, flush_rq);
 
 	/* and push the waiting requests to the next stage */
 	list_for_each_entry_safe(rq, n, running, flush.list) {
@@ -212,6 +258,11 @@ static void flush_end_io(struct request *flush_rq, int error)
 		queued |= blk_flush_complete_seq(rq, seq, error);
 	}
 
+	if (q->mq_ops) {
+		spin_unlock_irqrestore(q->queue_lock, flags);
+		return;
+	}
+
 	/*
 	 * Kick the queue to avoid stall for two cases:
 	 * 1. Moving a request silently to empty queue_head may stall the
@@ -246,6 +297,7 @@ static bool blk_kick_flush(struct request_queue *q)
 	struct list_head *pending = &q->flush_queue[q->flush_pending_idx];
 	struct request *first_rq =
 		list_first_entry(pending, struct request, flush.list);
+	struct request *flush_rq = &q->flush_rq;
 
 	/* C1 described at the top of this file */
 	if (q->flush_pending_idx != q->flush_running_idx || list_empty(pending))
@@ -261,15 +313,31 @@ static bool blk_kick_flush(struct request_queue *q)
 	 * Issue flush and toggle pending_idx.  This makes pending_idx
 	 * different from running_idx, which means flush is in flight.
 	 */
-	blk_rq_init(q, &q->flush_rq);
-	q->flush_rq.cmd_type = REQ_TYPE_FS;
-	q->flush_rq.cmd_flags = WRITE_FLUSH | REQ_FLUSH_SEQ;
-	q->flush_rq.rq_disk = first_rq->rq_disk;
-	q->flush_rq.end_io = flush_end_io;
+	if (q->mq_ops) {
+		struct blk_mq_hw_ctx *hctx;
+
+		/*
+		 * The flush request borrows the tag, software queue and
+		 * driver data of @first_rq, which can't be in flight itself
+		 * until the flush has completed.
+		 */
+		flush_rq = q->mq_flush_rq;
+		blk_rq_init(q, flush_rq);
+		flush_rq->mq_ctx = first_rq->mq_ctx;
+		flush_rq->tag = first_rq->tag;
+		hctx = q->mq_ops->map_queue(q, first_rq->mq_ctx->cpu);
+		memcpy(blk_mq_rq_to_pdu(flush_rq), blk_mq_rq_to_pdu(first_rq),
+		       hctx->cmd_size);
+	} else
+		blk_rq_init(q, flush_rq);
+
+	flush_rq->cmd_type = REQ_TYPE_FS;
+	flush_rq->cmd_flags = WRITE_FLUSH | REQ_FLUSH_SEQ;
+	flush_rq->rq_disk = first_rq->rq_disk;
+	flush_rq->end_io = flush_end_io;
 
 	q->flush_pending_idx ^= 1;
-	list_add_tail(&q->flush_rq.queuelist, &q->queue_head);
-	return true;
+	return blk_flush_queue_rq(flush_rq, false);
 }
 
 static void flush_data_end_io(struct request *rq, int error)
@@ -284,16 +352,26 @@ static void flush_data_end_io(struct request *rq, int error)
 		blk_run_queue_async(q);
 }
 
+static void mq_flush_data_end_io(struct request *rq, int error)
+{
+	struct request_queue *q = rq->q;
+	unsigned long flags;
+
+	spin_lock_irqsave(q->queue_lock, flags);
+	blk_flush_complete_seq(rq, REQ_FSEQ_DATA, error);
+	spin_unlock_irqrestore(q->queue_lock, flags);
+}
+
 /**
  * blk_insert_flush - insert a new FLUSH/FUA request
  * @rq: request to insert
  *
- * To be called from __elv_add_request() for %ELEVATOR_INSERT_FLUSH insertions.
- * @rq is being submitted.  Analyze what needs to be done and put it on the
- * right queue.
+ * To be called from __elv_add_request() for %ELEVATOR_INSERT_FLUSH insertions,
+ * or from the blk-mq submission path.  @rq is being submitted.  Analyze what
+ * needs to be done and put it on the right queue.
  *
  * CONTEXT:
- * spin_lock_irq(q->queue_lock)
+ * spin_lock_irq(q->queue_lock) for request_fn queues, none for blk-mq.
  */
 void blk_insert_flush(struct request *rq)
 {
@@ -316,7 +394,10 @@ void blk_insert_flush(struct request *rq)
 	 * complete the request.
 	 */
 	if (!policy) {
-		__blk_end_bidi_request(rq, 0, 0, 0);
+		if (q->mq_ops)
+			blk_mq_end_io(rq, 0);
+		else
+			__blk_end_bidi_request(rq, 0, 0, 0);
 		return;
 	}
 
@@ -329,7 +410,10 @@ void blk_insert_flush(struct request *rq)
 	 */
 	if ((policy & REQ_FSEQ_DATA) &&
 	    !(policy & (REQ_FSEQ_PREFLUSH | REQ_FSEQ_POSTFLUSH))) {
-		list_add_tail(&rq->queuelist, &q->queue_head);
+		if (q->mq_ops)
+			blk_mq_insert_request(q, rq, false, true);
+		else
+			list_add_tail(&rq->queuelist, &q->queue_head);
 		return;
 	}
 
@@ -341,6 +425,14 @@ void blk_insert_flush(struct request *rq)
 	INIT_LIST_HEAD(&rq->flush.list);
 	rq->cmd_flags |= REQ_FLUSH_SEQ;
 	rq->flush.saved_end_io = rq->end_io; /* Usually NULL */
+	if (q->mq_ops) {
+		rq->end_io = mq_flush_data_end_io;
+
+		spin_lock_irq(q->queue_lock);
+		blk_flush_complete_seq(rq, REQ_FSEQ_ACTIONS & ~policy, 0);
+		spin_unlock_irq(q->queue_lock);
+		return;
+	}
 	rq->end_io = flush_data_end_io;
 
 	blk_flush_complete_seq(rq, REQ_FSEQ_ACTIONS & ~policy, 0);
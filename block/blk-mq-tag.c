@@ -0,0 +1,216 @@
+/*
+ * Tag allocation for the multi-queue block layer.
+ *
+ * Every hardware queue owns a tag map sized to its queue depth.  Tags
+ * [0, nr_reserved_tags) form the reserved pool, the rest are handed out
+ * for normal I/O.  Allocation is a lockless bitmap search starting from a
+ * per-cpu hint, so that CPUs sharing a hardware queue tend to work on
+ * different cachelines of the map.
+ */
+#include <linux/kernel.h>
+#include <linux/module.h>
+#include <linux/slab.h>
+#include <linux/percpu.h>
+#include <linux/wait.h>
+#include <linux/sched.h>
+
+#include <linux/blk-mq.h>
+#include "blk-mq.h"
+
+struct blk_mq_tags {
+	unsigned int nr_tags;
+	unsigned int nr_reserved_tags;
+	unsigned int nr_normal_tags;
+
+	unsigned long *normal_map;
+	unsigned long *reserved_map;
+
+	unsigned int __percpu *alloc_hint;
+
+	wait_queue_head_t wait;
+};
+
+/*
+ * Find and grab a clear bit in @map, starting the search at @start and
+ * wrapping around once.  Returns -1 if the map is full.
+ */
+static int __blk_mq_get_bit(unsigned long *map, unsigned int depth,
+			    unsigned int start)
+{
+	unsigned int bit, end = depth;
+	bool wrapped = false;
+
+	if (start >= depth)
+		start = 0;
+
+	bit = start;
+	for (;;) {
+		bit = find_next_zero_bit(map, end, bit);
+		if (bit >= end) {
+			if (wrapped || !start)
+				return -1;
+			wrapped = true;
+			end = start;
+			bit = 0;
+			continue;
+		}
+		if (!test_and_set_bit_lock(bit, map))
+			return bit;
+		bit++;
+	}
+}
+
+static unsigned int __blk_mq_get_tag(struct blk_mq_tags *tags, bool reserved)
+{
+	unsigned int *hint;
+	int bit;
+
+	if (unlikely(reserved)) {
+		if (!tags->nr_reserved_tags)
+			return BLK_MQ_TAG_FAIL;
+
+		bit = __blk_mq_get_bit(tags->reserved_map,
+				       tags->nr_reserved_tags, 0);
+		return bit < 0 ? BLK_MQ_TAG_FAIL : bit;
+	}
+
+	hint = get_cpu_ptr(tags->alloc_hint);
+	bit = __blk_mq_get_bit(tags->normal_map, tags->nr_normal_tags, *hint);
+	if (bit >= 0)
+		*hint = bit + 1;
+	put_cpu_ptr(tags->alloc_hint);
+
+	if (bit < 0)
+		return BLK_MQ_TAG_FAIL;
+
+	return bit + tags->nr_reserved_tags;
+}
+
+/**
+ * blk_mq_get_tag - allocate a tag
+ * @tags:	tag map to allocate from
+ * @gfp:	if __GFP_WAIT is set, sleep until a tag becomes available
+ * @reserved:	allocate from the reserved pool
+ *
+ * Returns the allocated tag, or %BLK_MQ_TAG_FAIL.
+ */
+unsigned int blk_mq_get_tag(struct blk_mq_tags *tags, gfp_t gfp, bool reserved)
+{
+	DEFINE_WAIT(wait);
+	unsigned int tag;
+
+	tag = __blk_mq_get_tag(tags, reserved);
+	if (tag != BLK_MQ_TAG_FAIL || !(gfp & __GFP_WAIT))
+		return tag;
+
+	for (;;) {
+		prepare_to_wait_exclusive(&tags->wait, &wait,
+					  TASK_UNINTERRUPTIBLE);
+		tag = __blk_mq_get_tag(tags, reserved);
+		if (tag != BLK_MQ_TAG_FAIL)
+			break;
+		io_schedule();
+	}
+	finish_wait(&tags->wait, &wait);
+
+	return tag;
+}
+
+void blk_mq_put_tag(struct blk_mq_tags *tags, unsigned int tag)
+{
+	BUG_ON(tag >= tags->nr_tags);
+
+	if (tag < tags->nr_reserved_tags)
+		clear_bit_unlock(tag, tags->reserved_map);
+	else
+		clear_bit_unlock(tag - tags->nr_reserved_tags,
+				 tags->normal_map);
+
+	smp_mb__after_clear_bit();
+	if (waitqueue_active(&tags->wait))
+		wake_up(&tags->wait);
+}
+
+/*
+ * Sleep until at least one normal tag has been freed.
+ */
+void blk_mq_wait_for_tags(struct blk_mq_tags *tags)
+{
+	unsigned int tag = blk_mq_get_tag(tags, __GFP_WAIT, false);
+
+	blk_mq_put_tag(tags, tag);
+}
+
+bool blk_mq_has_free_tags(struct blk_mq_tags *tags)
+{
+	if (!tags)
+		return true;
+
+	return find_first_zero_bit(tags->normal_map, tags->nr_normal_tags) <
+		tags->nr_normal_tags;
+}
+
+/*
+ * Call @fn for every tag that is currently allocated.  The caller must
+ * cope with tags being freed and reallocated while iterating.
+ */
+void blk_mq_tag_busy_iter(struct blk_mq_tags *tags,
+			  void (*fn)(void *data, unsigned int tag), void *data)
+{
+	unsigned int bit;
+
+	for_each_set_bit(bit, tags->reserved_map, tags->nr_reserved_tags)
+		fn(data, bit);
+
+	for_each_set_bit(bit, tags->normal_map, tags->nr_normal_tags)
+		fn(data, bit + tags->nr_reserved_tags);
+}
+
+struct blk_mq_tags *blk_mq_init_tags(unsigned int total_tags,
+				     unsigned int reserved_tags, int node)
+{
+	struct blk_mq_tags *tags;
+	unsigned int cpu;
+
+	if (total_tags > BLK_MQ_MAX_DEPTH || reserved_tags >= total_tags) {
+		pr_err("blk-mq: tag depth %u (%u reserved) is invalid\n",
+		       total_tags, reserved_tags);
+		return NULL;
+	}
+
+	tags = kzalloc_node(sizeof(*tags), GFP_KERNEL, node);
+	if (!tags)
+		return NULL;
+
+	tags->nr_tags = total_tags;
+	tags->nr_reserved_tags = reserved_tags;
+	tags->nr_normal_tags = total_tags - reserved_tags;
+	init_waitqueue_head(&tags->wait);
+
+	tags->normal_map = kzalloc_node(BITS_TO_LONGS(tags->nr_normal_tags) *
+					sizeof(unsigned long), GFP_KERNEL, node);
+	tags->reserved_map = kzalloc_node(BITS_TO_LONGS(reserved_tags) *
+					  sizeof(unsigned long), GFP_KERNEL, node);
+	tags->alloc_hint = alloc_percpu(unsigned int);
+	if (!tags->normal_map || !tags->reserved_map || !tags->alloc_hint)
+		goto err_free;
+
+	/* spread the starting points of the cpus across the map */
+	for_each_possible_cpu(cpu)
+		*per_cpu_ptr(tags->alloc_hint, cpu) =
+			(cpu * tags->nr_normal_tags) / nr_cpu_ids;
+
+	return tags;
+
+err_free:
+	blk_mq_free_tags(tags);
+	return NULL;
+}
+
+void blk_mq_free_tags(struct blk_mq_tags *tags)
+{
+	free_percpu(tags->alloc_hint);
+	kfree(tags->reserved_map);
+	kfree(tags->normal_map);
+	kfree(tags);
+}
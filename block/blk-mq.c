@@ -0,0 +1,1217 @@
+/*
+ * Block multiqueue core code
+ *
+ * Requests are staged on per-cpu software queues (struct blk_mq_ctx) and
+ * handed to the driver through one or more hardware dispatch queues
+ * (struct blk_mq_hw_ctx).  The submission path does not touch a
+ * queue-wide lock: requests are preallocated per hardware queue and
+ * indexed by tag, are queued under the lock of the submitting CPU's
+ * software queue, and completions are steered back to that CPU.
+ */
+#include <linux/kernel.h>
+#include <linux/module.h>
+#include <linux/backing-dev.h>
+#include <linux/bio.h>
+#include <linux/blkdev.h>
+#include <linux/mm.h>
+#include <linux/init.h>
+#include <linux/slab.h>
+#include <linux/workqueue.h>
+#include <linux/smp.h>
+#include <linux/list_sort.h>
+#include <linux/cpu.h>
+#include <linux/cache.h>
+#include <linux/sched.h>
+#include <linux/delay.h>
+#include <linux/log2.h>
+
+#include <trace/events/block.h>
+
+#include <linux/blk-mq.h>
+#include "blk.h"
+#include "blk-mq.h"
+
+/*
+ * Requests are queued on the software queue of the CPU that allocated
+ * them.  The ctx is pinned with get_cpu() while it is chosen, but since
+ * software queues are never freed while the queue is alive, a request may
+ * still be inserted into the ctx of a CPU we have since migrated away from.
+ */
+static struct blk_mq_ctx *blk_mq_get_ctx(struct request_queue *q)
+{
+	return per_cpu_ptr(q->queue_ctx, get_cpu());
+}
+
+static void blk_mq_put_ctx(struct blk_mq_ctx *ctx)
+{
+	put_cpu();
+}
+
+/*
+ * Check if any of the ctx's have pending work in this hardware queue
+ */
+static bool blk_mq_hctx_has_pending(struct blk_mq_hw_ctx *hctx)
+{
+	unsigned int i;
+
+	if (!list_empty_careful(&hctx->dispatch))
+		return true;
+
+	for (i = 0; i < hctx->nr_ctx_map; i++)
+		if (hctx->ctx_map[i])
+			return true;
+
+	return false;
+}
+
+/*
+ * Mark this ctx as having pending work in this hardware queue
+ */
+static void blk_mq_hctx_mark_pending(struct blk_mq_hw_ctx *hctx,
+				     struct blk_mq_ctx *ctx)
+{
+	if (!test_bit(ctx->index_hw, hctx->ctx_map))
+		set_bit(ctx->index_hw, hctx->ctx_map);
+}
+
+static struct request *__blk_mq_alloc_request(struct blk_mq_hw_ctx *hctx,
+					      gfp_t gfp, bool reserved)
+{
+	struct request *rq;
+	unsigned int tag;
+
+	tag = blk_mq_get_tag(hctx->tags, gfp, reserved);
+	if (tag == BLK_MQ_TAG_FAIL)
+		return NULL;
+
+	rq = hctx->rqs[tag];
+	blk_rq_init(hctx->queue, rq);
+	rq->tag = tag;
+
+	return rq;
+}
+
+static void blk_mq_rq_ctx_init(struct request_queue *q, struct blk_mq_ctx *ctx,
+			       struct request *rq, unsigned int rw_flags)
+{
+	if (blk_queue_io_stat(q))
+		rw_flags |= REQ_IO_STAT;
+
+	rq->mq_ctx = ctx;
+	rq->cmd_flags = rw_flags;
+	ctx->rq_dispatched[rw_is_sync(rw_flags)]++;
+}
+
+/*
+ * Allocate a request from the hardware queue the current CPU maps to.  If
+ * the tag map is exhausted and @gfp allows it, sleep for a tag of that
+ * same hardware queue; the request stays associated with the software
+ * queue it was allocated for even if we wake up on another CPU.
+ */
+static struct request *blk_mq_get_request(struct request_queue *q,
+					  unsigned int rw_flags, gfp_t gfp,
+					  bool reserved)
+{
+	struct blk_mq_ctx *ctx = blk_mq_get_ctx(q);
+	struct blk_mq_hw_ctx *hctx = q->mq_ops->map_queue(q, ctx->cpu);
+	struct request *rq;
+
+	rq = __blk_mq_alloc_request(hctx, gfp & ~__GFP_WAIT, reserved);
+	blk_mq_put_ctx(ctx);
+
+	if (!rq && (gfp & __GFP_WAIT))
+		rq = __blk_mq_alloc_request(hctx, gfp, reserved);
+
+	if (rq)
+		blk_mq_rq_ctx_init(q, ctx, rq, rw_flags);
+
+	return rq;
+}
+
+struct request *blk_mq_alloc_request(struct request_queue *q, int rw,
+				     gfp_t gfp, bool reserved)
+{
+	if (unlikely(blk_queue_dead(q)))
+		return NULL;
+
+	return blk_mq_get_request(q, rw, gfp, reserved);
+}
+EXPORT_SYMBOL(blk_mq_alloc_request);
+
+struct request *blk_mq_alloc_reserved_request(struct request_queue *q, int rw,
+					      gfp_t gfp)
+{
+	return blk_mq_alloc_request(q, rw, gfp, true);
+}
+EXPORT_SYMBOL(blk_mq_alloc_reserved_request);
+
+static void __blk_mq_free_request(struct blk_mq_hw_ctx *hctx,
+				  struct blk_mq_ctx *ctx, struct request *rq)
+{
+	const int tag = rq->tag;
+
+	clear_bit(REQ_ATOM_STARTED, &rq->atomic_flags);
+	blk_mq_put_tag(hctx->tags, tag);
+}
+
+void blk_mq_free_request(struct request *rq)
+{
+	struct blk_mq_ctx *ctx = rq->mq_ctx;
+	struct request_queue *q = rq->q;
+	struct blk_mq_hw_ctx *hctx;
+
+	ctx->rq_completed[rq_is_sync(rq)]++;
+
+	hctx = q->mq_ops->map_queue(q, ctx->cpu);
+	__blk_mq_free_request(hctx, ctx, rq);
+}
+EXPORT_SYMBOL(blk_mq_free_request);
+
+bool blk_mq_can_queue(struct blk_mq_hw_ctx *hctx)
+{
+	return blk_mq_has_free_tags(hctx->tags);
+}
+EXPORT_SYMBOL(blk_mq_can_queue);
+
+struct request *blk_mq_tag_to_rq(struct blk_mq_hw_ctx *hctx, unsigned int tag)
+{
+	return hctx->rqs[tag];
+}
+EXPORT_SYMBOL(blk_mq_tag_to_rq);
+
+/**
+ * blk_mq_end_io - end I/O on a request
+ * @rq:		the request being processed
+ * @error:	%0 for success, < %0 for error
+ *
+ * Description:
+ *     Complete all bytes of @rq and release it.  Unlike the request_fn
+ *     completion helpers this does not need any queue lock.
+ */
+void blk_mq_end_io(struct request *rq, int error)
+{
+	if (blk_update_request(rq, error, blk_rq_bytes(rq)))
+		BUG();
+
+	/* the driver is done with it, don't let the timeout handler see it */
+	clear_bit(REQ_ATOM_STARTED, &rq->atomic_flags);
+
+	blk_account_io_done(rq);
+
+	if (rq->end_io)
+		rq->end_io(rq, error);
+	else
+		blk_mq_free_request(rq);
+}
+EXPORT_SYMBOL(blk_mq_end_io);
+
+static void blk_mq_complete_request_local(struct request *rq)
+{
+	struct request_queue *q = rq->q;
+
+	if (q->softirq_done_fn)
+		q->softirq_done_fn(rq);
+	else
+		blk_mq_end_io(rq, rq->errors);
+}
+
+#if defined(CONFIG_SMP) && defined(CONFIG_USE_GENERIC_SMP_HELPERS)
+static void blk_mq_complete_request_remote(void *data)
+{
+	blk_mq_complete_request_local(data);
+}
+
+/*
+ * Bounce the completion to the CPU that submitted @rq, unless it is
+ * offline or shares a cache with the completing CPU anyway.
+ */
+static bool blk_mq_ipi_complete_request(struct request *rq)
+{
+	struct request_queue *q = rq->q;
+	struct blk_mq_ctx *ctx = rq->mq_ctx;
+	bool shared = false;
+	int cpu;
+
+	if (!test_bit(QUEUE_FLAG_SAME_COMP, &q->queue_flags))
+		return false;
+
+	cpu = get_cpu();
+	if (!test_bit(QUEUE_FLAG_SAME_FORCE, &q->queue_flags))
+		shared = cpus_share_cache(cpu, ctx->cpu);
+
+	if (cpu == ctx->cpu || shared || !cpu_online(ctx->cpu)) {
+		put_cpu();
+		return false;
+	}
+
+	rq->csd.func = blk_mq_complete_request_remote;
+	rq->csd.info = rq;
+	rq->csd.flags = 0;
+	__smp_call_function_single(ctx->cpu, &rq->csd, 0);
+	put_cpu();
+
+	return true;
+}
+#else
+static bool blk_mq_ipi_complete_request(struct request *rq)
+{
+	return false;
+}
+#endif
+
+void __blk_mq_complete_request(struct request *rq)
+{
+	if (!blk_mq_ipi_complete_request(rq))
+		blk_mq_complete_request_local(rq);
+}
+
+/**
+ * blk_mq_complete_request - end I/O on a request
+ * @rq:		the request being processed
+ *
+ * Description:
+ *	Ends all I/O on a request. It does not handle partial completions.
+ *	The actual completion happens out-of-order, through the queue's
+ *	->complete handler on the CPU the request was submitted from.  If
+ *	the queue has no ->complete handler, blk_mq_end_io() is called with
+ *	rq->errors.
+ **/
+void blk_mq_complete_request(struct request *rq)
+{
+	if (unlikely(blk_should_fake_timeout(rq->q)))
+		return;
+	if (!blk_mark_rq_complete(rq))
+		__blk_mq_complete_request(rq);
+}
+EXPORT_SYMBOL(blk_mq_complete_request);
+
+static void blk_mq_start_request(struct request *rq)
+{
+	struct request_queue *q = rq->q;
+
+	trace_block_rq_issue(q, rq);
+
+	if (!rq->timeout)
+		rq->timeout = q->rq_timeout;
+	rq->deadline = jiffies + rq->timeout;
+
+	/*
+	 * Mark us as started and clear complete. Complete might have been
+	 * set if requeue raced with timeout, which then marked it as
+	 * complete. So be sure to clear complete again when we start
+	 * the request, otherwise we'll ignore the completion event.
+	 */
+	smp_mb__before_clear_bit();
+	set_bit(REQ_ATOM_STARTED, &rq->atomic_flags);
+	clear_bit(REQ_ATOM_COMPLETE, &rq->atomic_flags);
+
+	/*
+	 * All requests of a queue share the same timeout, so a pending timer
+	 * always expires before the deadline of this request.
+	 */
+	if (!timer_pending(&q->timeout))
+		mod_timer(&q->timeout, round_jiffies_up(rq->deadline));
+}
+
+static void blk_mq_requeue_request(struct request *rq)
+{
+	trace_block_rq_requeue(rq->q, rq);
+	clear_bit(REQ_ATOM_STARTED, &rq->atomic_flags);
+}
+
+struct blk_mq_timeout_data {
+	struct blk_mq_hw_ctx *hctx;
+	unsigned long next;
+	bool next_set;
+};
+
+static void blk_mq_rq_timed_out(struct request *rq)
+{
+	struct blk_mq_ops *ops = rq->q->mq_ops;
+	enum blk_eh_timer_return ret = BLK_EH_RESET_TIMER;
+
+	if (ops->timeout)
+		ret = ops->timeout(rq);
+
+	switch (ret) {
+	case BLK_EH_HANDLED:
+		__blk_mq_complete_request(rq);
+		break;
+	case BLK_EH_RESET_TIMER:
+		rq->deadline = jiffies + rq->timeout;
+		blk_clear_rq_complete(rq);
+		break;
+	case BLK_EH_NOT_HANDLED:
+		break;
+	default:
+		printk(KERN_ERR "block: bad eh return: %d\n", ret);
+		break;
+	}
+}
+
+static void blk_mq_timeout_check(void *__data, unsigned int tag)
+{
+	struct blk_mq_timeout_data *data = __data;
+	struct request *rq = data->hctx->rqs[tag];
+
+	if (!test_bit(REQ_ATOM_STARTED, &rq->atomic_flags))
+		return;
+
+	if (time_after_eq(jiffies, rq->deadline)) {
+		if (blk_mark_rq_complete(rq))
+			return;
+		blk_mq_rq_timed_out(rq);
+		if (!test_bit(REQ_ATOM_STARTED, &rq->atomic_flags) ||
+		    test_bit(REQ_ATOM_COMPLETE, &rq->atomic_flags))
+			return;
+	}
+
+	if (!data->next_set || time_after(data->next, rq->deadline)) {
+		data->next = rq->deadline;
+		data->next_set = true;
+	}
+}
+
+static void blk_mq_rq_timer(unsigned long __data)
+{
+	struct request_queue *q = (struct request_queue *) __data;
+	struct blk_mq_timeout_data data = { .next_set = false, };
+	struct blk_mq_hw_ctx *hctx;
+	int i;
+
+	queue_for_each_hw_ctx(q, hctx, i) {
+		data.hctx = hctx;
+		blk_mq_tag_busy_iter(hctx->tags, blk_mq_timeout_check, &data);
+	}
+
+	if (data.next_set)
+		mod_timer(&q->timeout, round_jiffies_up(data.next));
+}
+
+/*
+ * Run this hardware queue, pulling any software queues mapped to it in.
+ * Note that this function currently has various problems around ordering
+ * of IO. In particular, we'd like FIFO behaviour on handling existing
+ * items on the hctx->dispatch list. Ignore that for now.
+ */
+static void __blk_mq_run_hw_queue(struct blk_mq_hw_ctx *hctx)
+{
+	struct request_queue *q = hctx->queue;
+	struct blk_mq_ctx *ctx;
+	struct request *rq;
+	LIST_HEAD(rq_list);
+	int bit, queued;
+
+	if (unlikely(test_bit(BLK_MQ_S_STOPPED, &hctx->state)))
+		return;
+
+	hctx->run++;
+
+	/*
+	 * Touch any software queue that has pending entries.
+	 */
+	for_each_set_bit(bit, hctx->ctx_map, hctx->nr_ctx) {
+		clear_bit(bit, hctx->ctx_map);
+		ctx = hctx->ctxs[bit];
+		BUG_ON(bit != ctx->index_hw);
+
+		spin_lock(&ctx->lock);
+		list_splice_tail_init(&ctx->rq_list, &rq_list);
+		spin_unlock(&ctx->lock);
+	}
+
+	/*
+	 * If we have previous entries on our dispatch list, grab them
+	 * and stuff them at the front for more fair dispatch.
+	 */
+	if (!list_empty_careful(&hctx->dispatch)) {
+		spin_lock(&hctx->lock);
+		if (!list_empty(&hctx->dispatch))
+			list_splice_init(&hctx->dispatch, &rq_list);
+		spin_unlock(&hctx->lock);
+	}
+
+	/*
+	 * Now process all the entries, sending them to the driver.
+	 */
+	queued = 0;
+	while (!list_empty(&rq_list)) {
+		int ret;
+
+		rq = list_first_entry(&rq_list, struct request, queuelist);
+		list_del_init(&rq->queuelist);
+		blk_mq_start_request(rq);
+
+		ret = q->mq_ops->queue_rq(hctx, rq);
+		switch (ret) {
+		case BLK_MQ_RQ_QUEUE_OK:
+			queued++;
+			continue;
+		case BLK_MQ_RQ_QUEUE_BUSY:
+			/*
+			 * The driver is out of resources.  Put the request
+			 * back and leave the rest for the next run, which
+			 * the driver triggers by restarting the queue.
+			 */
+			list_add(&rq->queuelist, &rq_list);
+			blk_mq_requeue_request(rq);
+			break;
+		default:
+			pr_err("blk-mq: bad return on queue: %d\n", ret);
+			/* fall through */
+		case BLK_MQ_RQ_QUEUE_ERROR:
+			rq->errors = -EIO;
+			blk_mq_end_io(rq, rq->errors);
+			break;
+		}
+
+		if (ret == BLK_MQ_RQ_QUEUE_BUSY)
+			break;
+	}
+
+	if (!queued)
+		hctx->dispatched[0]++;
+	else if (queued < (1 << (BLK_MQ_MAX_DISPATCH_ORDER - 1)))
+		hctx->dispatched[ilog2(queued) + 1]++;
+
+	/*
+	 * Any items that need requeuing? Stuff them into hctx->dispatch,
+	 * that is where we will continue on next queue run.
+	 */
+	if (!list_empty(&rq_list)) {
+		spin_lock(&hctx->lock);
+		list_splice(&rq_list, &hctx->dispatch);
+		spin_unlock(&hctx->lock);
+	}
+}
+
+/**
+ * blk_mq_run_hw_queue - dispatch pending requests of a hardware queue
+ * @hctx:	hardware queue to run
+ * @async:	punt the dispatch to kblockd on a CPU mapped to @hctx
+ *
+ * Synchronous runs must be done from process context.
+ */
+void blk_mq_run_hw_queue(struct blk_mq_hw_ctx *hctx, bool async)
+{
+	unsigned int cpu;
+
+	if (unlikely(test_bit(BLK_MQ_S_STOPPED, &hctx->state) ||
+		     !blk_mq_hctx_has_pending(hctx)))
+		return;
+
+	if (!async) {
+		__blk_mq_run_hw_queue(hctx);
+		return;
+	}
+
+	cpu = cpumask_first_and(hctx->cpumask, cpu_online_mask);
+	if (cpu < nr_cpu_ids)
+		kblockd_schedule_delayed_work_on(cpu, &hctx->delayed_work, 0);
+	else
+		kblockd_schedule_delayed_work(hctx->queue,
+					      &hctx->delayed_work, 0);
+}
+
+void blk_mq_run_queues(struct request_queue *q, bool async)
+{
+	struct blk_mq_hw_ctx *hctx;
+	int i;
+
+	queue_for_each_hw_ctx(q, hctx, i)
+		blk_mq_run_hw_queue(hctx, async);
+}
+EXPORT_SYMBOL(blk_mq_run_queues);
+
+void blk_mq_stop_hw_queue(struct blk_mq_hw_ctx *hctx)
+{
+	cancel_delayed_work(&hctx->delayed_work);
+	set_bit(BLK_MQ_S_STOPPED, &hctx->state);
+}
+EXPORT_SYMBOL(blk_mq_stop_hw_queue);
+
+void blk_mq_stop_hw_queues(struct request_queue *q)
+{
+	struct blk_mq_hw_ctx *hctx;
+	int i;
+
+	queue_for_each_hw_ctx(q, hctx, i)
+		blk_mq_stop_hw_queue(hctx);
+}
+EXPORT_SYMBOL(blk_mq_stop_hw_queues);
+
+void blk_mq_start_hw_queue(struct blk_mq_hw_ctx *hctx)
+{
+	clear_bit(BLK_MQ_S_STOPPED, &hctx->state);
+	blk_mq_run_hw_queue(hctx, false);
+}
+EXPORT_SYMBOL(blk_mq_start_hw_queue);
+
+/*
+ * Restart all stopped hardware queues.  Safe to call from the driver's
+ * completion interrupt, the queues are run from kblockd.
+ */
+void blk_mq_start_stopped_hw_queues(struct request_queue *q)
+{
+	struct blk_mq_hw_ctx *hctx;
+	int i;
+
+	queue_for_each_hw_ctx(q, hctx, i) {
+		if (!test_bit(BLK_MQ_S_STOPPED, &hctx->state))
+			continue;
+
+		clear_bit(BLK_MQ_S_STOPPED, &hctx->state);
+		blk_mq_run_hw_queue(hctx, true);
+	}
+}
+EXPORT_SYMBOL(blk_mq_start_stopped_hw_queues);
+
+static void blk_mq_work_fn(struct work_struct *work)
+{
+	struct blk_mq_hw_ctx *hctx;
+
+	hctx = container_of(work, struct blk_mq_hw_ctx, delayed_work.work);
+	__blk_mq_run_hw_queue(hctx);
+}
+
+static void __blk_mq_insert_request(struct blk_mq_hw_ctx *hctx,
+				    struct request *rq, bool at_head)
+{
+	struct blk_mq_ctx *ctx = rq->mq_ctx;
+
+	trace_block_rq_insert(hctx->queue, rq);
+
+	if (at_head)
+		list_add(&rq->queuelist, &ctx->rq_list);
+	else
+		list_add_tail(&rq->queuelist, &ctx->rq_list);
+	blk_mq_hctx_mark_pending(hctx, ctx);
+}
+
+/**
+ * blk_mq_insert_request - queue a prepared request
+ * @q:		queue to insert into
+ * @rq:		request allocated from @q
+ * @at_head:	insert at the head of the software queue
+ * @run_queue:	dispatch the hardware queue right away
+ *
+ * Must be called from process context.
+ */
+void blk_mq_insert_request(struct request_queue *q, struct request *rq,
+			   bool at_head, bool run_queue)
+{
+	struct blk_mq_ctx *ctx = rq->mq_ctx;
+	struct blk_mq_hw_ctx *hctx;
+
+	hctx = q->mq_ops->map_queue(q, ctx->cpu);
+
+	spin_lock(&ctx->lock);
+	__blk_mq_insert_request(hctx, rq, at_head);
+	spin_unlock(&ctx->lock);
+
+	if (run_queue)
+		blk_mq_run_hw_queue(hctx, false);
+}
+EXPORT_SYMBOL(blk_mq_insert_request);
+
+static void blk_mq_insert_requests(struct request_queue *q,
+				   struct blk_mq_ctx *ctx,
+				   struct list_head *list, int depth,
+				   bool from_schedule)
+{
+	struct blk_mq_hw_ctx *hctx;
+
+	trace_block_unplug(q, depth, !from_schedule);
+
+	hctx = q->mq_ops->map_queue(q, ctx->cpu);
+
+	spin_lock(&ctx->lock);
+	while (!list_empty(list)) {
+		struct request *rq;
+
+		rq = list_first_entry(list, struct request, queuelist);
+		list_del_init(&rq->queuelist);
+		__blk_mq_insert_request(hctx, rq, false);
+	}
+	spin_unlock(&ctx->lock);
+
+	blk_mq_run_hw_queue(hctx, from_schedule);
+}
+
+static int plug_ctx_cmp(void *priv, struct list_head *a, struct list_head *b)
+{
+	struct request *rqa = container_of(a, struct request, queuelist);
+	struct request *rqb = container_of(b, struct request, queuelist);
+
+	return !(rqa->mq_ctx < rqb->mq_ctx ||
+		 (rqa->mq_ctx == rqb->mq_ctx &&
+		  blk_rq_pos(rqa) < blk_rq_pos(rqb)));
+}
+
+/*
+ * Called from blk_flush_plug_list().  Requests are batched per software
+ * queue so that each ctx lock is taken once per unplug.  If
+ * @from_schedule is true, the dispatch is punted to kblockd.
+ */
+void blk_mq_flush_plug_list(struct blk_plug *plug, bool from_schedule)
+{
+	struct blk_mq_ctx *this_ctx;
+	struct request_queue *this_q;
+	struct request *rq;
+	LIST_HEAD(list);
+	LIST_HEAD(ctx_list);
+	unsigned int depth;
+
+	list_splice_init(&plug->mq_list, &list);
+
+	list_sort(NULL, &list, plug_ctx_cmp);
+
+	this_q = NULL;
+	this_ctx = NULL;
+	depth = 0;
+
+	while (!list_empty(&list)) {
+		rq = list_entry_rq(list.next);
+		list_del_init(&rq->queuelist);
+		BUG_ON(!rq->q);
+		if (rq->mq_ctx != this_ctx) {
+			if (this_ctx)
+				blk_mq_insert_requests(this_q, this_ctx,
+						       &ctx_list, depth,
+						       from_schedule);
+
+			this_ctx = rq->mq_ctx;
+			this_q = rq->q;
+			depth = 0;
+		}
+
+		depth++;
+		list_add_tail(&rq->queuelist, &ctx_list);
+	}
+
+	/*
+	 * If 'this_ctx' is set, we know we have entries to complete
+	 * on 'ctx_list'. Do those.
+	 */
+	if (this_ctx)
+		blk_mq_insert_requests(this_q, this_ctx, &ctx_list, depth,
+				       from_schedule);
+}
+
+static void blk_mq_bio_to_request(struct request *rq, struct bio *bio)
+{
+	init_request_from_bio(rq, bio);
+	drive_stat_acct(rq, 1);
+}
+
+/*
+ * Try to merge @bio into one of the last few requests on the software
+ * queue.  Called with ctx->lock held.
+ */
+static bool blk_mq_attempt_merge(struct request_queue *q,
+				 struct blk_mq_ctx *ctx, struct bio *bio)
+{
+	struct request *rq;
+	int checked = 8;
+
+	list_for_each_entry_reverse(rq, &ctx->rq_list, queuelist) {
+		int el_ret;
+
+		if (!checked--)
+			break;
+
+		if (!blk_rq_merge_ok(rq, bio))
+			continue;
+
+		el_ret = blk_try_merge(rq, bio);
+		if (el_ret == ELEVATOR_BACK_MERGE) {
+			if (bio_attempt_back_merge(q, rq, bio)) {
+				ctx->rq_merged++;
+				return true;
+			}
+			break;
+		} else if (el_ret == ELEVATOR_FRONT_MERGE) {
+			if (bio_attempt_front_merge(q, rq, bio)) {
+				ctx->rq_merged++;
+				return true;
+			}
+			break;
+		}
+	}
+
+	return false;
+}
+
+static void blk_mq_make_request(struct request_queue *q, struct bio *bio)
+{
+	struct blk_mq_hw_ctx *hctx;
+	struct blk_mq_ctx *ctx;
+	const int is_sync = rw_is_sync(bio->bi_rw);
+	const int is_flush_fua = bio->bi_rw & (REQ_FLUSH | REQ_FUA);
+	int rw_flags = bio_data_dir(bio);
+	struct request *rq;
+	unsigned int use_plug, request_count = 0;
+
+	/*
+	 * If we have multiple hardware queues, just go directly to
+	 * one of those for sync IO.
+	 */
+	use_plug = !is_flush_fua && ((q->nr_hw_queues == 1) || !is_sync);
+
+	blk_queue_bounce(q, &bio);
+
+	if (use_plug && blk_attempt_plug_merge(q, bio, &request_count))
+		return;
+
+	if (unlikely(blk_queue_dead(q))) {
+		bio_endio(bio, -ENODEV);
+		return;
+	}
+
+	if (is_sync)
+		rw_flags |= REQ_SYNC;
+
+	trace_block_getrq(q, bio, bio_data_dir(bio));
+	rq = blk_mq_get_request(q, rw_flags, GFP_NOIO, false);
+	ctx = rq->mq_ctx;
+	hctx = q->mq_ops->map_queue(q, ctx->cpu);
+
+	hctx->queued++;
+
+	if (unlikely(is_flush_fua)) {
+		blk_mq_bio_to_request(rq, bio);
+		blk_insert_flush(rq);
+		return;
+	}
+
+	/*
+	 * A task plug currently exists. Since this is completely lockless,
+	 * utilize that to temporarily store requests until the task is
+	 * either done or scheduled away.
+	 */
+	if (use_plug) {
+		struct blk_plug *plug = current->plug;
+
+		if (plug) {
+			blk_mq_bio_to_request(rq, bio);
+			if (list_empty(&plug->mq_list))
+				trace_block_plug(q);
+			else if (request_count >= BLK_MAX_REQUEST_COUNT) {
+				blk_flush_plug_list(plug, false);
+				trace_block_plug(q);
+			}
+			list_add_tail(&rq->queuelist, &plug->mq_list);
+			return;
+		}
+	}
+
+	spin_lock(&ctx->lock);
+
+	if ((hctx->flags & BLK_MQ_F_SHOULD_MERGE) && !blk_queue_nomerges(q) &&
+	    blk_mq_attempt_merge(q, ctx, bio))
+		__blk_mq_free_request(hctx, ctx, rq);
+	else {
+		blk_mq_bio_to_request(rq, bio);
+		__blk_mq_insert_request(hctx, rq, false);
+	}
+
+	spin_unlock(&ctx->lock);
+
+	/*
+	 * For a SYNC request, send it to the hardware immediately. For an
+	 * ASYNC request, just ensure that we run it later on. The latter
+	 * allows for merging opportunities and more efficient dispatching.
+	 */
+	blk_mq_run_hw_queue(hctx, !is_sync);
+}
+
+/*
+ * Default mapping to a software queue, since we use one per CPU.
+ */
+struct blk_mq_hw_ctx *blk_mq_map_queue(struct request_queue *q, const int cpu)
+{
+	return q->queue_hw_ctx[q->mq_map[cpu]];
+}
+EXPORT_SYMBOL(blk_mq_map_queue);
+
+struct blk_mq_hw_ctx *blk_mq_alloc_single_hw_queue(struct blk_mq_reg *reg,
+						   unsigned int hctx_index)
+{
+	return kzalloc_node(sizeof(struct blk_mq_hw_ctx), GFP_KERNEL,
+			    reg->numa_node);
+}
+EXPORT_SYMBOL(blk_mq_alloc_single_hw_queue);
+
+void blk_mq_free_single_hw_queue(struct blk_mq_hw_ctx *hctx,
+				 unsigned int hctx_index)
+{
+	kfree(hctx);
+}
+EXPORT_SYMBOL(blk_mq_free_single_hw_queue);
+
+static size_t blk_mq_rq_size(unsigned int cmd_size)
+{
+	return round_up(sizeof(struct request) + cmd_size, cache_line_size());
+}
+
+static void blk_mq_free_rq_map(struct blk_mq_hw_ctx *hctx)
+{
+	unsigned int i;
+
+	if (hctx->tags)
+		blk_mq_free_tags(hctx->tags);
+	hctx->tags = NULL;
+
+	if (hctx->rqs)
+		for (i = 0; i < hctx->queue_depth; i++)
+			kfree(hctx->rqs[i]);
+	kfree(hctx->rqs);
+	hctx->rqs = NULL;
+}
+
+static int blk_mq_init_rq_map(struct blk_mq_hw_ctx *hctx,
+			      init_request_fn *init_request, void *data,
+			      unsigned int reserved_tags, int node)
+{
+	size_t rq_size = blk_mq_rq_size(hctx->cmd_size);
+	unsigned int i;
+
+	hctx->rqs = kzalloc_node(hctx->queue_depth * sizeof(struct request *),
+				 GFP_KERNEL, node);
+	if (!hctx->rqs)
+		return -ENOMEM;
+
+	for (i = 0; i < hctx->queue_depth; i++) {
+		struct request *rq;
+
+		rq = kzalloc_node(rq_size, GFP_KERNEL, node);
+		if (!rq)
+			goto err_rq_map;
+
+		hctx->rqs[i] = rq;
+		if (init_request && init_request(data, hctx, rq, i))
+			goto err_rq_map;
+	}
+
+	hctx->tags = blk_mq_init_tags(hctx->queue_depth, reserved_tags, node);
+	if (!hctx->tags)
+		goto err_rq_map;
+
+	return 0;
+
+err_rq_map:
+	blk_mq_free_rq_map(hctx);
+	return -ENOMEM;
+}
+
+static void blk_mq_exit_hw_queue(struct blk_mq_hw_ctx *hctx)
+{
+	blk_mq_free_rq_map(hctx);
+	kfree(hctx->ctx_map);
+	kfree(hctx->ctxs);
+	free_cpumask_var(hctx->cpumask);
+}
+
+static int blk_mq_init_hw_queues(struct request_queue *q,
+				 struct blk_mq_reg *reg, void *driver_data)
+{
+	struct blk_mq_hw_ctx *hctx;
+	unsigned int i, j;
+
+	/*
+	 * Initialize hardware queues
+	 */
+	queue_for_each_hw_ctx(q, hctx, i) {
+		unsigned int num_maps;
+		int node;
+
+		node = hctx->numa_node;
+		if (node == NUMA_NO_NODE)
+			node = hctx->numa_node = reg->numa_node;
+
+		INIT_DELAYED_WORK(&hctx->delayed_work, blk_mq_work_fn);
+		spin_lock_init(&hctx->lock);
+		INIT_LIST_HEAD(&hctx->dispatch);
+		hctx->queue = q;
+		hctx->queue_num = i;
+		hctx->flags = reg->flags;
+		hctx->queue_depth = reg->queue_depth;
+		hctx->cmd_size = reg->cmd_size;
+
+		if (!zalloc_cpumask_var_node(&hctx->cpumask, GFP_KERNEL, node))
+			break;
+
+		if (blk_mq_init_rq_map(hctx, reg->ops->init_request,
+				       driver_data, reg->reserved_tags, node))
+			break;
+
+		/*
+		 * Allocate space for all possible cpus to avoid allocation in
+		 * runtime
+		 */
+		hctx->ctxs = kmalloc_node(nr_cpu_ids * sizeof(void *),
+					  GFP_KERNEL, node);
+		if (!hctx->ctxs)
+			break;
+
+		num_maps = BITS_TO_LONGS(nr_cpu_ids);
+		hctx->ctx_map = kzalloc_node(num_maps * sizeof(unsigned long),
+					     GFP_KERNEL, node);
+		if (!hctx->ctx_map)
+			break;
+
+		hctx->nr_ctx_map = num_maps;
+		hctx->nr_ctx = 0;
+
+		if (reg->ops->init_hctx &&
+		    reg->ops->init_hctx(hctx, driver_data, i))
+			break;
+	}
+
+	if (i == q->nr_hw_queues)
+		return 0;
+
+	/*
+	 * Init failed
+	 */
+	queue_for_each_hw_ctx(q, hctx, j) {
+		if (j > i)
+			break;
+
+		if (j < i && reg->ops->exit_hctx)
+			reg->ops->exit_hctx(hctx, j);
+
+		blk_mq_exit_hw_queue(hctx);
+	}
+
+	return 1;
+}
+
+static void blk_mq_init_cpu_queues(struct request_queue *q,
+				   unsigned int nr_hw_queues)
+{
+	unsigned int i;
+
+	for_each_possible_cpu(i) {
+		struct blk_mq_ctx *__ctx = per_cpu_ptr(q->queue_ctx, i);
+		struct blk_mq_hw_ctx *hctx;
+
+		memset(__ctx, 0, sizeof(*__ctx));
+		__ctx->cpu = i;
+		spin_lock_init(&__ctx->lock);
+		INIT_LIST_HEAD(&__ctx->rq_list);
+		__ctx->queue = q;
+
+		if (!cpu_online(i))
+			continue;
+
+		/*
+		 * Set local node, IFF we have more than one hw queue. If
+		 * not, we remain on the home node of the device
+		 */
+		hctx = q->mq_ops->map_queue(q, i);
+		if (nr_hw_queues > 1 && hctx->numa_node == NUMA_NO_NODE)
+			hctx->numa_node = cpu_to_node(i);
+	}
+}
+
+static void blk_mq_map_swqueue(struct request_queue *q)
+{
+	struct blk_mq_hw_ctx *hctx;
+	unsigned int i;
+
+	/*
+	 * Map software to hardware queues
+	 */
+	for_each_possible_cpu(i) {
+		struct blk_mq_ctx *ctx = per_cpu_ptr(q->queue_ctx, i);
+
+		hctx = q->mq_ops->map_queue(q, i);
+		cpumask_set_cpu(i, hctx->cpumask);
+		ctx->index_hw = hctx->nr_ctx;
+		hctx->ctxs[hctx->nr_ctx++] = ctx;
+	}
+}
+
+/**
+ * blk_mq_init_queue - allocate a multi-queue request queue
+ * @reg:	description of the hardware queues and driver callbacks
+ * @driver_data: passed to the ->init_hctx and ->init_request callbacks
+ *
+ * Description:
+ *    Drivers that can accept requests on several hardware submission
+ *    queues, or that simply want to avoid the single queue_lock of the
+ *    request_fn model, register with blk_mq_init_queue() instead of
+ *    blk_init_queue().  Requests are handed to ->queue_rq, one at a time,
+ *    without any block layer lock held, and must be completed with
+ *    blk_mq_complete_request() or blk_mq_end_io().
+ *
+ *    Returns the queue, or %NULL on failure.  The queue is torn down with
+ *    blk_cleanup_queue().
+ **/
+struct request_queue *blk_mq_init_queue(struct blk_mq_reg *reg,
+					void *driver_data)
+{
+	struct blk_mq_hw_ctx **hctxs;
+	struct blk_mq_ctx *ctx;
+	struct request_queue *q;
+	int i;
+
+	if (!reg->nr_hw_queues ||
+	    !reg->ops->queue_rq || !reg->ops->map_queue ||
+	    !reg->ops->alloc_hctx || !reg->ops->free_hctx)
+		return NULL;
+
+	if (!reg->queue_depth)
+		reg->queue_depth = BLK_MQ_MAX_DEPTH;
+	else if (reg->queue_depth > BLK_MQ_MAX_DEPTH) {
+		pr_err("blk-mq: queuedepth too large (%u)\n", reg->queue_depth);
+		reg->queue_depth = BLK_MQ_MAX_DEPTH;
+	}
+
+	if (reg->queue_depth <= reg->reserved_tags)
+		return NULL;
+
+	ctx = alloc_percpu(struct blk_mq_ctx);
+	if (!ctx)
+		return NULL;
+
+	hctxs = kzalloc_node(reg->nr_hw_queues * sizeof(*hctxs), GFP_KERNEL,
+			     reg->numa_node);
+	if (!hctxs)
+		goto err_percpu;
+
+	for (i = 0; i < reg->nr_hw_queues; i++) {
+		hctxs[i] = reg->ops->alloc_hctx(reg, i);
+		if (!hctxs[i])
+			goto err_hctxs;
+
+		hctxs[i]->numa_node = NUMA_NO_NODE;
+		hctxs[i]->queue_num = i;
+	}
+
+	q = blk_alloc_queue_node(GFP_KERNEL, reg->numa_node);
+	if (!q)
+		goto err_hctxs;
+
+	q->mq_map = blk_mq_make_queue_map(reg);
+	if (!q->mq_map)
+		goto err_map;
+
+	/*
+	 * The flush request borrows the tag of the request it is issued
+	 * for, but needs its own room for the driver data.
+	 */
+	q->mq_flush_rq = kzalloc_node(blk_mq_rq_size(reg->cmd_size),
+				      GFP_KERNEL, reg->numa_node);
+	if (!q->mq_flush_rq)
+		goto err_map;
+
+	setup_timer(&q->timeout, blk_mq_rq_timer, (unsigned long) q);
+	blk_queue_rq_timeout(q, reg->timeout ? reg->timeout : 30 * HZ);
+
+	q->nr_queues = nr_cpu_ids;
+	q->nr_hw_queues = reg->nr_hw_queues;
+
+	q->queue_ctx = ctx;
+	q->queue_hw_ctx = hctxs;
+
+	q->mq_ops = reg->ops;
+	q->queue_flags |= QUEUE_FLAG_MQ_DEFAULT;
+
+	q->sg_reserved_size = INT_MAX;
+
+	blk_queue_make_request(q, blk_mq_make_request);
+	blk_queue_rq_timed_out(q, reg->ops->timeout);
+
+	if (reg->ops->complete)
+		blk_queue_softirq_done(q, reg->ops->complete);
+
+	blk_mq_init_cpu_queues(q, reg->nr_hw_queues);
+
+	if (blk_mq_init_hw_queues(q, reg, driver_data))
+		goto err_hw;
+
+	blk_mq_map_swqueue(q);
+
+	return q;
+
+err_hw:
+	/* tear the queue down as a plain bio queue, we free the rest */
+	q->mq_ops = NULL;
+	q->queue_ctx = NULL;
+	q->queue_hw_ctx = NULL;
+err_map:
+	kfree(q->mq_flush_rq);
+	kfree(q->mq_map);
+	blk_cleanup_queue(q);
+err_hctxs:
+	for (i = 0; i < reg->nr_hw_queues; i++) {
+		if (!hctxs[i])
+			break;
+		reg->ops->free_hctx(hctxs[i], i);
+	}
+	kfree(hctxs);
+err_percpu:
+	free_percpu(ctx);
+	return NULL;
+}
+EXPORT_SYMBOL(blk_mq_init_queue);
+
+/*
+ * Called from blk_release_queue() when the last reference to an
+ * blk-mq queue is dropped.
+ */
+void blk_mq_free_queue(struct request_queue *q)
+{
+	struct blk_mq_hw_ctx *hctx;
+	int i;
+
+	queue_for_each_hw_ctx(q, hctx, i) {
+		cancel_delayed_work_sync(&hctx->delayed_work);
+		if (q->mq_ops->exit_hctx)
+			q->mq_ops->exit_hctx(hctx, i);
+		blk_mq_exit_hw_queue(hctx);
+		q->mq_ops->free_hctx(hctx, i);
+	}
+
+	kfree(q->mq_flush_rq);
+	kfree(q->queue_hw_ctx);
+	free_percpu(q->queue_ctx);
+	kfree(q->mq_map);
+
+	q->mq_flush_rq = NULL;
+	q->queue_hw_ctx = NULL;
+	q->queue_ctx = NULL;
+	q->mq_map = NULL;
+}
+EXPORT_SYMBOL(blk_mq_free_queue);
+
+static void blk_mq_count_busy(void *data, unsigned int tag)
+{
+	(*(unsigned int *) data)++;
+}
+
+/*
+ * Wait until every request allocated from @q has been freed.  New
+ * allocations fail once the queue is marked dead, so this terminates as
+ * long as the driver completes what it was given.
+ */
+void blk_mq_drain_queue(struct request_queue *q)
+{
+	while (true) {
+		struct blk_mq_hw_ctx *hctx;
+		unsigned int busy = 0;
+		int i;
+
+		blk_mq_run_queues(q, false);
+
+		queue_for_each_hw_ctx(q, hctx, i)
+			blk_mq_tag_busy_iter(hctx->tags, blk_mq_count_busy,
+					     &busy);
+
+		if (!busy)
+			break;
+		msleep(10);
+	}
+}
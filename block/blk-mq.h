@@ -0,0 +1,49 @@
+#ifndef INT_BLK_MQ_H
+#define INT_BLK_MQ_H
+
+struct blk_mq_ctx {
+	struct {
+		spinlock_t		lock;
+		struct list_head	rq_list;
+	}  ____cacheline_aligned_in_smp;
+
+	unsigned int		cpu;
+	unsigned int		index_hw;
+
+	/* incremented at dispatch time */
+	unsigned long		rq_dispatched[2];
+	unsigned long		rq_merged;
+
+	/* incremented at completion time */
+	unsigned long		____cacheline_aligned_in_smp rq_completed[2];
+
+	struct request_queue	*queue;
+} ____cacheline_aligned_in_smp;
+
+void __blk_mq_complete_request(struct request *rq);
+void blk_mq_run_hw_queue(struct blk_mq_hw_ctx *hctx, bool async);
+void blk_mq_drain_queue(struct request_queue *q);
+
+/*
+ * CPU -> queue mappings
+ */
+int blk_mq_update_queue_map(unsigned int *map, unsigned int nr_queues);
+unsigned int *blk_mq_make_queue_map(struct blk_mq_reg *reg);
+
+/*
+ * Tag allocation
+ */
+#define BLK_MQ_TAG_FAIL		((unsigned int) -1)
+
+struct blk_mq_tags *blk_mq_init_tags(unsigned int nr_tags,
+		unsigned int reserved_tags, int node);
+void blk_mq_free_tags(struct blk_mq_tags *tags);
+unsigned int blk_mq_get_tag(struct blk_mq_tags *tags, gfp_t gfp,
+		bool reserved);
+void blk_mq_put_tag(struct blk_mq_tags *tags, unsigned int tag);
+void blk_mq_wait_for_tags(struct blk_mq_tags *tags);
+bool blk_mq_has_free_tags(struct blk_mq_tags *tags);
+void blk_mq_tag_busy_iter(struct blk_mq_tags *tags,
+		void (*fn)(void *data, unsigned int tag), void *data);
+
+#endif
@@ -138,9 +138,16 @@ static const struct ixgbe_stats ixgbe_gstrings_stats[] = {
 			 sizeof(((struct ixgbe_adapter *)0)->stats.pxoffrxc) + \
 			 sizeof(((struct ixgbe_adapter *)0)->stats.pxofftxc)) \
 			/ sizeof(u64))
+#ifdef CONFIG_NET_RX_BUSY_POLL
+/* yields, misses and cleaned per rx queue */
+#define IXGBE_BP_STATS_LEN (IXGBE_NUM_RX_QUEUES * 3)
+#else
+#define IXGBE_BP_STATS_LEN 0
+#endif
 #define IXGBE_STATS_LEN (IXGBE_GLOBAL_STATS_LEN + \
                          IXGBE_PB_STATS_LEN + \
-                         IXGBE_QUEUE_STATS_LEN)
+                         IXGBE_QUEUE_STATS_LEN + \
+                         IXGBE_BP_STATS_LEN)
 
 static const char ixgbe_gstrings_test[][ETH_GSTRING_LEN] = {
 	"Register test  (offline)", "Eeprom test    (offline)",
@@ -1074,6 +1081,23 @@ static void ixgbe_get_ethtool_stats(struct net_device *netdev,
 		} while (u64_stats_fetch_retry_bh(&ring->syncp, start));
 		i += 2;
 	}
+#ifdef CONFIG_NET_RX_BUSY_POLL
+	for (j = 0; j < IXGBE_NUM_RX_QUEUES; j++) {
+		ring = adapter->rx_ring[j];
+		if (!ring) {
+			data[i] = 0;
+			data[i+1] = 0;
+			data[i+2] = 0;
+			i += 3;
+			continue;
+		}
+
+		data[i]   = ring->rx_stats.yields;
+		data[i+1] = ring->rx_stats.misses;
+		data[i+2] = ring->rx_stats.cleaned;
+		i += 3;
+	}
+#endif
 
 	for (j = 0; j < IXGBE_MAX_PACKET_BUFFERS; j++) {
 		data[i++] = adapter->stats.pxontxc[j];
@@ -1114,6 +1138,16 @@ static void ixgbe_get_strings(struct net_device *netdev, u32 stringset,
 			sprintf(p, "rx_queue_%u_bytes", i);
 			p += ETH_GSTRING_LEN;
 		}
+#ifdef CONFIG_NET_RX_BUSY_POLL
+		for (i = 0; i < IXGBE_NUM_RX_QUEUES; i++) {
+			sprintf(p, "rx_queue_%u_bp_yields", i);
+			p += ETH_GSTRING_LEN;
+			sprintf(p, "rx_queue_%u_bp_misses", i);
+			p += ETH_GSTRING_LEN;
+			sprintf(p, "rx_queue_%u_bp_cleaned", i);
+			p += ETH_GSTRING_LEN;
+		}
+#endif
 		for (i = 0; i < IXGBE_MAX_PACKET_BUFFERS; i++) {
 			sprintf(p, "tx_pb_%u_pxon", i);
 			p += ETH_GSTRING_LEN;
@@ -133,6 +133,8 @@ int mlx4_en_activate_cq(struct mlx4_en_priv *priv, struct mlx4_en_cq *cq,
 
 	if (!cq->is_tx) {
 		netif_napi_add(cq->dev, &cq->napi, mlx4_en_poll_rx_cq, 64);
+		napi_hash_add(&cq->napi);
+		mlx4_en_cq_init_lock(cq);
 		napi_enable(&cq->napi);
 	}
 
@@ -156,6 +158,9 @@ void mlx4_en_deactivate_cq(struct mlx4_en_priv *priv, struct mlx4_en_cq *cq)
 {
 	if (!cq->is_tx) {
 		napi_disable(&cq->napi);
+		napi_hash_del(&cq->napi);
+		/* busy pollers may still see the napi through the hash */
+		synchronize_rcu();
 		netif_napi_del(&cq->napi);
 	}
 
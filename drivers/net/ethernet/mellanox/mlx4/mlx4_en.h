@@ -289,6 +289,11 @@ struct mlx4_en_rx_ring {
 	unsigned long packets;
 	unsigned long csum_ok;
 	unsigned long csum_none;
+#ifdef CONFIG_NET_RX_BUSY_POLL
+	unsigned long yields;
+	unsigned long misses;
+	unsigned long cleaned;
+#endif
 };
 
 
@@ -321,6 +326,21 @@ struct mlx4_en_cq {
 	u16 moder_cnt;
 	struct mlx4_cqe *buf;
 #define MLX4_EN_OPCODE_ERROR	0x1e
+
+#ifdef CONFIG_NET_RX_BUSY_POLL
+	unsigned int state;
+#define MLX4_EN_CQ_STATE_IDLE        0
+#define MLX4_EN_CQ_STATE_NAPI     1    /* NAPI owns this CQ */
+#define MLX4_EN_CQ_STATE_POLL     2    /* poll owns this CQ */
+#define MLX4_EN_CQ_STATE_DISABLED 4    /* CQ is disabled */
+#define MLX4_EN_CQ_OWNED (MLX4_EN_CQ_STATE_NAPI | MLX4_EN_CQ_STATE_POLL)
+#define MLX4_EN_CQ_LOCKED (MLX4_EN_CQ_OWNED | MLX4_EN_CQ_STATE_DISABLED)
+#define MLX4_EN_CQ_STATE_NAPI_YIELD  8    /* NAPI yielded this CQ */
+#define MLX4_EN_CQ_STATE_POLL_YIELD  16   /* poll yielded this CQ */
+#define CQ_YIELD (MLX4_EN_CQ_STATE_NAPI_YIELD | MLX4_EN_CQ_STATE_POLL_YIELD)
+#define CQ_USER_PEND (MLX4_EN_CQ_STATE_POLL | MLX4_EN_CQ_STATE_POLL_YIELD)
+	spinlock_t poll_lock; /* protects from busy poll / NAPI conflicts */
+#endif  /* CONFIG_NET_RX_BUSY_POLL */
 };
 
 struct mlx4_en_port_profile {
@@ -544,6 +564,146 @@ enum mlx4_en_wol {
 
 #define MLX4_EN_WOL_DO_MODIFY (1ULL << 63)
 
+#ifdef CONFIG_NET_RX_BUSY_POLL
+static inline void mlx4_en_cq_init_lock(struct mlx4_en_cq *cq)
+{
+	spin_lock_init(&cq->poll_lock);
+	cq->state = MLX4_EN_CQ_STATE_IDLE;
+}
+
+static inline void mlx4_en_cq_count_yield(struct mlx4_en_cq *cq)
+{
+	struct mlx4_en_priv *priv = netdev_priv(cq->dev);
+
+	priv->rx_ring[cq->ring].yields++;
+}
+
+/* called from the device poll routine to get ownership of a cq */
+static inline bool mlx4_en_cq_lock_napi(struct mlx4_en_cq *cq)
+{
+	bool rc = true;
+
+	spin_lock(&cq->poll_lock);
+	if (cq->state & MLX4_EN_CQ_LOCKED) {
+		WARN_ON(cq->state & MLX4_EN_CQ_STATE_NAPI);
+		cq->state |= MLX4_EN_CQ_STATE_NAPI_YIELD;
+		rc = false;
+		mlx4_en_cq_count_yield(cq);
+	} else {
+		/* we don't care if someone yielded */
+		cq->state = MLX4_EN_CQ_STATE_NAPI;
+	}
+	spin_unlock(&cq->poll_lock);
+	return rc;
+}
+
+/* returns true if someone tried to get the cq while napi had it */
+static inline bool mlx4_en_cq_unlock_napi(struct mlx4_en_cq *cq)
+{
+	bool rc = false;
+
+	spin_lock(&cq->poll_lock);
+	WARN_ON(cq->state & (MLX4_EN_CQ_STATE_POLL |
+			     MLX4_EN_CQ_STATE_NAPI_YIELD));
+
+	if (cq->state & MLX4_EN_CQ_STATE_POLL_YIELD)
+		rc = true;
+	/* will reset state to idle, unless CQ is disabled */
+	cq->state &= MLX4_EN_CQ_STATE_DISABLED;
+	spin_unlock(&cq->poll_lock);
+	return rc;
+}
+
+/* called from mlx4_en_low_latency_recv() with bottom halves disabled */
+static inline bool mlx4_en_cq_lock_poll(struct mlx4_en_cq *cq)
+{
+	bool rc = true;
+
+	spin_lock(&cq->poll_lock);
+	if (cq->state & MLX4_EN_CQ_LOCKED) {
+		cq->state |= MLX4_EN_CQ_STATE_POLL_YIELD;
+		rc = false;
+		mlx4_en_cq_count_yield(cq);
+	} else {
+		/* preserve yield marks */
+		cq->state |= MLX4_EN_CQ_STATE_POLL;
+	}
+	spin_unlock(&cq->poll_lock);
+	return rc;
+}
+
+/* returns true if someone tried to get the cq while it was locked */
+static inline bool mlx4_en_cq_unlock_poll(struct mlx4_en_cq *cq)
+{
+	bool rc = false;
+
+	spin_lock(&cq->poll_lock);
+	WARN_ON(cq->state & MLX4_EN_CQ_STATE_NAPI);
+
+	if (cq->state & MLX4_EN_CQ_STATE_POLL_YIELD)
+		rc = true;
+	/* will reset state to idle, unless CQ is disabled */
+	cq->state &= MLX4_EN_CQ_STATE_DISABLED;
+	spin_unlock(&cq->poll_lock);
+	return rc;
+}
+
+/* true if a socket is polling, even if it did not get the lock;
+ * netpoll processes the cq without owning it, so don't insist on that
+ */
+static inline bool mlx4_en_cq_ll_polling(struct mlx4_en_cq *cq)
+{
+	return cq->state & CQ_USER_PEND;
+}
+
+/* false if the CQ is currently owned */
+static inline bool mlx4_en_cq_disable(struct mlx4_en_cq *cq)
+{
+	bool rc = true;
+
+	spin_lock_bh(&cq->poll_lock);
+	if (cq->state & MLX4_EN_CQ_OWNED)
+		rc = false;
+	cq->state |= MLX4_EN_CQ_STATE_DISABLED;
+	spin_unlock_bh(&cq->poll_lock);
+	return rc;
+}
+#else
+static inline void mlx4_en_cq_init_lock(struct mlx4_en_cq *cq)
+{
+}
+
+static inline bool mlx4_en_cq_lock_napi(struct mlx4_en_cq *cq)
+{
+	return true;
+}
+
+static inline bool mlx4_en_cq_unlock_napi(struct mlx4_en_cq *cq)
+{
+	return false;
+}
+
+static inline bool mlx4_en_cq_lock_poll(struct mlx4_en_cq *cq)
+{
+	return false;
+}
+
+static inline bool mlx4_en_cq_unlock_poll(struct mlx4_en_cq *cq)
+{
+	return false;
+}
+
+static inline bool mlx4_en_cq_ll_polling(struct mlx4_en_cq *cq)
+{
+	return false;
+}
+
+static inline bool mlx4_en_cq_disable(struct mlx4_en_cq *cq)
+{
+	return true;
+}
+#endif /* CONFIG_NET_RX_BUSY_POLL */
+
 void mlx4_en_destroy_netdev(struct net_device *dev);
 int mlx4_en_init_netdev(struct mlx4_en_dev *mdev, int port,
 			struct mlx4_en_port_profile *prof);
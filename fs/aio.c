@@ -85,17 +85,27 @@ static void aio_free_ring(struct kioctx *ctx)
 	for (i=0; i<info->nr_pages; i++)
 		put_page(info->ring_pages[i]);
 
-	if (info->mmap_size) {
-		BUG_ON(ctx->mm != current->mm);
-		vm_munmap(info->mmap_base, info->mmap_size);
-	}
-
 	if (info->ring_pages && info->ring_pages != info->internal_pages)
 		kfree(info->ring_pages);
 	info->ring_pages = NULL;
 	info->nr = 0;
 }
 
+/*
+ * Unmap the ring from the owner's address space.  Must be called from
+ * the owning process: the final put of the kioctx may run from a worker.
+ */
+static void aio_unmap_ring(struct kioctx *ctx)
+{
+	struct aio_ring_info *info = &ctx->ring_info;
+
+	if (info->mmap_size) {
+		BUG_ON(ctx->mm != current->mm);
+		vm_munmap(info->mmap_base, info->mmap_size);
+		info->mmap_size = 0;
+	}
+}
+
 static int aio_setup_ring(struct kioctx *ctx)
 {
 	struct aio_ring *ring;
@@ -195,11 +205,12 @@ static void ctx_rcu_free(struct rcu_head *head)
 }
 
 /* __put_ioctx
- *	Called when the last user of an aio context has gone away,
- *	and the struct needs to be freed.
+ *	Called from a worker when the last user of an aio context has
+ *	gone away, and the struct needs to be freed.
  */
-static void __put_ioctx(struct kioctx *ctx)
+static void __put_ioctx(struct work_struct *work)
 {
+	struct kioctx *ctx = container_of(work, struct kioctx, free_work);
 	unsigned nr_events = ctx->max_reqs;
 	BUG_ON(ctx->reqs_active);
 
@@ -217,16 +228,34 @@ static void __put_ioctx(struct kioctx *ctx)
 	call_rcu(&ctx->rcu_head, ctx_rcu_free);
 }
 
+/*
+ * ->users is a percpu ref: io_submit() and io_getevents() take and drop
+ * a reference on every call, possibly from many threads sharing the
+ * context.  The initial reference stands for the mm's ioctx_list and is
+ * dropped with percpu_ref_kill() when the context is destroyed.  The
+ * release callback may run from RCU callback context, so the actual
+ * teardown is punted to a worker.
+ */
+static void free_ioctx_ref(struct percpu_ref *ref)
+{
+	struct kioctx *ctx = container_of(ref, struct kioctx, users);
+
+	schedule_work(&ctx->free_work);
+}
+
 static inline int try_get_ioctx(struct kioctx *kioctx)
 {
-	return atomic_inc_not_zero(&kioctx->users);
+	return percpu_ref_tryget(&kioctx->users);
+}
+
+static inline void get_ioctx(struct kioctx *kioctx)
+{
+	percpu_ref_get(&kioctx->users);
 }
 
 static inline void put_ioctx(struct kioctx *kioctx)
 {
-	BUG_ON(atomic_read(&kioctx->users) <= 0);
-	if (unlikely(atomic_dec_and_test(&kioctx->users)))
-		__put_ioctx(kioctx);
+	percpu_ref_put(&kioctx->users);
 }
 
 /* ioctx_alloc
@@ -256,7 +285,9 @@ static struct kioctx *ioctx_alloc(unsigned nr_events)
 	mm = ctx->mm = current->mm;
 	atomic_inc(&mm->mm_count);
 
-	atomic_set(&ctx->users, 2);
+	if (percpu_ref_init(&ctx->users, free_ioctx_ref))
+		goto out_freectx;
+
 	spin_lock_init(&ctx->ctx_lock);
 	spin_lock_init(&ctx->ring_info.ring_lock);
 	init_waitqueue_head(&ctx->wait);
@@ -264,9 +295,10 @@ static struct kioctx *ioctx_alloc(unsigned nr_events)
 	INIT_LIST_HEAD(&ctx->active_reqs);
 	INIT_LIST_HEAD(&ctx->run_list);
 	INIT_DELAYED_WORK(&ctx->wq, aio_kick_handler);
+	INIT_WORK(&ctx->free_work, __put_ioctx);
 
 	if (aio_setup_ring(ctx) < 0)
-		goto out_freectx;
+		goto out_freeref;
 
 	/* limit the number of system wide aios */
 	spin_lock(&aio_nr_lock);
@@ -280,6 +312,8 @@ static struct kioctx *ioctx_alloc(unsigned nr_events)
 
 	/* now link into global list. */
 	spin_lock(&mm->ioctx_lock);
+	/* one ref for the list, one for the caller */
+	get_ioctx(ctx);
 	hlist_add_head_rcu(&ctx->list, &mm->ioctx_list);
 	spin_unlock(&mm->ioctx_lock);
 
@@ -289,7 +323,10 @@ static struct kioctx *ioctx_alloc(unsigned nr_events)
 
 out_cleanup:
 	err = -EAGAIN;
+	aio_unmap_ring(ctx);
 	aio_free_ring(ctx);
+out_freeref:
+	percpu_ref_cancel_init(&ctx->users);
 out_freectx:
 	mmdrop(mm);
 	kmem_cache_free(kioctx_cachep, ctx);
@@ -376,11 +413,6 @@ void exit_aio(struct mm_struct *mm)
 
 		kill_ctx(ctx);
 
-		if (1 != atomic_read(&ctx->users))
-			printk(KERN_DEBUG
-				"exit_aio:ioctx still alive: %d %d %d\n",
-				atomic_read(&ctx->users), ctx->dead,
-				ctx->reqs_active);
 		/*
 		 * We don't need to bother with munmap() here -
 		 * exit_mmap(mm) is coming and it'll unmap everything.
@@ -392,7 +424,7 @@ void exit_aio(struct mm_struct *mm)
 		 * all other callers have ctx->mm == current->mm.
 		 */
 		ctx->ring_info.mmap_size = 0;
-		put_ioctx(ctx);
+		percpu_ref_kill(&ctx->users);
 	}
 }
 
@@ -421,6 +453,7 @@ static struct kiocb *__aio_get_req(struct kioctx *ctx)
 	req->ki_cancel = NULL;
 	req->ki_retry = NULL;
 	req->ki_dtor = NULL;
+	req->ki_complete = NULL;
 	req->private = NULL;
 	req->ki_iovec = NULL;
 	INIT_LIST_HEAD(&req->ki_run_list);
@@ -914,6 +947,11 @@ int aio_complete(struct kiocb *iocb, long res, long res2)
 		return 1;
 	}
 
+	if (iocb->ki_complete) {
+		iocb->ki_complete(iocb, res, res2);
+		return 1;
+	}
+
 	info = &ctx->ring_info;
 
 	/* add a completion event to the ring buffer.
@@ -1203,10 +1241,13 @@ static void io_destroy(struct kioctx *ioctx)
 
 	dprintk("aio_release(%p)\n", ioctx);
 	if (likely(!was_dead))
-		put_ioctx(ioctx);	/* twice for the list */
+		percpu_ref_kill(&ioctx->users);	/* drop the list's ref */
 
 	kill_ctx(ioctx);
 
+	if (likely(!was_dead))
+		aio_unmap_ring(ioctx);
+
 	/*
 	 * Wake up any waiters.  The setting of ctx->dead must be seen
 	 * by other CPUs at this point.  Right now, we rely on the
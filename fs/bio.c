@@ -56,6 +56,77 @@ static struct biovec_slab bvec_slabs[BIOVEC_NR_POOLS] __read_mostly = {
  */
 struct bio_set *fs_bio_set;
 
+/*
+ * Per cpu cache of bios in front of a bio_set's mempool, refilled from
+ * and drained to the bio slab in bulk.  Bios are only cached while the
+ * mempool is full, so the reserve is never kept away from its waiters.
+ */
+#define BIO_CACHE_SIZE		32
+#define BIO_CACHE_BULK		8
+
+struct bio_alloc_cache {
+	unsigned int nr;
+	void *entries[BIO_CACHE_SIZE];
+};
+
+static void *bio_cache_get(struct bio_set *bs, gfp_t gfp_mask)
+{
+	struct bio_alloc_cache *cache;
+	unsigned long flags;
+	void *p = NULL;
+
+	gfp_mask &= ~__GFP_WAIT;
+	gfp_mask |= __GFP_NOMEMALLOC | __GFP_NOWARN;
+
+	local_irq_save(flags);
+	cache = this_cpu_ptr(bs->cache);
+	if (!cache->nr)
+		cache->nr = kmem_cache_alloc_bulk(bs->bio_slab, gfp_mask,
+						  BIO_CACHE_BULK,
+						  cache->entries);
+	if (cache->nr)
+		p = cache->entries[--cache->nr];
+	local_irq_restore(flags);
+
+	return p;
+}
+
+static bool bio_cache_put(struct bio_set *bs, void *p)
+{
+	struct bio_alloc_cache *cache;
+	unsigned long flags;
+
+	if (bs->bio_pool->curr_nr < bs->bio_pool->min_nr)
+		return false;
+
+	local_irq_save(flags);
+	cache = this_cpu_ptr(bs->cache);
+	if (cache->nr == BIO_CACHE_SIZE) {
+		kmem_cache_free_bulk(bs->bio_slab, BIO_CACHE_SIZE / 2,
+				     cache->entries + BIO_CACHE_SIZE / 2);
+		cache->nr = BIO_CACHE_SIZE / 2;
+	}
+	cache->entries[cache->nr++] = p;
+	local_irq_restore(flags);
+
+	return true;
+}
+
+static void bio_cache_free(struct bio_set *bs)
+{
+	int cpu;
+
+	if (!bs->cache)
+		return;
+
+	for_each_possible_cpu(cpu) {
+		struct bio_alloc_cache *cache = per_cpu_ptr(bs->cache, cpu);
+
+		kmem_cache_free_bulk(bs->bio_slab, cache->nr, cache->entries);
+	}
+	free_percpu(bs->cache);
+}
+
 /*
  * Our slab pool management
  */
@@ -249,6 +320,8 @@ void bio_free(struct bio *bio, struct bio_set *bs)
 	if (bs->front_pad)
 		p -= bs->front_pad;
 
+	if (bs->cache && bio_cache_put(bs, p))
+		return;
 	mempool_free(p, bs->bio_pool);
 }
 EXPORT_SYMBOL(bio_free);
@@ -281,9 +354,12 @@ struct bio *bio_alloc_bioset(gfp_t gfp_mask, int nr_iovecs, struct bio_set *bs)
 	unsigned long idx = BIO_POOL_NONE;
 	struct bio_vec *bvl = NULL;
 	struct bio *bio;
-	void *p;
+	void *p = NULL;
 
-	p = mempool_alloc(bs->bio_pool, gfp_mask);
+	if (bs->cache)
+		p = bio_cache_get(bs, gfp_mask);
+	if (!p)
+		p = mempool_alloc(bs->bio_pool, gfp_mask);
 	if (unlikely(!p))
 		return NULL;
 	bio = p + bs->front_pad;
@@ -1595,6 +1671,8 @@ static void biovec_free_pools(struct bio_set *bs)
 
 void bioset_free(struct bio_set *bs)
 {
+	bio_cache_free(bs);
+
 	if (bs->bio_pool)
 		mempool_destroy(bs->bio_pool);
 
@@ -1740,6 +1818,8 @@ static int __init init_bio(void)
 	fs_bio_set = bioset_create(BIO_POOL_SIZE, 0);
 	if (!fs_bio_set)
 		panic("bio: can't allocate bios\n");
+	/* not fatal, the mempool is used directly without it */
+	fs_bio_set->cache = alloc_percpu(struct bio_alloc_cache);
 
 	if (bioset_integrity_create(fs_bio_set, BIO_POOL_SIZE))
 		panic("bio: can't create integrity pool\n");
@@ -0,0 +1,1239 @@
+/*
+ * Shared application/kernel submission and completion ring pairs, for
+ * supporting fast/efficient IO.
+ *
+ * A note on the read/write ordering memory barriers that are matched between
+ * the application and kernel side. When the application reads the CQ ring
+ * tail, it must use an appropriate smp_rmb() to order with the smp_wmb()
+ * the kernel uses after writing the tail. Failure to do so could cause a
+ * delay in when the application notices that completion events available.
+ * This isn't a fatal condition. Likewise, the application must use an
+ * appropriate smp_wmb() both before writing the SQ tail, and after writing
+ * the SQ tail. The first one orders the sqe writes with the tail write, and
+ * the latter is paired with the smp_rmb() the kernel will issue before
+ * reading the SQ tail on submission.
+ *
+ * Requests that can be completed without blocking are completed inline,
+ * from the io_uring_enter() call that submitted them. O_DIRECT reads and
+ * writes are submitted inline as well and complete asynchronously, like
+ * aio. Everything else is handed to a per-ring workqueue, which runs the
+ * operation in the context (mm and credentials) of the task that set up
+ * the ring.
+ *
+ * Distributed under the terms of the GNU GPL, version 2.
+ */
+#include <linux/kernel.h>
+#include <linux/init.h>
+#include <linux/errno.h>
+#include <linux/syscalls.h>
+#include <linux/compat.h>
+#include <linux/uio.h>
+#include <linux/aio.h>
+#include <linux/fsnotify.h>
+
+#include <linux/sched.h>
+#include <linux/fs.h>
+#include <linux/file.h>
+#include <linux/fdtable.h>
+#include <linux/mm.h>
+#include <linux/mman.h>
+#include <linux/mmu_context.h>
+#include <linux/percpu.h>
+#include <linux/slab.h>
+#include <linux/workqueue.h>
+#include <linux/poll.h>
+#include <linux/cred.h>
+#include <linux/net.h>
+#include <linux/socket.h>
+#include <linux/anon_inodes.h>
+#include <linux/io_uring.h>
+
+#include <asm/uaccess.h>
+
+#define IORING_MAX_ENTRIES	4096
+
+struct io_uring {
+	u32 head ____cacheline_aligned_in_smp;
+	u32 tail ____cacheline_aligned_in_smp;
+};
+
+struct io_sq_ring {
+	struct io_uring		r;
+	u32			ring_mask;
+	u32			ring_entries;
+	u32			dropped;
+	u32			flags;
+	u32			array[];
+};
+
+struct io_cq_ring {
+	struct io_uring		r;
+	u32			ring_mask;
+	u32			ring_entries;
+	u32			overflow;
+	struct io_uring_cqe	cqes[];
+};
+
+struct io_ring_ctx {
+	/*
+	 * One reference for the ring file, plus one for every request that
+	 * has been issued and not yet completed.
+	 */
+	atomic_t		refs;
+
+	/* read-mostly after setup */
+	unsigned int		sq_entries;
+	unsigned int		sq_mask;
+	unsigned int		cq_entries;
+	unsigned int		cq_mask;
+	struct io_sq_ring	*sq_ring;
+	struct io_uring_sqe	*sq_sqes;
+	struct io_cq_ring	*cq_ring;
+	size_t			sq_ring_size;
+	size_t			sq_sqes_size;
+	size_t			cq_ring_size;
+
+	struct mm_struct	*sqo_mm;
+	const struct cred	*creds;
+	struct workqueue_struct	*sqo_wq;
+	struct work_struct	free_work;
+
+	/* submission side, serialized by uring_lock */
+	struct mutex		uring_lock ____cacheline_aligned_in_smp;
+	unsigned int		cached_sq_head;
+
+	/* completion side */
+	spinlock_t		completion_lock ____cacheline_aligned_in_smp;
+	unsigned int		cached_cq_tail;
+	wait_queue_head_t	wait;
+	wait_queue_head_t	cq_wait;
+	struct list_head	cancel_list;	/* armed poll requests */
+};
+
+struct io_poll_iocb {
+	wait_queue_head_t	*head;
+	unsigned int		events;
+	bool			done;
+	bool			canceled;
+	bool			freed;
+	wait_queue_t		wait;
+};
+
+struct io_kiocb {
+	struct io_ring_ctx	*ctx;
+	struct file		*file;
+	struct io_uring_sqe	sqe;
+	atomic_t		refs;
+	struct list_head	list;
+	union {
+		struct kiocb		rw;	/* inline O_DIRECT I/O */
+		struct io_poll_iocb	poll;
+	};
+	struct work_struct	work;
+};
+
+static struct kmem_cache *req_cachep;
+
+static const struct file_operations io_uring_fops;
+
+static void io_ring_ctx_free(struct work_struct *work)
+{
+	struct io_ring_ctx *ctx = container_of(work, struct io_ring_ctx,
+					       free_work);
+
+	if (ctx->sqo_wq)
+		destroy_workqueue(ctx->sqo_wq);
+	if (ctx->sqo_mm)
+		mmdrop(ctx->sqo_mm);
+	if (ctx->creds)
+		put_cred(ctx->creds);
+	if (ctx->sq_ring)
+		free_pages((unsigned long)ctx->sq_ring,
+			   get_order(ctx->sq_ring_size));
+	if (ctx->sq_sqes)
+		free_pages((unsigned long)ctx->sq_sqes,
+			   get_order(ctx->sq_sqes_size));
+	if (ctx->cq_ring)
+		free_pages((unsigned long)ctx->cq_ring,
+			   get_order(ctx->cq_ring_size));
+	kfree(ctx);
+}
+
+static void io_ring_ctx_put(struct io_ring_ctx *ctx)
+{
+	/*
+	 * The last put can come from a wakeup callback, or from a work item
+	 * running on ctx->sqo_wq itself, so tear down from process context.
+	 */
+	if (atomic_dec_and_test(&ctx->refs))
+		schedule_work(&ctx->free_work);
+}
+
+static struct io_ring_ctx *io_ring_ctx_alloc(struct io_uring_params *p)
+{
+	struct io_ring_ctx *ctx;
+
+	ctx = kzalloc(sizeof(*ctx), GFP_KERNEL);
+	if (!ctx)
+		return NULL;
+
+	atomic_set(&ctx->refs, 1);
+	INIT_WORK(&ctx->free_work, io_ring_ctx_free);
+	mutex_init(&ctx->uring_lock);
+	spin_lock_init(&ctx->completion_lock);
+	init_waitqueue_head(&ctx->wait);
+	init_waitqueue_head(&ctx->cq_wait);
+	INIT_LIST_HEAD(&ctx->cancel_list);
+	return ctx;
+}
+
+static struct io_kiocb *io_get_req(struct io_ring_ctx *ctx)
+{
+	struct io_kiocb *req;
+
+	req = kmem_cache_alloc(req_cachep, GFP_KERNEL);
+	if (!req)
+		return NULL;
+
+	atomic_inc(&ctx->refs);
+	req->ctx = ctx;
+	req->file = NULL;
+	atomic_set(&req->refs, 1);
+	INIT_LIST_HEAD(&req->list);
+	return req;
+}
+
+static void io_free_req(struct io_kiocb *req)
+{
+	struct io_ring_ctx *ctx = req->ctx;
+
+	if (req->file)
+		fput(req->file);
+	kmem_cache_free(req_cachep, req);
+	io_ring_ctx_put(ctx);
+}
+
+static void io_put_req(struct io_kiocb *req)
+{
+	if (atomic_dec_and_test(&req->refs))
+		io_free_req(req);
+}
+
+static unsigned int io_cqring_events(struct io_cq_ring *ring)
+{
+	/* See comment at the top of this file */
+	smp_rmb();
+	return ACCESS_ONCE(ring->r.tail) - ACCESS_ONCE(ring->r.head);
+}
+
+/*
+ * Must be called with ctx->completion_lock held.
+ */
+static void io_cqring_fill_event(struct io_ring_ctx *ctx, u64 user_data,
+				 long res)
+{
+	struct io_cq_ring *ring = ctx->cq_ring;
+	struct io_uring_cqe *cqe;
+	unsigned int tail;
+
+	/*
+	 * Note that the head is written by the application, so we only
+	 * trust it as far as deciding whether there is room.
+	 */
+	tail = ctx->cached_cq_tail;
+	/* See comment at the top of this file */
+	smp_rmb();
+	if (tail - ACCESS_ONCE(ring->r.head) == ctx->cq_entries) {
+		ring->overflow++;
+		return;
+	}
+
+	cqe = &ring->cqes[tail & ctx->cq_mask];
+	cqe->user_data = user_data;
+	cqe->res = res;
+	cqe->flags = 0;
+	ctx->cached_cq_tail++;
+}
+
+static void io_commit_cqring(struct io_ring_ctx *ctx)
+{
+	struct io_cq_ring *ring = ctx->cq_ring;
+
+	if (ctx->cached_cq_tail != ACCESS_ONCE(ring->r.tail)) {
+		/* order cqe stores with ring update */
+		smp_wmb();
+		ACCESS_ONCE(ring->r.tail) = ctx->cached_cq_tail;
+		/* write side barrier of tail update, app has read side */
+		smp_wmb();
+	}
+}
+
+static void io_cqring_ev_posted(struct io_ring_ctx *ctx)
+{
+	/* pairs with the set_current_state() in wait_event_interruptible() */
+	smp_mb();
+	if (waitqueue_active(&ctx->wait))
+		wake_up(&ctx->wait);
+	if (waitqueue_active(&ctx->cq_wait))
+		wake_up_interruptible(&ctx->cq_wait);
+}
+
+static void io_cqring_add_event(struct io_ring_ctx *ctx, u64 user_data,
+				long res)
+{
+	unsigned long flags;
+
+	spin_lock_irqsave(&ctx->completion_lock, flags);
+	io_cqring_fill_event(ctx, user_data, res);
+	io_commit_cqring(ctx);
+	spin_unlock_irqrestore(&ctx->completion_lock, flags);
+
+	io_cqring_ev_posted(ctx);
+}
+
+/*
+ * Run a request that may block. Called from the ring workqueue, with the
+ * mm and credentials of the ring owner already in place.
+ */
+static long io_issue_blocking(struct io_kiocb *req)
+{
+	const struct io_uring_sqe *sqe = &req->sqe;
+	void __user *addr = (void __user *)(unsigned long)sqe->addr;
+	struct socket *sock;
+	loff_t pos, end;
+	int err;
+
+	switch (sqe->opcode) {
+	case IORING_OP_READV:
+		/* positioned I/O only, like preadv() */
+		if (!(req->file->f_mode & FMODE_PREAD))
+			return -ESPIPE;
+		pos = sqe->off;
+		return vfs_readv(req->file, addr, sqe->len, &pos);
+	case IORING_OP_WRITEV:
+		if (!(req->file->f_mode & FMODE_PWRITE))
+			return -ESPIPE;
+		pos = sqe->off;
+		return vfs_writev(req->file, addr, sqe->len, &pos);
+	case IORING_OP_FSYNC:
+		end = sqe->len ? sqe->off + sqe->len - 1 : LLONG_MAX;
+		return vfs_fsync_range(req->file, sqe->off, end,
+				sqe->fsync_flags & IORING_FSYNC_DATASYNC);
+	case IORING_OP_SENDMSG:
+	case IORING_OP_RECVMSG:
+		sock = sock_from_file(req->file, &err);
+		if (!sock)
+			return err;
+		if (sqe->opcode == IORING_OP_SENDMSG)
+			return __sys_sendmsg_sock(sock, addr, sqe->msg_flags);
+		return __sys_recvmsg_sock(sock, addr, sqe->msg_flags);
+	}
+	return -EINVAL;
+}
+
+static void io_sq_wq_submit_work(struct work_struct *work)
+{
+	struct io_kiocb *req = container_of(work, struct io_kiocb, work);
+	struct io_ring_ctx *ctx = req->ctx;
+	struct mm_struct *mm = ctx->sqo_mm;
+	const struct cred *old_cred;
+	mm_segment_t old_fs;
+	long ret = -EFAULT;
+
+	old_cred = override_creds(ctx->creds);
+	/* the owner may have exited, don't resurrect its address space */
+	if (atomic_inc_not_zero(&mm->mm_users)) {
+		old_fs = get_fs();
+		set_fs(USER_DS);
+		use_mm(mm);
+		ret = io_issue_blocking(req);
+		unuse_mm(mm);
+		set_fs(old_fs);
+		mmput(mm);
+	}
+	revert_creds(old_cred);
+
+	io_cqring_add_event(ctx, req->sqe.user_data, ret);
+	io_put_req(req);
+}
+
+static void io_queue_async_work(struct io_kiocb *req)
+{
+	INIT_WORK(&req->work, io_sq_wq_submit_work);
+	queue_work(req->ctx->sqo_wq, &req->work);
+}
+
+static void io_put_req_work(struct work_struct *work)
+{
+	struct io_kiocb *req = container_of(work, struct io_kiocb, work);
+
+	io_put_req(req);
+}
+
+/*
+ * Called through aio_complete() once inline O_DIRECT I/O is done, often
+ * from interrupt context. Dropping the last file reference has to wait
+ * for process context, like aio does.
+ */
+static void io_complete_rw(struct kiocb *kiocb, long res, long res2)
+{
+	struct io_kiocb *req = container_of(kiocb, struct io_kiocb, rw);
+
+	io_cqring_add_event(req->ctx, req->sqe.user_data, res);
+
+	if (fput_atomic(req->file)) {
+		req->file = NULL;
+		io_put_req(req);
+		return;
+	}
+	INIT_WORK(&req->work, io_put_req_work);
+	queue_work(req->ctx->sqo_wq, &req->work);
+}
+
+/*
+ * Submit an O_DIRECT READV/WRITEV from the submitting task, through the
+ * same ->aio_read/->aio_write path as aio. -EIOCBQUEUED means the request
+ * is in flight and io_complete_rw() will post its event. *punt is set for
+ * buffered I/O, and when the filesystem would have blocked.
+ */
+static long io_rw_nowait(struct io_kiocb *req, bool *punt)
+{
+	const struct io_uring_sqe *sqe = &req->sqe;
+	struct iovec __user *uvec = (void __user *)(unsigned long)sqe->addr;
+	struct iovec iovstack[UIO_FASTIOV], *iov = iovstack;
+	struct file *file = req->file;
+	struct kiocb *kiocb = &req->rw;
+	int type = sqe->opcode == IORING_OP_READV ? READ : WRITE;
+	ssize_t (*fn)(struct kiocb *, const struct iovec *, unsigned long,
+		      loff_t);
+	loff_t pos = sqe->off;
+	size_t tot_len;
+	long ret;
+
+	*punt = false;
+	if (type == READ) {
+		if (!(file->f_mode & FMODE_READ))
+			return -EBADF;
+		/* positioned I/O only, like preadv() */
+		if (!(file->f_mode & FMODE_PREAD))
+			return -ESPIPE;
+		fn = file->f_op->aio_read;
+	} else {
+		if (!(file->f_mode & FMODE_WRITE))
+			return -EBADF;
+		if (!(file->f_mode & FMODE_PWRITE))
+			return -ESPIPE;
+		fn = file->f_op->aio_write;
+	}
+
+	/* buffered I/O can't be asked not to block */
+	if (!(file->f_flags & O_DIRECT) || !fn) {
+		*punt = true;
+		return 0;
+	}
+
+	ret = rw_copy_check_uvector(type, uvec, sqe->len,
+				    ARRAY_SIZE(iovstack), iovstack, &iov);
+	if (ret <= 0)
+		goto out;
+
+	tot_len = ret;
+	ret = rw_verify_area(type, file, &pos, tot_len);
+	if (ret < 0)
+		goto out;
+
+	memset(kiocb, 0, sizeof(*kiocb));
+	kiocb->ki_users = 1;
+	kiocb->ki_filp = file;
+	kiocb->ki_pos = pos;
+	kiocb->ki_nbytes = tot_len;
+	kiocb->ki_left = tot_len;
+	kiocb->ki_complete = io_complete_rw;
+	INIT_LIST_HEAD(&kiocb->ki_run_list);
+
+	ret = fn(kiocb, iov, sqe->len, kiocb->ki_pos);
+	if (ret == -EAGAIN) {
+		*punt = true;
+		ret = 0;
+	} else if (ret > 0) {
+		if (type == READ)
+			fsnotify_access(file);
+		else
+			fsnotify_modify(file);
+	}
+out:
+	if (iov != iovstack)
+		kfree(iov);
+	return ret;
+}
+
+/*
+ * Try a socket operation without blocking from the submitting task. *punt
+ * is set if it would have blocked and the application is fine with that,
+ * in which case the request should be retried from the workqueue.
+ */
+static long io_sock_nowait(struct io_kiocb *req, bool *punt)
+{
+	const struct io_uring_sqe *sqe = &req->sqe;
+	void __user *addr = (void __user *)(unsigned long)sqe->addr;
+	unsigned int flags = sqe->msg_flags;
+	struct socket *sock;
+	int err;
+	long ret;
+
+	*punt = false;
+	sock = sock_from_file(req->file, &err);
+	if (!sock)
+		return err;
+
+	if (sqe->opcode == IORING_OP_SENDMSG)
+		ret = __sys_sendmsg_sock(sock, addr, flags | MSG_DONTWAIT);
+	else
+		ret = __sys_recvmsg_sock(sock, addr, flags | MSG_DONTWAIT);
+
+	*punt = ret == -EAGAIN && !(flags & MSG_DONTWAIT) &&
+		!(req->file->f_flags & O_NONBLOCK);
+	return ret;
+}
+
+static void io_poll_complete(struct io_kiocb *req, unsigned int mask)
+{
+	struct io_ring_ctx *ctx = req->ctx;
+	long res = mask;
+
+	if (ACCESS_ONCE(req->poll.canceled))
+		res = -ECANCELED;
+	req->poll.done = true;
+	io_cqring_fill_event(ctx, req->sqe.user_data, res);
+	io_commit_cqring(ctx);
+}
+
+static unsigned int io_poll_file(struct io_kiocb *req)
+{
+	poll_table pt;
+
+	init_poll_funcptr(&pt, NULL);
+	pt._key = req->poll.events;
+	return req->file->f_op->poll(req->file, &pt) & req->poll.events;
+}
+
+static void io_poll_complete_work(struct work_struct *work)
+{
+	struct io_kiocb *req = container_of(work, struct io_kiocb, work);
+	struct io_poll_iocb *poll = &req->poll;
+	struct io_ring_ctx *ctx = req->ctx;
+	unsigned int mask = 0;
+
+	if (poll->freed)
+		mask = POLLHUP;
+	else if (!ACCESS_ONCE(poll->canceled))
+		mask = io_poll_file(req);
+
+	if (!mask && !ACCESS_ONCE(poll->canceled)) {
+		/*
+		 * Spurious wakeup: go back on the wait queue, then poll once
+		 * more so an event that fired in between isn't lost.
+		 */
+		spin_lock_irq(&poll->head->lock);
+		__add_wait_queue(poll->head, &poll->wait);
+		spin_unlock_irq(&poll->head->lock);
+
+		mask = io_poll_file(req);
+		if (!mask)
+			return;
+
+		spin_lock_irq(&poll->head->lock);
+		if (list_empty(&poll->wait.task_list)) {
+			/* io_poll_wake() got there first and owns it now */
+			spin_unlock_irq(&poll->head->lock);
+			return;
+		}
+		list_del_init(&poll->wait.task_list);
+		spin_unlock_irq(&poll->head->lock);
+	}
+
+	spin_lock_irq(&ctx->completion_lock);
+	list_del_init(&req->list);
+	io_poll_complete(req, mask);
+	spin_unlock_irq(&ctx->completion_lock);
+
+	io_cqring_ev_posted(ctx);
+	io_put_req(req);
+}
+
+static int io_poll_wake(wait_queue_t *wait, unsigned mode, int sync,
+			void *key)
+{
+	struct io_poll_iocb *poll = container_of(wait, struct io_poll_iocb,
+						 wait);
+	struct io_kiocb *req = container_of(poll, struct io_kiocb, poll);
+	struct io_ring_ctx *ctx = req->ctx;
+	unsigned long mask = (unsigned long)key;
+	unsigned long flags;
+
+	/* for instances that support it check for an event match first: */
+	if (mask && !(mask & (poll->events | POLLFREE)))
+		return 0;
+
+	list_del_init(&poll->wait.task_list);
+
+	if (mask & POLLFREE) {
+		/*
+		 * The wait queue is going away, report a hangup. Once ->head
+		 * is cleared nobody else touches the queue; it stays valid
+		 * until an RCU grace period has passed.
+		 */
+		poll->freed = true;
+		smp_wmb();
+		ACCESS_ONCE(poll->head) = NULL;
+		mask = POLLHUP;
+	}
+
+	if (mask && spin_trylock_irqsave(&ctx->completion_lock, flags)) {
+		list_del_init(&req->list);
+		io_poll_complete(req, mask & poll->events);
+		spin_unlock_irqrestore(&ctx->completion_lock, flags);
+
+		io_cqring_ev_posted(ctx);
+		io_put_req(req);
+	} else {
+		INIT_WORK(&req->work, io_poll_complete_work);
+		queue_work(ctx->sqo_wq, &req->work);
+	}
+
+	return 1;
+}
+
+struct io_poll_table {
+	poll_table		pt;
+	struct io_kiocb		*req;
+	int			error;
+};
+
+static void io_poll_queue_proc(struct file *file, wait_queue_head_t *head,
+			       poll_table *p)
+{
+	struct io_poll_table *pt = container_of(p, struct io_poll_table, pt);
+
+	/* a single wait queue per request, like aio poll */
+	if (unlikely(pt->req->poll.head)) {
+		pt->error = -EINVAL;
+		return;
+	}
+
+	pt->error = 0;
+	pt->req->poll.head = head;
+	add_wait_queue(head, &pt->req->poll.wait);
+}
+
+/*
+ * Must be called with ctx->completion_lock held.
+ */
+static void io_poll_remove_one(struct io_kiocb *req)
+{
+	struct io_poll_iocb *poll = &req->poll;
+	wait_queue_head_t *head;
+
+	list_del_init(&req->list);
+	ACCESS_ONCE(poll->canceled) = true;
+
+	/*
+	 * A POLLFREE wakeup may run concurrently and clear ->head. The
+	 * queues that send POLLFREE are freed after an RCU grace period,
+	 * so a head seen under rcu_read_lock() can still be locked; the
+	 * wakeup has then removed our entry already.
+	 */
+	rcu_read_lock();
+	head = ACCESS_ONCE(poll->head);
+	if (head) {
+		spin_lock(&head->lock);
+		if (!list_empty(&poll->wait.task_list)) {
+			list_del_init(&poll->wait.task_list);
+			INIT_WORK(&req->work, io_poll_complete_work);
+			queue_work(req->ctx->sqo_wq, &req->work);
+		}
+		spin_unlock(&head->lock);
+	}
+	rcu_read_unlock();
+}
+
+static void io_poll_remove_all(struct io_ring_ctx *ctx)
+{
+	struct io_kiocb *req;
+
+	spin_lock_irq(&ctx->completion_lock);
+	while (!list_empty(&ctx->cancel_list)) {
+		req = list_first_entry(&ctx->cancel_list, struct io_kiocb,
+				       list);
+		io_poll_remove_one(req);
+	}
+	spin_unlock_irq(&ctx->completion_lock);
+}
+
+/*
+ * Find a running poll command that matches one specified in sqe->addr,
+ * and remove it if found.
+ */
+static long io_poll_remove(struct io_kiocb *req)
+{
+	struct io_ring_ctx *ctx = req->ctx;
+	struct io_kiocb *poll_req, *next;
+	long ret = -ENOENT;
+
+	spin_lock_irq(&ctx->completion_lock);
+	list_for_each_entry_safe(poll_req, next, &ctx->cancel_list, list) {
+		if (req->sqe.addr == poll_req->sqe.user_data) {
+			io_poll_remove_one(poll_req);
+			ret = 0;
+			break;
+		}
+	}
+	spin_unlock_irq(&ctx->completion_lock);
+
+	return ret;
+}
+
+/*
+ * Arm a poll request. Returns 0 if the request now belongs to the wait
+ * queue (or has already been completed), an error otherwise.
+ */
+static long io_poll_add(struct io_kiocb *req)
+{
+	struct io_poll_iocb *poll = &req->poll;
+	struct io_ring_ctx *ctx = req->ctx;
+	struct io_poll_table ipt;
+	wait_queue_head_t *head;
+	bool cancel = false;
+	unsigned int mask;
+
+	if (!req->file->f_op->poll)
+		return -EPERM;
+
+	poll->events = req->sqe.poll_events | POLLERR | POLLHUP;
+	poll->head = NULL;
+	poll->done = false;
+	poll->canceled = false;
+	poll->freed = false;
+
+	init_poll_funcptr(&ipt.pt, io_poll_queue_proc);
+	ipt.pt._key = poll->events;
+	ipt.req = req;
+	ipt.error = -EINVAL; /* same as no support for poll */
+
+	/* initialized the list so that we can do list_empty checks */
+	INIT_LIST_HEAD(&poll->wait.task_list);
+	init_waitqueue_func_entry(&poll->wait, io_poll_wake);
+
+	/* hold the request across the wakeup racing with us below */
+	atomic_inc(&req->refs);
+
+	mask = req->file->f_op->poll(req->file, &ipt.pt) & poll->events;
+
+	spin_lock_irq(&ctx->completion_lock);
+	/* see io_poll_remove_one() about a concurrent POLLFREE */
+	rcu_read_lock();
+	head = ACCESS_ONCE(poll->head);
+	if (likely(head)) {
+		spin_lock(&head->lock);
+		if (unlikely(list_empty(&poll->wait.task_list))) {
+			/* io_poll_wake() already took over */
+			if (ipt.error)
+				cancel = true;
+			ipt.error = 0;
+			mask = 0;
+		}
+		if (mask || ipt.error)
+			list_del_init(&poll->wait.task_list);
+		else if (cancel)
+			ACCESS_ONCE(poll->canceled) = true;
+		else if (!poll->done) /* actually waiting for an event */
+			list_add_tail(&req->list, &ctx->cancel_list);
+		spin_unlock(&head->lock);
+	} else {
+		smp_rmb();
+		if (poll->freed) {
+			/* a POLLFREE wakeup already took over */
+			ipt.error = 0;
+			mask = 0;
+		}
+	}
+	rcu_read_unlock();
+	if (mask) {
+		ipt.error = 0;
+		io_poll_complete(req, mask);
+	}
+	spin_unlock_irq(&ctx->completion_lock);
+
+	if (mask) {
+		io_cqring_ev_posted(ctx);
+		io_put_req(req);
+	}
+	io_put_req(req);
+	return ipt.error;
+}
+
+static long io_req_prep(struct io_kiocb *req)
+{
+	const struct io_uring_sqe *sqe = &req->sqe;
+
+	if (sqe->flags || sqe->ioprio)
+		return -EINVAL;
+
+	switch (sqe->opcode) {
+	case IORING_OP_NOP:
+	case IORING_OP_POLL_REMOVE:
+		return 0;
+	case IORING_OP_READV:
+	case IORING_OP_WRITEV:
+		if (sqe->rw_flags)
+			return -EINVAL;
+		break;
+	case IORING_OP_FSYNC:
+		if (sqe->fsync_flags & ~IORING_FSYNC_DATASYNC)
+			return -EINVAL;
+		break;
+	case IORING_OP_SENDMSG:
+	case IORING_OP_RECVMSG:
+		if (sqe->msg_flags & MSG_CMSG_COMPAT)
+			return -EINVAL;
+		break;
+	case IORING_OP_POLL_ADD:
+		break;
+	default:
+		return -EINVAL;
+	}
+
+	req->file = fget(sqe->fd);
+	if (!req->file)
+		return -EBADF;
+	/* a ring must not pin itself through its own requests */
+	if (req->file->f_op == &io_uring_fops)
+		return -EBADF;
+	return 0;
+}
+
+/*
+ * Issue one request. Either it completes inline, it is armed on a wait
+ * queue, or it is handed to the workqueue; in every case a completion
+ * event will eventually be posted for it.
+ */
+static void io_submit_sqe(struct io_kiocb *req)
+{
+	struct io_ring_ctx *ctx = req->ctx;
+	bool punt;
+	long ret;
+
+	ret = io_req_prep(req);
+	if (ret)
+		goto complete;
+
+	switch (req->sqe.opcode) {
+	case IORING_OP_NOP:
+		ret = 0;
+		break;
+	case IORING_OP_POLL_ADD:
+		ret = io_poll_add(req);
+		if (!ret)
+			return;
+		break;
+	case IORING_OP_POLL_REMOVE:
+		ret = io_poll_remove(req);
+		break;
+	case IORING_OP_READV:
+	case IORING_OP_WRITEV:
+		ret = io_rw_nowait(req, &punt);
+		if (punt)
+			goto punt;
+		/* io_complete_rw() owns the request now */
+		if (ret == -EIOCBQUEUED)
+			return;
+		break;
+	case IORING_OP_SENDMSG:
+	case IORING_OP_RECVMSG:
+		ret = io_sock_nowait(req, &punt);
+		if (punt)
+			goto punt;
+		break;
+	default:
+		/*
+		 * There is no way to ask the filesystem to attempt an fsync
+		 * without blocking, so go straight to the workqueue.
+		 */
+		goto punt;
+	}
+
+complete:
+	io_cqring_add_event(ctx, req->sqe.user_data, ret);
+	io_put_req(req);
+	return;
+punt:
+	io_queue_async_work(req);
+}
+
+static void io_commit_sqring(struct io_ring_ctx *ctx)
+{
+	struct io_sq_ring *ring = ctx->sq_ring;
+
+	if (ctx->cached_sq_head != ACCESS_ONCE(ring->r.head)) {
+		/*
+		 * Ensure any loads from the SQEs are done at this point,
+		 * since once we write the new head, the application could
+		 * write new data to them.
+		 */
+		smp_mb();
+		ACCESS_ONCE(ring->r.head) = ctx->cached_sq_head;
+	}
+}
+
+/*
+ * Fetch the next sqe, if one is available. The index array indirection
+ * lets the application keep sqes in any order. Invalid indices are skipped
+ * and accounted in the ring's dropped counter.
+ */
+static bool io_get_sqring(struct io_ring_ctx *ctx, struct io_uring_sqe *sqe)
+{
+	struct io_sq_ring *ring = ctx->sq_ring;
+	unsigned int head;
+
+	head = ctx->cached_sq_head;
+	/* See comment at the top of this file */
+	smp_rmb();
+	while (head != ACCESS_ONCE(ring->r.tail)) {
+		unsigned int index = ACCESS_ONCE(ring->array[head & ctx->sq_mask]);
+
+		head++;
+		if (index < ctx->sq_entries) {
+			memcpy(sqe, &ctx->sq_sqes[index], sizeof(*sqe));
+			ctx->cached_sq_head = head;
+			return true;
+		}
+
+		/* drop invalid entries */
+		ring->dropped++;
+		ctx->cached_sq_head = head;
+	}
+
+	return false;
+}
+
+static int io_ring_submit(struct io_ring_ctx *ctx, unsigned int to_submit)
+{
+	struct io_kiocb *req;
+	int submitted = 0;
+
+	while (submitted < to_submit) {
+		unsigned int inflight, posted;
+
+		/*
+		 * Don't let the requests in flight plus the events not yet
+		 * reaped exceed what the completion ring can hold, or events
+		 * would be lost to overflow. A request that completes in
+		 * between is counted twice at worst, as refs is read first.
+		 */
+		inflight = atomic_read(&ctx->refs) - 1;
+		smp_rmb();
+		posted = ACCESS_ONCE(ctx->cached_cq_tail) -
+			 ACCESS_ONCE(ctx->cq_ring->r.head);
+		if (inflight + posted >= ctx->cq_entries) {
+			if (!submitted)
+				submitted = -EBUSY;
+			break;
+		}
+
+		req = io_get_req(ctx);
+		if (!req) {
+			if (!submitted)
+				submitted = -EAGAIN;
+			break;
+		}
+		if (!io_get_sqring(ctx, &req->sqe)) {
+			io_put_req(req);
+			break;
+		}
+
+		io_submit_sqe(req);
+		submitted++;
+	}
+	io_commit_sqring(ctx);
+
+	return submitted;
+}
+
+static int io_cqring_wait(struct io_ring_ctx *ctx, unsigned int min_events)
+{
+	struct io_cq_ring *ring = ctx->cq_ring;
+	int ret;
+
+	if (io_cqring_events(ring) >= min_events)
+		return 0;
+
+	ret = wait_event_interruptible(ctx->wait,
+				       io_cqring_events(ring) >= min_events);
+	if (ret == -ERESTARTSYS)
+		ret = -EINTR;
+	return ret;
+}
+
+static int io_uring_release(struct inode *inode, struct file *file)
+{
+	struct io_ring_ctx *ctx = file->private_data;
+
+	file->private_data = NULL;
+	/*
+	 * Armed polls would otherwise never complete. Requests running on
+	 * the workqueue keep the ctx alive until they finish.
+	 */
+	io_poll_remove_all(ctx);
+	io_ring_ctx_put(ctx);
+	return 0;
+}
+
+static unsigned int io_uring_poll(struct file *file, poll_table *wait)
+{
+	struct io_ring_ctx *ctx = file->private_data;
+	unsigned int mask = 0;
+
+	poll_wait(file, &ctx->cq_wait, wait);
+	/* See comment at the top of this file */
+	smp_rmb();
+	if (ACCESS_ONCE(ctx->sq_ring->r.tail) - ctx->cached_sq_head !=
+	    ctx->sq_entries)
+		mask |= POLLOUT | POLLWRNORM;
+	if (ACCESS_ONCE(ctx->cq_ring->r.head) != ctx->cached_cq_tail)
+		mask |= POLLIN | POLLRDNORM;
+
+	return mask;
+}
+
+static int io_uring_mmap(struct file *file, struct vm_area_struct *vma)
+{
+	loff_t offset = (loff_t) vma->vm_pgoff << PAGE_SHIFT;
+	unsigned long sz = vma->vm_end - vma->vm_start;
+	struct io_ring_ctx *ctx = file->private_data;
+	unsigned long pfn;
+	size_t size;
+	void *ptr;
+
+	switch (offset) {
+	case IORING_OFF_SQ_RING:
+		ptr = ctx->sq_ring;
+		size = ctx->sq_ring_size;
+		break;
+	case IORING_OFF_SQES:
+		ptr = ctx->sq_sqes;
+		size = ctx->sq_sqes_size;
+		break;
+	case IORING_OFF_CQ_RING:
+		ptr = ctx->cq_ring;
+		size = ctx->cq_ring_size;
+		break;
+	default:
+		return -EINVAL;
+	}
+
+	if (sz > (PAGE_SIZE << get_order(size)))
+		return -EINVAL;
+
+	pfn = virt_to_phys(ptr) >> PAGE_SHIFT;
+	return remap_pfn_range(vma, vma->vm_start, pfn, sz, vma->vm_page_prot);
+}
+
+SYSCALL_DEFINE4(io_uring_enter, unsigned int, fd, u32, to_submit,
+		u32, min_complete, u32, flags)
+{
+	struct io_ring_ctx *ctx;
+	int submitted = 0;
+	int fput_needed;
+	struct file *f;
+	long ret;
+
+	if (flags & ~IORING_ENTER_GETEVENTS)
+		return -EINVAL;
+
+	f = fget_light(fd, &fput_needed);
+	if (!f)
+		return -EBADF;
+
+	ret = -EOPNOTSUPP;
+	if (f->f_op != &io_uring_fops)
+		goto out_fput;
+
+	/* requests are issued against the address space of the ring owner */
+	ctx = f->private_data;
+	ret = -EPERM;
+	if (current->mm != ctx->sqo_mm)
+		goto out_fput;
+
+	ret = 0;
+	if (to_submit) {
+		to_submit = min(to_submit, ctx->sq_entries);
+
+		mutex_lock(&ctx->uring_lock);
+		submitted = io_ring_submit(ctx, to_submit);
+		mutex_unlock(&ctx->uring_lock);
+
+		if (submitted < 0) {
+			ret = submitted;
+			submitted = 0;
+			goto out_fput;
+		}
+	}
+	if (flags & IORING_ENTER_GETEVENTS) {
+		min_complete = min(min_complete, ctx->cq_entries);
+		ret = io_cqring_wait(ctx, min_complete);
+	}
+
+out_fput:
+	fput_light(f, fput_needed);
+	return submitted ? submitted : ret;
+}
+
+static const struct file_operations io_uring_fops = {
+	.release	= io_uring_release,
+	.mmap		= io_uring_mmap,
+	.poll		= io_uring_poll,
+	.llseek		= noop_llseek,
+};
+
+static void *io_mem_alloc(size_t size)
+{
+	gfp_t gfp_flags = GFP_KERNEL | __GFP_ZERO | __GFP_NOWARN |
+			  __GFP_COMP | __GFP_NORETRY;
+
+	return (void *) __get_free_pages(gfp_flags, get_order(size));
+}
+
+static int io_allocate_scq_urings(struct io_ring_ctx *ctx,
+				  struct io_uring_params *p)
+{
+	struct io_sq_ring *sq_ring;
+	struct io_cq_ring *cq_ring;
+
+	ctx->sq_ring_size = sizeof(*sq_ring) + p->sq_entries * sizeof(u32);
+	sq_ring = io_mem_alloc(ctx->sq_ring_size);
+	if (!sq_ring)
+		return -ENOMEM;
+	ctx->sq_ring = sq_ring;
+	sq_ring->ring_mask = p->sq_entries - 1;
+	sq_ring->ring_entries = p->sq_entries;
+	ctx->sq_mask = sq_ring->ring_mask;
+	ctx->sq_entries = sq_ring->ring_entries;
+
+	ctx->sq_sqes_size = p->sq_entries * sizeof(struct io_uring_sqe);
+	ctx->sq_sqes = io_mem_alloc(ctx->sq_sqes_size);
+	if (!ctx->sq_sqes)
+		return -ENOMEM;
+
+	ctx->cq_ring_size = sizeof(*cq_ring) +
+			    p->cq_entries * sizeof(struct io_uring_cqe);
+	cq_ring = io_mem_alloc(ctx->cq_ring_size);
+	if (!cq_ring)
+		return -ENOMEM;
+	ctx->cq_ring = cq_ring;
+	cq_ring->ring_mask = p->cq_entries - 1;
+	cq_ring->ring_entries = p->cq_entries;
+	ctx->cq_mask = cq_ring->ring_mask;
+	ctx->cq_entries = cq_ring->ring_entries;
+	return 0;
+}
+
+static int io_uring_create(unsigned int entries, struct io_uring_params *p,
+			   struct io_uring_params __user *params)
+{
+	struct io_ring_ctx *ctx;
+	int ret;
+
+	if (!entries || entries > IORING_MAX_ENTRIES)
+		return -EINVAL;
+
+	/*
+	 * Use twice as many entries for the CQ ring. It's possible for the
+	 * application to drive a higher depth than the size of the SQ ring,
+	 * since the sqes are only used at submission time.
+	 */
+	p->sq_entries = roundup_pow_of_two(entries);
+	p->cq_entries = 2 * p->sq_entries;
+
+	ctx = io_ring_ctx_alloc(p);
+	if (!ctx)
+		return -ENOMEM;
+
+	atomic_inc(&current->mm->mm_count);
+	ctx->sqo_mm = current->mm;
+	ctx->creds = get_current_cred();
+
+	ret = io_allocate_scq_urings(ctx, p);
+	if (ret)
+		goto err;
+
+	ctx->sqo_wq = alloc_workqueue("io_ring-wq", WQ_UNBOUND | WQ_FREEZABLE,
+				      min(ctx->sq_entries - 1,
+					  2 * num_online_cpus()));
+	ret = -ENOMEM;
+	if (!ctx->sqo_wq)
+		goto err;
+
+	memset(&p->sq_off, 0, sizeof(p->sq_off));
+	p->sq_off.head = offsetof(struct io_sq_ring, r.head);
+	p->sq_off.tail = offsetof(struct io_sq_ring, r.tail);
+	p->sq_off.ring_mask = offsetof(struct io_sq_ring, ring_mask);
+	p->sq_off.ring_entries = offsetof(struct io_sq_ring, ring_entries);
+	p->sq_off.flags = offsetof(struct io_sq_ring, flags);
+	p->sq_off.dropped = offsetof(struct io_sq_ring, dropped);
+	p->sq_off.array = offsetof(struct io_sq_ring, array);
+
+	memset(&p->cq_off, 0, sizeof(p->cq_off));
+	p->cq_off.head = offsetof(struct io_cq_ring, r.head);
+	p->cq_off.tail = offsetof(struct io_cq_ring, r.tail);
+	p->cq_off.ring_mask = offsetof(struct io_cq_ring, ring_mask);
+	p->cq_off.ring_entries = offsetof(struct io_cq_ring, ring_entries);
+	p->cq_off.overflow = offsetof(struct io_cq_ring, overflow);
+	p->cq_off.cqes = offsetof(struct io_cq_ring, cqes);
+
+	ret = -EFAULT;
+	if (copy_to_user(params, p, sizeof(*p)))
+		goto err;
+
+	ret = anon_inode_getfd("[io_uring]", &io_uring_fops, ctx,
+			       O_RDWR | O_CLOEXEC);
+	if (ret < 0)
+		goto err;
+	return ret;
+err:
+	io_ring_ctx_put(ctx);
+	return ret;
+}
+
+/*
+ * Sets up an aio uring context, and returns the fd. Applications asks for a
+ * ring size, we return the actual sq/cq ring sizes (among other things) in
+ * the params structure passed in.
+ */
+SYSCALL_DEFINE2(io_uring_setup, u32, entries,
+		struct io_uring_params __user *, params)
+{
+	struct io_uring_params p;
+	int i;
+
+	if (copy_from_user(&p, params, sizeof(p)))
+		return -EFAULT;
+	for (i = 0; i < ARRAY_SIZE(p.resv); i++) {
+		if (p.resv[i])
+			return -EINVAL;
+	}
+	if (p.flags)
+		return -EINVAL;
+
+	/* sqe pointers are native sized, there is no compat layout */
+	if (is_compat_task())
+		return -EINVAL;
+
+	return io_uring_create(entries, &p, params);
+}
+
+static int __init io_uring_init(void)
+{
+	req_cachep = KMEM_CACHE(io_kiocb, SLAB_HWCACHE_ALIGN | SLAB_PANIC);
+	return 0;
+}
+__initcall(io_uring_init);
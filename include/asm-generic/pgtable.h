@@ -457,6 +457,27 @@ static inline pmd_t pmd_read_atomic(pmd_t *pmdp)
 }
 #endif
 
+#ifndef CONFIG_NUMA_BALANCING
+/*
+ * Only architectures selecting ARCH_SUPPORTS_NUMA_BALANCING provide
+ * NUMA hinting PTEs.
+ */
+static inline int pte_numa(pte_t pte)
+{
+	return 0;
+}
+
+static inline pte_t pte_mknuma(pte_t pte)
+{
+	return pte;
+}
+
+static inline pte_t pte_mknonnuma(pte_t pte)
+{
+	return pte;
+}
+#endif /* !CONFIG_NUMA_BALANCING */
+
 /*
  * This function is meant to be used by sites walking pagetables with
  * the mmap_sem hold in read mode to protect against MADV_DONTNEED and
@@ -6,6 +6,7 @@
 #include <linux/aio_abi.h>
 #include <linux/uio.h>
 #include <linux/rcupdate.h>
+#include <linux/percpu-refcount.h>
 
 #include <linux/atomic.h>
 
@@ -95,6 +96,12 @@ struct kiocb {
 	int			(*ki_cancel)(struct kiocb *, struct io_event *);
 	ssize_t			(*ki_retry)(struct kiocb *);
 	void			(*ki_dtor)(struct kiocb *);
+	/*
+	 * Set by in-kernel submitters that have no kioctx, aio_complete()
+	 * then hands the result to it instead of an aio ring.  May be
+	 * called from interrupt context.
+	 */
+	void			(*ki_complete)(struct kiocb *, long, long);
 
 	union {
 		void __user		*user;
@@ -180,7 +187,7 @@ static inline unsigned aio_ring_avail(struct aio_ring_info *info,
 }
 
 struct kioctx {
-	atomic_t		users;
+	struct percpu_ref	users;
 	int			dead;
 	struct mm_struct	*mm;
 
@@ -203,6 +210,7 @@ struct kioctx {
 
 	struct delayed_work	wq;
 
+	struct work_struct	free_work;
 	struct rcu_head		rcu_head;
 };
 
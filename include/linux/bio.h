@@ -292,6 +292,8 @@ struct bio_set {
 	unsigned int front_pad;
 
 	mempool_t *bio_pool;
+	/* per cpu bios in front of bio_pool, fs_bio_set only */
+	struct bio_alloc_cache __percpu *cache;
 #if defined(CONFIG_BLK_DEV_INTEGRITY)
 	mempool_t *bio_integrity_pool;
 #endif
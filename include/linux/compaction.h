@@ -23,8 +23,10 @@ extern int fragmentation_index(struct zone *zone, unsigned int order);
 extern unsigned long try_to_compact_pages(struct zonelist *zonelist,
 			int order, gfp_t gfp_mask, nodemask_t *mask,
 			bool sync);
-extern int compact_pgdat(pg_data_t *pgdat, int order);
 extern unsigned long compaction_suitable(struct zone *zone, int order);
+extern void wakeup_kcompactd(pg_data_t *pgdat, int order, int classzone_idx);
+extern int kcompactd_run(int nid);
+extern void kcompactd_stop(int nid);
 
 /* Do not skip compaction more than 64 times */
 #define COMPACT_MAX_DEFER_SHIFT 6
@@ -69,14 +71,23 @@ static inline unsigned long try_to_compact_pages(struct zonelist *zonelist,
 	return COMPACT_CONTINUE;
 }
 
-static inline int compact_pgdat(pg_data_t *pgdat, int order)
+static inline unsigned long compaction_suitable(struct zone *zone, int order)
 {
-	return COMPACT_CONTINUE;
+	return COMPACT_SKIPPED;
 }
 
-static inline unsigned long compaction_suitable(struct zone *zone, int order)
+static inline void wakeup_kcompactd(pg_data_t *pgdat, int order,
+				    int classzone_idx)
+{
+}
+
+static inline int kcompactd_run(int nid)
+{
+	return 0;
+}
+
+static inline void kcompactd_stop(int nid)
 {
-	return COMPACT_SKIPPED;
 }
 
 static inline void defer_compaction(struct zone *zone, int order)
@@ -0,0 +1,75 @@
+#ifndef _LINUX_CONTEXT_TRACKING_H
+#define _LINUX_CONTEXT_TRACKING_H
+
+#include <linux/sched.h>
+#include <linux/percpu.h>
+
+enum ctx_state {
+	IN_KERNEL = 0,
+	IN_USER,
+};
+
+#ifdef CONFIG_CONTEXT_TRACKING
+
+struct context_tracking {
+	/*
+	 * When active is false, probes are unset in order
+	 * to minimize overhead: TIF flags are cleared
+	 * and calls to user_enter/exit are ignored.
+	 */
+	bool active;
+	enum ctx_state state;
+};
+
+DECLARE_PER_CPU(struct context_tracking, context_tracking);
+
+static inline bool context_tracking_in_user(void)
+{
+	return __this_cpu_read(context_tracking.state) == IN_USER;
+}
+
+static inline bool context_tracking_active(void)
+{
+	return __this_cpu_read(context_tracking.active);
+}
+
+extern void context_tracking_cpu_set(int cpu);
+extern void user_enter(void);
+extern void user_exit(void);
+extern void context_tracking_task_switch(struct task_struct *prev,
+					 struct task_struct *next);
+
+/*
+ * Exceptions may hit userspace or the kernel.  Leave the user context
+ * on entry and restore whatever context was interrupted on exit.
+ */
+static inline enum ctx_state exception_enter(void)
+{
+	enum ctx_state prev_ctx;
+
+	prev_ctx = this_cpu_read(context_tracking.state);
+	user_exit();
+
+	return prev_ctx;
+}
+
+static inline void exception_exit(enum ctx_state prev_ctx)
+{
+	if (prev_ctx == IN_USER)
+		user_enter();
+}
+
+#else
+
+static inline bool context_tracking_in_user(void) { return false; }
+static inline bool context_tracking_active(void) { return false; }
+static inline void user_enter(void) { }
+static inline void user_exit(void) { }
+static inline void context_tracking_task_switch(struct task_struct *prev,
+						struct task_struct *next) { }
+static inline enum ctx_state exception_enter(void) { return IN_KERNEL; }
+static inline void exception_exit(enum ctx_state prev_ctx) { }
+
+#endif /* !CONFIG_CONTEXT_TRACKING */
+
+#endif
@@ -2,6 +2,8 @@
 #define LINUX_MM_INLINE_H
 
 #include <linux/huge_mm.h>
+#include <linux/rcupdate.h>
+#include <linux/spinlock.h>
 
 /**
  * page_is_file_cache - should the page be on a file LRU or anon LRU?
@@ -21,6 +23,82 @@ static inline int page_is_file_cache(struct page *page)
 	return !PageSwapBacked(page);
 }
 
+/**
+ * lock_page_lruvec_irq - lock the lruvec a page belongs to
+ * @page: the page
+ *
+ * Returns the lruvec @page is on, or is to be added to, with its
+ * lru_lock held and interrupts disabled.  A page off the lru can move
+ * to another memcg before the lock is taken, so the lookup is checked
+ * again under the lock and retried if it went stale; the lruvec itself
+ * stays valid meanwhile because memcgs are freed by RCU.
+ */
+static inline struct lruvec *lock_page_lruvec_irq(struct page *page)
+{
+	struct zone *zone = page_zone(page);
+	struct lruvec *lruvec;
+
+	rcu_read_lock();
+again:
+	lruvec = mem_cgroup_page_lruvec(page, zone);
+	spin_lock_irq(&lruvec->lru_lock);
+	if (unlikely(!mem_cgroup_page_lruvec_locked(page, zone, lruvec))) {
+		spin_unlock_irq(&lruvec->lru_lock);
+		goto again;
+	}
+	rcu_read_unlock();
+	return lruvec;
+}
+
+static inline struct lruvec *lock_page_lruvec_irqsave(struct page *page,
+						      unsigned long *flags)
+{
+	struct zone *zone = page_zone(page);
+	struct lruvec *lruvec;
+
+	rcu_read_lock();
+again:
+	lruvec = mem_cgroup_page_lruvec(page, zone);
+	spin_lock_irqsave(&lruvec->lru_lock, *flags);
+	if (unlikely(!mem_cgroup_page_lruvec_locked(page, zone, lruvec))) {
+		spin_unlock_irqrestore(&lruvec->lru_lock, *flags);
+		goto again;
+	}
+	rcu_read_unlock();
+	return lruvec;
+}
+
+/**
+ * relock_page_lruvec_irq - switch to the lruvec lock of another page
+ * @page: the page
+ * @locked: the lruvec currently locked, or NULL
+ *
+ * For batched operations: keeps @locked if @page belongs to it, which
+ * is the common case, and otherwise drops it and locks the right one.
+ */
+static inline struct lruvec *relock_page_lruvec_irq(struct page *page,
+						    struct lruvec *locked)
+{
+	if (locked) {
+		if (mem_cgroup_page_lruvec_locked(page, page_zone(page), locked))
+			return locked;
+		spin_unlock_irq(&locked->lru_lock);
+	}
+	return lock_page_lruvec_irq(page);
+}
+
+static inline struct lruvec *relock_page_lruvec_irqsave(struct page *page,
+							struct lruvec *locked,
+							unsigned long *flags)
+{
+	if (locked) {
+		if (mem_cgroup_page_lruvec_locked(page, page_zone(page), locked))
+			return locked;
+		spin_unlock_irqrestore(&locked->lru_lock, *flags);
+	}
+	return lock_page_lruvec_irqsave(page, flags);
+}
+
 static __always_inline void add_page_to_lru_list(struct page *page,
 				struct lruvec *lruvec, enum lru_list lru)
 {
@@ -0,0 +1,132 @@
+#ifndef _LINUX_PERCPU_REFCOUNT_H
+#define _LINUX_PERCPU_REFCOUNT_H
+
+/*
+ * Percpu reference counts.
+ *
+ * For objects that are looked up and released far more often than they
+ * are torn down.  While the ref is live, percpu_ref_get() and
+ * percpu_ref_put() only touch a counter of the local CPU, so they never
+ * bounce a cache line between CPUs.  The sum of those counters is
+ * meaningless on its own, which is why a percpu ref cannot tell when it
+ * drops to zero - until it is killed.
+ *
+ * percpu_ref_kill() switches the ref over to a single atomic_t.  Since
+ * getters and putters may still be on the percpu path, the switch takes
+ * an RCU-sched grace period, after which the percpu counters are folded
+ * into the atomic and the initial reference is dropped.  From then on
+ * the ref behaves like a plain atomic refcount and ->release() is called
+ * when it hits zero.
+ *
+ * The owner's initial reference (from percpu_ref_init()) must only be
+ * dropped by percpu_ref_kill(), and ->release() may be called from RCU
+ * callback context, so it must not sleep.
+ */
+
+#include <linux/atomic.h>
+#include <linux/kernel.h>
+#include <linux/percpu.h>
+#include <linux/rcupdate.h>
+
+struct percpu_ref;
+typedef void (percpu_ref_func_t)(struct percpu_ref *);
+
+struct percpu_ref {
+	atomic_t		count;
+	/*
+	 * Pointer to the percpu counters.  The low bit is set once the
+	 * ref has been killed; get and put then go to ->count instead.
+	 */
+	unsigned long		pcpu_count_ptr;
+	percpu_ref_func_t	*release;
+	struct rcu_head		rcu;
+};
+
+extern int __must_check percpu_ref_init(struct percpu_ref *ref,
+					percpu_ref_func_t *release);
+extern void percpu_ref_cancel_init(struct percpu_ref *ref);
+extern void percpu_ref_kill(struct percpu_ref *ref);
+
+#define PCPU_REF_DEAD		1UL
+
+static inline bool __pcpu_ref_alive(struct percpu_ref *ref,
+				    unsigned __percpu **pcpu_countp)
+{
+	unsigned long pcpu_ptr = ACCESS_ONCE(ref->pcpu_count_ptr);
+
+	if (unlikely(pcpu_ptr & PCPU_REF_DEAD))
+		return false;
+
+	*pcpu_countp = (unsigned __percpu *)pcpu_ptr;
+	return true;
+}
+
+/**
+ * percpu_ref_get - increment a percpu refcount
+ * @ref: percpu_ref to get
+ *
+ * The caller must already hold a reference, directly or through an
+ * RCU-protected lookup of an object that has not been killed.
+ */
+static inline void percpu_ref_get(struct percpu_ref *ref)
+{
+	unsigned __percpu *pcpu_count;
+
+	rcu_read_lock_sched();
+
+	if (__pcpu_ref_alive(ref, &pcpu_count))
+		__this_cpu_inc(*pcpu_count);
+	else
+		atomic_inc(&ref->count);
+
+	rcu_read_unlock_sched();
+}
+
+/**
+ * percpu_ref_tryget - try to increment a percpu refcount
+ * @ref: percpu_ref to try-get
+ *
+ * Fails only when the ref has been killed and has already dropped to
+ * zero, i.e. ->release() has been or is about to be called.
+ *
+ * Returns %true on success.
+ */
+static inline bool percpu_ref_tryget(struct percpu_ref *ref)
+{
+	unsigned __percpu *pcpu_count;
+	bool ret = true;
+
+	rcu_read_lock_sched();
+
+	if (__pcpu_ref_alive(ref, &pcpu_count))
+		__this_cpu_inc(*pcpu_count);
+	else
+		ret = atomic_inc_not_zero(&ref->count);
+
+	rcu_read_unlock_sched();
+
+	return ret;
+}
+
+/**
+ * percpu_ref_put - decrement a percpu refcount
+ * @ref: percpu_ref to put
+ *
+ * Calls ->release() if the ref has been killed and this was the last
+ * reference.
+ */
+static inline void percpu_ref_put(struct percpu_ref *ref)
+{
+	unsigned __percpu *pcpu_count;
+
+	rcu_read_lock_sched();
+
+	if (__pcpu_ref_alive(ref, &pcpu_count))
+		__this_cpu_dec(*pcpu_count);
+	else if (unlikely(atomic_dec_and_test(&ref->count)))
+		ref->release(ref);
+
+	rcu_read_unlock_sched();
+}
+
+#endif
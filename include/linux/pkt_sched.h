@@ -735,4 +735,37 @@ struct tc_fq_codel_xstats {
 	};
 };
 
+/* FQ */
+
+enum {
+	TCA_FQ_UNSPEC,
+	TCA_FQ_PLIMIT,		/* limit of total number of packets in queue */
+	TCA_FQ_FLOW_PLIMIT,	/* limit of packets per flow */
+	TCA_FQ_QUANTUM,		/* RR quantum */
+	TCA_FQ_INITIAL_QUANTUM,		/* RR quantum for new flow */
+	TCA_FQ_RATE_ENABLE,	/* enable/disable rate limiting */
+	TCA_FQ_FLOW_DEFAULT_RATE,/* obsolete, do not use */
+	TCA_FQ_FLOW_MAX_RATE,	/* per flow max rate */
+	TCA_FQ_BUCKETS_LOG,	/* log2(number of buckets) */
+	TCA_FQ_FLOW_REFILL_DELAY,	/* flow credit refill delay in usec */
+	__TCA_FQ_MAX
+};
+
+#define TCA_FQ_MAX	(__TCA_FQ_MAX - 1)
+
+struct tc_fq_qd_stats {
+	__u64	gc_flows;
+	__u64	highprio_packets;
+	__u64	tcp_retrans;
+	__u64	throttled;
+	__u64	flows_plimit;
+	__u64	pkts_too_long;
+	__u64	allocation_errors;
+	__s64	time_next_delayed_flow;
+	__u32	flows;
+	__u32	inactive_flows;
+	__u32	throttled_flows;
+	__u32	pad;
+};
+
 #endif
@@ -1532,6 +1532,22 @@ struct task_struct {
 	short il_next;
 	short pref_node_fork;
 #endif
+#ifdef CONFIG_NUMA_BALANCING
+	int numa_scan_seq;
+	unsigned int numa_scan_period;
+	u64 node_stamp;			/* migration stamp  */
+	struct callback_head numa_work;
+
+	/*
+	 * Hinting faults per node: numa_faults is the decaying average
+	 * used for placement, numa_faults_buffer collects the faults of
+	 * the current scan pass.  Both are nr_node_ids long.
+	 */
+	unsigned long *numa_faults;
+	unsigned long *numa_faults_buffer;
+	int numa_preferred_nid;
+	unsigned long numa_pages_migrated;
+#endif /* CONFIG_NUMA_BALANCING */
 	struct rcu_head rcu;
 
 	/*
@@ -2015,8 +2031,17 @@ static inline void idle_task_exit(void) {}
 
 #if defined(CONFIG_NO_HZ) && defined(CONFIG_SMP)
 extern void wake_up_idle_cpu(int cpu);
+extern void wake_up_nohz_cpu(int cpu);
 #else
 static inline void wake_up_idle_cpu(int cpu) { }
+static inline void wake_up_nohz_cpu(int cpu) { }
+#endif
+
+#ifdef CONFIG_NO_HZ_FULL
+extern bool sched_can_stop_tick(void);
+extern u64 scheduler_tick_max_deferment(void);
+#else
+static inline bool sched_can_stop_tick(void) { return false; }
 #endif
 
 extern unsigned int sysctl_sched_latency;
@@ -2057,6 +2082,24 @@ static inline unsigned int get_sysctl_timer_migration(void)
 extern unsigned int sysctl_sched_rt_period;
 extern int sysctl_sched_rt_runtime;
 
+#ifdef CONFIG_NUMA_BALANCING
+extern int sysctl_numa_balancing;
+extern unsigned int sysctl_numa_balancing_scan_delay;
+extern unsigned int sysctl_numa_balancing_scan_period_min;
+extern unsigned int sysctl_numa_balancing_scan_period_max;
+extern unsigned int sysctl_numa_balancing_scan_size;
+
+extern void task_numa_fault(int node, int pages, bool migrated);
+extern void task_numa_free(struct task_struct *p);
+#else
+static inline void task_numa_fault(int node, int pages, bool migrated)
+{
+}
+static inline void task_numa_free(struct task_struct *p)
+{
+}
+#endif
+
 int sched_rt_handler(struct ctl_table *table, int write,
 		void __user *buffer, size_t *lenp,
 		loff_t *ppos);
@@ -1,6 +1,10 @@
 #ifndef _LINUX_SHRINKER_H
 #define _LINUX_SHRINKER_H
 
+#include <linux/nodemask.h>
+
+struct mem_cgroup;
+
 /*
  * This struct is used to pass information from page reclaim to the shrinkers.
  * We consolidate the values for easier extention later.
@@ -10,6 +14,14 @@ struct shrink_control {
 
 	/* How many slab objects shrinker() should scan and try to reclaim */
 	unsigned long nr_to_scan;
+
+	/* shrink from these nodes */
+	nodemask_t nodes_to_scan;
+	/* current node being shrunk (for NUMA aware shrinkers) */
+	int nid;
+
+	/* reclaim from this memcg only (if not NULL) */
+	struct mem_cgroup *memcg;
 };
 
 /*
@@ -26,17 +38,36 @@ struct shrink_control {
  *
  * Note that 'shrink' will be passed nr_to_scan == 0 when the VM is
  * querying the cache size, so a fastpath for that case is appropriate.
+ *
+ * If the shrinker sets SHRINKER_NUMA_AWARE, it is called once for each
+ * node in 'nodes_to_scan', with 'nid' set to the node being reclaimed,
+ * and both the count and the scan should only cover objects on that
+ * node.  Pressure that could not be applied is then remembered per node
+ * as well.  Other shrinkers are called once, with 'nid' set to 0.
+ *
+ * Shrinkers that set SHRINKER_MEMCG_AWARE are also called with 'memcg'
+ * set during reclaim on behalf of a memory cgroup, and should only
+ * count and free objects charged to it.  Other shrinkers are skipped
+ * for such reclaim.
  */
 struct shrinker {
 	int (*shrink)(struct shrinker *, struct shrink_control *sc);
 	int seeks;	/* seeks to recreate an obj */
 	long batch;	/* reclaim batch size, 0 = default */
+	unsigned long flags;
 
 	/* These are for internal use */
 	struct list_head list;
 	atomic_long_t nr_in_batch; /* objs pending delete */
+	/* objs pending delete, per node for NUMA aware shrinkers */
+	atomic_long_t *nr_deferred;
 };
 #define DEFAULT_SEEKS 2 /* A good number if you don't know better. */
+
+/* Flags */
+#define SHRINKER_NUMA_AWARE	(1 << 0)
+#define SHRINKER_MEMCG_AWARE	(1 << 1)
+
 extern void register_shrinker(struct shrinker *);
 extern void unregister_shrinker(struct shrinker *);
 #endif
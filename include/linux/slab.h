@@ -11,6 +11,7 @@
 
 #include <linux/gfp.h>
 #include <linux/types.h>
+#include <linux/workqueue.h>
 
 /*
  * Flags to pass to kmem_cache_create().
@@ -122,14 +123,27 @@ struct kmem_cache {
 void __init kmem_cache_init(void);
 int slab_is_available(void);
 
+struct mem_cgroup;
 struct kmem_cache *kmem_cache_create(const char *, size_t, size_t,
 			unsigned long,
 			void (*)(void *));
+struct kmem_cache *
+kmem_cache_create_memcg(struct mem_cgroup *, const char *, size_t, size_t,
+			unsigned long, void (*)(void *), struct kmem_cache *);
 void kmem_cache_destroy(struct kmem_cache *);
 int kmem_cache_shrink(struct kmem_cache *);
 void kmem_cache_free(struct kmem_cache *, void *);
 unsigned int kmem_cache_size(struct kmem_cache *);
 
+/*
+ * Bulk allocation and freeing of an array of objects, cheaper than the
+ * same number of single object calls.  kmem_cache_alloc_bulk() either
+ * fills the whole array and returns its size, or returns 0.  Both may
+ * be called with interrupts disabled, if @flags does not allow sleeping.
+ */
+int kmem_cache_alloc_bulk(struct kmem_cache *, gfp_t, size_t, void **);
+void kmem_cache_free_bulk(struct kmem_cache *, size_t, void **);
+
 /*
  * Please use this macro to create slab caches. Simply specify the
  * name of the structure and maybe some flags that are listed above.
@@ -186,6 +200,48 @@ void kfree(const void *);
 void kzfree(const void *);
 size_t ksize(const void *);
 
+#ifdef CONFIG_MEMCG_KMEM
+/*
+ * Copies of a root cache, indexed by memcg_cache_id().  Replaced under
+ * slab_mutex when the number of kmem-limited groups grows, readers
+ * look it up under rcu_read_lock().
+ */
+struct memcg_cache_array {
+	struct rcu_head rcu_head;
+	struct kmem_cache *entries[0];
+};
+
+/**
+ * struct memcg_cache_params - per-memcg state of a kmem_cache
+ * @is_root_cache: true for caches created with kmem_cache_create()
+ * @memcg_caches: root caches only, the per-memcg copies of this cache
+ * @memcg: memcg copies only, the cgroup the objects are charged to
+ * @list: entry in the list of caches belonging to @memcg
+ * @cachep: the kmem_cache these parameters belong to
+ * @root_cache: the cache this one was copied from
+ * @dead: @memcg is gone, destroy the cache once it becomes empty
+ * @nr_pages: number of slab pages currently held by the cache
+ * @destroy: work item releasing a dead cache
+ */
+struct memcg_cache_params {
+	bool is_root_cache;
+	union {
+		struct memcg_cache_array __rcu *memcg_caches;
+		struct {
+			struct mem_cgroup *memcg;
+			struct list_head list;
+			struct kmem_cache *cachep;
+			struct kmem_cache *root_cache;
+			bool dead;
+			atomic_t nr_pages;
+			struct work_struct destroy;
+		};
+	};
+};
+
+int memcg_update_all_caches(int num_memcgs);
+#endif
+
 /*
  * Allocator specific definitions. These are mainly used to establish optimized
  * ways to convert kmalloc() calls to kmem_cache_alloc() invocations by
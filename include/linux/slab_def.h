@@ -56,6 +56,9 @@ struct kmem_cache {
 	int refcount;
 	int object_size;
 	int align;
+#ifdef CONFIG_MEMCG_KMEM
+	struct memcg_cache_params *memcg_params;
+#endif
 
 /* 5) statistics */
 #ifdef CONFIG_DEBUG_SLAB
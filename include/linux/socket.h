@@ -340,5 +340,11 @@ extern int __sys_recvmmsg(int fd, struct mmsghdr __user *mmsg, unsigned int vlen
 			  unsigned int flags, struct timespec *timeout);
 extern int __sys_sendmmsg(int fd, struct mmsghdr __user *mmsg,
 			  unsigned int vlen, unsigned int flags);
+
+struct socket;
+extern int __sys_sendmsg_sock(struct socket *sock, struct msghdr __user *msg,
+			      unsigned int flags);
+extern int __sys_recvmsg_sock(struct socket *sock, struct msghdr __user *msg,
+			      unsigned int flags);
 #endif /* not kernel and not glibc */
 #endif /* _LINUX_SOCKET_H */
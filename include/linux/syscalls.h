@@ -17,6 +17,7 @@ struct inode;
 struct iocb;
 struct io_event;
 struct iovec;
+struct io_uring_params;
 struct itimerspec;
 struct itimerval;
 struct kexec_segment;
@@ -860,4 +861,8 @@ asmlinkage long sys_process_vm_writev(pid_t pid,
 
 asmlinkage long sys_kcmp(pid_t pid1, pid_t pid2, int type,
 			 unsigned long idx1, unsigned long idx2);
+asmlinkage long sys_io_uring_setup(u32 entries,
+				   struct io_uring_params __user *p);
+asmlinkage long sys_io_uring_enter(unsigned int fd, u32 to_submit,
+				   u32 min_complete, u32 flags);
 #endif
@@ -50,6 +50,11 @@ struct fib6_config {
 	struct nl_info	fc_nlinfo;
 };
 
+/*
+ * Lookups walk the tree under rcu_read_lock() only; every change is made
+ * with the table's tb6_lock held for writing, and nodes and routes that
+ * drop out of the tree are freed after a grace period.
+ */
 struct fib6_node {
 	struct fib6_node	*parent;
 	struct fib6_node	*left;
@@ -63,12 +68,16 @@ struct fib6_node {
 	__u16			fn_flags;
 	__u32			fn_sernum;
 	struct rt6_info		*rr_ptr;
+	struct rcu_head		rcu;
 };
 
 #ifndef CONFIG_IPV6_SUBTREES
 #define FIB6_SUBTREE(fn)	NULL
+#define FIB6_SUBTREE_RCU(fn)	NULL
 #else
 #define FIB6_SUBTREE(fn)	((fn)->subtree)
+/* for lookups under rcu_read_lock() */
+#define FIB6_SUBTREE_RCU(fn)	rcu_dereference((fn)->subtree)
 #endif
 
 /*
@@ -100,6 +109,15 @@ struct rt6_info {
 
 	atomic_t			rt6i_ref;
 
+	/*
+	 * Copies of this route handed out by lookups, one slot per
+	 * possible cpu, allocated on first use since routes are also
+	 * added from atomic context.  The copies (RTF_PCPU) are never
+	 * linked into the tree; they hold a reference on this route in
+	 * dst.from and are freed when it leaves the tree.
+	 */
+	struct rt6_info			**rt6i_pcpu;
+
 	/* These are in a separate cache line. */
 	struct rt6key			rt6i_dst ____cacheline_aligned_in_smp;
 	u32				rt6i_flags;
@@ -150,6 +168,15 @@ static inline void rt6_transfer_peer(struct rt6_info *rt, struct rt6_info *ort)
 	inetpeer_transfer_peer(&rt->_rt6i_peer, &ort->_rt6i_peer);
 }
 
+/* Cookie for ip6_dst_check(): per-cpu copies follow their fib entry */
+static inline u32 rt6_get_cookie(const struct rt6_info *rt)
+{
+	if (rt->rt6i_flags & RTF_PCPU)
+		rt = (struct rt6_info *)rt->dst.from;
+
+	return rt->rt6i_node ? rt->rt6i_node->fn_sernum : 0;
+}
+
 static inline struct inet6_dev *ip6_dst_idev(struct dst_entry *dst)
 {
 	return ((struct rt6_info *)dst)->rt6i_idev;
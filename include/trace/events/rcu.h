@@ -516,6 +516,42 @@ TRACE_EVENT(rcu_batch_end,
 		  __entry->risk ? 'R' : '.')
 );
 
+/*
+ * Tracepoint for the callback-offload ("rcuo") kthreads of no-CBs CPUs.
+ * The first argument is the type of RCU, the second is the no-CBs CPU,
+ * the third is a string describing the event, and the fourth is the
+ * number of callbacks queued for the kthread at that point.  Possible
+ * events are:
+ *
+ *	"WakeEmpty": Callback queued on an empty list, kthread awakened.
+ *	"Sleep": The kthread found no callbacks and is going to sleep.
+ *	"Poll": The kthread found no callbacks while polling.
+ *	"WokeQueue": The kthread took a batch of callbacks off the list.
+ */
+TRACE_EVENT(rcu_nocb_wake,
+
+	TP_PROTO(char *rcuname, int cpu, char *reason, long qlen),
+
+	TP_ARGS(rcuname, cpu, reason, qlen),
+
+	TP_STRUCT__entry(
+		__field(char *, rcuname)
+		__field(int, cpu)
+		__field(char *, reason)
+		__field(long, qlen)
+	),
+
+	TP_fast_assign(
+		__entry->rcuname = rcuname;
+		__entry->cpu = cpu;
+		__entry->reason = reason;
+		__entry->qlen = qlen;
+	),
+
+	TP_printk("%s %d %s ql=%ld", __entry->rcuname, __entry->cpu,
+		  __entry->reason, __entry->qlen)
+);
+
 /*
  * Tracepoint for rcutorture readers.  The first argument is the name
  * of the RCU flavor from rcutorture's viewpoint and the second argument
@@ -607,6 +643,7 @@ TRACE_EVENT(rcu_barrier,
 #define trace_rcu_invoke_kfree_callback(rcuname, rhp, offset) do { } while (0)
 #define trace_rcu_batch_end(rcuname, callbacks_invoked, cb, nr, iit, risk) \
 	do { } while (0)
+#define trace_rcu_nocb_wake(rcuname, cpu, reason, qlen) do { } while (0)
 #define trace_rcu_torture_read(rcutorturename, rhp) do { } while (0)
 #define trace_rcu_barrier(name, s, cpu, cnt, done) do { } while (0)
 
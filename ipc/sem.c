@@ -94,12 +94,13 @@
 struct sem {
 	int	semval;		/* current value */
 	int	sempid;		/* pid of last operation */
+	spinlock_t	lock;	/* spinlock for fine-grained semtimedop */
 	struct list_head sem_pending; /* pending single-sop operations */
-};
+} ____cacheline_aligned_in_smp;
 
 /* One queue for each sleeping process in the system. */
 struct sem_queue {
-	struct list_head	simple_list; /* queue of pending operations */
+	struct list_head	simple_list; /* list of tasks to wake up */
 	struct list_head	list;	 /* queue of pending operations */
 	struct task_struct	*sleeper; /* this process */
 	struct sem_undo		*undo;	 /* undo structure */
@@ -155,8 +156,16 @@ static int sysvipc_sem_proc_show(struct seq_file *s, void *it);
  *	sem_undo.id_next,
  *	sem_array.sem_pending{,last},
  *	sem_array.sem_undo: sem_lock() for read/write
+ *	sem.sem_pending: semop_lock() for read/write
  *	sem_undo.proc_next: only "current" is allowed to read/write that field.
- *	
+ *
+ * Locking:
+ *	A semtimedop() that touches a single semaphore while no complex
+ *	(multi-sop) operation is pending only takes sem.lock of that
+ *	semaphore.  Everything else takes sem_perm.lock, the array lock,
+ *	and then waits until all per-semaphore lock holders are gone, so
+ *	holding the array lock still means owning the whole array.
+ *	sem_array.complex_count only changes under the array lock.
  */
 
 #define sc_semmsl	sem_ctls[0]
@@ -190,24 +199,58 @@ void __init sem_init (void)
 				IPC_SEM_IDS, sysvipc_sem_proc_show);
 }
 
+/*
+ * Wait until all simple operations that hold a per-semaphore lock have
+ * left their critical section.  Called with the array lock held: new
+ * simple operations see it and back off, see semop_lock().
+ */
+static void sem_wait_array(struct sem_array *sma)
+{
+	int i;
+
+	/* order taking sem_perm.lock before reading the semaphore locks */
+	smp_mb();
+	for (i = 0; i < sma->sem_nsems; i++)
+		spin_unlock_wait(&sma->sem_base[i].lock);
+	/* and reading the semaphores after the last holder is gone */
+	smp_rmb();
+}
+
 /*
  * sem_lock_(check_) routines are called in the paths where the rw_mutex
- * is not held.
+ * is not held.  They take the array lock.
  */
 static inline struct sem_array *sem_lock(struct ipc_namespace *ns, int id)
 {
 	struct kern_ipc_perm *ipcp = ipc_lock(&sem_ids(ns), id);
+	struct sem_array *sma;
 
 	if (IS_ERR(ipcp))
 		return (struct sem_array *)ipcp;
 
-	return container_of(ipcp, struct sem_array, sem_perm);
+	sma = container_of(ipcp, struct sem_array, sem_perm);
+	sem_wait_array(sma);
+	return sma;
 }
 
 static inline struct sem_array *sem_lock_check(struct ipc_namespace *ns,
 						int id)
 {
 	struct kern_ipc_perm *ipcp = ipc_lock_check(&sem_ids(ns), id);
+	struct sem_array *sma;
+
+	if (IS_ERR(ipcp))
+		return (struct sem_array *)ipcp;
+
+	sma = container_of(ipcp, struct sem_array, sem_perm);
+	sem_wait_array(sma);
+	return sma;
+}
+
+static inline struct sem_array *sem_obtain_object_check(struct ipc_namespace *ns,
+							int id)
+{
+	struct kern_ipc_perm *ipcp = ipc_obtain_object_check(&sem_ids(ns), id);
 
 	if (IS_ERR(ipcp))
 		return (struct sem_array *)ipcp;
@@ -215,9 +258,99 @@ static inline struct sem_array *sem_lock_check(struct ipc_namespace *ns,
 	return container_of(ipcp, struct sem_array, sem_perm);
 }
 
+/**
+ * semop_lock - lock a semaphore array for semtimedop
+ * @sma: semaphore array, found with rcu_read_lock() held
+ * @sops: operations that will be performed
+ * @nsops: number of operations
+ *
+ * A single operation only takes the lock of the semaphore it works on,
+ * unless complex operations are pending, which may have to be completed
+ * by it.  Everything else takes the array lock.
+ *
+ * Returns the number of the semaphore that was locked, or -1 for the
+ * array lock; this is what semop_unlock() expects.
+ */
+static int semop_lock(struct sem_array *sma, struct sembuf *sops, int nsops)
+{
+	struct sem *sem;
+
+	if (nsops != 1)
+		goto lock_array;
+
+	sem = sma->sem_base + sops->sem_num;
+again:
+	if (sma->complex_count)
+		goto lock_array;
+
+	spin_lock(&sem->lock);
+	/* pairs with the smp_mb() in sem_wait_array() */
+	smp_mb();
+	if (likely(!spin_is_locked(&sma->sem_perm.lock))) {
+		/*
+		 * The array lock is free, so complex_count is stable until
+		 * we drop sem->lock.  It may have changed while we were
+		 * spinning, though.
+		 */
+		smp_rmb();
+		if (likely(!sma->complex_count))
+			return sops->sem_num;
+
+		spin_unlock(&sem->lock);
+		goto lock_array;
+	}
+
+	/* someone owns the whole array, wait for them and try again */
+	spin_unlock(&sem->lock);
+	spin_unlock_wait(&sma->sem_perm.lock);
+	goto again;
+
+lock_array:
+	spin_lock(&sma->sem_perm.lock);
+	sem_wait_array(sma);
+	return -1;
+}
+
+static inline void semop_unlock(struct sem_array *sma, int locknum)
+{
+	if (locknum == -1)
+		spin_unlock(&sma->sem_perm.lock);
+	else
+		spin_unlock(&sma->sem_base[locknum].lock);
+}
+
+/*
+ * Look up and lock a semaphore array for semtimedop.  Returns with
+ * rcu_read_lock() held on success.
+ */
+static struct sem_array *sem_obtain_lock(struct ipc_namespace *ns, int id,
+					 struct sembuf *sops, int nsops,
+					 int *locknum)
+{
+	struct sem_array *sma;
+
+	rcu_read_lock();
+	sma = sem_obtain_object_check(ns, id);
+	if (IS_ERR(sma))
+		goto out_rcu;
+
+	*locknum = semop_lock(sma, sops, nsops);
+
+	/* freeary() may have removed the array while we were spinning */
+	if (likely(!sma->sem_perm.deleted))
+		return sma;
+
+	semop_unlock(sma, *locknum);
+	sma = ERR_PTR(-EINVAL);
+out_rcu:
+	rcu_read_unlock();
+	return sma;
+}
+
 static inline void sem_lock_and_putref(struct sem_array *sma)
 {
 	ipc_lock_by_ptr(&sma->sem_perm);
+	sem_wait_array(sma);
 	ipc_rcu_putref(sma);
 }
 
@@ -314,24 +447,28 @@ static int newary(struct ipc_namespace *ns, struct ipc_params *params)
 		return retval;
 	}
 
-	id = ipc_addid(&sem_ids(ns), &sma->sem_perm, ns->sc_semmni);
-	if (id < 0) {
-		security_sem_free(sma);
-		ipc_rcu_putref(sma);
-		return id;
-	}
-	ns->used_sems += nsems;
-
 	sma->sem_base = (struct sem *) &sma[1];
 
-	for (i = 0; i < nsems; i++)
+	for (i = 0; i < nsems; i++) {
+		spin_lock_init(&sma->sem_base[i].lock);
 		INIT_LIST_HEAD(&sma->sem_base[i].sem_pending);
+	}
 
+	/* semop_lock() may look at the array as soon as it is in the idr */
 	sma->complex_count = 0;
 	INIT_LIST_HEAD(&sma->sem_pending);
 	INIT_LIST_HEAD(&sma->list_id);
 	sma->sem_nsems = nsems;
 	sma->sem_ctime = get_seconds();
+
+	id = ipc_addid(&sem_ids(ns), &sma->sem_perm, ns->sc_semmni);
+	if (id < 0) {
+		security_sem_free(sma);
+		ipc_rcu_putref(sma);
+		return id;
+	}
+	ns->used_sems += nsems;
+
 	sem_unlock(sma);
 
 	return sma->sem_perm.id;
@@ -502,9 +639,7 @@ static void wake_up_sem_queue_do(struct list_head *pt)
 static void unlink_queue(struct sem_array *sma, struct sem_queue *q)
 {
 	list_del(&q->list);
-	if (q->nsops == 1)
-		list_del(&q->simple_list);
-	else
+	if (q->nsops > 1)
 		sma->complex_count--;
 }
 
@@ -559,7 +694,7 @@ static int check_restart(struct sem_array *sma, struct sem_queue *q)
 	 * semval is 0. Check if there are wait-for-zero semops.
 	 * They must be the first entries in the per-semaphore simple queue
 	 */
-	h = list_first_entry(&curr->sem_pending, struct sem_queue, simple_list);
+	h = list_first_entry(&curr->sem_pending, struct sem_queue, list);
 	BUG_ON(h->nsops != 1);
 	BUG_ON(h->sops[0].sem_num != q->sops[0].sem_num);
 
@@ -579,8 +714,10 @@ static int check_restart(struct sem_array *sma, struct sem_queue *q)
  * @pt: list head for the tasks that must be woken up.
  *
  * update_queue must be called after a semaphore in a semaphore array
- * was modified. If multiple semaphore were modified, then @semnum
- * must be set to -1.
+ * was modified. Single-sop operations are queued on the semaphore they
+ * wait for and are scanned with @semnum set to that semaphore, complex
+ * operations are queued on the array and are scanned with @semnum set
+ * to -1.
  * The tasks that must be woken up are added to @pt. The return code
  * is stored in q->pid.
  * The function return 1 if at least one semop was completed successfully.
@@ -590,30 +727,19 @@ static int update_queue(struct sem_array *sma, int semnum, struct list_head *pt)
 	struct sem_queue *q;
 	struct list_head *walk;
 	struct list_head *pending_list;
-	int offset;
 	int semop_completed = 0;
 
-	/* if there are complex operations around, then knowing the semaphore
-	 * that was modified doesn't help us. Assume that multiple semaphores
-	 * were modified.
-	 */
-	if (sma->complex_count)
-		semnum = -1;
-
-	if (semnum == -1) {
+	if (semnum == -1)
 		pending_list = &sma->sem_pending;
-		offset = offsetof(struct sem_queue, list);
-	} else {
+	else
 		pending_list = &sma->sem_base[semnum].sem_pending;
-		offset = offsetof(struct sem_queue, simple_list);
-	}
 
 again:
 	walk = pending_list->next;
 	while (walk != pending_list) {
 		int error, restart;
 
-		q = (struct sem_queue *)((char *)walk - offset);
+		q = list_entry(walk, struct sem_queue, list);
 		walk = walk->next;
 
 		/* If we are scanning the single sop, per-semaphore list of
@@ -667,11 +793,21 @@ again:
 static void do_smart_update(struct sem_array *sma, struct sembuf *sops, int nsops,
 			int otime, struct list_head *pt)
 {
-	int i;
+	int i, progress;
 
 	if (sma->complex_count || sops == NULL) {
-		if (update_queue(sma, -1, pt))
-			otime = 1;
+		/*
+		 * Anything may have changed, and an operation completed on
+		 * one queue can unblock operations on another one: scan all
+		 * of them until nothing moves any more.
+		 */
+		do {
+			progress = update_queue(sma, -1, pt);
+			for (i = 0; i < sma->sem_nsems; i++)
+				progress |= update_queue(sma, i, pt);
+			if (progress)
+				otime = 1;
+		} while (progress);
 		goto done;
 	}
 
@@ -703,6 +839,13 @@ static int count_semncnt (struct sem_array * sma, ushort semnum)
 	struct sem_queue * q;
 
 	semncnt = 0;
+	list_for_each_entry(q, &sma->sem_base[semnum].sem_pending, list) {
+		struct sembuf * sops = q->sops;
+
+		if ((sops->sem_op < 0) && !(sops->sem_flg & IPC_NOWAIT))
+			semncnt++;
+	}
+
 	list_for_each_entry(q, &sma->sem_pending, list) {
 		struct sembuf * sops = q->sops;
 		int nsops = q->nsops;
@@ -722,6 +865,13 @@ static int count_semzcnt (struct sem_array * sma, ushort semnum)
 	struct sem_queue * q;
 
 	semzcnt = 0;
+	list_for_each_entry(q, &sma->sem_base[semnum].sem_pending, list) {
+		struct sembuf * sops = q->sops;
+
+		if ((sops->sem_op == 0) && !(sops->sem_flg & IPC_NOWAIT))
+			semzcnt++;
+	}
+
 	list_for_each_entry(q, &sma->sem_pending, list) {
 		struct sembuf * sops = q->sops;
 		int nsops = q->nsops;
@@ -745,9 +895,11 @@ static void freeary(struct ipc_namespace *ns, struct kern_ipc_perm *ipcp)
 	struct sem_queue *q, *tq;
 	struct sem_array *sma = container_of(ipcp, struct sem_array, sem_perm);
 	struct list_head tasks;
+	int i;
 
 	/* Free the existing undo structures for this semaphore set.  */
 	assert_spin_locked(&sma->sem_perm.lock);
+	sem_wait_array(sma);
 	list_for_each_entry_safe(un, tu, &sma->list_id, list_id) {
 		list_del(&un->list_id);
 		spin_lock(&un->ulp->lock);
@@ -763,6 +915,14 @@ static void freeary(struct ipc_namespace *ns, struct kern_ipc_perm *ipcp)
 		unlink_queue(sma, q);
 		wake_up_sem_queue_prepare(&tasks, q, -EIDRM);
 	}
+	for (i = 0; i < sma->sem_nsems; i++) {
+		struct sem *sem = sma->sem_base + i;
+
+		list_for_each_entry_safe(q, tq, &sem->sem_pending, list) {
+			unlink_queue(sma, q);
+			wake_up_sem_queue_prepare(&tasks, q, -EIDRM);
+		}
+	}
 
 	/* Remove the semaphore set from the IDR */
 	sem_rmid(ns, sma);
@@ -1335,7 +1495,7 @@ SYSCALL_DEFINE4(semtimedop, int, semid, struct sembuf __user *, tsops,
 	struct sembuf fast_sops[SEMOPM_FAST];
 	struct sembuf* sops = fast_sops, *sop;
 	struct sem_undo *un;
-	int undos = 0, alter = 0, max;
+	int undos = 0, alter = 0, max, locknum;
 	struct sem_queue queue;
 	unsigned long jiffies_left = 0;
 	struct ipc_namespace *ns;
@@ -1380,59 +1540,55 @@ SYSCALL_DEFINE4(semtimedop, int, semid, struct sembuf __user *, tsops,
 	}
 
 	if (undos) {
+		/* on success, find_alloc_undo() returns with rcu_read_lock() */
 		un = find_alloc_undo(ns, semid);
 		if (IS_ERR(un)) {
 			error = PTR_ERR(un);
 			goto out_free;
 		}
-	} else
+	} else {
 		un = NULL;
+		rcu_read_lock();
+	}
 
 	INIT_LIST_HEAD(&tasks);
 
-	sma = sem_lock_check(ns, semid);
+	/*
+	 * The checks below are done before the array is locked, as they
+	 * only look at state that is set up before the array is published.
+	 */
+	sma = sem_obtain_object_check(ns, semid);
 	if (IS_ERR(sma)) {
-		if (un)
-			rcu_read_unlock();
+		rcu_read_unlock();
 		error = PTR_ERR(sma);
 		goto out_free;
 	}
 
-	/*
-	 * semid identifiers are not unique - find_alloc_undo may have
-	 * allocated an undo structure, it was invalidated by an RMID
-	 * and now a new array with received the same id. Check and fail.
-	 * This case can be detected checking un->semid. The existence of
-	 * "un" itself is guaranteed by rcu.
-	 */
-	error = -EIDRM;
-	if (un) {
-		if (un->semid == -1) {
-			rcu_read_unlock();
-			goto out_unlock_free;
-		} else {
-			/*
-			 * rcu lock can be released, "un" cannot disappear:
-			 * - sem_lock is acquired, thus IPC_RMID is
-			 *   impossible.
-			 * - exit_sem is impossible, it always operates on
-			 *   current (or a dead task).
-			 */
-
-			rcu_read_unlock();
-		}
-	}
-
 	error = -EFBIG;
 	if (max >= sma->sem_nsems)
-		goto out_unlock_free;
+		goto out_rcu_wakeup;
 
 	error = -EACCES;
 	if (ipcperms(ns, &sma->sem_perm, alter ? S_IWUGO : S_IRUGO))
-		goto out_unlock_free;
+		goto out_rcu_wakeup;
 
 	error = security_sem_semop(sma, sops, nsops, alter);
 	if (error)
+		goto out_rcu_wakeup;
+
+	locknum = semop_lock(sma, sops, nsops);
+
+	/*
+	 * The array may have been removed while it was not locked.
+	 * semid identifiers are not unique either - find_alloc_undo may have
+	 * allocated an undo structure, it was invalidated by an RMID
+	 * and now a new array with received the same id. Check and fail.
+	 * This case can be detected checking un->semid. The existence of
+	 * "un" itself is guaranteed by rcu, which is held until the array
+	 * is unlocked.
+	 */
+	error = -EIDRM;
+	if (sma->sem_perm.deleted || (un && un->semid == -1))
 		goto out_unlock_free;
 
 	error = try_atomic_semop (sma, sops, nsops, un, task_tgid_vnr(current));
@@ -1452,21 +1608,20 @@ SYSCALL_DEFINE4(semtimedop, int, semid, struct sembuf __user *, tsops,
 	queue.undo = un;
 	queue.pid = task_tgid_vnr(current);
 	queue.alter = alter;
-	if (alter)
-		list_add_tail(&queue.list, &sma->sem_pending);
-	else
-		list_add(&queue.list, &sma->sem_pending);
 
 	if (nsops == 1) {
 		struct sem *curr;
 		curr = &sma->sem_base[sops->sem_num];
 
 		if (alter)
-			list_add_tail(&queue.simple_list, &curr->sem_pending);
+			list_add_tail(&queue.list, &curr->sem_pending);
 		else
-			list_add(&queue.simple_list, &curr->sem_pending);
+			list_add(&queue.list, &curr->sem_pending);
 	} else {
-		INIT_LIST_HEAD(&queue.simple_list);
+		if (alter)
+			list_add_tail(&queue.list, &sma->sem_pending);
+		else
+			list_add(&queue.list, &sma->sem_pending);
 		sma->complex_count++;
 	}
 
@@ -1475,7 +1630,8 @@ SYSCALL_DEFINE4(semtimedop, int, semid, struct sembuf __user *, tsops,
 
 sleep_again:
 	current->state = TASK_INTERRUPTIBLE;
-	sem_unlock(sma);
+	semop_unlock(sma, locknum);
+	rcu_read_unlock();
 
 	if (timeout)
 		jiffies_left = schedule_timeout(jiffies_left);
@@ -1497,7 +1653,7 @@ sleep_again:
 		goto out_free;
 	}
 
-	sma = sem_lock(ns, semid);
+	sma = sem_obtain_lock(ns, semid, sops, nsops, &locknum);
 
 	/*
 	 * Wait until it's guaranteed that no wakeup_sem_queue_do() is ongoing.
@@ -1505,7 +1661,7 @@ sleep_again:
 	error = get_queue_result(&queue);
 
 	/*
-	 * Array removed? If yes, leave without sem_unlock().
+	 * Array removed? If yes, leave without semop_unlock().
 	 */
 	if (IS_ERR(sma)) {
 		goto out_free;
@@ -1514,7 +1670,7 @@ sleep_again:
 
 	/*
 	 * If queue.status != -EINTR we are woken up by another process.
-	 * Leave without unlink_queue(), but with sem_unlock().
+	 * Leave without unlink_queue(), but with semop_unlock().
 	 */
 
 	if (error != -EINTR) {
@@ -1536,8 +1692,9 @@ sleep_again:
 	unlink_queue(sma, &queue);
 
 out_unlock_free:
-	sem_unlock(sma);
-
+	semop_unlock(sma, locknum);
+out_rcu_wakeup:
+	rcu_read_unlock();
 	wake_up_sem_queue_do(&tasks);
 out_free:
 	if(sops != fast_sops)
@@ -261,6 +261,17 @@ int ipc_addid(struct ipc_ids* ids, struct kern_ipc_perm* new, int size)
 
 	spin_lock_init(&new->lock);
 	new->deleted = 0;
+
+	/*
+	 * Everything ipc_obtain_object_check() and ipcperms() look at must
+	 * be set up before the entry becomes visible in the idr: lockless
+	 * lookups do not wait for the lock taken below.
+	 */
+	current_euid_egid(&euid, &egid);
+	new->cuid = new->uid = euid;
+	new->gid = new->cgid = egid;
+	new->seq = ids->seq;
+
 	rcu_read_lock();
 	spin_lock(&new->lock);
 
@@ -273,12 +284,7 @@ int ipc_addid(struct ipc_ids* ids, struct kern_ipc_perm* new, int size)
 
 	ids->in_use++;
 
-	current_euid_egid(&euid, &egid);
-	new->cuid = new->uid = euid;
-	new->gid = new->cgid = egid;
-
-	new->seq = ids->seq++;
-	if(ids->seq > ids->seq_max)
+	if (++ids->seq > ids->seq_max)
 		ids->seq = 0;
 
 	new->id = ipc_buildid(id, new->seq);
@@ -671,6 +677,49 @@ void ipc64_perm_to_ipc_perm (struct ipc64_perm *in, struct ipc_perm *out)
 	out->seq	= in->seq;
 }
 
+/**
+ * ipc_obtain_object - Look up an ipc structure without locking it
+ * @ids: IPC identifier set
+ * @id: ipc id to look for
+ *
+ * Look for an id in the ipc ids idr and return the associated ipc object.
+ * Neither the rw_mutex nor the object's spinlock are taken: the caller
+ * must hold rcu_read_lock() for as long as it uses the object, and must
+ * check ->deleted once it has locked the object by whatever means.
+ */
+struct kern_ipc_perm *ipc_obtain_object(struct ipc_ids *ids, int id)
+{
+	struct kern_ipc_perm *out;
+	int lid = ipcid_to_idx(id);
+
+	out = idr_find(&ids->ipcs_idr, lid);
+	if (out == NULL)
+		return ERR_PTR(-EINVAL);
+
+	return out;
+}
+
+/**
+ * ipc_obtain_object_check - Look up an ipc structure and check its id
+ * @ids: IPC identifier set
+ * @id: ipc id to look for
+ *
+ * Like ipc_obtain_object(), but also fails with -EIDRM if the slot
+ * has been reused for a different object in the meantime.
+ */
+struct kern_ipc_perm *ipc_obtain_object_check(struct ipc_ids *ids, int id)
+{
+	struct kern_ipc_perm *out = ipc_obtain_object(ids, id);
+
+	if (IS_ERR(out))
+		return out;
+
+	if (ipc_checkid(out, id))
+		return ERR_PTR(-EIDRM);
+
+	return out;
+}
+
 /**
  * ipc_lock - Lock an ipc structure without rw_mutex held
  * @ids: IPC identifier set
@@ -684,13 +733,12 @@ void ipc64_perm_to_ipc_perm (struct ipc64_perm *in, struct ipc_perm *out)
 struct kern_ipc_perm *ipc_lock(struct ipc_ids *ids, int id)
 {
 	struct kern_ipc_perm *out;
-	int lid = ipcid_to_idx(id);
 
 	rcu_read_lock();
-	out = idr_find(&ids->ipcs_idr, lid);
-	if (out == NULL) {
+	out = ipc_obtain_object(ids, id);
+	if (IS_ERR(out)) {
 		rcu_read_unlock();
-		return ERR_PTR(-EINVAL);
+		return out;
 	}
 
 	spin_lock(&out->lock);
@@ -36,6 +36,7 @@
 #include <linux/perf_event.h>
 #include <linux/ftrace_event.h>
 #include <linux/hw_breakpoint.h>
+#include <linux/tick.h>
 
 #include "internal.h"
 
@@ -652,8 +653,12 @@ static void perf_pmu_rotate_start(struct pmu *pmu)
 
 	WARN_ON(!irqs_disabled());
 
-	if (list_empty(&cpuctx->rotation_list))
+	if (list_empty(&cpuctx->rotation_list)) {
+		/* Rotation is driven by the tick, make sure it runs */
+		if (list_empty(head))
+			tick_nohz_full_kick();
 		list_add(&cpuctx->rotation_list, head);
+	}
 }
 
 static void get_ctx(struct perf_event_context *ctx)
@@ -2569,6 +2574,20 @@ void perf_event_task_tick(void)
 	}
 }
 
+#ifdef CONFIG_NO_HZ_FULL
+/*
+ * Frequency adjustment, unthrottling and rotation are done from
+ * perf_event_task_tick(), so a CPU with active contexts needs the tick.
+ */
+bool perf_event_can_stop_tick(void)
+{
+	if (__this_cpu_read(perf_throttled_count))
+		return false;
+
+	return list_empty(&__get_cpu_var(rotation_list));
+}
+#endif
+
 static int event_enable_on_exec(struct perf_event *event,
 				struct perf_event_context *ctx)
 {
@@ -60,6 +60,7 @@
 #include <linux/pid.h>
 #include <linux/nsproxy.h>
 #include <linux/ptrace.h>
+#include <linux/bootmem.h>
 
 #include <asm/futex.h>
 
@@ -67,8 +68,6 @@
 
 int __read_mostly futex_cmpxchg_enabled;
 
-#define FUTEX_HASHBITS (CONFIG_BASE_SMALL ? 4 : 8)
-
 /*
  * Futex flags used to encode options to functions and preserve them across
  * restarts.
@@ -142,13 +141,47 @@ static const struct futex_q futex_q_init = {
  * Hash buckets are shared by all the futex_keys that hash to the same
  * location.  Each key may have multiple futex_q structures, one for each task
  * waiting on a futex.
+ *
+ * ->waiters counts the tasks queued on, or about to queue on, the bucket,
+ * so that futex_wake() can skip the lock when there is nobody to wake:
+ *
+ * CPU 0 (waiter)			CPU 1 (waker)
+ *
+ * waiters++ (queue_lock)		*futex = newval
+ * smp_mb()				smp_mb() (hb_waiters_pending)
+ * lock hb; uval = *futex		if (!waiters) return
+ * if (uval == val) queue; sleep	lock hb; wake
+ *
+ * Either the waiter sees the new value and does not sleep, or the waker
+ * sees the waiter and takes the lock.
  */
 struct futex_hash_bucket {
+	atomic_t waiters;
 	spinlock_t lock;
 	struct plist_head chain;
-};
+} ____cacheline_aligned_in_smp;
+
+static unsigned long __read_mostly futex_hashsize;
+static struct futex_hash_bucket *futex_queues;
 
-static struct futex_hash_bucket futex_queues[1<<FUTEX_HASHBITS];
+static inline void hb_waiters_inc(struct futex_hash_bucket *hb)
+{
+	atomic_inc(&hb->waiters);
+	/* Order the increment against the read of the futex value */
+	smp_mb__after_atomic_inc();
+}
+
+static inline void hb_waiters_dec(struct futex_hash_bucket *hb)
+{
+	atomic_dec(&hb->waiters);
+}
+
+static inline int hb_waiters_pending(struct futex_hash_bucket *hb)
+{
+	/* Order the caller's futex value store against the read of waiters */
+	smp_mb();
+	return atomic_read(&hb->waiters);
+}
 
 /*
  * We hash on the keys returned from get_futex_key (see below).
@@ -158,7 +191,7 @@ static struct futex_hash_bucket *hash_futex(union futex_key *key)
 	u32 hash = jhash2((u32*)&key->both.word,
 			  (sizeof(key->both.word)+sizeof(key->both.ptr))/4,
 			  key->both.offset);
-	return &futex_queues[hash & ((1 << FUTEX_HASHBITS)-1)];
+	return &futex_queues[hash & (futex_hashsize - 1)];
 }
 
 /*
@@ -830,6 +863,7 @@ static void __unqueue_futex(struct futex_q *q)
 
 	hb = container_of(q->lock_ptr, struct futex_hash_bucket, lock);
 	plist_del(&q->list, &hb->chain);
+	hb_waiters_dec(hb);
 }
 
 /*
@@ -987,6 +1021,11 @@ futex_wake(u32 __user *uaddr, unsigned int flags, int nr_wake, u32 bitset)
 		goto out;
 
 	hb = hash_futex(&key);
+
+	/* Make sure we really have tasks to wake up */
+	if (!hb_waiters_pending(hb))
+		goto out_put_key;
+
 	spin_lock(&hb->lock);
 	head = &hb->chain;
 
@@ -1008,6 +1047,7 @@ futex_wake(u32 __user *uaddr, unsigned int flags, int nr_wake, u32 bitset)
 	}
 
 	spin_unlock(&hb->lock);
+out_put_key:
 	put_futex_key(&key);
 out:
 	return ret;
@@ -1122,7 +1162,9 @@ void requeue_futex(struct futex_q *q, struct futex_hash_bucket *hb1,
 	 */
 	if (likely(&hb1->chain != &hb2->chain)) {
 		plist_del(&q->list, &hb1->chain);
+		hb_waiters_dec(hb1);
 		plist_add(&q->list, &hb2->chain);
+		hb_waiters_inc(hb2);
 		q->lock_ptr = &hb2->lock;
 	}
 	get_futex_key_refs(key2);
@@ -1465,6 +1507,12 @@ static inline struct futex_hash_bucket *queue_lock(struct futex_q *q)
 	hb = hash_futex(&q->key);
 	q->lock_ptr = &hb->lock;
 
+	/*
+	 * Count ourselves before reading the futex value under the lock,
+	 * see struct futex_hash_bucket.
+	 */
+	hb_waiters_inc(hb);
+
 	spin_lock(&hb->lock);
 	return hb;
 }
@@ -1474,6 +1522,7 @@ queue_unlock(struct futex_q *q, struct futex_hash_bucket *hb)
 	__releases(&hb->lock)
 {
 	spin_unlock(&hb->lock);
+	hb_waiters_dec(hb);
 }
 
 /**
@@ -2208,6 +2257,7 @@ int handle_early_requeue_pi_wakeup(struct futex_hash_bucket *hb,
 		 * Unqueue the futex_q and determine which it was.
 		 */
 		plist_del(&q->list, &hb->chain);
+		hb_waiters_dec(hb);
 
 		/* Handle spurious wakeups gracefully */
 		ret = -EWOULDBLOCK;
@@ -2709,8 +2759,27 @@ SYSCALL_DEFINE6(futex, u32 __user *, uaddr, int, op, u32, val,
 
 static int __init futex_init(void)
 {
+	unsigned int futex_shift;
+	unsigned long i;
 	u32 curval;
-	int i;
+
+#if CONFIG_BASE_SMALL
+	futex_hashsize = 16;
+#else
+	/*
+	 * 256 buckets per possible CPU: the number of concurrently
+	 * blocked tasks, and with it the collisions on a fixed size
+	 * table, grows with the machine.
+	 */
+	futex_hashsize = roundup_pow_of_two(256 * num_possible_cpus());
+#endif
+
+	/* Spread over the nodes like the other large hashes (hashdist) */
+	futex_queues = alloc_large_system_hash("futex", sizeof(*futex_queues),
+					       futex_hashsize, 0, 0,
+					       &futex_shift, NULL,
+					       futex_hashsize, futex_hashsize);
+	futex_hashsize = 1UL << futex_shift;
 
 	/*
 	 * This will fail and we want it. Some arch implementations do
@@ -2725,7 +2794,8 @@ static int __init futex_init(void)
 	if (cmpxchg_futex_value_locked(&curval, NULL, 0, 0) == -EFAULT)
 		futex_cmpxchg_enabled = 1;
 
-	for (i = 0; i < ARRAY_SIZE(futex_queues); i++) {
+	for (i = 0; i < futex_hashsize; i++) {
+		atomic_set(&futex_queues[i].waiters, 0);
 		plist_head_init(&futex_queues[i].chain);
 		spin_lock_init(&futex_queues[i].lock);
 	}
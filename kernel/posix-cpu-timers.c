@@ -8,6 +8,7 @@
 #include <linux/math64.h>
 #include <asm/uaccess.h>
 #include <linux/kernel_stat.h>
+#include <linux/tick.h>
 #include <trace/events/timer.h>
 
 /*
@@ -769,6 +770,13 @@ static int posix_cpu_timer_set(struct k_itimer *timer, int flags,
 	spin_unlock(&p->sighand->siglock);
 	read_unlock(&tasklist_lock);
 
+	/*
+	 * The timer is checked from the tick of the CPU the task runs
+	 * on, which may be a full dynticks CPU with the tick stopped.
+	 */
+	if (new_expires.sched != 0)
+		tick_nohz_full_kick_all();
+
 	/*
 	 * Install the new reload setting, and
 	 * set up the signal and overrun bookkeeping.
@@ -1274,6 +1282,23 @@ static inline int fastpath_timer_check(struct task_struct *tsk)
 	return 0;
 }
 
+#ifdef CONFIG_NO_HZ_FULL
+/*
+ * The thread and thread group timers are only checked from the tick,
+ * a full dynticks CPU must keep it while the current task has some.
+ */
+bool posix_cpu_timers_can_stop_tick(struct task_struct *tsk)
+{
+	if (!task_cputime_zero(&tsk->cputime_expires))
+		return false;
+
+	if (tsk->signal->cputimer.running)
+		return false;
+
+	return true;
+}
+#endif
+
 /*
  * This is called from the timer interrupt handler.  The irq handler has
  * already updated our counts.  We need to check if any timers fire now.
@@ -1389,6 +1414,8 @@ void set_process_cpu_timer(struct task_struct *tsk, unsigned int clock_idx,
 			tsk->signal->cputime_expires.virt_exp = *newval;
 		break;
 	}
+
+	tick_nohz_full_kick_all();
 }
 
 static int do_cpu_nanosleep(const clockid_t which_clock, int flags,
@@ -25,6 +25,7 @@
  */
 
 #include <linux/delay.h>
+#include <linux/tick.h>
 
 #define RCU_KTHREAD_PRIO 1
 
@@ -34,6 +35,13 @@
 #define RCU_BOOST_PRIO RCU_KTHREAD_PRIO
 #endif
 
+#ifdef CONFIG_RCU_NOCB_CPU
+static cpumask_var_t rcu_nocb_mask; /* CPUs to have callbacks offloaded. */
+static bool have_rcu_nocb_mask;	    /* Was rcu_nocb_mask allocated? */
+static bool rcu_nocb_poll;	    /* Offload kthreads are to poll. */
+static char __initdata nocb_buf[NR_CPUS * 5];
+#endif /* #ifdef CONFIG_RCU_NOCB_CPU */
+
 /*
  * Check the RCU kernel configuration parameters and print informative
  * messages about anything out of the ordinary.  If you like #ifdef, you
@@ -74,12 +82,36 @@ static void __init rcu_bootup_announce_oddness(void)
 		printk(KERN_INFO "\tExperimental boot-time adjustment of leaf fanout to %d.\n", rcu_fanout_leaf);
 	if (nr_cpu_ids != NR_CPUS)
 		printk(KERN_INFO "\tRCU restricting CPUs from NR_CPUS=%d to nr_cpu_ids=%d.\n", NR_CPUS, nr_cpu_ids);
+#ifdef CONFIG_RCU_NOCB_CPU
+#ifdef CONFIG_NO_HZ_FULL
+	/* Full dynticks CPUs can't have callbacks of their own. */
+	if (tick_nohz_full_running) {
+		if (!have_rcu_nocb_mask) {
+			zalloc_cpumask_var(&rcu_nocb_mask, GFP_KERNEL);
+			have_rcu_nocb_mask = true;
+		}
+		cpumask_or(rcu_nocb_mask, rcu_nocb_mask, tick_nohz_full_mask);
+	}
+#endif /* #ifdef CONFIG_NO_HZ_FULL */
+	if (have_rcu_nocb_mask) {
+		cpumask_and(rcu_nocb_mask, rcu_nocb_mask, cpu_possible_mask);
+		if (cpumask_test_cpu(0, rcu_nocb_mask)) {
+			cpumask_clear_cpu(0, rcu_nocb_mask);
+			printk(KERN_INFO "\tCPU 0: illegal no-CBs CPU (cleared).\n");
+		}
+		cpulist_scnprintf(nocb_buf, sizeof(nocb_buf), rcu_nocb_mask);
+		printk(KERN_INFO "\tOffload RCU callbacks from CPUs: %s.\n",
+		       nocb_buf);
+		if (rcu_nocb_poll)
+			printk(KERN_INFO "\tPoll for callbacks from no-CBs CPUs.\n");
+	}
+#endif /* #ifdef CONFIG_RCU_NOCB_CPU */
 }
 
 #ifdef CONFIG_TREE_PREEMPT_RCU
 
 struct rcu_state rcu_preempt_state =
-	RCU_STATE_INITIALIZER(rcu_preempt, call_rcu);
+	RCU_STATE_INITIALIZER(rcu_preempt, 'p', call_rcu);
 DEFINE_PER_CPU(struct rcu_data, rcu_preempt_data);
 static struct rcu_state *rcu_state = &rcu_preempt_state;
 
@@ -634,7 +666,7 @@ static void rcu_preempt_do_callbacks(void)
  */
 void call_rcu(struct rcu_head *head, void (*func)(struct rcu_head *rcu))
 {
-	__call_rcu(head, func, &rcu_preempt_state, 0);
+	__call_rcu(head, func, &rcu_preempt_state, 0, 1);
 }
 EXPORT_SYMBOL_GPL(call_rcu);
 
@@ -648,7 +680,7 @@ EXPORT_SYMBOL_GPL(call_rcu);
 void kfree_call_rcu(struct rcu_head *head,
 		    void (*func)(struct rcu_head *rcu))
 {
-	__call_rcu(head, func, &rcu_preempt_state, 1);
+	__call_rcu(head, func, &rcu_preempt_state, 1, 1);
 }
 EXPORT_SYMBOL_GPL(kfree_call_rcu);
 
@@ -991,7 +1023,7 @@ static void rcu_preempt_check_callbacks(int cpu)
 void kfree_call_rcu(struct rcu_head *head,
 		    void (*func)(struct rcu_head *rcu))
 {
-	__call_rcu(head, func, &rcu_sched_state, 1);
+	__call_rcu(head, func, &rcu_sched_state, 1, 1);
 }
 EXPORT_SYMBOL_GPL(kfree_call_rcu);
 
@@ -2227,3 +2259,292 @@ static void increment_cpu_stall_ticks(void)
 }
 
 #endif /* #else #ifdef CONFIG_RCU_CPU_STALL_INFO */
+
+#ifdef CONFIG_RCU_NOCB_CPU
+
+/*
+ * Offload callback processing from the boot-time-specified set of CPUs
+ * specified by rcu_nocb_mask.  For each CPU in the set, there is a
+ * kthread per RCU flavor that pulls the callbacks from the corresponding
+ * CPU, waits for a grace period to elapse, and invokes the callbacks.
+ * The no-CBs CPUs do a wake_up() on their kthread when they insert a
+ * callback into an empty list, unless the rcu_nocb_poll boot parameter
+ * has been specified, in which case each kthread actively polls its
+ * CPU.  (Which isn't so great for energy efficiency, but which does
+ * reduce RCU's overhead on that CPU.)
+ *
+ * The kthreads are not bound to any CPU, so they can be moved to
+ * housekeeping CPUs, which keeps callback invocation (and the cache
+ * misses and lock contention that come with it) off the no-CBs CPUs.
+ * Note that the no-CBs CPUs still need to report quiescent states,
+ * so they still take part in grace-period processing.
+ */
+
+/* Parse the boot-time rcu_nocbs= CPU list from the kernel parameters. */
+static int __init rcu_nocb_setup(char *str)
+{
+	alloc_bootmem_cpumask_var(&rcu_nocb_mask);
+	have_rcu_nocb_mask = true;
+	cpulist_parse(str, rcu_nocb_mask);
+	return 1;
+}
+__setup("rcu_nocbs=", rcu_nocb_setup);
+
+static int __init parse_rcu_nocb_poll(char *arg)
+{
+	rcu_nocb_poll = true;
+	return 1;
+}
+__setup("rcu_nocb_poll", parse_rcu_nocb_poll);
+
+/* Is the specified CPU a no-CBs CPU? */
+static bool is_nocb_cpu(int cpu)
+{
+	if (have_rcu_nocb_mask)
+		return cpumask_test_cpu(cpu, rcu_nocb_mask);
+	return false;
+}
+
+/*
+ * Enqueue the specified string of rcu_head structures onto the specified
+ * CPU's no-CBs list.  The CPU is specified by rdp, the head of the
+ * string by rhp, and the tail of the string by rhtp.  The non-lazy/lazy
+ * counts are supplied by rhcount and rhcount_lazy.
+ *
+ * This may be called from any CPU, and the list is lockless: the xchg()
+ * of the tail pointer serializes concurrent enqueuers, and the kthread
+ * copes with an enqueuer that has not yet linked in its callbacks.
+ *
+ * If the list was empty, also wake up the kthread servicing it.
+ */
+static void __call_rcu_nocb_enqueue(struct rcu_data *rdp,
+				    struct rcu_head *rhp,
+				    struct rcu_head **rhtp,
+				    long rhcount, long rhcount_lazy)
+{
+	struct rcu_head **old_rhpp;
+	struct task_struct *t;
+
+	/* Enqueue the callback on the nocb list and update counts. */
+	old_rhpp = xchg(&rdp->nocb_tail, rhtp);
+	ACCESS_ONCE(*old_rhpp) = rhp;
+	atomic_long_add(rhcount, &rdp->nocb_q_count);
+	atomic_long_add(rhcount_lazy, &rdp->nocb_q_count_lazy);
+
+	/* If we are not being polled and there is a kthread, awaken it. */
+	t = ACCESS_ONCE(rdp->nocb_kthread);
+	if (rcu_nocb_poll || !t)
+		return;
+	if (old_rhpp == &rdp->nocb_head) {
+		trace_rcu_nocb_wake(rdp->rsp->name, rdp->cpu, "WakeEmpty",
+				    atomic_long_read(&rdp->nocb_q_count));
+		wake_up(&rdp->nocb_wq);
+	}
+}
+
+/*
+ * This is a helper for __call_rcu(), which invokes this when the normal
+ * callback queue is to be bypassed because this CPU is a no-CBs CPU.
+ * Returns false if the callback should go on the normal queue after all.
+ */
+static bool __call_rcu_nocb(struct rcu_data *rdp, struct rcu_head *rhp,
+			    bool lazy)
+{
+	if (!is_nocb_cpu(rdp->cpu))
+		return false;
+
+	/* The callback may be invoked as soon as it is queued, trace first. */
+	if (__is_kfree_rcu_offset((unsigned long)rhp->func))
+		trace_rcu_kfree_callback(rdp->rsp->name, rhp,
+					 (unsigned long)rhp->func,
+					 atomic_long_read(&rdp->nocb_q_count_lazy),
+					 atomic_long_read(&rdp->nocb_q_count));
+	else
+		trace_rcu_callback(rdp->rsp->name, rhp,
+				   atomic_long_read(&rdp->nocb_q_count_lazy),
+				   atomic_long_read(&rdp->nocb_q_count));
+	__call_rcu_nocb_enqueue(rdp, rhp, &rhp->next, 1, lazy);
+	return true;
+}
+
+static void rcu_nocb_barrier_callback(struct rcu_head *rhp)
+{
+	struct rcu_data *rdp = container_of(rhp, struct rcu_data,
+					    nocb_barrier_head);
+
+	rcu_barrier_cpu_done(rdp->rsp);
+}
+
+/*
+ * Queue the _rcu_barrier() callback behind everything already queued
+ * for the specified no-CBs CPU's kthread.  Unlike for normal CPUs, no
+ * IPI is needed, as the no-CBs list may be appended to from any CPU,
+ * and this works whether or not the no-CBs CPU is online.  The CPU's
+ * normal list, which can hold adopted orphans, is handled separately.
+ */
+static void rcu_nocb_barrier(struct rcu_state *rsp, struct rcu_data *rdp)
+{
+	struct rcu_head *rhp = &rdp->nocb_barrier_head;
+
+	debug_rcu_head_queue(rhp);
+	rhp->func = rcu_nocb_barrier_callback;
+	rhp->next = NULL;
+	__call_rcu_nocb_enqueue(rdp, rhp, &rhp->next, 1, 0);
+}
+
+struct rcu_nocb_gp {
+	struct rcu_head head;
+	struct completion completion;
+};
+
+static void rcu_nocb_gp_done(struct rcu_head *rhp)
+{
+	struct rcu_nocb_gp *rng = container_of(rhp, struct rcu_nocb_gp, head);
+
+	complete(&rng->completion);
+}
+
+/*
+ * Wait for a grace period of the specified flavor.  The callback is
+ * queued on the normal list of whatever CPU we are running on, even if
+ * that is itself a no-CBs CPU, so that a no-CBs kthread never waits on
+ * another no-CBs kthread.
+ */
+static void rcu_nocb_wait_gp(struct rcu_state *rsp)
+{
+	struct rcu_nocb_gp rng;
+
+	init_rcu_head_on_stack(&rng.head);
+	init_completion(&rng.completion);
+	__call_rcu(&rng.head, rcu_nocb_gp_done, rsp, 0, 0);
+	wait_for_completion(&rng.completion);
+	destroy_rcu_head_on_stack(&rng.head);
+}
+
+/*
+ * Per-rcu_data kthread, but only for no-CBs CPUs.  Each kthread invokes
+ * callbacks queued by the corresponding no-CBs CPU.
+ */
+static int rcu_nocb_kthread(void *arg)
+{
+	long c, cl;
+	struct rcu_head *list;
+	struct rcu_head *next;
+	struct rcu_head **tail;
+	struct rcu_data *rdp = arg;
+
+	/* Each pass through this loop invokes one batch of callbacks */
+	for (;;) {
+		/* If not polling, wait for next batch of callbacks. */
+		if (!rcu_nocb_poll) {
+			trace_rcu_nocb_wake(rdp->rsp->name, rdp->cpu, "Sleep",
+					    0);
+			wait_event_interruptible(rdp->nocb_wq,
+						 ACCESS_ONCE(rdp->nocb_head));
+		}
+		list = ACCESS_ONCE(rdp->nocb_head);
+		if (!list) {
+			if (rcu_nocb_poll)
+				trace_rcu_nocb_wake(rdp->rsp->name, rdp->cpu,
+						    "Poll", 0);
+			schedule_timeout_interruptible(1);
+			flush_signals(current);
+			continue;
+		}
+
+		/*
+		 * Extract queued callbacks, update counts, and wait
+		 * for a grace period to elapse.
+		 */
+		ACCESS_ONCE(rdp->nocb_head) = NULL;
+		tail = xchg(&rdp->nocb_tail, &rdp->nocb_head);
+		c = atomic_long_xchg(&rdp->nocb_q_count, 0);
+		cl = atomic_long_xchg(&rdp->nocb_q_count_lazy, 0);
+		ACCESS_ONCE(rdp->nocb_p_count) += c;
+		ACCESS_ONCE(rdp->nocb_p_count_lazy) += cl;
+		rdp->n_nocbs_wakeups++;
+		trace_rcu_nocb_wake(rdp->rsp->name, rdp->cpu, "WokeQueue", c);
+		rcu_nocb_wait_gp(rdp->rsp);
+
+		/* Each pass through the following loop invokes a callback. */
+		trace_rcu_batch_start(rdp->rsp->name, cl, c, -1);
+		c = cl = 0;
+		while (list) {
+			next = list->next;
+			/* Wait for enqueuing to complete, if needed. */
+			while (next == NULL && &list->next != tail) {
+				schedule_timeout_interruptible(1);
+				next = ACCESS_ONCE(list->next);
+			}
+			debug_rcu_head_unqueue(list);
+			local_bh_disable();
+			if (__rcu_reclaim(rdp->rsp->name, list))
+				cl++;
+			c++;
+			local_bh_enable();
+			list = next;
+		}
+		trace_rcu_batch_end(rdp->rsp->name, c, !!list, 0, 0, 1);
+		ACCESS_ONCE(rdp->nocb_p_count) -= c;
+		ACCESS_ONCE(rdp->nocb_p_count_lazy) -= cl;
+		rdp->n_nocbs_invoked += c;
+	}
+	return 0;
+}
+
+/* Initialize per-rcu_data variables for no-CBs CPUs. */
+static void __init rcu_boot_init_nocb_percpu_data(struct rcu_data *rdp)
+{
+	rdp->nocb_tail = &rdp->nocb_head;
+	init_waitqueue_head(&rdp->nocb_wq);
+}
+
+/*
+ * Create a kthread for each RCU flavor for each no-CBs CPU.  Callbacks
+ * queued before this point simply wait on the list for their kthread.
+ */
+static int __init rcu_spawn_nocb_kthreads(void)
+{
+	int cpu;
+	struct rcu_data *rdp;
+	struct rcu_state *rsp;
+	struct task_struct *t;
+
+	if (!have_rcu_nocb_mask)
+		return 0;
+	for_each_rcu_flavor(rsp) {
+		for_each_cpu(cpu, rcu_nocb_mask) {
+			rdp = per_cpu_ptr(rsp->rda, cpu);
+			t = kthread_run(rcu_nocb_kthread, rdp,
+					"rcuo%c/%d", rsp->abbr, cpu);
+			BUG_ON(IS_ERR(t));
+			ACCESS_ONCE(rdp->nocb_kthread) = t;
+		}
+	}
+	return 0;
+}
+early_initcall(rcu_spawn_nocb_kthreads);
+
+#else /* #ifdef CONFIG_RCU_NOCB_CPU */
+
+static bool is_nocb_cpu(int cpu)
+{
+	return false;
+}
+
+static bool __call_rcu_nocb(struct rcu_data *rdp, struct rcu_head *rhp,
+			    bool lazy)
+{
+	return false;
+}
+
+static void rcu_nocb_barrier(struct rcu_state *rsp, struct rcu_data *rdp)
+{
+	WARN_ON_ONCE(1);
+}
+
+static void __init rcu_boot_init_nocb_percpu_data(struct rcu_data *rdp)
+{
+}
+
+#endif /* #else #ifdef CONFIG_RCU_NOCB_CPU */
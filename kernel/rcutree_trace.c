@@ -116,8 +116,18 @@ static void print_one_rcu_data(struct seq_file *m, struct rcu_data *rdp)
 		   per_cpu(rcu_cpu_kthread_loops, rdp->cpu) & 0xffff);
 #endif /* #ifdef CONFIG_RCU_BOOST */
 	seq_printf(m, " b=%ld", rdp->blimit);
-	seq_printf(m, " ci=%lu co=%lu ca=%lu\n",
+	seq_printf(m, " ci=%lu co=%lu ca=%lu",
 		   rdp->n_cbs_invoked, rdp->n_cbs_orphaned, rdp->n_cbs_adopted);
+#ifdef CONFIG_RCU_NOCB_CPU
+	if (rdp->nocb_kthread)
+		seq_printf(m, " nq=%ld/%ld np=%ld/%ld ni=%lu nw=%lu",
+			   atomic_long_read(&rdp->nocb_q_count_lazy),
+			   atomic_long_read(&rdp->nocb_q_count),
+			   ACCESS_ONCE(rdp->nocb_p_count_lazy),
+			   ACCESS_ONCE(rdp->nocb_p_count),
+			   rdp->n_nocbs_invoked, rdp->n_nocbs_wakeups);
+#endif /* #ifdef CONFIG_RCU_NOCB_CPU */
+	seq_putc(m, '\n');
 }
 
 static int show_rcudata(struct seq_file *m, void *unused)
@@ -177,8 +187,17 @@ static void print_one_rcu_data_csv(struct seq_file *m, struct rcu_data *rdp)
 					  rdp->cpu)));
 #endif /* #ifdef CONFIG_RCU_BOOST */
 	seq_printf(m, ",%ld", rdp->blimit);
-	seq_printf(m, ",%lu,%lu,%lu\n",
+	seq_printf(m, ",%lu,%lu,%lu",
 		   rdp->n_cbs_invoked, rdp->n_cbs_orphaned, rdp->n_cbs_adopted);
+#ifdef CONFIG_RCU_NOCB_CPU
+	seq_printf(m, ",%ld,%ld,%ld,%ld,%lu,%lu",
+		   atomic_long_read(&rdp->nocb_q_count_lazy),
+		   atomic_long_read(&rdp->nocb_q_count),
+		   ACCESS_ONCE(rdp->nocb_p_count_lazy),
+		   ACCESS_ONCE(rdp->nocb_p_count),
+		   rdp->n_nocbs_invoked, rdp->n_nocbs_wakeups);
+#endif /* #ifdef CONFIG_RCU_NOCB_CPU */
+	seq_putc(m, '\n');
 }
 
 static int show_rcudata_csv(struct seq_file *m, void *unused)
@@ -192,7 +211,11 @@ static int show_rcudata_csv(struct seq_file *m, void *unused)
 #ifdef CONFIG_RCU_BOOST
 	seq_puts(m, "\"kt\",\"ktl\"");
 #endif /* #ifdef CONFIG_RCU_BOOST */
-	seq_puts(m, ",\"b\",\"ci\",\"co\",\"ca\"\n");
+	seq_puts(m, ",\"b\",\"ci\",\"co\",\"ca\"");
+#ifdef CONFIG_RCU_NOCB_CPU
+	seq_puts(m, ",\"nql\",\"nq\",\"npl\",\"np\",\"ni\",\"nw\"");
+#endif /* #ifdef CONFIG_RCU_NOCB_CPU */
+	seq_puts(m, "\n");
 	for_each_rcu_flavor(rsp) {
 		seq_printf(m, "\"%s:\"\n", rsp->name);
 		for_each_possible_cpu(cpu)
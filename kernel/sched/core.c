@@ -72,6 +72,7 @@
 #include <linux/slab.h>
 #include <linux/init_task.h>
 #include <linux/binfmts.h>
+#include <linux/context_tracking.h>
 
 #include <asm/switch_to.h>
 #include <asm/tlb.h>
@@ -558,7 +559,8 @@ int get_nohz_timer_target(void)
 	rcu_read_lock();
 	for_each_domain(cpu, sd) {
 		for_each_cpu(i, sched_domain_span(sd)) {
-			if (!idle_cpu(i)) {
+			/* Keep housekeeping timers off full dynticks CPUs */
+			if (!idle_cpu(i) && !tick_nohz_full_cpu(i)) {
 				cpu = i;
 				goto unlock;
 			}
@@ -608,12 +610,63 @@ void wake_up_idle_cpu(int cpu)
 		smp_send_reschedule(cpu);
 }
 
+/*
+ * Same as wake_up_idle_cpu(), but also handles a busy full dynticks
+ * CPU, whose tick may be stopped although it is not idle.
+ */
+void wake_up_nohz_cpu(int cpu)
+{
+	if (tick_nohz_full_cpu(cpu))
+		tick_nohz_full_kick_cpu(cpu);
+	else
+		wake_up_idle_cpu(cpu);
+}
+
 static inline bool got_nohz_idle_kick(void)
 {
 	int cpu = smp_processor_id();
 	return idle_cpu(cpu) && test_bit(NOHZ_BALANCE_KICK, nohz_flags(cpu));
 }
 
+#ifdef CONFIG_NO_HZ_FULL
+/*
+ * Called with interrupts disabled by the full dynticks code, on the
+ * CPU whose tick is being evaluated.
+ */
+bool sched_can_stop_tick(void)
+{
+	struct rq *rq = this_rq();
+
+	/* Make sure rq->nr_running update is visible after the IPI */
+	smp_rmb();
+
+	/* More than one running task needs preemption */
+	if (rq->nr_running > 1)
+		return false;
+
+	return true;
+}
+
+/*
+ * How much longer the tick of this nohz_full CPU may stay stopped.  The
+ * runqueue clock, the load averages and the running task's vruntime are
+ * only updated from scheduler_tick(), so keep it running at least once
+ * a second until that work can be done remotely.
+ */
+u64 scheduler_tick_max_deferment(void)
+{
+	struct rq *rq = this_rq();
+	unsigned long next, now = ACCESS_ONCE(jiffies);
+
+	next = rq->last_sched_tick + HZ;
+
+	if (time_before_eq(next, now))
+		return 0;
+
+	return (u64)jiffies_to_usecs(next - now) * NSEC_PER_USEC;
+}
+#endif /* CONFIG_NO_HZ_FULL */
+
 #else /* CONFIG_NO_HZ */
 
 static inline bool got_nohz_idle_kick(void)
@@ -1483,7 +1536,12 @@ static void sched_ttwu_pending(void)
 
 void scheduler_ipi(void)
 {
-	if (llist_empty(&this_rq()->wake_list) && !got_nohz_idle_kick())
+	/*
+	 * A full dynticks CPU may be kicked so that it reevaluates its
+	 * tick, which is done on irq_exit().
+	 */
+	if (llist_empty(&this_rq()->wake_list) && !got_nohz_idle_kick() &&
+	    !tick_nohz_full_cpu(smp_processor_id()))
 		return;
 
 	/*
@@ -1722,6 +1780,17 @@ static void __sched_fork(struct task_struct *p)
 #ifdef CONFIG_PREEMPT_NOTIFIERS
 	INIT_HLIST_HEAD(&p->preempt_notifiers);
 #endif
+
+#ifdef CONFIG_NUMA_BALANCING
+	p->node_stamp = 0ULL;
+	p->numa_scan_seq = p->mm ? p->mm->numa_scan_seq : 0;
+	p->numa_scan_period = sysctl_numa_balancing_scan_delay;
+	p->numa_work.func = NULL;
+	p->numa_faults = NULL;
+	p->numa_faults_buffer = NULL;
+	p->numa_preferred_nid = -1;
+	p->numa_pages_migrated = 0;
+#endif /* CONFIG_NUMA_BALANCING */
 }
 
 /*
@@ -2080,6 +2149,7 @@ context_switch(struct rq *rq, struct task_struct *prev,
 	spin_release(&rq->lock.dep_map, 1, _THIS_IP_);
 #endif
 
+	context_tracking_task_switch(prev, next);
 	/* Here we just switch the register state and the stack. */
 	switch_to(prev, next, prev);
 
@@ -2750,6 +2820,26 @@ unlock:
 	raw_spin_unlock_irqrestore(&p->pi_lock, flags);
 }
 
+#ifdef CONFIG_NUMA_BALANCING
+/*
+ * Move the current task to @target_cpu, used by NUMA balancing to bring
+ * a task to the node holding its memory.
+ */
+int migrate_task_to(struct task_struct *p, int target_cpu)
+{
+	struct migration_arg arg = { p, target_cpu };
+	int curr_cpu = task_cpu(p);
+
+	if (curr_cpu == target_cpu)
+		return 0;
+
+	if (!cpumask_test_cpu(target_cpu, tsk_cpus_allowed(p)))
+		return -EINVAL;
+
+	return stop_one_cpu(curr_cpu, migration_cpu_stop, &arg);
+}
+#endif
+
 #endif
 
 DEFINE_PER_CPU(struct kernel_stat, kstat);
@@ -3219,6 +3309,11 @@ void scheduler_tick(void)
 	curr->sched_class->task_tick(rq, curr, 0);
 	raw_spin_unlock(&rq->lock);
 
+	rq_last_tick_reset(rq);
+
+	/* task_work_add() takes ->pi_lock, which nests outside rq->lock */
+	task_tick_numa(rq, curr);
+
 	perf_event_task_tick();
 
 #ifdef CONFIG_SMP
@@ -3462,6 +3557,20 @@ asmlinkage void __sched schedule(void)
 }
 EXPORT_SYMBOL(schedule);
 
+#ifdef CONFIG_CONTEXT_TRACKING
+/*
+ * Called from the return to userspace paths, where the CPU may already
+ * be in user context: we may be here after a set_need_resched() from an
+ * exception, or after a remote wakeup whose IPI has not arrived yet.
+ */
+asmlinkage void __sched schedule_user(void)
+{
+	user_exit();
+	schedule();
+	user_enter();
+}
+#endif
+
 /**
  * schedule_preempt_disabled - called with preemption disabled
  *
@@ -26,6 +26,8 @@
 #include <linux/slab.h>
 #include <linux/profile.h>
 #include <linux/interrupt.h>
+#include <linux/mempolicy.h>
+#include <linux/task_work.h>
 
 #include <trace/events/sched.h>
 
@@ -772,6 +774,322 @@ update_stats_curr_start(struct cfs_rq *cfs_rq, struct sched_entity *se)
 	se->exec_start = rq_of(cfs_rq)->clock_task;
 }
 
+#ifdef CONFIG_NUMA_BALANCING
+/*
+ * Automatic NUMA balancing: every numa_scan_period ms of runtime a task
+ * turns the PTEs of the next numa_balancing_scan_size MB of its address
+ * space into NUMA hinting PTEs.  The resulting faults migrate private
+ * pages to the faulting node and tell which node holds most of the
+ * task's memory, which the task is then moved to.
+ */
+int sysctl_numa_balancing = 1;
+
+/* Minimum and maximum time between two scan windows of a task, in ms */
+unsigned int sysctl_numa_balancing_scan_period_min = 1000;
+unsigned int sysctl_numa_balancing_scan_period_max = 60000;
+
+/* Portion of address space to scan in MB */
+unsigned int sysctl_numa_balancing_scan_size = 256;
+
+/* Scan @scan_size MB every @scan_period after an initial @scan_delay in ms */
+unsigned int sysctl_numa_balancing_scan_delay = 1000;
+
+/*
+ * Move the current task to the least loaded CPU of its preferred node,
+ * unless that would leave the destination busier than the source is now:
+ * the load balancer would only move it back.
+ */
+static void task_numa_migrate(struct task_struct *p)
+{
+	int nid = p->numa_preferred_nid;
+	unsigned long src_load, dst_load, min_load = ULONG_MAX;
+	int cpu, dst_cpu = -1;
+
+	src_load = cpu_rq(task_cpu(p))->load.weight;
+
+	for_each_cpu_and(cpu, cpumask_of_node(nid), tsk_cpus_allowed(p)) {
+		if (!cpu_active(cpu))
+			continue;
+
+		dst_load = cpu_rq(cpu)->load.weight;
+		if (dst_load < min_load) {
+			min_load = dst_load;
+			dst_cpu = cpu;
+		}
+	}
+
+	if (dst_cpu >= 0 && min_load + p->se.load.weight <= src_load)
+		migrate_task_to(p, dst_cpu);
+}
+
+/*
+ * Once per pass over the address space, fold the faults of the pass into
+ * the decaying per node averages and pick the node with the most faults.
+ */
+static void task_numa_placement(struct task_struct *p)
+{
+	int seq, nid, max_nid = -1;
+	unsigned long max_faults = 0;
+
+	if (!p->mm)	/* for example, ksmd faulting in a user's mm */
+		return;
+
+	seq = ACCESS_ONCE(p->mm->numa_scan_seq);
+	if (p->numa_scan_seq == seq)
+		return;
+	p->numa_scan_seq = seq;
+
+	for_each_online_node(nid) {
+		unsigned long faults;
+
+		faults = p->numa_faults[nid] / 2 + p->numa_faults_buffer[nid];
+		p->numa_faults[nid] = faults;
+		p->numa_faults_buffer[nid] = 0;
+
+		if (faults > max_faults) {
+			max_faults = faults;
+			max_nid = nid;
+		}
+	}
+
+	if (max_nid == -1)
+		return;
+
+	p->numa_preferred_nid = max_nid;
+	if (cpu_to_node(task_cpu(p)) != max_nid)
+		task_numa_migrate(p);
+}
+
+/*
+ * Got a NUMA hinting fault for @pages pages now living on @node.
+ */
+void task_numa_fault(int node, int pages, bool migrated)
+{
+	struct task_struct *p = current;
+
+	if (!sysctl_numa_balancing)
+		return;
+
+	/* Allocate buffer to track faults on a per-node basis */
+	if (unlikely(!p->numa_faults)) {
+		int size = sizeof(*p->numa_faults) * 2 * nr_node_ids;
+
+		p->numa_faults = kzalloc(size, GFP_KERNEL|__GFP_NOWARN);
+		if (!p->numa_faults)
+			return;
+		p->numa_faults_buffer = p->numa_faults + nr_node_ids;
+	}
+
+	/*
+	 * Scan faster while pages are moving, and back off once the memory
+	 * has settled on the node the task runs on.
+	 */
+	if (migrated) {
+		p->numa_pages_migrated += pages;
+		p->numa_scan_period = max(sysctl_numa_balancing_scan_period_min,
+					  p->numa_scan_period / 2);
+	} else {
+		p->numa_scan_period = min(sysctl_numa_balancing_scan_period_max,
+					  p->numa_scan_period + jiffies_to_msecs(10));
+	}
+
+	task_numa_placement(p);
+
+	p->numa_faults_buffer[node] += pages;
+}
+
+void task_numa_free(struct task_struct *p)
+{
+	kfree(p->numa_faults);
+}
+
+static void reset_ptenuma_scan(struct task_struct *p)
+{
+	ACCESS_ONCE(p->mm->numa_scan_seq)++;
+	p->mm->numa_scan_offset = 0;
+}
+
+/*
+ * The expensive part of numa migration is done from task_work context.
+ * Triggered from task_tick_numa().
+ */
+static void task_numa_work(struct callback_head *work)
+{
+	unsigned long migrate, next_scan, now = jiffies;
+	struct task_struct *p = current;
+	struct mm_struct *mm = p->mm;
+	struct vm_area_struct *vma;
+	unsigned long start, end;
+	long pages;
+
+	WARN_ON_ONCE(p != container_of(work, struct task_struct, numa_work));
+
+	/* Allow task_tick_numa() to queue the work again */
+	work->func = NULL;
+
+	/*
+	 * Who cares about NUMA placement when they're dying.
+	 *
+	 * NOTE: make sure not to dereference p->mm before this check,
+	 * exit_task_work() happens _after_ exit_mm() so we could be called
+	 * without p->mm even though we still had it when we enqueued this
+	 * work.
+	 */
+	if (p->flags & PF_EXITING)
+		return;
+
+	/*
+	 * Enforce maximal scan/migration frequency..
+	 */
+	migrate = mm->numa_next_scan;
+	if (time_before(now, migrate))
+		return;
+
+	next_scan = now + msecs_to_jiffies(p->numa_scan_period);
+	/* Only one thread of the mm scans each window */
+	if (cmpxchg(&mm->numa_next_scan, migrate, next_scan) != migrate)
+		return;
+
+	pages = sysctl_numa_balancing_scan_size;
+	pages <<= 20 - PAGE_SHIFT; /* MB in pages */
+	if (!pages)
+		return;
+
+	down_read(&mm->mmap_sem);
+	start = mm->numa_scan_offset;
+	vma = find_vma(mm, start);
+	if (!vma) {
+		reset_ptenuma_scan(p);
+		start = 0;
+		vma = mm->mmap;
+	}
+	for (; vma; vma = vma->vm_next) {
+		if (!vma_migratable(vma))
+			continue;
+
+		/* Inaccessible mappings never fault, don't bother */
+		if (!(vma->vm_flags & (VM_READ | VM_WRITE | VM_EXEC)))
+			continue;
+
+		/*
+		 * Read-only file mappings, shared libraries mostly, are
+		 * used from all nodes alike: leave them where they are.
+		 */
+		if (vma->vm_file &&
+		    (vma->vm_flags & (VM_READ | VM_WRITE)) == VM_READ)
+			continue;
+
+		do {
+			start = max(start, vma->vm_start);
+			end = min(start + (pages << PAGE_SHIFT), vma->vm_end);
+			pages -= change_prot_numa(vma, start, end);
+
+			start = end;
+			if (pages <= 0)
+				goto out;
+		} while (end != vma->vm_end);
+	}
+
+out:
+	/*
+	 * It is possible to reach the end of the VMA list but the last few
+	 * VMAs are not guaranteed to the vma_migratable. If they are not, we
+	 * would find the !migratable VMA on the next scan but not reset the
+	 * scanner to the start so check it now.
+	 */
+	if (vma)
+		mm->numa_scan_offset = start;
+	else
+		reset_ptenuma_scan(p);
+	up_read(&mm->mmap_sem);
+}
+
+/*
+ * Drive the periodic memory faults..
+ */
+void task_tick_numa(struct rq *rq, struct task_struct *curr)
+{
+	struct callback_head *work = &curr->numa_work;
+	u64 period, now;
+
+	if (!sysctl_numa_balancing || curr->sched_class != &fair_sched_class)
+		return;
+
+	/*
+	 * We don't care about NUMA placement if we don't have memory, or
+	 * never return to userspace to run the work.  numa_work.func is
+	 * only set while the work is queued.
+	 */
+	if (!curr->mm || (curr->flags & (PF_EXITING | PF_KTHREAD)) ||
+	    work->func)
+		return;
+
+	/*
+	 * Using runtime rather than walltime has the dual advantage that
+	 * we (mostly) drive the selection from busy threads and that the
+	 * task needs to have done some actual work before we bother with
+	 * NUMA placement.
+	 */
+	now = curr->se.sum_exec_runtime;
+	period = (u64)curr->numa_scan_period * NSEC_PER_MSEC;
+
+	if (now - curr->node_stamp > period) {
+		if (!curr->node_stamp)
+			curr->numa_scan_period = sysctl_numa_balancing_scan_period_min;
+		curr->node_stamp = now;
+
+		if (!time_before(jiffies, curr->mm->numa_next_scan)) {
+			init_task_work(work, task_numa_work);
+			task_work_add(curr, work, true);
+		}
+	}
+}
+
+/*
+ * The load balancer prefers moving tasks toward the node holding most of
+ * their memory, see can_migrate_task().
+ */
+static bool migrate_improves_locality(struct task_struct *p, int src_cpu,
+				      int dst_cpu)
+{
+	int src_nid, dst_nid;
+
+	if (!sched_feat(NUMA_FAVOUR_HIGHER) || p->numa_preferred_nid == -1)
+		return false;
+
+	src_nid = cpu_to_node(src_cpu);
+	dst_nid = cpu_to_node(dst_cpu);
+
+	return src_nid != dst_nid && dst_nid == p->numa_preferred_nid;
+}
+
+static bool migrate_degrades_locality(struct task_struct *p, int src_cpu,
+				      int dst_cpu)
+{
+	int src_nid, dst_nid;
+
+	if (!sched_feat(NUMA_RESIST_LOWER) || p->numa_preferred_nid == -1)
+		return false;
+
+	src_nid = cpu_to_node(src_cpu);
+	dst_nid = cpu_to_node(dst_cpu);
+
+	return src_nid != dst_nid && src_nid == p->numa_preferred_nid;
+}
+#else
+static inline bool migrate_improves_locality(struct task_struct *p,
+					     int src_cpu, int dst_cpu)
+{
+	return false;
+}
+
+static inline bool migrate_degrades_locality(struct task_struct *p,
+					     int src_cpu, int dst_cpu)
+{
+	return false;
+}
+#endif /* CONFIG_NUMA_BALANCING */
+
 /**************************************************
  * Scheduling class queueing methods:
  */
@@ -3168,11 +3486,17 @@ int can_migrate_task(struct task_struct *p, struct lb_env *env)
 
 	/*
 	 * Aggressive migration if:
-	 * 1) task is cache cold, or
-	 * 2) too many balance attempts have failed.
+	 * 1) destination numa is preferred
+	 * 2) task is cache cold, or
+	 * 3) too many balance attempts have failed.
 	 */
+	if (migrate_improves_locality(p, env->src_cpu, env->dst_cpu))
+		return 1;
 
 	tsk_cache_hot = task_hot(p, env->src_rq->clock_task, env->sd);
+	if (!tsk_cache_hot)
+		tsk_cache_hot = migrate_degrades_locality(p, env->src_cpu,
+							  env->dst_cpu);
 	if (!tsk_cache_hot ||
 		env->sd->nr_balance_failed > env->sd->cache_nice_tries) {
 #ifdef CONFIG_SCHEDSTATS
@@ -69,3 +69,13 @@ SCHED_FEAT(TTWU_QUEUE, true)
 SCHED_FEAT(FORCE_SD_OVERLAP, false)
 SCHED_FEAT(RT_RUNTIME_SHARE, true)
 SCHED_FEAT(LB_MIN, false)
+
+#ifdef CONFIG_NUMA_BALANCING
+/*
+ * Let the load balancer move tasks to the node holding most of their
+ * memory even if they are cache hot (FAVOUR_HIGHER), and count moving
+ * them away from it as cache hot (RESIST_LOWER).
+ */
+SCHED_FEAT(NUMA_FAVOUR_HIGHER, true)
+SCHED_FEAT(NUMA_RESIST_LOWER, false)
+#endif
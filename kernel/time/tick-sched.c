@@ -20,6 +20,10 @@
 #include <linux/profile.h>
 #include <linux/sched.h>
 #include <linux/module.h>
+#include <linux/irq_work.h>
+#include <linux/posix-timers.h>
+#include <linux/perf_event.h>
+#include <linux/context_tracking.h>
 
 #include <asm/irq_regs.h>
 
@@ -98,6 +102,72 @@ static ktime_t tick_init_jiffy_update(void)
 	return period;
 }
 
+#ifdef CONFIG_NO_HZ_FULL
+/*
+ * Cputime accounting while the tick is stopped on a busy nohz_full CPU.
+ * Nothing samples the running task anymore, so the jiffies elapsed since
+ * ts->full_jiffies are charged on the user/kernel boundaries and context
+ * switches instead.  The granularity is the same as the tick's.
+ */
+static void __tick_nohz_full_account(struct tick_sched *ts,
+				     struct task_struct *p, bool user,
+				     unsigned long until)
+{
+	unsigned long ticks = until - ts->full_jiffies;
+	cputime_t cputime;
+
+	/* We might be one off, see tick_nohz_full_flush_ticks() */
+	if (!ticks || ticks >= LONG_MAX)
+		return;
+
+	cputime = jiffies_to_cputime(ticks);
+	if (user)
+		account_user_time(p, cputime, cputime_to_scaled(cputime));
+	else
+		account_system_time(p, hardirq_count(), cputime,
+				    cputime_to_scaled(cputime));
+}
+
+/**
+ * tick_nohz_full_account_ticks - charge the ticks missed by a task
+ * @p: the task that ran since the last boundary
+ * @user: whether @p ran in userspace
+ *
+ * Called with interrupts disabled.
+ */
+void tick_nohz_full_account_ticks(struct task_struct *p, bool user)
+{
+	struct tick_sched *ts = &__get_cpu_var(tick_cpu_sched);
+	unsigned long now;
+
+	if (!ts->tick_stopped || ts->inidle)
+		return;
+
+	now = jiffies;
+	__tick_nohz_full_account(ts, p, user, now);
+	ts->full_jiffies = now;
+}
+
+/*
+ * The stopped tick fired for a timer: update_process_times() accounts
+ * the current jiffy, catch up with the ones before it.
+ */
+static void tick_nohz_full_flush_ticks(struct tick_sched *ts, int user)
+{
+	unsigned long now;
+
+	if (ts->inidle)
+		return;
+
+	now = jiffies;
+	__tick_nohz_full_account(ts, current, user, now - 1);
+	ts->full_jiffies = now;
+}
+#else
+static inline void tick_nohz_full_flush_ticks(struct tick_sched *ts,
+					      int user) { }
+#endif
+
 /*
  * NOHZ - aka dynamic tick functionality
  */
@@ -334,6 +404,13 @@ static ktime_t tick_nohz_stop_sched_tick(struct tick_sched *ts,
 			time_delta = KTIME_MAX;
 		}
 
+#ifdef CONFIG_NO_HZ_FULL
+		/* A busy CPU still owes the scheduler its residual tick */
+		if (!ts->inidle)
+			time_delta = min(time_delta,
+					 scheduler_tick_max_deferment());
+#endif
+
 		/*
 		 * calculate the expiry time for the next timer wheel
 		 * timer. delta_jiffies >= NEXT_TIMER_MAX_DELTA signals
@@ -372,8 +449,10 @@ static ktime_t tick_nohz_stop_sched_tick(struct tick_sched *ts,
 		 * the scheduler tick in nohz_restart_sched_tick.
 		 */
 		if (!ts->tick_stopped) {
-			select_nohz_load_balancer(1);
-			calc_load_enter_idle();
+			if (ts->inidle) {
+				select_nohz_load_balancer(1);
+				calc_load_enter_idle();
+			}
 
 			ts->last_tick = hrtimer_get_expires(&ts->sched_timer);
 			ts->tick_stopped = 1;
@@ -433,6 +512,17 @@ static bool can_stop_idle_tick(int cpu, struct tick_sched *ts)
 	if (need_resched())
 		return false;
 
+	/*
+	 * nohz_full CPUs never take the do_timer() duty, so the
+	 * timekeeper has to keep its tick for them, and somebody
+	 * has to be around to pick the duty up when it was dropped.
+	 */
+	if (tick_nohz_full_enabled()) {
+		if (tick_do_timer_cpu == cpu ||
+		    tick_do_timer_cpu == TICK_DO_TIMER_NONE)
+			return false;
+	}
+
 	if (unlikely(local_softirq_pending() && cpu_online(cpu))) {
 		static int ratelimit;
 
@@ -505,11 +595,177 @@ void tick_nohz_idle_enter(void)
 	 * update of the idle time accounting in tick_nohz_start_idle().
 	 */
 	ts->inidle = 1;
+
+	/*
+	 * The tick may already be stopped if this is a nohz_full CPU
+	 * whose last task just went to sleep.  Hand it over to idle.
+	 */
+	if (tick_nohz_full_cpu(smp_processor_id()) && ts->tick_stopped) {
+		select_nohz_load_balancer(1);
+		calc_load_enter_idle();
+		ts->idle_jiffies = jiffies;
+	}
+
 	__tick_nohz_idle_enter(ts);
 
 	local_irq_enable();
 }
 
+static void tick_nohz_restart(struct tick_sched *ts, ktime_t now);
+
+#ifdef CONFIG_NO_HZ_FULL
+bool tick_nohz_full_running __read_mostly;
+cpumask_var_t tick_nohz_full_mask;
+
+/*
+ * The kick only has to raise an interrupt: the tick dependencies are
+ * re-evaluated from irq_exit() on nohz_full CPUs.
+ */
+static void nohz_full_kick_work_func(struct irq_work *work)
+{
+}
+
+static DEFINE_PER_CPU(struct irq_work, nohz_full_kick_work) = {
+	.func = nohz_full_kick_work_func,
+};
+
+/**
+ * tick_nohz_full_kick - re-evaluate the tick of the current CPU
+ *
+ * Called by the subsystems that need the tick, after they queued some
+ * work it has to handle.  Must be called with preemption disabled.
+ */
+void tick_nohz_full_kick(void)
+{
+	if (!tick_nohz_full_cpu(smp_processor_id()))
+		return;
+
+	if (__this_cpu_read(tick_cpu_sched.tick_stopped))
+		irq_work_queue(&__get_cpu_var(nohz_full_kick_work));
+}
+
+/**
+ * tick_nohz_full_kick_cpu - re-evaluate the tick of a given CPU
+ * @cpu: the CPU to kick
+ */
+void tick_nohz_full_kick_cpu(int cpu)
+{
+	if (!tick_nohz_full_cpu(cpu))
+		return;
+
+	if (cpu == smp_processor_id())
+		tick_nohz_full_kick();
+	else
+		smp_send_reschedule(cpu);
+}
+
+/**
+ * tick_nohz_full_kick_all - re-evaluate the tick of all nohz_full CPUs
+ *
+ * Used when a dependency that is not tied to a CPU, like a process wide
+ * posix cpu timer, is installed.
+ */
+void tick_nohz_full_kick_all(void)
+{
+	int cpu;
+
+	if (!tick_nohz_full_running)
+		return;
+
+	preempt_disable();
+	for_each_cpu_and(cpu, tick_nohz_full_mask, cpu_online_mask)
+		tick_nohz_full_kick_cpu(cpu);
+	preempt_enable();
+}
+
+static bool can_stop_full_tick(int cpu)
+{
+	WARN_ON_ONCE(!irqs_disabled());
+
+	if (cpu == tick_do_timer_cpu)
+		return false;
+
+	if (!sched_can_stop_tick())
+		return false;
+
+	if (!posix_cpu_timers_can_stop_tick(current))
+		return false;
+
+	if (!perf_event_can_stop_tick())
+		return false;
+
+#ifdef CONFIG_HAVE_UNSTABLE_SCHED_CLOCK
+	/* sched_clock() is kept coherent by the tick on these machines */
+	if (!sched_clock_stable)
+		return false;
+#endif
+
+	return true;
+}
+
+static void tick_nohz_full_stop_tick(struct tick_sched *ts)
+{
+	int cpu = smp_processor_id();
+	ktime_t now;
+
+	if (!tick_nohz_full_cpu(cpu) || is_idle_task(current))
+		return;
+
+	if (ts->nohz_mode == NOHZ_MODE_INACTIVE)
+		return;
+
+	now = ktime_get();
+
+	if (can_stop_full_tick(cpu)) {
+		int was_stopped = ts->tick_stopped;
+
+		tick_nohz_stop_sched_tick(ts, now, cpu);
+		if (!was_stopped && ts->tick_stopped)
+			ts->full_jiffies = ts->last_jiffies;
+	} else if (ts->tick_stopped) {
+		tick_do_update_jiffies64(now);
+		tick_nohz_full_account_ticks(current,
+					     context_tracking_in_user());
+		ts->tick_stopped = 0;
+		tick_nohz_restart(ts, now);
+	}
+}
+
+static int __init tick_nohz_full_setup(char *str)
+{
+	static char buf[128] __initdata;
+	int cpu;
+
+	alloc_bootmem_cpumask_var(&tick_nohz_full_mask);
+	if (cpulist_parse(str, tick_nohz_full_mask) < 0) {
+		pr_warning("NOHZ: Incorrect nohz_full cpumask\n");
+		return 1;
+	}
+
+	/* The boot CPU keeps the timekeeping duty */
+	cpu = smp_processor_id();
+	if (cpumask_test_cpu(cpu, tick_nohz_full_mask)) {
+		pr_warning("NOHZ: Clearing %d from nohz_full range for timekeeping\n",
+			   cpu);
+		cpumask_clear_cpu(cpu, tick_nohz_full_mask);
+	}
+	cpumask_and(tick_nohz_full_mask, tick_nohz_full_mask, cpu_possible_mask);
+	if (cpumask_empty(tick_nohz_full_mask))
+		return 1;
+
+	for_each_cpu(cpu, tick_nohz_full_mask)
+		context_tracking_cpu_set(cpu);
+	tick_nohz_full_running = true;
+
+	cpulist_scnprintf(buf, sizeof(buf), tick_nohz_full_mask);
+	pr_info("NOHZ: Full dynticks CPUs: %s.\n", buf);
+	return 1;
+}
+__setup("nohz_full=", tick_nohz_full_setup);
+#else
+static inline void tick_nohz_full_stop_tick(struct tick_sched *ts) { }
+#endif /* CONFIG_NO_HZ_FULL */
+
 /**
  * tick_nohz_irq_exit - update next tick event from interrupt exit
  *
@@ -517,15 +773,18 @@ void tick_nohz_idle_enter(void)
  * a reschedule, it may still add, modify or delete a timer, enqueue
  * an RCU callback, etc...
  * So we need to re-calculate and reprogram the next tick event.
+ *
+ * On nohz_full CPUs this is also where the tick gets stopped or
+ * restarted while a task is running.
  */
 void tick_nohz_irq_exit(void)
 {
 	struct tick_sched *ts = &__get_cpu_var(tick_cpu_sched);
 
-	if (!ts->inidle)
-		return;
-
-	__tick_nohz_idle_enter(ts);
+	if (ts->inidle)
+		__tick_nohz_idle_enter(ts);
+	else
+		tick_nohz_full_stop_tick(ts);
 }
 
 /**
@@ -659,7 +918,8 @@ static void tick_nohz_handler(struct clock_event_device *dev)
 	 * this duty, then the jiffies update is still serialized by
 	 * xtime_lock.
 	 */
-	if (unlikely(tick_do_timer_cpu == TICK_DO_TIMER_NONE))
+	if (unlikely(tick_do_timer_cpu == TICK_DO_TIMER_NONE) &&
+	    !tick_nohz_full_cpu(cpu))
 		tick_do_timer_cpu = cpu;
 
 	/* Check, if the jiffies need an update */
@@ -677,6 +937,7 @@ static void tick_nohz_handler(struct clock_event_device *dev)
 	if (ts->tick_stopped) {
 		touch_softlockup_watchdog();
 		ts->idle_jiffies++;
+		tick_nohz_full_flush_ticks(ts, user_mode(regs));
 	}
 
 	update_process_times(user_mode(regs));
@@ -811,7 +1072,8 @@ static enum hrtimer_restart tick_sched_timer(struct hrtimer *timer)
 	 * this duty, then the jiffies update is still serialized by
 	 * xtime_lock.
 	 */
-	if (unlikely(tick_do_timer_cpu == TICK_DO_TIMER_NONE))
+	if (unlikely(tick_do_timer_cpu == TICK_DO_TIMER_NONE) &&
+	    !tick_nohz_full_cpu(cpu))
 		tick_do_timer_cpu = cpu;
 #endif
 
@@ -836,6 +1098,8 @@ static enum hrtimer_restart tick_sched_timer(struct hrtimer *timer)
 			touch_softlockup_watchdog();
 			if (idle_cpu(cpu))
 				ts->idle_jiffies++;
+			else
+				tick_nohz_full_flush_ticks(ts, user_mode(regs));
 		}
 		update_process_times(user_mode(regs));
 		profile_tick(CPU_PROFILING);
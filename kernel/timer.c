@@ -784,6 +784,14 @@ __mod_timer(struct timer_list *timer, unsigned long expires,
 	timer->expires = expires;
 	internal_add_timer(base, timer);
 
+	/*
+	 * The tick of a full dynticks CPU may be programmed past the new
+	 * expiry, let it reevaluate the timer wheel.
+	 */
+	if (base == __this_cpu_read(tvec_bases) &&
+	    !tbase_get_deferrable(timer->base))
+		tick_nohz_full_kick();
+
 out_unlock:
 	spin_unlock_irqrestore(&base->lock, flags);
 
@@ -949,14 +957,14 @@ void add_timer_on(struct timer_list *timer, int cpu)
 	debug_activate(timer, timer->expires);
 	internal_add_timer(base, timer);
 	/*
-	 * Check whether the other CPU is idle and needs to be
-	 * triggered to reevaluate the timer wheel when nohz is
-	 * active. We are protected against the other CPU fiddling
-	 * with the timer by holding the timer base lock. This also
-	 * makes sure that a CPU on the way to idle can not evaluate
-	 * the timer wheel.
+	 * Check whether the other CPU is in dynticks mode and needs
+	 * to be triggered to reevaluate the timer wheel. We are
+	 * protected against the other CPU fiddling with the timer by
+	 * holding the timer base lock. This also makes sure that a
+	 * CPU on the way to stop its tick can not evaluate the timer
+	 * wheel.
 	 */
-	wake_up_idle_cpu(cpu);
+	wake_up_nohz_cpu(cpu);
 	spin_unlock_irqrestore(&base->lock, flags);
 }
 EXPORT_SYMBOL_GPL(add_timer_on);
@@ -0,0 +1,109 @@
+/*
+ * Percpu reference counts, see include/linux/percpu-refcount.h.
+ */
+
+#include <linux/kernel.h>
+#include <linux/module.h>
+#include <linux/percpu-refcount.h>
+
+/*
+ * While the ref is live the atomic count only holds the initial
+ * reference plus this bias, so that puts which already see the ref as
+ * dead cannot take it to zero before the percpu counters are folded
+ * in.  The percpu counters are unsigned and may wrap individually; only
+ * their sum modulo 2^32 is meaningful.
+ */
+#define PCPU_COUNT_BIAS		(1U << 31)
+
+/**
+ * percpu_ref_init - initialize a percpu refcount
+ * @ref: percpu_ref to initialize
+ * @release: function which will be called when refcount hits 0
+ *
+ * Initializes the refcount in percpu mode, holding a single reference
+ * which is dropped by percpu_ref_kill().
+ *
+ * Returns 0 on success or -ENOMEM if the percpu counters could not be
+ * allocated.
+ */
+int percpu_ref_init(struct percpu_ref *ref, percpu_ref_func_t *release)
+{
+	unsigned __percpu *pcpu_count;
+
+	atomic_set(&ref->count, 1 + PCPU_COUNT_BIAS);
+
+	pcpu_count = alloc_percpu(unsigned);
+	if (!pcpu_count)
+		return -ENOMEM;
+
+	ref->pcpu_count_ptr = (unsigned long)pcpu_count;
+	ref->release = release;
+	return 0;
+}
+EXPORT_SYMBOL_GPL(percpu_ref_init);
+
+/**
+ * percpu_ref_cancel_init - undo percpu_ref_init()
+ * @ref: percpu_ref to cancel init for
+ *
+ * For error paths of the owner's constructor: frees the percpu counters
+ * of a ref which has never been handed out.  ->release() is not called.
+ */
+void percpu_ref_cancel_init(struct percpu_ref *ref)
+{
+	unsigned __percpu *pcpu_count;
+	unsigned count = 0;
+	int cpu;
+
+	WARN_ON_ONCE(ref->pcpu_count_ptr & PCPU_REF_DEAD);
+	pcpu_count = (unsigned __percpu *)ref->pcpu_count_ptr;
+
+	for_each_possible_cpu(cpu)
+		count += *per_cpu_ptr(pcpu_count, cpu);
+	WARN_ON_ONCE(count);
+
+	free_percpu(pcpu_count);
+}
+EXPORT_SYMBOL_GPL(percpu_ref_cancel_init);
+
+static void percpu_ref_kill_rcu(struct rcu_head *rcu)
+{
+	struct percpu_ref *ref = container_of(rcu, struct percpu_ref, rcu);
+	unsigned __percpu *pcpu_count;
+	unsigned count = 0;
+	int cpu;
+
+	pcpu_count = (unsigned __percpu *)(ref->pcpu_count_ptr & ~PCPU_REF_DEAD);
+
+	/* Nobody uses the percpu counters any more, fold them in */
+	for_each_possible_cpu(cpu)
+		count += *per_cpu_ptr(pcpu_count, cpu);
+
+	free_percpu(pcpu_count);
+
+	atomic_add((int)count - PCPU_COUNT_BIAS, &ref->count);
+
+	/* Drop the initial reference, possibly releasing the object */
+	percpu_ref_put(ref);
+}
+
+/**
+ * percpu_ref_kill - drop the initial ref
+ * @ref: percpu_ref to kill
+ *
+ * Switches @ref to atomic mode and drops the reference taken by
+ * percpu_ref_init().  The switch completes after an RCU-sched grace
+ * period, so ->release() is never called directly from here; gets and
+ * puts remain valid until the count reaches zero.
+ *
+ * Must be called exactly once per ref.
+ */
+void percpu_ref_kill(struct percpu_ref *ref)
+{
+	WARN_ONCE(ref->pcpu_count_ptr & PCPU_REF_DEAD,
+		  "percpu_ref_kill() called more than once!\n");
+
+	ref->pcpu_count_ptr |= PCPU_REF_DEAD;
+	call_rcu_sched(&ref->rcu, percpu_ref_kill_rcu);
+}
+EXPORT_SYMBOL_GPL(percpu_ref_kill);
@@ -0,0 +1,104 @@
+/*
+ * Microbenchmark for kmem_cache_alloc_bulk() and kmem_cache_free_bulk().
+ *
+ * For each bulk size, a batch of objects is allocated and freed again
+ * LOOPS times, once one object at a time and once with the bulk calls,
+ * and the average cost per object is reported in cycles.
+ */
+#define pr_fmt(fmt) KBUILD_MODNAME ": " fmt
+
+#include <linux/init.h>
+#include <linux/kernel.h>
+#include <linux/module.h>
+#include <linux/sched.h>
+#include <linux/slab.h>
+#include <linux/timex.h>
+
+#define LOOPS		100000
+#define OBJ_SIZE	256
+#define MAX_BULK	256
+
+static void *objs[MAX_BULK];
+
+static const unsigned int bulk_sizes[] = {
+	1, 2, 3, 4, 8, 16, 30, 32, 64, 128, 256,
+};
+
+static int bench_single(struct kmem_cache *s, unsigned int bulk,
+			unsigned long long *cycles)
+{
+	cycles_t start, stop;
+	unsigned int i, j;
+
+	start = get_cycles();
+	for (i = 0; i < LOOPS; i++) {
+		for (j = 0; j < bulk; j++) {
+			objs[j] = kmem_cache_alloc(s, GFP_KERNEL);
+			if (!objs[j])
+				goto fail;
+		}
+		for (j = 0; j < bulk; j++)
+			kmem_cache_free(s, objs[j]);
+	}
+	stop = get_cycles();
+
+	*cycles = div_u64(stop - start, LOOPS * bulk);
+	return 0;
+
+fail:
+	while (j--)
+		kmem_cache_free(s, objs[j]);
+	return -ENOMEM;
+}
+
+static int bench_bulk(struct kmem_cache *s, unsigned int bulk,
+		      unsigned long long *cycles)
+{
+	cycles_t start, stop;
+	unsigned int i;
+
+	start = get_cycles();
+	for (i = 0; i < LOOPS; i++) {
+		if (!kmem_cache_alloc_bulk(s, GFP_KERNEL, bulk, objs))
+			return -ENOMEM;
+		kmem_cache_free_bulk(s, bulk, objs);
+	}
+	stop = get_cycles();
+
+	*cycles = div_u64(stop - start, LOOPS * bulk);
+	return 0;
+}
+
+static int __init test_slab_bulk_init(void)
+{
+	unsigned long long single, bulk;
+	struct kmem_cache *s;
+	unsigned int i;
+	int err = 0;
+
+	s = kmem_cache_create("test_slab_bulk", OBJ_SIZE, 0, 0, NULL);
+	if (!s)
+		return -ENOMEM;
+
+	for (i = 0; i < ARRAY_SIZE(bulk_sizes); i++) {
+		unsigned int nr = bulk_sizes[i];
+
+		err = bench_single(s, nr, &single);
+		if (!err)
+			err = bench_bulk(s, nr, &bulk);
+		if (err) {
+			pr_err("bulk %u: allocation failed\n", nr);
+			break;
+		}
+		pr_info("bulk %3u: single %llu, bulk %llu cycles per object\n",
+			nr, single, bulk);
+		cond_resched();
+	}
+
+	kmem_cache_destroy(s);
+
+	/* nothing to keep loaded */
+	return err ? err : -EAGAIN;
+}
+module_init(test_slab_bulk_init);
+MODULE_LICENSE("GPL");
@@ -0,0 +1,363 @@
+/*
+ * mm/list_lru.c
+ *
+ * Generic LRU lists for caches of reclaimable objects.  Every object is
+ * kept on the list of the node its memory came from, so that a shrinker
+ * asked to relieve pressure on one node only scans and frees objects
+ * that actually live there, and so that the list locks of different
+ * nodes do not bounce between them.
+ *
+ * Memcg aware lrus additionally keep, per node, one list for each kmem
+ * limited cgroup, so that reclaim on behalf of a cgroup only scans the
+ * objects charged to it.
+ */
+#include <linux/kernel.h>
+#include <linux/module.h>
+#include <linux/mm.h>
+#include <linux/slab.h>
+#include <linux/mutex.h>
+#include <linux/list_lru.h>
+#include <linux/memcontrol.h>
+#include "slab.h"
+
+#ifdef CONFIG_MEMCG_KMEM
+static LIST_HEAD(list_lrus);
+static DEFINE_MUTEX(list_lrus_mutex);
+/* number of per memcg lists every memcg aware lru has, per node */
+static int list_lrus_size;
+
+static inline struct list_lru_one *
+list_lru_from_id(struct list_lru_node *nlru, int idx)
+{
+	if (idx >= 0 && idx < nlru->nr_memcg_lrus)
+		return &nlru->memcg_lrus[idx];
+	return &nlru->lru;
+}
+
+static inline int lru_memcg_id(struct list_lru *lru, struct list_head *item)
+{
+	if (list_empty(&lru->list))
+		return -1;
+	return memcg_cache_id_from_obj(item);
+}
+#else
+static inline struct list_lru_one *
+list_lru_from_id(struct list_lru_node *nlru, int idx)
+{
+	return &nlru->lru;
+}
+
+static inline int lru_memcg_id(struct list_lru *lru, struct list_head *item)
+{
+	return -1;
+}
+#endif /* CONFIG_MEMCG_KMEM */
+
+bool list_lru_add(struct list_lru *lru, struct list_head *item)
+{
+	int nid = page_to_nid(virt_to_page(item));
+	struct list_lru_node *nlru = &lru->node[nid];
+	struct list_lru_one *l;
+
+	spin_lock(&nlru->lock);
+	WARN_ON_ONCE(nlru->nr_items < 0);
+	if (list_empty(item)) {
+		l = list_lru_from_id(nlru, lru_memcg_id(lru, item));
+		list_add_tail(item, &l->list);
+		l->nr_items++;
+		if (nlru->nr_items++ == 0)
+			node_set(nid, lru->active_nodes);
+		spin_unlock(&nlru->lock);
+		return true;
+	}
+	spin_unlock(&nlru->lock);
+	return false;
+}
+EXPORT_SYMBOL_GPL(list_lru_add);
+
+bool list_lru_del(struct list_lru *lru, struct list_head *item)
+{
+	int nid = page_to_nid(virt_to_page(item));
+	struct list_lru_node *nlru = &lru->node[nid];
+	struct list_lru_one *l;
+
+	spin_lock(&nlru->lock);
+	if (!list_empty(item)) {
+		l = list_lru_from_id(nlru, lru_memcg_id(lru, item));
+		list_del_init(item);
+		l->nr_items--;
+		if (--nlru->nr_items == 0)
+			node_clear(nid, lru->active_nodes);
+		WARN_ON_ONCE(nlru->nr_items < 0);
+		spin_unlock(&nlru->lock);
+		return true;
+	}
+	spin_unlock(&nlru->lock);
+	return false;
+}
+EXPORT_SYMBOL_GPL(list_lru_del);
+
+unsigned long list_lru_count_node_memcg(struct list_lru *lru, int nid,
+					struct mem_cgroup *memcg)
+{
+	unsigned long count = 0;
+	struct list_lru_node *nlru = &lru->node[nid];
+	int idx = -1;
+
+	if (memcg) {
+		idx = memcg_cache_id(memcg);
+		if (idx < 0)
+			return 0;
+	}
+
+	spin_lock(&nlru->lock);
+	WARN_ON_ONCE(nlru->nr_items < 0);
+	if (idx < 0)
+		count += nlru->nr_items;
+	else
+		count += list_lru_from_id(nlru, idx)->nr_items;
+	spin_unlock(&nlru->lock);
+
+	return count;
+}
+EXPORT_SYMBOL_GPL(list_lru_count_node_memcg);
+
+static unsigned long
+__list_lru_walk_one(struct list_lru *lru, int nid, int idx,
+		    list_lru_walk_cb isolate, void *cb_arg,
+		    unsigned long *nr_to_walk)
+{
+	struct list_lru_node *nlru = &lru->node[nid];
+	struct list_head *item, *n;
+	struct list_lru_one *l;
+	unsigned long isolated = 0;
+
+	spin_lock(&nlru->lock);
+	/* the lists may have been reallocated while the lock was dropped */
+restart:
+	l = list_lru_from_id(nlru, idx);
+	list_for_each_safe(item, n, &l->list) {
+		enum lru_status ret;
+
+		/*
+		 * decrement nr_to_walk first so that we don't livelock if we
+		 * get stuck on large numbers of LRU_RETRY items
+		 */
+		if (!*nr_to_walk)
+			break;
+		--*nr_to_walk;
+
+		ret = isolate(item, &nlru->lock, cb_arg);
+		switch (ret) {
+		case LRU_REMOVED:
+			l->nr_items--;
+			if (--nlru->nr_items == 0)
+				node_clear(nid, lru->active_nodes);
+			WARN_ON_ONCE(nlru->nr_items < 0);
+			isolated++;
+			break;
+		case LRU_ROTATE:
+			list_move_tail(item, &l->list);
+			break;
+		case LRU_SKIP:
+			break;
+		case LRU_RETRY:
+			/*
+			 * The lru lock has been dropped, our list traversal is
+			 * now invalid and so we have to restart from scratch.
+			 */
+			goto restart;
+		default:
+			BUG();
+		}
+	}
+
+	spin_unlock(&nlru->lock);
+	return isolated;
+}
+
+unsigned long list_lru_walk_node_memcg(struct list_lru *lru, int nid,
+				       struct mem_cgroup *memcg,
+				       list_lru_walk_cb isolate, void *cb_arg,
+				       unsigned long *nr_to_walk)
+{
+	unsigned long isolated;
+	int idx;
+
+	if (memcg) {
+		idx = memcg_cache_id(memcg);
+		if (idx < 0)
+			return 0;
+		return __list_lru_walk_one(lru, nid, idx, isolate, cb_arg,
+					   nr_to_walk);
+	}
+
+	isolated = __list_lru_walk_one(lru, nid, -1, isolate, cb_arg,
+				       nr_to_walk);
+#ifdef CONFIG_MEMCG_KMEM
+	/*
+	 * Unlocked read: lists added concurrently belong to cgroups that
+	 * have no objects yet.
+	 */
+	for (idx = 0; idx < ACCESS_ONCE(lru->node[nid].nr_memcg_lrus); idx++) {
+		if (!*nr_to_walk)
+			break;
+		isolated += __list_lru_walk_one(lru, nid, idx, isolate, cb_arg,
+						nr_to_walk);
+	}
+#endif
+	return isolated;
+}
+EXPORT_SYMBOL_GPL(list_lru_walk_node_memcg);
+
+static int __list_lru_init(struct list_lru *lru)
+{
+	int i;
+	size_t size = sizeof(*lru->node) * nr_node_ids;
+
+	lru->node = kzalloc(size, GFP_KERNEL);
+	if (!lru->node)
+		return -ENOMEM;
+
+	nodes_clear(lru->active_nodes);
+	for (i = 0; i < nr_node_ids; i++) {
+		spin_lock_init(&lru->node[i].lock);
+		INIT_LIST_HEAD(&lru->node[i].lru.list);
+		lru->node[i].lru.nr_items = 0;
+		lru->node[i].nr_items = 0;
+	}
+#ifdef CONFIG_MEMCG_KMEM
+	INIT_LIST_HEAD(&lru->list);
+#endif
+	return 0;
+}
+
+int list_lru_init(struct list_lru *lru)
+{
+	return __list_lru_init(lru);
+}
+EXPORT_SYMBOL_GPL(list_lru_init);
+
+#ifdef CONFIG_MEMCG_KMEM
+static void memcg_destroy_list_lru(struct list_lru *lru)
+{
+	int i;
+
+	for (i = 0; i < nr_node_ids; i++)
+		kfree(lru->node[i].memcg_lrus);
+}
+
+/*
+ * Grow the per memcg lists of every node of @lru to @new_size.  Nodes
+ * that were already grown when an allocation fails keep their bigger
+ * arrays, which is harmless: ids are only handed out once all lrus fit.
+ */
+static int memcg_update_list_lru(struct list_lru *lru, int old_size,
+				 int new_size)
+{
+	int i, j;
+
+	for (i = 0; i < nr_node_ids; i++) {
+		struct list_lru_node *nlru = &lru->node[i];
+		struct list_lru_one *old, *new;
+
+		if (nlru->nr_memcg_lrus >= new_size)
+			continue;
+
+		new = kmalloc(new_size * sizeof(*new), GFP_KERNEL);
+		if (!new)
+			return -ENOMEM;
+
+		for (j = old_size; j < new_size; j++) {
+			INIT_LIST_HEAD(&new[j].list);
+			new[j].nr_items = 0;
+		}
+
+		spin_lock(&nlru->lock);
+		old = nlru->memcg_lrus;
+		for (j = 0; j < old_size; j++) {
+			INIT_LIST_HEAD(&new[j].list);
+			list_splice(&old[j].list, &new[j].list);
+			new[j].nr_items = old[j].nr_items;
+		}
+		nlru->memcg_lrus = new;
+		nlru->nr_memcg_lrus = new_size;
+		spin_unlock(&nlru->lock);
+
+		kfree(old);
+	}
+	return 0;
+}
+
+/**
+ * memcg_update_all_list_lrus - make room for @num_memcgs cgroups
+ * @num_memcgs: new number of kmem limited cgroup ids
+ *
+ * Called from the memcg core before a new kmem id is handed out.
+ */
+int memcg_update_all_list_lrus(int num_memcgs)
+{
+	struct list_lru *lru;
+	int ret = 0;
+
+	mutex_lock(&list_lrus_mutex);
+	if (num_memcgs <= list_lrus_size)
+		goto out;
+
+	list_for_each_entry(lru, &list_lrus, list) {
+		ret = memcg_update_list_lru(lru, list_lrus_size, num_memcgs);
+		if (ret)
+			goto out;
+	}
+	list_lrus_size = num_memcgs;
+out:
+	mutex_unlock(&list_lrus_mutex);
+	return ret;
+}
+
+int list_lru_init_memcg(struct list_lru *lru)
+{
+	int ret;
+
+	ret = __list_lru_init(lru);
+	if (ret)
+		return ret;
+
+	mutex_lock(&list_lrus_mutex);
+	ret = memcg_update_list_lru(lru, 0, list_lrus_size);
+	if (ret) {
+		mutex_unlock(&list_lrus_mutex);
+		memcg_destroy_list_lru(lru);
+		kfree(lru->node);
+		lru->node = NULL;
+		return ret;
+	}
+	list_add(&lru->list, &list_lrus);
+	mutex_unlock(&list_lrus_mutex);
+	return 0;
+}
+#else
+int list_lru_init_memcg(struct list_lru *lru)
+{
+	return __list_lru_init(lru);
+}
+#endif /* CONFIG_MEMCG_KMEM */
+EXPORT_SYMBOL_GPL(list_lru_init_memcg);
+
+void list_lru_destroy(struct list_lru *lru)
+{
+	/* not initialized, e.g. on the error path of the owner's setup */
+	if (!lru->node)
+		return;
+#ifdef CONFIG_MEMCG_KMEM
+	if (!list_empty(&lru->list)) {
+		mutex_lock(&list_lrus_mutex);
+		list_del(&lru->list);
+		mutex_unlock(&list_lrus_mutex);
+		memcg_destroy_list_lru(lru);
+	}
+#endif
+	kfree(lru->node);
+	lru->node = NULL;
+}
+EXPORT_SYMBOL_GPL(list_lru_destroy);
@@ -39,6 +39,7 @@
 #include <linux/slab.h>
 #include <linux/swap.h>
 #include <linux/swapops.h>
+#include <linux/shmem_fs.h>
 #include <linux/spinlock.h>
 #include <linux/eventfd.h>
 #include <linux/sort.h>
@@ -49,7 +50,9 @@
 #include <linux/page_cgroup.h>
 #include <linux/cpu.h>
 #include <linux/oom.h>
+#include <linux/list_lru.h>
 #include "internal.h"
+#include "slab.h"
 #include <net/sock.h>
 #include <net/tcp_memcontrol.h>
 
@@ -264,6 +267,10 @@ struct mem_cgroup {
 		struct work_struct work_freeing;
 	};
 
+	/*
+	 * the counter to account for kernel memory usage.
+	 */
+	struct res_counter kmem;
 	/*
 	 * Per cgroup active and inactive list, similar to the
 	 * per zone LRU lists.
@@ -329,8 +336,49 @@ struct mem_cgroup {
 #ifdef CONFIG_INET
 	struct tcp_memcontrol tcp_mem;
 #endif
+#ifdef CONFIG_MEMCG_KMEM
+	/* analogous to slab_common's slab_caches list. per-memcg */
+	struct list_head memcg_slab_caches;
+	/* Not a spinlock, we can take a lot of time walking the list */
+	struct mutex slab_caches_mutex;
+	/* kmem accounting state, see the KMEM_ACCOUNTED_* flags */
+	unsigned long kmem_account_flags;
+	/* Index in the kmem_cache->memcg_params->memcg_caches array */
+	int kmemcg_id;
+#endif
 };
 
+/* internal only representation about the status of kmem accounting. */
+enum {
+	KMEM_ACCOUNTED_ACTIVE = 0, /* accounted by this cgroup itself */
+	KMEM_ACCOUNTED_ACTIVATED, /* limit set here, static key taken */
+	KMEM_ACCOUNTED_DEAD, /* dead memcg with pending kmem charges */
+};
+
+#ifdef CONFIG_MEMCG_KMEM
+static inline void memcg_kmem_set_active(struct mem_cgroup *memcg)
+{
+	set_bit(KMEM_ACCOUNTED_ACTIVE, &memcg->kmem_account_flags);
+}
+
+static bool memcg_kmem_is_active(struct mem_cgroup *memcg)
+{
+	return test_bit(KMEM_ACCOUNTED_ACTIVE, &memcg->kmem_account_flags);
+}
+
+static void memcg_kmem_mark_dead(struct mem_cgroup *memcg)
+{
+	if (test_bit(KMEM_ACCOUNTED_ACTIVE, &memcg->kmem_account_flags))
+		set_bit(KMEM_ACCOUNTED_DEAD, &memcg->kmem_account_flags);
+}
+
+static bool memcg_kmem_test_and_clear_dead(struct mem_cgroup *memcg)
+{
+	return test_and_clear_bit(KMEM_ACCOUNTED_DEAD,
+				  &memcg->kmem_account_flags);
+}
+#endif
+
 /* Stuffs for move charges at task migration. */
 /*
  * Types of charges to be moved. "move_charge_at_immitgrate" is treated as a
@@ -388,6 +436,7 @@ enum charge_type {
 #define _MEM			(0)
 #define _MEMSWAP		(1)
 #define _OOM_TYPE		(2)
+#define _KMEM			(3)
 #define MEMFILE_PRIVATE(x, val)	((x) << 16 | (val))
 #define MEMFILE_TYPE(val)	((val) >> 16 & 0xffff)
 #define MEMFILE_ATTR(val)	((val) & 0xffff)
@@ -486,6 +535,58 @@ static void disarm_sock_keys(struct mem_cgroup *memcg)
 }
 #endif
 
+#ifdef CONFIG_MEMCG_KMEM
+/*
+ * This will be the memcg's index in each cache's ->memcg_params->memcg_caches
+ * and in the per-memcg lists of memcg aware list_lrus.  The css_id is not
+ * used for this: ids are only handed out to kmem-limited groups, so that the
+ * arrays indexed by them stay small even with many cgroups around.
+ */
+static DEFINE_IDA(kmem_limited_groups);
+int memcg_limited_groups_array_size;
+
+/*
+ * MIN_SIZE is different than 1, because we would like to avoid going through
+ * the alloc/free process all the time. In a small machine, 4 kmem-limited
+ * cgroups is a reasonable guess. In the future, it could be a parameter or
+ * tunable, but that is strictly not necessary.
+ *
+ * MAX_SIZE should be as large as the number of css_ids. Ideally, we could get
+ * this constant directly from cgroup, but it is understandable that this is
+ * better kept as an internal representation in cgroup.c. In any case, the
+ * css_id space is not getting any smaller, and we don't have to necessarily
+ * increase ours as well if it increases.
+ */
+#define MEMCG_CACHES_MIN_SIZE 4
+#define MEMCG_CACHES_MAX_SIZE 65535
+
+struct static_key memcg_kmem_enabled_key;
+EXPORT_SYMBOL(memcg_kmem_enabled_key);
+
+static void disarm_kmem_keys(struct mem_cgroup *memcg)
+{
+	if (memcg_kmem_is_active(memcg))
+		ida_simple_remove(&kmem_limited_groups, memcg->kmemcg_id);
+	if (test_bit(KMEM_ACCOUNTED_ACTIVATED, &memcg->kmem_account_flags))
+		static_key_slow_dec(&memcg_kmem_enabled_key);
+	/*
+	 * This check can't live in kmem destruction function,
+	 * since the charges will outlive the cgroup
+	 */
+	WARN_ON(res_counter_read_u64(&memcg->kmem, RES_USAGE) != 0);
+}
+#else
+static void disarm_kmem_keys(struct mem_cgroup *memcg)
+{
+}
+#endif /* CONFIG_MEMCG_KMEM */
+
+static void disarm_static_keys(struct mem_cgroup *memcg)
+{
+	disarm_sock_keys(memcg);
+	disarm_kmem_keys(memcg);
+}
+
 static void drain_all_stock_async(struct mem_cgroup *memcg);
 
 static struct mem_cgroup_per_zone *
@@ -1087,6 +1188,11 @@ struct lruvec *mem_cgroup_zone_lruvec(struct zone *zone,
  * mem_cgroup_page_lruvec - return lruvec for adding an lru page
  * @page: the page
  * @zone: zone of the page
+ *
+ * Without the lru_lock of the returned lruvec this is only a guess,
+ * confirm it with mem_cgroup_page_lruvec_locked() once the lock is
+ * held, as lock_page_lruvec_irq() does.  The caller must also be in
+ * an RCU read-side section until then.
  */
 struct lruvec *mem_cgroup_page_lruvec(struct page *page, struct zone *zone)
 {
@@ -1101,21 +1207,56 @@ struct lruvec *mem_cgroup_page_lruvec(struct page *page, struct zone *zone)
 	memcg = pc->mem_cgroup;
 
 	/*
-	 * Surreptitiously switch any uncharged offlist page to root:
-	 * an uncharged page off lru does nothing to secure
-	 * its former mem_cgroup from sudden removal.
-	 *
-	 * Our caller holds lru_lock, and PageCgroupUsed is updated
-	 * under page_cgroup lock: between them, they make all uses
-	 * of pc->mem_cgroup safe.
+	 * An uncharged page off lru does nothing to secure its former
+	 * mem_cgroup from sudden removal: it belongs to root.
 	 */
-	if (!PageLRU(page) && !PageCgroupUsed(pc) && memcg != root_mem_cgroup)
-		pc->mem_cgroup = memcg = root_mem_cgroup;
+	if (!PageLRU(page) && !PageCgroupUsed(pc))
+		memcg = root_mem_cgroup;
 
 	mz = page_cgroup_zoneinfo(memcg, page);
 	return &mz->lruvec;
 }
 
+/**
+ * mem_cgroup_page_lruvec_locked - check the lruvec of a page
+ * @page: the page
+ * @zone: zone of the page
+ * @lruvec: lruvec whose lru_lock is held
+ *
+ * Returns true if @page belongs to @lruvec.  It then keeps belonging
+ * to it until @lruvec->lru_lock is released: PageLRU is only cleared,
+ * and a page off lru only gets charged, under the lru_lock of the
+ * lruvec the page currently belongs to.
+ */
+bool mem_cgroup_page_lruvec_locked(struct page *page, struct zone *zone,
+				   struct lruvec *lruvec)
+{
+	struct page_cgroup *pc;
+	bool ret;
+
+	rcu_read_lock();
+	ret = mem_cgroup_page_lruvec(page, zone) == lruvec;
+	rcu_read_unlock();
+
+	if (!ret || mem_cgroup_disabled())
+		return ret;
+
+	/*
+	 * Surreptitiously switch any uncharged offlist page to root,
+	 * so that it stays there once it is put on the lru.
+	 *
+	 * We hold root's lru_lock, and PageCgroupUsed is only set on
+	 * such a page with that held: between them, they make this
+	 * update of pc->mem_cgroup safe.
+	 */
+	pc = lookup_page_cgroup(page);
+	if (!PageLRU(page) && !PageCgroupUsed(pc) &&
+	    pc->mem_cgroup != root_mem_cgroup)
+		pc->mem_cgroup = root_mem_cgroup;
+
+	return true;
+}
+
 /**
  * mem_cgroup_update_lru_size - account for adding or removing an lru page
  * @lruvec: mem_cgroup per zone lru vector
@@ -2535,8 +2676,7 @@ static void __mem_cgroup_commit_charge(struct mem_cgroup *memcg,
 				       bool lrucare)
 {
 	struct page_cgroup *pc = lookup_page_cgroup(page);
-	struct zone *uninitialized_var(zone);
-	struct lruvec *lruvec;
+	struct lruvec *uninitialized_var(lruvec);
 	bool was_on_lru = false;
 	bool anon;
 
@@ -2552,10 +2692,8 @@ static void __mem_cgroup_commit_charge(struct mem_cgroup *memcg,
 	 * may already be on some other mem_cgroup's LRU.  Take care of it.
 	 */
 	if (lrucare) {
-		zone = page_zone(page);
-		spin_lock_irq(&zone->lru_lock);
+		lruvec = lock_page_lruvec_irq(page);
 		if (PageLRU(page)) {
-			lruvec = mem_cgroup_zone_lruvec(zone, pc->mem_cgroup);
 			ClearPageLRU(page);
 			del_page_from_lru_list(page, lruvec, page_lru(page));
 			was_on_lru = true;
@@ -2575,12 +2713,15 @@ static void __mem_cgroup_commit_charge(struct mem_cgroup *memcg,
 
 	if (lrucare) {
 		if (was_on_lru) {
-			lruvec = mem_cgroup_zone_lruvec(zone, pc->mem_cgroup);
+			/* irqs stay disabled until the page is back */
+			spin_unlock(&lruvec->lru_lock);
+			lruvec = mem_cgroup_zone_lruvec(page_zone(page), memcg);
+			spin_lock(&lruvec->lru_lock);
 			VM_BUG_ON(PageLRU(page));
 			SetPageLRU(page);
 			add_page_to_lru_list(page, lruvec, page_lru(page));
 		}
-		spin_unlock_irq(&zone->lru_lock);
+		spin_unlock_irq(&lruvec->lru_lock);
 	}
 
 	if (ctype == MEM_CGROUP_CHARGE_TYPE_ANON)
@@ -2599,12 +2740,629 @@ static void __mem_cgroup_commit_charge(struct mem_cgroup *memcg,
 	memcg_check_events(memcg, page);
 }
 
+#ifdef CONFIG_MEMCG_KMEM
+static inline bool memcg_can_account_kmem(struct mem_cgroup *memcg)
+{
+	return !mem_cgroup_disabled() && !mem_cgroup_is_root(memcg) &&
+		memcg_kmem_is_active(memcg);
+}
+
+/*
+ * Shrink the slab objects charged to @root and its children.  Like page
+ * reclaim, a lower @priority scans a bigger share of the objects.
+ */
+void memcg_kmem_shrink_slab(struct mem_cgroup *root, gfp_t gfp, int priority)
+{
+	unsigned long nr_pages;
+	struct mem_cgroup *memcg;
+
+	nr_pages = res_counter_read_u64(&root->kmem, RES_USAGE) >> PAGE_SHIFT;
+
+	memcg = mem_cgroup_iter(root, NULL, NULL);
+	do {
+		struct shrink_control shrink = {
+			.gfp_mask = gfp,
+			.memcg = memcg,
+		};
+
+		if (memcg_kmem_is_active(memcg)) {
+			nodes_setall(shrink.nodes_to_scan);
+			shrink_slab(&shrink, (nr_pages >> priority) + 1,
+				    nr_pages + 1);
+		}
+		memcg = mem_cgroup_iter(root, memcg, NULL);
+	} while (memcg);
+}
+
+static int memcg_charge_kmem(struct mem_cgroup *memcg, gfp_t gfp, u64 size)
+{
+	struct res_counter *fail_res;
+	struct mem_cgroup *_memcg;
+	int priority = DEF_PRIORITY;
+	bool may_oom;
+	int ret;
+
+	/*
+	 * Kernel memory can't be swapped out or moved around, so when the
+	 * kmem limit is hit the only way to make room is to shrink the
+	 * slab caches of the group that is over its limit.
+	 */
+	while ((ret = res_counter_charge(&memcg->kmem, size, &fail_res))) {
+		if (!(gfp & __GFP_WAIT) || priority < 0 ||
+		    fatal_signal_pending(current))
+			return ret;
+		memcg_kmem_shrink_slab(mem_cgroup_from_res_counter(fail_res,
+								   kmem),
+				       gfp, priority--);
+	}
+
+	/*
+	 * A dead group can still allocate slab pages for the objects
+	 * that were handed out before its tasks left.  There is nobody
+	 * to reclaim from, so charge it unconditionally.
+	 */
+	if (unlikely(css_is_removed(&memcg->css)))
+		goto nofail;
+
+	/*
+	 * Conditions under which we can wait for the oom_killer. Those are
+	 * the same conditions tested by the core page allocator
+	 */
+	may_oom = (gfp & __GFP_FS) && !(gfp & __GFP_NORETRY);
+
+	_memcg = memcg;
+	ret = __mem_cgroup_try_charge(NULL, gfp, size >> PAGE_SHIFT,
+				      &_memcg, may_oom);
+
+	if (ret == -EINTR) {
+		/*
+		 * __mem_cgroup_try_charge() chose to bypass to root due to
+		 * OOM kill or fatal signal.  Since our only options are to
+		 * either fail the allocation or charge it to this cgroup, do
+		 * it as a temporary condition. But we can't fail. From a
+		 * kmem/slab perspective, the cache has already been selected,
+		 * by memcg_kmem_get_cache(), so it is too late to change
+		 * our minds.
+		 */
+		goto nofail;
+	} else if (ret)
+		res_counter_uncharge(&memcg->kmem, size);
+
+	return ret;
+nofail:
+	res_counter_charge_nofail(&memcg->res, size, &fail_res);
+	if (do_swap_account)
+		res_counter_charge_nofail(&memcg->memsw, size, &fail_res);
+	return 0;
+}
+
+static void memcg_uncharge_kmem(struct mem_cgroup *memcg, u64 size)
+{
+	res_counter_uncharge(&memcg->res, size);
+	if (do_swap_account)
+		res_counter_uncharge(&memcg->memsw, size);
+
+	/* Not down to 0 */
+	if (res_counter_uncharge(&memcg->kmem, size))
+		return;
+
+	/*
+	 * The last kmem charge of a dead group is gone, drop the reference
+	 * that kept it around (see memcg_update_kmem_limit()).
+	 */
+	if (memcg_kmem_test_and_clear_dead(memcg))
+		mem_cgroup_put(memcg);
+}
+
+int memcg_cache_id(struct mem_cgroup *memcg)
+{
+	return memcg ? memcg->kmemcg_id : -1;
+}
+
+/*
+ * Grow the per-memcg arrays of every root cache to @num_groups entries.
+ * Called with slab_mutex held.
+ */
+int memcg_update_cache_size(struct kmem_cache *s, int num_groups)
+{
+	struct memcg_cache_params *params = s->memcg_params;
+	struct memcg_cache_array *old, *new;
+
+	old = rcu_dereference_protected(params->memcg_caches,
+					lockdep_is_held(&slab_mutex));
+
+	new = kzalloc(sizeof(*new) + num_groups * sizeof(struct kmem_cache *),
+		      GFP_KERNEL);
+	if (!new)
+		return -ENOMEM;
+
+	if (old)
+		memcpy(new->entries, old->entries,
+		       memcg_limited_groups_array_size *
+		       sizeof(struct kmem_cache *));
+
+	rcu_assign_pointer(params->memcg_caches, new);
+	if (old)
+		kfree_rcu(old, rcu_head);
+	return 0;
+}
+
+void memcg_update_array_size(int num)
+{
+	memcg_limited_groups_array_size = num;
+}
+
+/*
+ * Assign @memcg its kmem id, growing the arrays indexed by it when the
+ * new id does not fit.  Called with set_limit_mutex held.
+ */
+static int memcg_update_cache_sizes(struct mem_cgroup *memcg)
+{
+	int num, size, ret;
+
+	num = ida_simple_get(&kmem_limited_groups,
+			     0, MEMCG_CACHES_MAX_SIZE, GFP_KERNEL);
+	if (num < 0)
+		return num;
+
+	size = memcg_limited_groups_array_size;
+	if (num >= size) {
+		size = max(MEMCG_CACHES_MIN_SIZE, 2 * (num + 1));
+		size = min(size, MEMCG_CACHES_MAX_SIZE);
+	}
+
+	ret = memcg_update_all_caches(size);
+	if (!ret)
+		ret = memcg_update_all_list_lrus(size);
+	if (ret) {
+		ida_simple_remove(&kmem_limited_groups, num);
+		return ret;
+	}
+
+	memcg->kmemcg_id = num;
+	INIT_LIST_HEAD(&memcg->memcg_slab_caches);
+	mutex_init(&memcg->slab_caches_mutex);
+	/* publish the id before anyone sees the group as active */
+	smp_wmb();
+	memcg_kmem_set_active(memcg);
+	return 0;
+}
+
+static void kmem_cache_destroy_work_func(struct work_struct *w);
+
+/*
+ * Called with slab_mutex held, from kmem_cache_create_memcg().  A root
+ * cache that fails to get its parameters is simply not accounted, only
+ * the creation of a memcg copy can fail here.
+ */
+int memcg_register_cache(struct mem_cgroup *memcg, struct kmem_cache *s,
+			 struct kmem_cache *root_cache)
+{
+	struct memcg_cache_params *params;
+	struct memcg_cache_array *arr;
+
+	if (!memcg) {
+		/* merged with an existing cache */
+		if (s->memcg_params)
+			return 0;
+
+		params = kzalloc(sizeof(*params), GFP_KERNEL);
+		if (!params)
+			return 0;
+		params->is_root_cache = true;
+		if (memcg_limited_groups_array_size) {
+			arr = kzalloc(sizeof(*arr) +
+				      memcg_limited_groups_array_size *
+				      sizeof(struct kmem_cache *), GFP_KERNEL);
+			if (!arr) {
+				kfree(params);
+				return 0;
+			}
+			RCU_INIT_POINTER(params->memcg_caches, arr);
+		}
+		s->memcg_params = params;
+		return 0;
+	}
+
+	params = kzalloc(sizeof(*params), GFP_KERNEL);
+	if (!params)
+		return -ENOMEM;
+
+	params->memcg = memcg;
+	params->cachep = s;
+	params->root_cache = root_cache;
+	atomic_set(&params->nr_pages, 0);
+	INIT_WORK(&params->destroy, kmem_cache_destroy_work_func);
+	s->memcg_params = params;
+
+	/* The cache holds the group, whose id indexes the caches below */
+	mem_cgroup_get(memcg);
+
+	mutex_lock(&memcg->slab_caches_mutex);
+	list_add(&params->list, &memcg->memcg_slab_caches);
+	mutex_unlock(&memcg->slab_caches_mutex);
+
+	arr = rcu_dereference_protected(root_cache->memcg_params->memcg_caches,
+					lockdep_is_held(&slab_mutex));
+	/* initialize the cache before making it visible to allocations */
+	smp_wmb();
+	arr->entries[memcg_cache_id(memcg)] = s;
+	return 0;
+}
+
+/* Called with slab_mutex held, when @s is destroyed */
+void memcg_release_cache(struct kmem_cache *s)
+{
+	struct memcg_cache_params *params = s->memcg_params;
+	struct memcg_cache_array *arr;
+	struct kmem_cache *root;
+	struct mem_cgroup *memcg;
+
+	if (!params)
+		return;
+
+	if (params->is_root_cache) {
+		kfree(rcu_dereference_protected(params->memcg_caches,
+						lockdep_is_held(&slab_mutex)));
+		goto out;
+	}
+
+	memcg = params->memcg;
+	root = params->root_cache;
+
+	arr = rcu_dereference_protected(root->memcg_params->memcg_caches,
+					lockdep_is_held(&slab_mutex));
+	arr->entries[memcg_cache_id(memcg)] = NULL;
+
+	mutex_lock(&memcg->slab_caches_mutex);
+	list_del(&params->list);
+	mutex_unlock(&memcg->slab_caches_mutex);
+
+	mem_cgroup_put(memcg);
+out:
+	s->memcg_params = NULL;
+	kfree(params);
+}
+
+static struct kmem_cache *cache_from_memcg(struct kmem_cache *s, int idx)
+{
+	struct kmem_cache *cachep;
+
+	rcu_read_lock();
+	cachep = rcu_dereference(s->memcg_params->memcg_caches)->entries[idx];
+	rcu_read_unlock();
+	return cachep;
+}
+
+/*
+ * Serializes creation of memcg copies against their destruction, see
+ * kmem_cache_destroy_work_func() and kmem_cache_destroy_memcg_children().
+ */
+static DEFINE_MUTEX(memcg_cache_mutex);
+
+static void kmem_cache_destroy_work_func(struct work_struct *w)
+{
+	struct memcg_cache_params *params;
+
+	params = container_of(w, struct memcg_cache_params, destroy);
+
+	mutex_lock(&memcg_cache_mutex);
+	/* kmem_cache_destroy_memcg_children() took over */
+	if (!params->dead)
+		goto out;
+	/*
+	 * If shrinking gets us down to 0 pages, memcg_uncharge_slab() puts
+	 * us back into the workqueue and the cache is destroyed by that
+	 * run.  Destroying it right away would leave that work pointing
+	 * to freed memory.
+	 */
+	if (atomic_read(&params->nr_pages) != 0)
+		kmem_cache_shrink(params->cachep);
+	else
+		kmem_cache_destroy(params->cachep);
+out:
+	mutex_unlock(&memcg_cache_mutex);
+}
+
+static void mem_cgroup_destroy_cache(struct kmem_cache *cachep)
+{
+	/*
+	 * Caches of a live group are never destroyed when they become
+	 * empty, and a work that is already pending takes care of
+	 * the rest.
+	 */
+	if (!cachep->memcg_params->dead)
+		return;
+	schedule_work(&cachep->memcg_params->destroy);
+}
+
+void kmem_cache_destroy_memcg_children(struct kmem_cache *s)
+{
+	struct kmem_cache *c;
+	int i;
+
+	if (!s->memcg_params || !s->memcg_params->is_root_cache)
+		return;
+
+	/*
+	 * If the cache is being destroyed, we trust that there is no one
+	 * else requesting objects from it, so no new copies can show up.
+	 */
+	mutex_lock(&memcg_cache_mutex);
+	for_each_memcg_cache_index(i) {
+		c = cache_from_memcg(s, i);
+		if (!c)
+			continue;
+		/*
+		 * The destroy work only touches copies still marked dead,
+		 * clearing the flag leaves this one to us.
+		 */
+		c->memcg_params->dead = false;
+		mutex_unlock(&memcg_cache_mutex);
+		cancel_work_sync(&c->memcg_params->destroy);
+		kmem_cache_destroy(c);
+		mutex_lock(&memcg_cache_mutex);
+	}
+	mutex_unlock(&memcg_cache_mutex);
+}
+
+static void mem_cgroup_destroy_all_caches(struct mem_cgroup *memcg)
+{
+	struct memcg_cache_params *params;
+
+	if (!memcg_kmem_is_active(memcg))
+		return;
+
+	mutex_lock(&memcg->slab_caches_mutex);
+	list_for_each_entry(params, &memcg->memcg_slab_caches, list) {
+		params->dead = true;
+		schedule_work(&params->destroy);
+	}
+	mutex_unlock(&memcg->slab_caches_mutex);
+}
+
+static char *memcg_cache_name(struct mem_cgroup *memcg, struct kmem_cache *s)
+{
+	struct dentry *dentry;
+	char *name;
+
+	rcu_read_lock();
+	dentry = rcu_dereference(memcg->css.cgroup->dentry);
+	name = kasprintf(GFP_ATOMIC, "%s(%d:%s)", s->name,
+			 memcg_cache_id(memcg),
+			 dentry ? (const char *)dentry->d_name.name : "");
+	rcu_read_unlock();
+	return name;
+}
+
+static struct kmem_cache *kmem_cache_dup(struct mem_cgroup *memcg,
+					 struct kmem_cache *s)
+{
+	struct kmem_cache *new;
+	char *name;
+
+	name = memcg_cache_name(memcg, s);
+	if (!name)
+		return NULL;
+
+	new = kmem_cache_create_memcg(memcg, name, s->object_size, s->align,
+				      (s->flags & ~SLAB_PANIC), s->ctor, s);
+	kfree(name);
+	return new;
+}
+
+static void memcg_create_kmem_cache(struct mem_cgroup *memcg,
+				    struct kmem_cache *cachep)
+{
+	mutex_lock(&memcg_cache_mutex);
+	if (!cache_from_memcg(cachep, memcg_cache_id(memcg)))
+		kmem_cache_dup(memcg, cachep);
+	mutex_unlock(&memcg_cache_mutex);
+}
+
+struct create_work {
+	struct mem_cgroup *memcg;
+	struct kmem_cache *cachep;
+	struct work_struct work;
+};
+
+static void memcg_create_cache_work_func(struct work_struct *w)
+{
+	struct create_work *cw;
+
+	cw = container_of(w, struct create_work, work);
+	memcg_create_kmem_cache(cw->memcg, cw->cachep);
+	/* Drop the reference gotten when we enqueued. */
+	css_put(&cw->memcg->css);
+	kfree(cw);
+}
+
+/*
+ * Enqueue the creation of a per-memcg kmem_cache.
+ * Called with rcu_read_lock.
+ */
+static void memcg_create_cache_enqueue(struct mem_cgroup *memcg,
+				       struct kmem_cache *cachep)
+{
+	struct create_work *cw;
+
+	cw = kmalloc(sizeof(struct create_work), GFP_NOWAIT);
+	if (cw == NULL) {
+		css_put(&memcg->css);
+		return;
+	}
+
+	cw->memcg = memcg;
+	cw->cachep = cachep;
+
+	INIT_WORK(&cw->work, memcg_create_cache_work_func);
+	schedule_work(&cw->work);
+}
+
+/*
+ * Return the kmem_cache we're supposed to use for a slab allocation.
+ * We try to use the current memcg's version of the cache.
+ *
+ * If the cache does not exist yet, its creation is queued to a workqueue
+ * and the current allocation goes through with the original cache.
+ *
+ * Can't be called in interrupt context or from kernel threads.
+ */
+struct kmem_cache *__memcg_kmem_get_cache(struct kmem_cache *cachep,
+					  gfp_t gfp)
+{
+	struct mem_cgroup *memcg;
+	struct kmem_cache *memcg_cachep;
+
+	/* kmalloc caches and caches created too early are not accounted */
+	if (!cachep->memcg_params)
+		return cachep;
+	VM_BUG_ON(!cachep->memcg_params->is_root_cache);
+
+	rcu_read_lock();
+	memcg = mem_cgroup_from_task(rcu_dereference(current->mm->owner));
+	if (!memcg || !memcg_can_account_kmem(memcg))
+		goto out;
+	/* pairs with the smp_wmb() in memcg_update_cache_sizes() */
+	smp_rmb();
+
+	memcg_cachep = cache_from_memcg(cachep, memcg_cache_id(memcg));
+	if (likely(memcg_cachep)) {
+		cachep = memcg_cachep;
+		goto out;
+	}
+
+	/* The corresponding put will be done in the workqueue. */
+	if (css_tryget(&memcg->css))
+		memcg_create_cache_enqueue(memcg, cachep);
+out:
+	rcu_read_unlock();
+	return cachep;
+}
+EXPORT_SYMBOL(__memcg_kmem_get_cache);
+
+int __memcg_charge_slab(struct kmem_cache *cachep, gfp_t gfp, int order)
+{
+	struct memcg_cache_params *params = cachep->memcg_params;
+	int ret;
+
+	ret = memcg_charge_kmem(params->memcg, gfp, PAGE_SIZE << order);
+	if (!ret)
+		atomic_add(1 << order, &params->nr_pages);
+	return ret;
+}
+
+void __memcg_uncharge_slab(struct kmem_cache *cachep, int order)
+{
+	struct memcg_cache_params *params = cachep->memcg_params;
+
+	memcg_uncharge_kmem(params->memcg, PAGE_SIZE << order);
+	if (atomic_sub_and_test(1 << order, &params->nr_pages))
+		mem_cgroup_destroy_cache(cachep);
+}
+
+/*
+ * We need to verify if the allocation against current->mm->owner's memcg is
+ * possible for the given order. But the page is not allocated yet, so we'll
+ * need a further commit step to do the final arrangements.
+ *
+ * It is possible for the task to switch cgroups in this mean time, so at
+ * commit time, we can't rely on task conversion any longer.  We'll then use
+ * the handle argument to return to the caller which cgroup we should commit
+ * against. We could also return the memcg directly and avoid the pointer
+ * passing, but a boolean return value gives better semantics considering
+ * the compiled-out case as well.
+ *
+ * Returning true means the allocation is possible.
+ */
+bool
+__memcg_kmem_newpage_charge(gfp_t gfp, struct mem_cgroup **_memcg, int order)
+{
+	struct mem_cgroup *memcg;
+	int ret;
+
+	*_memcg = NULL;
+	memcg = try_get_mem_cgroup_from_mm(current->mm);
+
+	/*
+	 * very rare case described in mem_cgroup_from_task. Unfortunately there
+	 * isn't much we can do without complicating this too much, and it would
+	 * be gfp-dependent anyway. Just let it go
+	 */
+	if (unlikely(!memcg))
+		return true;
+
+	if (!memcg_can_account_kmem(memcg)) {
+		css_put(&memcg->css);
+		return true;
+	}
+
+	ret = memcg_charge_kmem(memcg, gfp, PAGE_SIZE << order);
+	if (!ret)
+		*_memcg = memcg;
+
+	css_put(&memcg->css);
+	return (ret == 0);
+}
+
+void __memcg_kmem_commit_charge(struct page *page, struct mem_cgroup *memcg,
+			      int order)
+{
+	struct page_cgroup *pc;
+
+	VM_BUG_ON(mem_cgroup_is_root(memcg));
+
+	/* The page allocation failed. Revert */
+	if (!page) {
+		memcg_uncharge_kmem(memcg, PAGE_SIZE << order);
+		return;
+	}
+
+	pc = lookup_page_cgroup(page);
+	lock_page_cgroup(pc);
+	pc->mem_cgroup = memcg;
+	SetPageCgroupUsed(pc);
+	unlock_page_cgroup(pc);
+}
+
+void __memcg_kmem_uncharge_pages(struct page *page, int order)
+{
+	struct mem_cgroup *memcg = NULL;
+	struct page_cgroup *pc;
+
+	pc = lookup_page_cgroup(page);
+	/*
+	 * Fast unlocked return. Theoretically might have changed, have to
+	 * check again after locking.
+	 */
+	if (!PageCgroupUsed(pc))
+		return;
+
+	lock_page_cgroup(pc);
+	if (PageCgroupUsed(pc)) {
+		memcg = pc->mem_cgroup;
+		ClearPageCgroupUsed(pc);
+	}
+	unlock_page_cgroup(pc);
+
+	/*
+	 * We trust that only if there is a memcg associated with the page, it
+	 * is a valid allocation
+	 */
+	if (!memcg)
+		return;
+
+	VM_BUG_ON(mem_cgroup_is_root(memcg));
+	memcg_uncharge_kmem(memcg, PAGE_SIZE << order);
+}
+#endif /* CONFIG_MEMCG_KMEM */
+
 #ifdef CONFIG_TRANSPARENT_HUGEPAGE
 
 #define PCGF_NOCOPY_AT_SPLIT (1 << PCG_LOCK | 1 << PCG_MIGRATION)
 /*
  * Because tail pages are not marked as "used", set it. We're under
- * zone->lru_lock, 'splitting on pmd' and compound_lock.
+ * the lruvec's lru_lock, 'splitting on pmd' and compound_lock.
  * charge/uncharge will be never happen and move_account() is done under
  * compound_lock(), so we don't have to take care of races.
  */
@@ -3698,9 +4456,7 @@ static bool mem_cgroup_force_empty_list(struct mem_cgroup *memcg,
 	unsigned long flags, loop;
 	struct list_head *list;
 	struct page *busy;
-	struct zone *zone;
 
-	zone = &NODE_DATA(node)->node_zones[zid];
 	mz = mem_cgroup_zoneinfo(memcg, node, zid);
 	list = &mz->lruvec.lists[lru];
 
@@ -3712,19 +4468,19 @@ static bool mem_cgroup_force_empty_list(struct mem_cgroup *memcg,
 		struct page_cgroup *pc;
 		struct page *page;
 
-		spin_lock_irqsave(&zone->lru_lock, flags);
+		spin_lock_irqsave(&mz->lruvec.lru_lock, flags);
 		if (list_empty(list)) {
-			spin_unlock_irqrestore(&zone->lru_lock, flags);
+			spin_unlock_irqrestore(&mz->lruvec.lru_lock, flags);
 			break;
 		}
 		page = list_entry(list->prev, struct page, lru);
 		if (busy == page) {
 			list_move(&page->lru, list);
 			busy = NULL;
-			spin_unlock_irqrestore(&zone->lru_lock, flags);
+			spin_unlock_irqrestore(&mz->lruvec.lru_lock, flags);
 			continue;
 		}
-		spin_unlock_irqrestore(&zone->lru_lock, flags);
+		spin_unlock_irqrestore(&mz->lruvec.lru_lock, flags);
 
 		pc = lookup_page_cgroup(page);
 
@@ -3748,6 +4504,7 @@ static int mem_cgroup_force_empty(struct mem_cgroup *memcg, bool free_all)
 	int node, zid, shrink;
 	int nr_retries = MEM_CGROUP_RECLAIM_RETRIES;
 	struct cgroup *cgrp = memcg->css.cgroup;
+	u64 usage;
 
 	css_get(&memcg->css);
 
@@ -3781,8 +4538,16 @@ move_account:
 		mem_cgroup_end_move(memcg);
 		memcg_oom_recover(memcg);
 		cond_resched();
+		/*
+		 * Kernel memory may not necessarily be trackable to a specific
+		 * process. So they are not migrated, and therefore we can't
+		 * expect their value to drop to 0 here.
+		 * Having res filled up with kmem only is enough.
+		 */
+		usage = res_counter_read_u64(&memcg->res, RES_USAGE) -
+			res_counter_read_u64(&memcg->kmem, RES_USAGE);
 	/* "ret" should also be checked to ensure all lists are empty. */
-	} while (res_counter_read_u64(&memcg->res, RES_USAGE) > 0 || ret);
+	} while (usage > 0 || ret);
 out:
 	css_put(&memcg->css);
 	return ret;
@@ -3797,7 +4562,8 @@ try_to_free:
 	lru_add_drain_all();
 	/* try to free all pages in this cgroup */
 	shrink = 1;
-	while (nr_retries && res_counter_read_u64(&memcg->res, RES_USAGE) > 0) {
+	while (nr_retries && res_counter_read_u64(&memcg->res, RES_USAGE) -
+			    res_counter_read_u64(&memcg->kmem, RES_USAGE) > 0) {
 		int progress;
 
 		if (signal_pending(current)) {
@@ -3904,6 +4670,98 @@ static inline u64 mem_cgroup_usage(struct mem_cgroup *memcg, bool swap)
 	return val << PAGE_SHIFT;
 }
 
+static int memcg_update_kmem_limit(struct cgroup *cont, u64 val)
+{
+	int ret = -EINVAL;
+#ifdef CONFIG_MEMCG_KMEM
+	struct mem_cgroup *memcg = mem_cgroup_from_cont(cont);
+	bool must_inc_static_branch = false;
+
+	/*
+	 * For simplicity, we won't allow this to be disabled.  It also can't
+	 * be changed if the cgroup has children already, or if tasks had
+	 * already joined.
+	 *
+	 * If tasks join before we set the limit, a person looking at
+	 * kmem.usage_in_bytes will have no way to determine when it took
+	 * place, which makes the value quite meaningless.
+	 *
+	 * After it first became limited, changes in the value of the limit are
+	 * of course permitted.
+	 *
+	 * Taking the cgroup_lock is really offensive, but it is so far the only
+	 * way to guarantee that no children will appear.
+	 */
+	cgroup_lock();
+	mutex_lock(&set_limit_mutex);
+	if (!memcg_kmem_is_active(memcg) && val != RESOURCE_MAX) {
+		if (cgroup_task_count(cont) || (memcg->use_hierarchy &&
+						!list_empty(&cont->children))) {
+			ret = -EBUSY;
+			goto out;
+		}
+		ret = res_counter_set_limit(&memcg->kmem, val);
+		VM_BUG_ON(ret);
+
+		ret = memcg_update_cache_sizes(memcg);
+		if (ret) {
+			res_counter_set_limit(&memcg->kmem, RESOURCE_MAX);
+			goto out;
+		}
+		set_bit(KMEM_ACCOUNTED_ACTIVATED, &memcg->kmem_account_flags);
+		must_inc_static_branch = true;
+		/*
+		 * kmem charges can outlive the cgroup. In the case of slab
+		 * pages, for instance, a page contain objects from various
+		 * processes, so it is unfeasible to migrate them away. We
+		 * need to reference count the memcg because of that.
+		 */
+		mem_cgroup_get(memcg);
+	} else
+		ret = res_counter_set_limit(&memcg->kmem, val);
+out:
+	mutex_unlock(&set_limit_mutex);
+	cgroup_unlock();
+
+	/*
+	 * We can't inc the static branch inside cgroup_lock, see free_work()
+	 * for details. No rollback is needed after this point, so deferring
+	 * it is safe; only one writer could have activated the group.
+	 */
+	if (must_inc_static_branch)
+		static_key_slow_inc(&memcg_kmem_enabled_key);
+#endif
+	return ret;
+}
+
+#ifdef CONFIG_MEMCG_KMEM
+/*
+ * Children of a kmem-limited group are accounted as well, their charges
+ * propagate up to the limit set above them.  The static key is left to
+ * the group that set the limit: we are under cgroup_lock here, and the
+ * child holds a reference on its parent anyway.
+ */
+static int memcg_propagate_kmem(struct mem_cgroup *memcg)
+{
+	struct mem_cgroup *parent = parent_mem_cgroup(memcg);
+	int ret;
+
+	memcg->kmemcg_id = -1;
+	if (!parent || !memcg_kmem_is_active(parent))
+		return 0;
+
+	mutex_lock(&set_limit_mutex);
+	ret = memcg_update_cache_sizes(memcg);
+	mutex_unlock(&set_limit_mutex);
+	if (ret)
+		return ret;
+
+	/* dropped once the kmem charges are gone, see kmem_cgroup_destroy() */
+	mem_cgroup_get(memcg);
+	return 0;
+}
+#endif
+
 static ssize_t mem_cgroup_read(struct cgroup *cont, struct cftype *cft,
 			       struct file *file, char __user *buf,
 			       size_t nbytes, loff_t *ppos)
@@ -3932,6 +4790,9 @@ static ssize_t mem_cgroup_read(struct cgroup *cont, struct cftype *cft,
 		else
 			val = res_counter_read_u64(&memcg->memsw, name);
 		break;
+	case _KMEM:
+		val = res_counter_read_u64(&memcg->kmem, name);
+		break;
 	default:
 		BUG();
 	}
@@ -3969,8 +4830,12 @@ static int mem_cgroup_write(struct cgroup *cont, struct cftype *cft,
 			break;
 		if (type == _MEM)
 			ret = mem_cgroup_resize_limit(memcg, val);
-		else
+		else if (type == _MEMSWAP)
 			ret = mem_cgroup_resize_memsw_limit(memcg, val);
+		else if (type == _KMEM)
+			ret = memcg_update_kmem_limit(cont, val);
+		else
+			return -EINVAL;
 		break;
 	case RES_SOFT_LIMIT:
 		ret = res_counter_memparse_write_strategy(buffer, &val);
@@ -4035,14 +4900,22 @@ static int mem_cgroup_reset(struct cgroup *cont, unsigned int event)
 	case RES_MAX_USAGE:
 		if (type == _MEM)
 			res_counter_reset_max(&memcg->res);
-		else
+		else if (type == _MEMSWAP)
 			res_counter_reset_max(&memcg->memsw);
+		else if (type == _KMEM)
+			res_counter_reset_max(&memcg->kmem);
+		else
+			return -EINVAL;
 		break;
 	case RES_FAILCNT:
 		if (type == _MEM)
 			res_counter_reset_failcnt(&memcg->res);
-		else
+		else if (type == _MEMSWAP)
 			res_counter_reset_failcnt(&memcg->memsw);
+		else if (type == _KMEM)
+			res_counter_reset_failcnt(&memcg->kmem);
+		else
+			return -EINVAL;
 		break;
 	}
 
@@ -4604,12 +5477,36 @@ static int mem_cgroup_oom_control_write(struct cgroup *cgrp,
 #ifdef CONFIG_MEMCG_KMEM
 static int memcg_init_kmem(struct mem_cgroup *memcg, struct cgroup_subsys *ss)
 {
-	return mem_cgroup_sockets_init(memcg, ss);
+	int ret;
+
+	ret = mem_cgroup_sockets_init(memcg, ss);
+	if (ret)
+		return ret;
+
+	ret = memcg_propagate_kmem(memcg);
+	if (ret)
+		mem_cgroup_sockets_destroy(memcg);
+	return ret;
 };
 
 static void kmem_cgroup_destroy(struct mem_cgroup *memcg)
 {
 	mem_cgroup_sockets_destroy(memcg);
+
+	mem_cgroup_destroy_all_caches(memcg);
+	memcg_kmem_mark_dead(memcg);
+
+	if (res_counter_read_u64(&memcg->kmem, RES_USAGE) != 0)
+		return;
+
+	/*
+	 * Charges already down to 0, undo mem_cgroup_get() done at
+	 * activation, being careful not to race with memcg_uncharge_kmem:
+	 * the charges may have gone down to 0 between mark_dead and the
+	 * res_counter read, in which case the put was already done there.
+	 */
+	if (memcg_kmem_test_and_clear_dead(memcg))
+		mem_cgroup_put(memcg);
 }
 #else
 static int memcg_init_kmem(struct mem_cgroup *memcg, struct cgroup_subsys *ss)
@@ -4717,6 +5614,31 @@ static struct cftype mem_cgroup_files[] = {
 		.trigger = mem_cgroup_reset,
 		.read = mem_cgroup_read,
 	},
+#endif
+#ifdef CONFIG_MEMCG_KMEM
+	{
+		.name = "kmem.limit_in_bytes",
+		.private = MEMFILE_PRIVATE(_KMEM, RES_LIMIT),
+		.write_string = mem_cgroup_write,
+		.read = mem_cgroup_read,
+	},
+	{
+		.name = "kmem.usage_in_bytes",
+		.private = MEMFILE_PRIVATE(_KMEM, RES_USAGE),
+		.read = mem_cgroup_read,
+	},
+	{
+		.name = "kmem.failcnt",
+		.private = MEMFILE_PRIVATE(_KMEM, RES_FAILCNT),
+		.trigger = mem_cgroup_reset,
+		.read = mem_cgroup_read,
+	},
+	{
+		.name = "kmem.max_usage_in_bytes",
+		.private = MEMFILE_PRIVATE(_KMEM, RES_MAX_USAGE),
+		.trigger = mem_cgroup_reset,
+		.read = mem_cgroup_read,
+	},
 #endif
 	{ },	/* terminate */
 };
@@ -4793,6 +5715,7 @@ static void free_work(struct work_struct *work)
 {
 	struct mem_cgroup *memcg;
 	int size = sizeof(struct mem_cgroup);
+	int node;
 
 	memcg = container_of(work, struct mem_cgroup, work_freeing);
 	/*
@@ -4806,7 +5729,13 @@ static void free_work(struct work_struct *work)
 	 * to move this code around, and make sure it is outside
 	 * the cgroup_lock.
 	 */
-	disarm_sock_keys(memcg);
+	disarm_static_keys(memcg);
+	/*
+	 * The per-zone lruvecs go with it: lock_page_lruvec_irq() may still
+	 * be spinning on one of their lru_locks under rcu_read_lock().
+	 */
+	for_each_node(node)
+		free_mem_cgroup_per_zone_info(memcg, node);
 	if (size < PAGE_SIZE)
 		kfree(memcg);
 	else
@@ -4835,14 +5764,9 @@ static void free_rcu(struct rcu_head *rcu_head)
 
 static void __mem_cgroup_free(struct mem_cgroup *memcg)
 {
-	int node;
-
 	mem_cgroup_remove_from_trees(memcg);
 	free_css_id(&mem_cgroup_subsys, &memcg->css);
 
-	for_each_node(node)
-		free_mem_cgroup_per_zone_info(memcg, node);
-
 	free_percpu(memcg->stat);
 	call_rcu(&memcg->rcu_freeing, free_rcu);
 }
@@ -4963,6 +5887,7 @@ mem_cgroup_create(struct cgroup *cont)
 	if (parent && parent->use_hierarchy) {
 		res_counter_init(&memcg->res, &parent->res);
 		res_counter_init(&memcg->memsw, &parent->memsw);
+		res_counter_init(&memcg->kmem, &parent->kmem);
 		/*
 		 * We increment refcnt of the parent to ensure that we can
 		 * safely access it on res_counter_charge/uncharge.
@@ -4973,6 +5898,7 @@ mem_cgroup_create(struct cgroup *cont)
 	} else {
 		res_counter_init(&memcg->res, NULL);
 		res_counter_init(&memcg->memsw, NULL);
+		res_counter_init(&memcg->kmem, NULL);
 	}
 	memcg->last_scanned_node = MAX_NUMNODES;
 	INIT_LIST_HEAD(&memcg->oom_notify);
@@ -5165,16 +6091,20 @@ static struct page *mc_handle_file_pte(struct vm_area_struct *vma,
 		pgoff = pte_to_pgoff(ptent);
 
 	/* page is moved even if it's not RSS of this task(page-faulted). */
-	page = find_get_page(mapping, pgoff);
-
 #ifdef CONFIG_SWAP
 	/* shmem/tmpfs may report page out on swap: account for that too. */
-	if (radix_tree_exceptional_entry(page)) {
-		swp_entry_t swap = radix_to_swp_entry(page);
-		if (do_swap_account)
-			*entry = swap;
-		page = find_get_page(&swapper_space, swap.val);
-	}
+	if (shmem_mapping(mapping)) {
+		page = find_get_entry(mapping, pgoff);
+		if (radix_tree_exceptional_entry(page)) {
+			swp_entry_t swap = radix_to_swp_entry(page);
+			if (do_swap_account)
+				*entry = swap;
+			page = find_get_page(&swapper_space, swap.val);
+		}
+	} else
+		page = find_get_page(mapping, pgoff);
+#else
+	page = find_get_page(mapping, pgoff);
 #endif
 	return page;
 }
@@ -1538,6 +1538,65 @@ struct mempolicy *get_vma_policy(struct task_struct *task,
 	return pol;
 }
 
+#ifdef CONFIG_NUMA_BALANCING
+/*
+ * change_prot_numa - turn the PTEs of a range into NUMA hinting PTEs
+ *
+ * The next access to each of the pages will trap into do_numa_page(),
+ * telling which node uses it.  Returns the number of PTEs updated.
+ */
+unsigned long change_prot_numa(struct vm_area_struct *vma,
+			unsigned long addr, unsigned long end)
+{
+	unsigned long nr_updated;
+
+	nr_updated = change_protection(vma, addr, end, vma->vm_page_prot, 0, 1);
+	if (nr_updated)
+		count_vm_numa_events(NUMA_PTE_UPDATES, nr_updated);
+
+	return nr_updated;
+}
+#endif /* CONFIG_NUMA_BALANCING */
+
+/**
+ * mpol_misplaced - check whether current page node is valid in policy
+ *
+ * @page   - page to be checked
+ * @vma    - vm area where page mapped
+ * @addr   - virtual address where page mapped
+ *
+ * Lookup current policy node id for vma,addr and "compare to" page's
+ * node id.  Only the default, local allocation policy asks for pages
+ * to follow the tasks using them: explicit policies are left alone.
+ *
+ * Returns:
+ *	-1	- not misplaced, page is in the right node
+ *	node	- node id where the page should be
+ *
+ * Policy determination "mimics" alloc_page_vma().
+ * Called from fault path where we know the vma and faulting address.
+ */
+int mpol_misplaced(struct page *page, struct vm_area_struct *vma,
+		   unsigned long addr)
+{
+	struct mempolicy *pol;
+	int curnid = page_to_nid(page);
+	int polnid;
+	int ret = -1;
+
+	pol = get_vma_policy(current, vma, addr);
+	if (pol->mode != MPOL_PREFERRED || !(pol->flags & MPOL_F_LOCAL))
+		goto out;
+
+	polnid = numa_node_id();
+	if (curnid != polnid)
+		ret = polnid;
+out:
+	mpol_cond_put(pol);
+
+	return ret;
+}
+
 /*
  * Return a nodemask representing a mempolicy for filtering nodes for
  * page allocation
@@ -93,6 +93,7 @@ void lruvec_init(struct lruvec *lruvec, struct zone *zone)
 
 	memset(lruvec, 0, sizeof(struct lruvec));
 
+	spin_lock_init(&lruvec->lru_lock);
 	for_each_lru(lru)
 		INIT_LIST_HEAD(&lruvec->lists[lru]);
 
@@ -27,7 +27,125 @@ extern enum slab_state slab_state;
 extern struct mutex slab_mutex;
 extern struct list_head slab_caches;
 
+struct mem_cgroup;
 struct kmem_cache *__kmem_cache_create(const char *name, size_t size,
-	size_t align, unsigned long flags, void (*ctor)(void *));
+	size_t align, unsigned long flags, void (*ctor)(void *),
+	struct mem_cgroup *memcg);
+
+/* Generic bulk operations, for allocators without an optimized version */
+int __kmem_cache_alloc_bulk(struct kmem_cache *s, gfp_t flags, size_t nr,
+			    void **p);
+void __kmem_cache_free_bulk(struct kmem_cache *s, size_t nr, void **p);
+
+#ifdef CONFIG_MEMCG_KMEM
+#include <linux/mm.h>
+#include <linux/memcontrol.h>
+
+static inline bool is_root_cache(struct kmem_cache *s)
+{
+	return !s->memcg_params || s->memcg_params->is_root_cache;
+}
+
+/*
+ * Slab pages of a memcg copy are charged to its cgroup, root caches
+ * are not accounted.
+ */
+static inline int memcg_charge_slab(struct kmem_cache *s, gfp_t gfp, int order)
+{
+	if (is_root_cache(s))
+		return 0;
+	return __memcg_charge_slab(s, gfp, order);
+}
+
+static inline void memcg_uncharge_slab(struct kmem_cache *s, int order)
+{
+	if (is_root_cache(s))
+		return;
+	__memcg_uncharge_slab(s, order);
+}
+
+static inline struct kmem_cache *page_slab_cache(struct page *page)
+{
+#ifdef CONFIG_SLUB
+	return page->slab;
+#else
+	return page->slab_cache;
+#endif
+}
+
+/*
+ * Objects allocated from a memcg copy are freed through the root cache
+ * the caller knows about: find the cache that really holds @x.
+ */
+static inline struct kmem_cache *cache_from_obj(struct kmem_cache *s, void *x)
+{
+	struct kmem_cache *cachep;
+
+	if (!memcg_kmem_enabled())
+		return s;
+
+	cachep = page_slab_cache(virt_to_head_page(x));
+	if (likely(cachep == s))
+		return s;
+	if (!is_root_cache(cachep) && cachep->memcg_params->root_cache == s)
+		return cachep;
+
+	WARN_ONCE(1, "%s: Wrong slab cache. %s but object is from %s\n",
+		  __func__, s->name, cachep->name);
+	return s;
+}
+
+/*
+ * The kmem id of the cgroup @x is charged to, or -1 for anything that
+ * was not allocated from a memcg copy.
+ */
+static inline int memcg_cache_id_from_obj(void *x)
+{
+	struct page *page = virt_to_head_page(x);
+	struct kmem_cache *s;
+
+	if (!PageSlab(page))
+		return -1;
+	s = page_slab_cache(page);
+	if (is_root_cache(s))
+		return -1;
+	return memcg_cache_id(s->memcg_params->memcg);
+}
+#else
+static inline bool is_root_cache(struct kmem_cache *s)
+{
+	return true;
+}
+
+static inline int memcg_charge_slab(struct kmem_cache *s, gfp_t gfp, int order)
+{
+	return 0;
+}
+
+static inline void memcg_uncharge_slab(struct kmem_cache *s, int order)
+{
+}
+
+static inline struct kmem_cache *cache_from_obj(struct kmem_cache *s, void *x)
+{
+	return s;
+}
+
+static inline int memcg_cache_id_from_obj(void *x)
+{
+	return -1;
+}
+
+static inline int memcg_register_cache(struct mem_cgroup *memcg,
+				       struct kmem_cache *s,
+				       struct kmem_cache *root_cache)
+{
+	return 0;
+}
+
+static inline void memcg_release_cache(struct kmem_cache *s)
+{
+}
+#endif /* CONFIG_MEMCG_KMEM */
 
 #endif
@@ -13,6 +13,7 @@
 #include <linux/module.h>
 #include <linux/cpu.h>
 #include <linux/uaccess.h>
+#include <linux/memcontrol.h>
 #include <asm/cacheflush.h>
 #include <asm/tlbflush.h>
 #include <asm/page.h>
@@ -46,10 +47,15 @@ DEFINE_MUTEX(slab_mutex);
  * %SLAB_HWCACHE_ALIGN - Align the objects in this cache to a hardware
  * cacheline.  This can be beneficial if you're counting cycles as closely
  * as davem.
+ *
+ * kmem_cache_create_memcg() creates the copy of @parent_cache that holds
+ * the objects charged to @memcg, it is only called by the memcg core.
  */
 
-struct kmem_cache *kmem_cache_create(const char *name, size_t size, size_t align,
-		unsigned long flags, void (*ctor)(void *))
+struct kmem_cache *
+kmem_cache_create_memcg(struct mem_cgroup *memcg, const char *name, size_t size,
+			size_t align, unsigned long flags, void (*ctor)(void *),
+			struct kmem_cache *parent_cache)
 {
 	struct kmem_cache *s = NULL;
 
@@ -96,7 +102,15 @@ struct kmem_cache *kmem_cache_create(const char *name, size_t size, size_t align
 	WARN_ON(strchr(name, ' '));	/* It confuses parsers */
 #endif
 
-	s = __kmem_cache_create(name, size, align, flags, ctor);
+	s = __kmem_cache_create(name, size, align, flags, ctor, memcg);
+
+	if (s && memcg_register_cache(memcg, s, parent_cache)) {
+		mutex_unlock(&slab_mutex);
+		put_online_cpus();
+		kmem_cache_destroy(s);
+		s = NULL;
+		goto out;
+	}
 
 #ifdef CONFIG_DEBUG_VM
 oops:
@@ -104,16 +118,78 @@ oops:
 	mutex_unlock(&slab_mutex);
 	put_online_cpus();
 
-#ifdef CONFIG_DEBUG_VM
 out:
-#endif
 	if (!s && (flags & SLAB_PANIC))
 		panic("kmem_cache_create: Failed to create slab '%s'\n", name);
 
 	return s;
 }
+
+struct kmem_cache *kmem_cache_create(const char *name, size_t size, size_t align,
+		unsigned long flags, void (*ctor)(void *))
+{
+	return kmem_cache_create_memcg(NULL, name, size, align, flags, ctor, NULL);
+}
 EXPORT_SYMBOL(kmem_cache_create);
 
+#ifdef CONFIG_MEMCG_KMEM
+/*
+ * Make room for @num_memcgs copies in every root cache, called by the
+ * memcg core before it hands out a new kmem id.
+ */
+int memcg_update_all_caches(int num_memcgs)
+{
+	struct kmem_cache *s;
+	int ret = 0;
+
+	mutex_lock(&slab_mutex);
+	if (num_memcgs <= memcg_limited_groups_array_size)
+		goto out;
+
+	list_for_each_entry(s, &slab_caches, list) {
+		if (!s->memcg_params || !s->memcg_params->is_root_cache)
+			continue;
+
+		/*
+		 * Caches updated so far just keep their bigger array,
+		 * the next update will resize them again anyway.
+		 */
+		ret = memcg_update_cache_size(s, num_memcgs);
+		if (ret)
+			goto out;
+	}
+
+	memcg_update_array_size(num_memcgs);
+out:
+	mutex_unlock(&slab_mutex);
+	return ret;
+}
+#endif
+
+void __kmem_cache_free_bulk(struct kmem_cache *s, size_t nr, void **p)
+{
+	size_t i;
+
+	for (i = 0; i < nr; i++)
+		kmem_cache_free(s, p[i]);
+}
+
+int __kmem_cache_alloc_bulk(struct kmem_cache *s, gfp_t flags, size_t nr,
+			    void **p)
+{
+	size_t i;
+
+	for (i = 0; i < nr; i++) {
+		void *x = p[i] = kmem_cache_alloc(s, flags);
+
+		if (!x) {
+			__kmem_cache_free_bulk(s, i, p);
+			return 0;
+		}
+	}
+	return i;
+}
+
 int slab_is_available(void)
 {
 	return slab_state >= UP;
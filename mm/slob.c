@@ -509,7 +509,8 @@ size_t ksize(const void *block)
 EXPORT_SYMBOL(ksize);
 
 struct kmem_cache *__kmem_cache_create(const char *name, size_t size,
-	size_t align, unsigned long flags, void (*ctor)(void *))
+	size_t align, unsigned long flags, void (*ctor)(void *),
+	struct mem_cgroup *memcg)
 {
 	struct kmem_cache *c;
 
@@ -607,6 +608,19 @@ void kmem_cache_free(struct kmem_cache *c, void *b)
 }
 EXPORT_SYMBOL(kmem_cache_free);
 
+void kmem_cache_free_bulk(struct kmem_cache *c, size_t nr, void **p)
+{
+	__kmem_cache_free_bulk(c, nr, p);
+}
+EXPORT_SYMBOL(kmem_cache_free_bulk);
+
+int kmem_cache_alloc_bulk(struct kmem_cache *c, gfp_t flags, size_t nr,
+			  void **p)
+{
+	return __kmem_cache_alloc_bulk(c, flags, nr, p);
+}
+EXPORT_SYMBOL(kmem_cache_alloc_bulk);
+
 unsigned int kmem_cache_size(struct kmem_cache *c)
 {
 	return c->size;
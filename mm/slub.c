@@ -1256,17 +1256,26 @@ static inline void slab_free_hook(struct kmem_cache *s, void *x) {}
 /*
  * Slab allocation and freeing
  */
-static inline struct page *alloc_slab_page(gfp_t flags, int node,
-					struct kmem_cache_order_objects oo)
+static inline struct page *alloc_slab_page(struct kmem_cache *s,
+		gfp_t flags, int node, struct kmem_cache_order_objects oo)
 {
+	struct page *page;
 	int order = oo_order(oo);
 
 	flags |= __GFP_NOTRACK;
 
+	if (memcg_charge_slab(s, flags, order))
+		return NULL;
+
 	if (node == NUMA_NO_NODE)
-		return alloc_pages(flags, order);
+		page = alloc_pages(flags, order);
 	else
-		return alloc_pages_exact_node(node, flags, order);
+		page = alloc_pages_exact_node(node, flags, order);
+
+	if (!page)
+		memcg_uncharge_slab(s, order);
+
+	return page;
 }
 
 static struct page *allocate_slab(struct kmem_cache *s, gfp_t flags, int node)
@@ -1288,14 +1297,14 @@ static struct page *allocate_slab(struct kmem_cache *s, gfp_t flags, int node)
 	 */
 	alloc_gfp = (flags | __GFP_NOWARN | __GFP_NORETRY) & ~__GFP_NOFAIL;
 
-	page = alloc_slab_page(alloc_gfp, node, oo);
+	page = alloc_slab_page(s, alloc_gfp, node, oo);
 	if (unlikely(!page)) {
 		oo = s->min;
 		/*
 		 * Allocation may have failed due to fragmentation.
 		 * Try a lower order alloc if possible
 		 */
-		page = alloc_slab_page(flags, node, oo);
+		page = alloc_slab_page(s, flags, node, oo);
 
 		if (page)
 			stat(s, ORDER_FALLBACK);
@@ -1407,6 +1416,7 @@ static void __free_slab(struct kmem_cache *s, struct page *page)
 	if (current->reclaim_state)
 		current->reclaim_state->reclaimed_slab += pages;
 	__free_pages(page, order);
+	memcg_uncharge_slab(s, order);
 }
 
 #define need_reserve_slab_rcu						\
@@ -2316,6 +2326,7 @@ static __always_inline void *slab_alloc(struct kmem_cache *s,
 	if (slab_pre_alloc_hook(s, gfpflags))
 		return NULL;
 
+	s = memcg_kmem_get_cache(s, gfpflags);
 redo:
 
 	/*
@@ -2605,6 +2616,7 @@ void kmem_cache_free(struct kmem_cache *s, void *x)
 {
 	struct page *page;
 
+	s = cache_from_obj(s, x);
 	page = virt_to_head_page(x);
 
 	slab_free(s, page, x, _RET_IP_);
@@ -2613,6 +2625,108 @@ void kmem_cache_free(struct kmem_cache *s, void *x)
 }
 EXPORT_SYMBOL(kmem_cache_free);
 
+/*
+ * Bulk operations work on the cpu slab with interrupts disabled instead
+ * of doing one cmpxchg per object.  Without the cmpxchg the transaction
+ * id has to be advanced by hand, before interrupts are enabled again,
+ * so that a fastpath that was interrupted on this cpu retries.
+ */
+void kmem_cache_free_bulk(struct kmem_cache *orig_s, size_t nr, void **p)
+{
+	struct kmem_cache *s = NULL;
+	struct kmem_cache_cpu *c = NULL;
+	unsigned long flags;
+	size_t i;
+
+	local_irq_save(flags);
+	for (i = 0; i < nr; i++) {
+		void *object = p[i];
+		struct kmem_cache *cachep = cache_from_obj(orig_s, object);
+		struct page *page = virt_to_head_page(object);
+
+		/* memcg copies have cpu slabs of their own */
+		if (cachep != s) {
+			if (c)
+				c->tid = next_tid(c->tid);
+			s = cachep;
+			c = this_cpu_ptr(s->cpu_slab);
+		}
+
+		slab_free_hook(s, object);
+
+		if (likely(page == c->page)) {
+			set_freepointer(s, object, c->freelist);
+			c->freelist = object;
+			stat(s, FREE_FASTPATH);
+		} else {
+			c->tid = next_tid(c->tid);
+			local_irq_restore(flags);
+			__slab_free(s, page, object, _RET_IP_);
+			local_irq_save(flags);
+			c = this_cpu_ptr(s->cpu_slab);
+		}
+	}
+	if (c)
+		c->tid = next_tid(c->tid);
+	local_irq_restore(flags);
+}
+EXPORT_SYMBOL(kmem_cache_free_bulk);
+
+int kmem_cache_alloc_bulk(struct kmem_cache *s, gfp_t gfpflags, size_t nr,
+			  void **p)
+{
+	struct kmem_cache_cpu *c;
+	unsigned long flags;
+	size_t i;
+
+	if (slab_pre_alloc_hook(s, gfpflags))
+		return 0;
+
+	s = memcg_kmem_get_cache(s, gfpflags);
+
+	local_irq_save(flags);
+	c = this_cpu_ptr(s->cpu_slab);
+
+	for (i = 0; i < nr; i++) {
+		void *object = c->freelist;
+
+		if (unlikely(!object)) {
+			/*
+			 * The slow path may enable interrupts to allocate a
+			 * new slab, and we may come back on another cpu.
+			 */
+			c->tid = next_tid(c->tid);
+			p[i] = __slab_alloc(s, gfpflags, NUMA_NO_NODE,
+					    _RET_IP_, c);
+			if (unlikely(!p[i]))
+				goto error;
+			c = this_cpu_ptr(s->cpu_slab);
+			continue;
+		}
+		c->freelist = get_freepointer(s, object);
+		p[i] = object;
+		stat(s, ALLOC_FASTPATH);
+	}
+	c->tid = next_tid(c->tid);
+	local_irq_restore(flags);
+
+	for (i = 0; i < nr; i++) {
+		if (unlikely(gfpflags & __GFP_ZERO))
+			memset(p[i], 0, s->object_size);
+		slab_post_alloc_hook(s, gfpflags, p[i]);
+	}
+	return nr;
+
+error:
+	local_irq_restore(flags);
+	nr = i;
+	for (i = 0; i < nr; i++)
+		slab_post_alloc_hook(s, gfpflags, p[i]);
+	kmem_cache_free_bulk(s, nr, p);
+	return 0;
+}
+EXPORT_SYMBOL(kmem_cache_alloc_bulk);
+
 /*
  * Object placement in a slab is made very easy because we always start at
  * offset 0. If we tune the size of the object to the alignment then we can
@@ -3196,10 +3310,15 @@ static inline int kmem_cache_close(struct kmem_cache *s)
  */
 void kmem_cache_destroy(struct kmem_cache *s)
 {
+	/* Copies go away with the last user of the root cache */
+	if (s->refcount == 1)
+		kmem_cache_destroy_memcg_children(s);
+
 	mutex_lock(&slab_mutex);
 	s->refcount--;
 	if (!s->refcount) {
 		list_del(&s->list);
+		memcg_release_cache(s);
 		mutex_unlock(&slab_mutex);
 		if (kmem_cache_close(s)) {
 			printk(KERN_ERR "SLUB %s: %s called for cache that "
@@ -3884,6 +4003,10 @@ static int slab_unmergeable(struct kmem_cache *s)
 	if (s->refcount < 0)
 		return 1;
 
+	/* Objects of a memcg copy are charged to its cgroup */
+	if (!is_root_cache(s))
+		return 1;
+
 	return 0;
 }
 
@@ -3929,12 +4052,14 @@ static struct kmem_cache *find_mergeable(size_t size,
 }
 
 struct kmem_cache *__kmem_cache_create(const char *name, size_t size,
-		size_t align, unsigned long flags, void (*ctor)(void *))
+		size_t align, unsigned long flags, void (*ctor)(void *),
+		struct mem_cgroup *memcg)
 {
-	struct kmem_cache *s;
+	struct kmem_cache *s = NULL;
 	char *n;
 
-	s = find_mergeable(size, align, flags, name, ctor);
+	if (!memcg)
+		s = find_mergeable(size, align, flags, name, ctor);
 	if (s) {
 		s->refcount++;
 		/*
@@ -36,9 +36,40 @@
 /* How many pages do we try to swap or page in/out together? */
 int page_cluster;
 
-static DEFINE_PER_CPU(struct pagevec[NR_LRU_LISTS], lru_add_pvecs);
-static DEFINE_PER_CPU(struct pagevec, lru_rotate_pvecs);
-static DEFINE_PER_CPU(struct pagevec, lru_deactivate_pvecs);
+/*
+ * Per-cpu batches of pages waiting for an LRU operation.  They work like
+ * pagevecs, but the number of pages gathered before a flush adapts to
+ * how well the batch amortises the lru_lock, see lru_batch_adapt().
+ */
+
+/* 62 pointers + two long's align the lru_batch structure to a power of two */
+#define LRU_BATCH_SIZE	62
+
+struct lru_batch {
+	unsigned long nr;
+	unsigned long limit;	/* flush threshold, 0 means PAGEVEC_SIZE */
+	struct page *pages[LRU_BATCH_SIZE];
+};
+
+static DEFINE_PER_CPU(struct lru_batch[NR_LRU_LISTS], lru_add_batches);
+static DEFINE_PER_CPU(struct lru_batch, lru_rotate_batch);
+static DEFINE_PER_CPU(struct lru_batch, lru_deactivate_batch);
+
+static inline unsigned long lru_batch_limit(struct lru_batch *batch)
+{
+	return batch->limit ?: PAGEVEC_SIZE;
+}
+
+/*
+ * Add a page to a batch.  Returns the number of slots still available
+ * below the current flush threshold.
+ */
+static inline unsigned long lru_batch_add(struct lru_batch *batch,
+					  struct page *page)
+{
+	batch->pages[batch->nr++] = page;
+	return lru_batch_limit(batch) - batch->nr;
+}
 
 /*
  * This path almost never happens for VM activity - pages are normally
@@ -47,16 +78,14 @@ static DEFINE_PER_CPU(struct pagevec, lru_deactivate_pvecs);
 static void __page_cache_release(struct page *page)
 {
 	if (PageLRU(page)) {
-		struct zone *zone = page_zone(page);
 		struct lruvec *lruvec;
 		unsigned long flags;
 
-		spin_lock_irqsave(&zone->lru_lock, flags);
-		lruvec = mem_cgroup_page_lruvec(page, zone);
+		lruvec = lock_page_lruvec_irqsave(page, &flags);
 		VM_BUG_ON(!PageLRU(page));
 		__ClearPageLRU(page);
 		del_page_from_lru_list(page, lruvec, page_off_lru(page));
-		spin_unlock_irqrestore(&zone->lru_lock, flags);
+		spin_unlock_irqrestore(&lruvec->lru_lock, flags);
 	}
 }
 
@@ -288,35 +317,77 @@ int get_kernel_page(unsigned long start, int write, struct page **pages)
 }
 EXPORT_SYMBOL_GPL(get_kernel_page);
 
-static void pagevec_lru_move_fn(struct pagevec *pvec,
+/*
+ * Apply move_fn to each page under the lru_lock of its lruvec, keeping the
+ * lock across consecutive pages of the same lruvec.  Returns the number of
+ * times a lock had to be taken.
+ */
+static int lru_move_pages(struct page **pages, int nr,
 	void (*move_fn)(struct page *page, struct lruvec *lruvec, void *arg),
 	void *arg)
 {
-	int i;
-	struct zone *zone = NULL;
-	struct lruvec *lruvec;
+	struct lruvec *lruvec = NULL;
 	unsigned long flags = 0;
+	int nr_locks = 0;
+	int i;
 
-	for (i = 0; i < pagevec_count(pvec); i++) {
-		struct page *page = pvec->pages[i];
-		struct zone *pagezone = page_zone(page);
-
-		if (pagezone != zone) {
-			if (zone)
-				spin_unlock_irqrestore(&zone->lru_lock, flags);
-			zone = pagezone;
-			spin_lock_irqsave(&zone->lru_lock, flags);
-		}
+	for (i = 0; i < nr; i++) {
+		struct page *page = pages[i];
+		struct lruvec *locked = lruvec;
 
-		lruvec = mem_cgroup_page_lruvec(page, zone);
+		lruvec = relock_page_lruvec_irqsave(page, lruvec, &flags);
+		if (lruvec != locked)
+			nr_locks++;
 		(*move_fn)(page, lruvec, arg);
 	}
-	if (zone)
-		spin_unlock_irqrestore(&zone->lru_lock, flags);
+	if (lruvec)
+		spin_unlock_irqrestore(&lruvec->lru_lock, flags);
+
+	return nr_locks;
+}
+
+static void pagevec_lru_move_fn(struct pagevec *pvec,
+	void (*move_fn)(struct page *page, struct lruvec *lruvec, void *arg),
+	void *arg)
+{
+	lru_move_pages(pvec->pages, pagevec_count(pvec), move_fn, arg);
 	release_pages(pvec->pages, pvec->nr, pvec->cold);
 	pagevec_reinit(pvec);
 }
 
+/*
+ * A full batch that was flushed under a single lru_lock may grow, so that
+ * streaming workloads take the lock less often.  One whose pages were
+ * spread over several lruvecs gained little from its size and shrinks
+ * back towards PAGEVEC_SIZE: a bigger batch only keeps more pages away
+ * from reclaim and lengthens the irq-disabled flush.
+ */
+static void lru_batch_adapt(struct lru_batch *batch, int nr_locks)
+{
+	unsigned long limit = lru_batch_limit(batch);
+
+	if (batch->nr < limit)
+		return;
+
+	if (nr_locks == 1)
+		limit = min_t(unsigned long, limit * 2, LRU_BATCH_SIZE);
+	else
+		limit = max_t(unsigned long, limit / 2, PAGEVEC_SIZE);
+	batch->limit = limit;
+}
+
+static void lru_batch_move_fn(struct lru_batch *batch,
+	void (*move_fn)(struct page *page, struct lruvec *lruvec, void *arg),
+	void *arg)
+{
+	int nr_locks;
+
+	nr_locks = lru_move_pages(batch->pages, batch->nr, move_fn, arg);
+	release_pages(batch->pages, batch->nr, 0);
+	lru_batch_adapt(batch, nr_locks);
+	batch->nr = 0;
+}
+
 static void pagevec_move_tail_fn(struct page *page, struct lruvec *lruvec,
 				 void *arg)
 {
@@ -330,14 +401,14 @@ static void pagevec_move_tail_fn(struct page *page, struct lruvec *lruvec,
 }
 
 /*
- * pagevec_move_tail() must be called with IRQ disabled.
+ * lru_batch_move_tail() must be called with IRQ disabled.
  * Otherwise this may cause nasty races.
  */
-static void pagevec_move_tail(struct pagevec *pvec)
+static void lru_batch_move_tail(struct lru_batch *batch)
 {
 	int pgmoved = 0;
 
-	pagevec_lru_move_fn(pvec, pagevec_move_tail_fn, &pgmoved);
+	lru_batch_move_fn(batch, pagevec_move_tail_fn, &pgmoved);
 	__count_vm_events(PGROTATED, pgmoved);
 }
 
@@ -350,14 +421,14 @@ void rotate_reclaimable_page(struct page *page)
 {
 	if (!PageLocked(page) && !PageDirty(page) && !PageActive(page) &&
 	    !PageUnevictable(page) && PageLRU(page)) {
-		struct pagevec *pvec;
+		struct lru_batch *batch;
 		unsigned long flags;
 
 		page_cache_get(page);
 		local_irq_save(flags);
-		pvec = &__get_cpu_var(lru_rotate_pvecs);
-		if (!pagevec_add(pvec, page))
-			pagevec_move_tail(pvec);
+		batch = &__get_cpu_var(lru_rotate_batch);
+		if (!lru_batch_add(batch, page))
+			lru_batch_move_tail(batch);
 		local_irq_restore(flags);
 	}
 }
@@ -390,25 +461,25 @@ static void __activate_page(struct page *page, struct lruvec *lruvec,
 }
 
 #ifdef CONFIG_SMP
-static DEFINE_PER_CPU(struct pagevec, activate_page_pvecs);
+static DEFINE_PER_CPU(struct lru_batch, activate_page_batch);
 
 static void activate_page_drain(int cpu)
 {
-	struct pagevec *pvec = &per_cpu(activate_page_pvecs, cpu);
+	struct lru_batch *batch = &per_cpu(activate_page_batch, cpu);
 
-	if (pagevec_count(pvec))
-		pagevec_lru_move_fn(pvec, __activate_page, NULL);
+	if (batch->nr)
+		lru_batch_move_fn(batch, __activate_page, NULL);
 }
 
 void activate_page(struct page *page)
 {
 	if (PageLRU(page) && !PageActive(page) && !PageUnevictable(page)) {
-		struct pagevec *pvec = &get_cpu_var(activate_page_pvecs);
+		struct lru_batch *batch = &get_cpu_var(activate_page_batch);
 
 		page_cache_get(page);
-		if (!pagevec_add(pvec, page))
-			pagevec_lru_move_fn(pvec, __activate_page, NULL);
-		put_cpu_var(activate_page_pvecs);
+		if (!lru_batch_add(batch, page))
+			lru_batch_move_fn(batch, __activate_page, NULL);
+		put_cpu_var(activate_page_batch);
 	}
 }
 
@@ -419,11 +490,11 @@ static inline void activate_page_drain(int cpu)
 
 void activate_page(struct page *page)
 {
-	struct zone *zone = page_zone(page);
+	struct lruvec *lruvec;
 
-	spin_lock_irq(&zone->lru_lock);
-	__activate_page(page, mem_cgroup_page_lruvec(page, zone), NULL);
-	spin_unlock_irq(&zone->lru_lock);
+	lruvec = lock_page_lruvec_irq(page);
+	__activate_page(page, lruvec, NULL);
+	spin_unlock_irq(&lruvec->lru_lock);
 }
 #endif
 
@@ -440,20 +511,42 @@ void mark_page_accessed(struct page *page)
 			PageReferenced(page) && PageLRU(page)) {
 		activate_page(page);
 		ClearPageReferenced(page);
+		if (page_is_file_cache(page))
+			workingset_activation(page);
 	} else if (!PageReferenced(page)) {
 		SetPageReferenced(page);
 	}
 }
 EXPORT_SYMBOL(mark_page_accessed);
 
+static void __pagevec_lru_add_fn(struct page *page, struct lruvec *lruvec,
+				 void *arg)
+{
+	enum lru_list lru = (enum lru_list)arg;
+	int file = is_file_lru(lru);
+	int active = is_active_lru(lru);
+
+	VM_BUG_ON(PageActive(page));
+	VM_BUG_ON(PageUnevictable(page));
+	VM_BUG_ON(PageLRU(page));
+
+	SetPageLRU(page);
+	if (active)
+		SetPageActive(page);
+	add_page_to_lru_list(page, lruvec, lru);
+	update_page_reclaim_stat(lruvec, file, active);
+}
+
 void __lru_cache_add(struct page *page, enum lru_list lru)
 {
-	struct pagevec *pvec = &get_cpu_var(lru_add_pvecs)[lru];
+	struct lru_batch *batch = &get_cpu_var(lru_add_batches)[lru];
+
+	VM_BUG_ON(is_unevictable_lru(lru));
 
 	page_cache_get(page);
-	if (!pagevec_add(pvec, page))
-		__pagevec_lru_add(pvec, lru);
-	put_cpu_var(lru_add_pvecs);
+	if (!lru_batch_add(batch, page))
+		lru_batch_move_fn(batch, __pagevec_lru_add_fn, (void *)lru);
+	put_cpu_var(lru_add_batches);
 }
 EXPORT_SYMBOL(__lru_cache_add);
 
@@ -488,15 +581,13 @@ void lru_cache_add_lru(struct page *page, enum lru_list lru)
  */
 void add_page_to_unevictable_list(struct page *page)
 {
-	struct zone *zone = page_zone(page);
 	struct lruvec *lruvec;
 
-	spin_lock_irq(&zone->lru_lock);
-	lruvec = mem_cgroup_page_lruvec(page, zone);
+	lruvec = lock_page_lruvec_irq(page);
 	SetPageUnevictable(page);
 	SetPageLRU(page);
 	add_page_to_lru_list(page, lruvec, LRU_UNEVICTABLE);
-	spin_unlock_irq(&zone->lru_lock);
+	spin_unlock_irq(&lruvec->lru_lock);
 }
 
 /*
@@ -573,29 +664,30 @@ static void lru_deactivate_fn(struct page *page, struct lruvec *lruvec,
  */
 void lru_add_drain_cpu(int cpu)
 {
-	struct pagevec *pvecs = per_cpu(lru_add_pvecs, cpu);
-	struct pagevec *pvec;
-	int lru;
+	struct lru_batch *batches = per_cpu(lru_add_batches, cpu);
+	struct lru_batch *batch;
+	enum lru_list lru;
 
 	for_each_lru(lru) {
-		pvec = &pvecs[lru - LRU_BASE];
-		if (pagevec_count(pvec))
-			__pagevec_lru_add(pvec, lru);
+		batch = &batches[lru - LRU_BASE];
+		if (batch->nr)
+			lru_batch_move_fn(batch, __pagevec_lru_add_fn,
+					  (void *)lru);
 	}
 
-	pvec = &per_cpu(lru_rotate_pvecs, cpu);
-	if (pagevec_count(pvec)) {
+	batch = &per_cpu(lru_rotate_batch, cpu);
+	if (batch->nr) {
 		unsigned long flags;
 
 		/* No harm done if a racing interrupt already did this */
 		local_irq_save(flags);
-		pagevec_move_tail(pvec);
+		lru_batch_move_tail(batch);
 		local_irq_restore(flags);
 	}
 
-	pvec = &per_cpu(lru_deactivate_pvecs, cpu);
-	if (pagevec_count(pvec))
-		pagevec_lru_move_fn(pvec, lru_deactivate_fn, NULL);
+	batch = &per_cpu(lru_deactivate_batch, cpu);
+	if (batch->nr)
+		lru_batch_move_fn(batch, lru_deactivate_fn, NULL);
 
 	activate_page_drain(cpu);
 }
@@ -618,11 +710,11 @@ void deactivate_page(struct page *page)
 		return;
 
 	if (likely(get_page_unless_zero(page))) {
-		struct pagevec *pvec = &get_cpu_var(lru_deactivate_pvecs);
+		struct lru_batch *batch = &get_cpu_var(lru_deactivate_batch);
 
-		if (!pagevec_add(pvec, page))
-			pagevec_lru_move_fn(pvec, lru_deactivate_fn, NULL);
-		put_cpu_var(lru_deactivate_pvecs);
+		if (!lru_batch_add(batch, page))
+			lru_batch_move_fn(batch, lru_deactivate_fn, NULL);
+		put_cpu_var(lru_deactivate_batch);
 	}
 }
 
@@ -650,8 +742,8 @@ int lru_add_drain_all(void)
  * passed pages.  If it fell to zero then remove the page from the LRU and
  * free it.
  *
- * Avoid taking zone->lru_lock if possible, but if it is taken, retain it
- * for the remainder of the operation.
+ * Avoid taking an lru_lock if possible, but if it is taken, retain it
+ * for as long as the following pages belong to the same lruvec.
  *
  * The locking in this function is against shrink_inactive_list(): we recheck
  * the page count inside the lock to see whether shrink_inactive_list()
@@ -662,17 +754,17 @@ void release_pages(struct page **pages, int nr, int cold)
 {
 	int i;
 	LIST_HEAD(pages_to_free);
-	struct zone *zone = NULL;
-	struct lruvec *lruvec;
+	struct lruvec *lruvec = NULL;
 	unsigned long uninitialized_var(flags);
 
 	for (i = 0; i < nr; i++) {
 		struct page *page = pages[i];
 
 		if (unlikely(PageCompound(page))) {
-			if (zone) {
-				spin_unlock_irqrestore(&zone->lru_lock, flags);
-				zone = NULL;
+			if (lruvec) {
+				spin_unlock_irqrestore(&lruvec->lru_lock,
+						       flags);
+				lruvec = NULL;
 			}
 			put_compound_page(page);
 			continue;
@@ -682,17 +774,8 @@ void release_pages(struct page **pages, int nr, int cold)
 			continue;
 
 		if (PageLRU(page)) {
-			struct zone *pagezone = page_zone(page);
-
-			if (pagezone != zone) {
-				if (zone)
-					spin_unlock_irqrestore(&zone->lru_lock,
-									flags);
-				zone = pagezone;
-				spin_lock_irqsave(&zone->lru_lock, flags);
-			}
-
-			lruvec = mem_cgroup_page_lruvec(page, zone);
+			lruvec = relock_page_lruvec_irqsave(page, lruvec,
+							    &flags);
 			VM_BUG_ON(!PageLRU(page));
 			__ClearPageLRU(page);
 			del_page_from_lru_list(page, lruvec, page_off_lru(page));
@@ -700,8 +783,8 @@ void release_pages(struct page **pages, int nr, int cold)
 
 		list_add(&page->lru, &pages_to_free);
 	}
-	if (zone)
-		spin_unlock_irqrestore(&zone->lru_lock, flags);
+	if (lruvec)
+		spin_unlock_irqrestore(&lruvec->lru_lock, flags);
 
 	free_hot_cold_page_list(&pages_to_free, cold);
 }
@@ -737,8 +820,7 @@ void lru_add_page_tail(struct page *page, struct page *page_tail,
 	VM_BUG_ON(!PageHead(page));
 	VM_BUG_ON(PageCompound(page_tail));
 	VM_BUG_ON(PageLRU(page_tail));
-	VM_BUG_ON(NR_CPUS != 1 &&
-		  !spin_is_locked(&lruvec_zone(lruvec)->lru_lock));
+	VM_BUG_ON(NR_CPUS != 1 && !spin_is_locked(&lruvec->lru_lock));
 
 	SetPageLRU(page_tail);
 
@@ -777,24 +859,6 @@ void lru_add_page_tail(struct page *page, struct page *page_tail,
 }
 #endif /* CONFIG_TRANSPARENT_HUGEPAGE */
 
-static void __pagevec_lru_add_fn(struct page *page, struct lruvec *lruvec,
-				 void *arg)
-{
-	enum lru_list lru = (enum lru_list)arg;
-	int file = is_file_lru(lru);
-	int active = is_active_lru(lru);
-
-	VM_BUG_ON(PageActive(page));
-	VM_BUG_ON(PageUnevictable(page));
-	VM_BUG_ON(PageLRU(page));
-
-	SetPageLRU(page);
-	if (active)
-		SetPageActive(page);
-	add_page_to_lru_list(page, lruvec, lru);
-	update_page_reclaim_stat(lruvec, file, active);
-}
-
 /*
  * Add the passed pages to the LRU, then drop the caller's refcount
  * on them.  Reinitialises the caller's pagevec.
@@ -49,6 +49,68 @@ void do_invalidatepage(struct page *page, unsigned long offset)
 		(*invalidatepage)(page, offset);
 }
 
+static void clear_shadow_entry(struct address_space *mapping, pgoff_t index,
+			       void *entry)
+{
+	struct radix_tree_node *node;
+	void **slot;
+
+	spin_lock_irq(&mapping->tree_lock);
+	/*
+	 * Regular page slots are stabilized by the page lock even
+	 * without the tree itself locked.  These unlocked entries
+	 * need verification under the tree lock.
+	 */
+	if (__radix_tree_lookup(&mapping->page_tree, index, &node,
+				&slot) != entry)
+		goto unlock;
+	radix_tree_replace_slot(slot, NULL);
+	mapping->nrshadows--;
+	if (!node)
+		goto unlock;
+	workingset_node_shadows_dec(node);
+	/*
+	 * Don't track node without shadow entries.  Avoid acquiring
+	 * the list_lru lock if already untracked; the list_empty()
+	 * test is safe under the tree_lock.
+	 */
+	if (!workingset_node_shadows(node) &&
+	    !list_empty(&node->private_list))
+		list_lru_del(&workingset_shadow_nodes, &node->private_list);
+	__radix_tree_delete_node(&mapping->page_tree, node);
+unlock:
+	spin_unlock_irq(&mapping->tree_lock);
+}
+
+/*
+ * Remove the shadow entries that reclaim left in [start, end].  shmem
+ * swap entries are never counted in nrshadows, and so left alone.
+ */
+static void clear_shadow_entries(struct address_space *mapping,
+				 pgoff_t start, pgoff_t end)
+{
+	void *entries[PAGEVEC_SIZE];
+	pgoff_t indices[PAGEVEC_SIZE];
+	pgoff_t index = start;
+	unsigned int i, nr;
+
+	while (index <= end && mapping->nrshadows) {
+		nr = find_get_shadows(mapping, index, PAGEVEC_SIZE,
+				      entries, indices);
+		if (!nr)
+			break;
+		for (i = 0; i < nr; i++) {
+			index = indices[i];
+			if (index > end)
+				return;
+			clear_shadow_entry(mapping, index, entries[i]);
+		}
+		if (++index == 0)
+			break;
+		cond_resched();
+	}
+}
+
 static inline void truncate_partial_page(struct page *page, unsigned partial)
 {
 	zero_user_segment(page, partial, PAGE_CACHE_SIZE);
@@ -214,8 +276,12 @@ void truncate_inode_pages_range(struct address_space *mapping,
 	int i;
 
 	cleancache_invalidate_inode(mapping);
-	if (mapping->nrpages == 0)
-		return;
+	if (mapping->nrpages == 0) {
+		/* pairs with the smp_wmb() in page_cache_tree_delete() */
+		smp_rmb();
+		if (mapping->nrshadows == 0)
+			return;
+	}
 
 	BUG_ON((lend & (PAGE_CACHE_SIZE - 1)) != (PAGE_CACHE_SIZE - 1));
 	end = (lend >> PAGE_CACHE_SHIFT);
@@ -292,6 +358,11 @@ void truncate_inode_pages_range(struct address_space *mapping,
 		mem_cgroup_uncharge_end();
 		index++;
 	}
+	/*
+	 * All pages in the range are gone, so reclaim can't leave any
+	 * more shadow entries behind in it.
+	 */
+	clear_shadow_entries(mapping, start, end);
 	cleancache_invalidate_inode(mapping);
 }
 EXPORT_SYMBOL(truncate_inode_pages_range);
@@ -374,6 +445,7 @@ unsigned long invalidate_mapping_pages(struct address_space *mapping,
 		cond_resched();
 		index++;
 	}
+	clear_shadow_entries(mapping, start, end);
 	return count;
 }
 EXPORT_SYMBOL(invalidate_mapping_pages);
@@ -400,7 +472,7 @@ invalidate_complete_page2(struct address_space *mapping, struct page *page)
 
 	clear_page_mlock(page);
 	BUG_ON(page_has_private(page));
-	__delete_from_page_cache(page);
+	__delete_from_page_cache(page, NULL);
 	spin_unlock_irq(&mapping->tree_lock);
 	mem_cgroup_uncharge_cache_page(page);
 
@@ -500,6 +572,7 @@ int invalidate_inode_pages2_range(struct address_space *mapping,
 		cond_resched();
 		index++;
 	}
+	clear_shadow_entries(mapping, start, end);
 	cleancache_invalidate_inode(mapping);
 	return ret;
 }
@@ -27,6 +27,7 @@
 #include <linux/pfn.h>
 #include <linux/kmemleak.h>
 #include <linux/atomic.h>
+#include <linux/llist.h>
 #include <asm/uaccess.h>
 #include <asm/tlbflush.h>
 #include <asm/shmparam.h>
@@ -245,30 +246,45 @@ EXPORT_SYMBOL(vmalloc_to_pfn);
 
 /*** Global kva allocator ***/
 
-#define VM_LAZY_FREE	0x01
-#define VM_LAZY_FREEING	0x02
 #define VM_VM_AREA	0x04
 
+/*
+ * A vmap_area describes either an allocated range of KVA, linked into
+ * vmap_area_root and vmap_area_list, or a hole between allocated ranges,
+ * linked into free_vmap_area_root.  Lazily freed areas stay allocated
+ * until they have been purged.  Together the two trees always cover the
+ * whole address space, so an allocation only has to search the holes.
+ */
 struct vmap_area {
 	unsigned long va_start;
 	unsigned long va_end;
 	unsigned long flags;
 	struct rb_node rb_node;		/* address sorted rbtree */
 	struct list_head list;		/* address sorted list */
-	struct list_head purge_list;	/* "lazy purge" list */
+	struct llist_node purge_list;	/* "lazy purge" list */
 	struct vm_struct *vm;
-	struct rcu_head rcu_head;
+	unsigned long subtree_max_size;	/* largest hole in this subtree */
 };
 
 static DEFINE_SPINLOCK(vmap_area_lock);
 static LIST_HEAD(vmap_area_list);
 static struct rb_root vmap_area_root = RB_ROOT;
 
-/* The vmap cache globals are protected by vmap_area_lock */
-static struct rb_node *free_vmap_cache;
-static unsigned long cached_hole_size;
-static unsigned long cached_vstart;
-static unsigned long cached_align;
+/*
+ * Holes sorted by address, augmented with the largest hole size of each
+ * subtree so that the lowest fitting hole is found in O(log n).
+ * Protected by vmap_area_lock.
+ */
+static struct rb_root free_vmap_area_root = RB_ROOT;
+
+/*
+ * Spare node for splitting a hole in two, allocated outside of
+ * vmap_area_lock by alloc_vmap_area().
+ */
+static DEFINE_PER_CPU(struct vmap_area *, vmap_split_node);
+
+/* Lazily freed areas, queued on the freeing CPU until the next purge */
+static DEFINE_PER_CPU(struct llist_head, vmap_purge_list);
 
 static unsigned long vmap_area_pcpu_hole;
 
@@ -318,9 +334,286 @@ static void __insert_vmap_area(struct vmap_area *va)
 	if (tmp) {
 		struct vmap_area *prev;
 		prev = rb_entry(tmp, struct vmap_area, rb_node);
-		list_add_rcu(&va->list, &prev->list);
+		list_add(&va->list, &prev->list);
 	} else
-		list_add_rcu(&va->list, &vmap_area_list);
+		list_add(&va->list, &vmap_area_list);
+}
+
+static inline unsigned long va_size(struct vmap_area *va)
+{
+	return va->va_end - va->va_start;
+}
+
+static inline unsigned long free_subtree_max_size(struct rb_node *node)
+{
+	if (!node)
+		return 0;
+	return rb_entry(node, struct vmap_area, rb_node)->subtree_max_size;
+}
+
+static unsigned long compute_subtree_max_size(struct vmap_area *va)
+{
+	return max3(va_size(va),
+		    free_subtree_max_size(va->rb_node.rb_left),
+		    free_subtree_max_size(va->rb_node.rb_right));
+}
+
+static void free_vmap_area_augment_cb(struct rb_node *node, void *data)
+{
+	struct vmap_area *va = rb_entry(node, struct vmap_area, rb_node);
+
+	va->subtree_max_size = compute_subtree_max_size(va);
+}
+
+/*
+ * A hole changed size in place: fix up the subtree maxima above it.
+ */
+static void free_vmap_area_propagate(struct vmap_area *va)
+{
+	struct rb_node *node = &va->rb_node;
+
+	while (node) {
+		unsigned long max_size;
+
+		va = rb_entry(node, struct vmap_area, rb_node);
+		max_size = compute_subtree_max_size(va);
+		if (va->subtree_max_size == max_size)
+			break;
+		va->subtree_max_size = max_size;
+		node = rb_parent(node);
+	}
+}
+
+static void __insert_free_vmap_area(struct vmap_area *va)
+{
+	struct rb_node **p = &free_vmap_area_root.rb_node;
+	struct rb_node *parent = NULL;
+
+	while (*p) {
+		struct vmap_area *tmp_va;
+
+		parent = *p;
+		tmp_va = rb_entry(parent, struct vmap_area, rb_node);
+		if (va->va_end <= tmp_va->va_start)
+			p = &(*p)->rb_left;
+		else if (va->va_start >= tmp_va->va_end)
+			p = &(*p)->rb_right;
+		else
+			BUG();
+	}
+
+	va->subtree_max_size = va_size(va);
+	rb_link_node(&va->rb_node, parent, p);
+	rb_insert_color(&va->rb_node, &free_vmap_area_root);
+	rb_augment_insert(&va->rb_node, free_vmap_area_augment_cb, NULL);
+}
+
+static void __erase_free_vmap_area(struct vmap_area *va)
+{
+	struct rb_node *deepest;
+
+	deepest = rb_augment_erase_begin(&va->rb_node);
+	rb_erase(&va->rb_node, &free_vmap_area_root);
+	RB_CLEAR_NODE(&va->rb_node);
+	rb_augment_erase_end(deepest, free_vmap_area_augment_cb, NULL);
+}
+
+/*
+ * Return the range of @va to the holes, merging it with the holes on
+ * either side.  @va is either reused as a hole or freed.
+ */
+static void __merge_free_vmap_area(struct vmap_area *va)
+{
+	struct rb_node *n = free_vmap_area_root.rb_node;
+	struct vmap_area *prev = NULL, *next = NULL;
+
+	while (n) {
+		struct vmap_area *tmp;
+
+		tmp = rb_entry(n, struct vmap_area, rb_node);
+		if (va->va_start < tmp->va_start) {
+			next = tmp;
+			n = n->rb_left;
+		} else {
+			prev = tmp;
+			n = n->rb_right;
+		}
+	}
+
+	BUG_ON(prev && prev->va_end > va->va_start);
+	BUG_ON(next && next->va_start < va->va_end);
+
+	if (next && next->va_start == va->va_end) {
+		if (prev && prev->va_end == va->va_start) {
+			prev->va_end = next->va_end;
+			__erase_free_vmap_area(next);
+			kfree(next);
+			free_vmap_area_propagate(prev);
+		} else {
+			next->va_start = va->va_start;
+			free_vmap_area_propagate(next);
+		}
+		kfree(va);
+	} else if (prev && prev->va_end == va->va_start) {
+		prev->va_end = va->va_end;
+		free_vmap_area_propagate(prev);
+		kfree(va);
+	} else
+		__insert_free_vmap_area(va);
+}
+
+/*
+ * Take [nva_start, nva_start + size) out of the hole @va.  Carving from
+ * the middle needs a new node for the lower part: *@spare is used if set,
+ * otherwise one is allocated without sleeping.
+ */
+static int __clip_free_vmap_area(struct vmap_area *va, unsigned long nva_start,
+				 unsigned long size, struct vmap_area **spare)
+{
+	unsigned long nva_end = nva_start + size;
+
+	BUG_ON(nva_start < va->va_start || nva_end > va->va_end);
+
+	if (nva_start == va->va_start && nva_end == va->va_end) {
+		__erase_free_vmap_area(va);
+		kfree(va);
+	} else if (nva_start == va->va_start) {
+		va->va_start = nva_end;
+		free_vmap_area_propagate(va);
+	} else if (nva_end == va->va_end) {
+		va->va_end = nva_start;
+		free_vmap_area_propagate(va);
+	} else {
+		struct vmap_area *lva = *spare;
+
+		if (!lva)
+			lva = kmalloc(sizeof(struct vmap_area), GFP_NOWAIT);
+		if (unlikely(!lva))
+			return -ENOMEM;
+		*spare = NULL;
+
+		lva->va_start = va->va_start;
+		lva->va_end = nva_start;
+		va->va_start = nva_end;
+		free_vmap_area_propagate(va);
+		__insert_free_vmap_area(lva);
+	}
+
+	return 0;
+}
+
+/* Returns the hole containing @addr */
+static struct vmap_area *__find_free_vmap_area(unsigned long addr)
+{
+	struct rb_node *n = free_vmap_area_root.rb_node;
+
+	while (n) {
+		struct vmap_area *va;
+
+		va = rb_entry(n, struct vmap_area, rb_node);
+		if (addr < va->va_start)
+			n = n->rb_left;
+		else if (addr >= va->va_end)
+			n = n->rb_right;
+		else
+			return va;
+	}
+
+	return NULL;
+}
+
+static bool free_vmap_area_fits(struct vmap_area *va, unsigned long size,
+				unsigned long align, unsigned long vstart,
+				unsigned long *addr)
+{
+	unsigned long nva_start = ALIGN(max(va->va_start, vstart), align);
+
+	/* ALIGN() or the end may have wrapped */
+	if (nva_start < vstart || nva_start + size < nva_start)
+		return false;
+	if (nva_start + size > va->va_end)
+		return false;
+
+	*addr = nva_start;
+	return true;
+}
+
+/*
+ * Find the lowest hole above @vstart that fits @size at @align.  The
+ * subtree maxima let the search skip every subtree whose holes are all
+ * too small.  Holes are page aligned, so only a larger @align has to be
+ * paid for up front, which can make this miss a tight fit; callers fall
+ * back to __find_vmap_lowest_linear() for those.
+ */
+static struct vmap_area *__find_vmap_lowest_match(unsigned long size,
+				unsigned long align, unsigned long vstart,
+				unsigned long *addr)
+{
+	struct rb_node *node = free_vmap_area_root.rb_node;
+	unsigned long length = size;
+
+	if (align > PAGE_SIZE)
+		length += align - 1;
+
+	while (node) {
+		struct vmap_area *va = rb_entry(node, struct vmap_area, rb_node);
+
+		if (free_subtree_max_size(node->rb_left) >= length &&
+		    vstart < va->va_start) {
+			node = node->rb_left;
+			continue;
+		}
+
+		if (free_vmap_area_fits(va, size, align, vstart, addr))
+			return va;
+
+		if (free_subtree_max_size(node->rb_right) >= length) {
+			node = node->rb_right;
+			continue;
+		}
+
+		/*
+		 * Nothing in this subtree: go back up to the nearest node
+		 * we descended to the left from, which itself and its
+		 * right subtree have not been looked at yet.
+		 */
+		for (;;) {
+			struct rb_node *child = node;
+
+			node = rb_parent(node);
+			if (!node)
+				return NULL;
+			if (node->rb_left != child)
+				continue;
+
+			va = rb_entry(node, struct vmap_area, rb_node);
+			if (free_vmap_area_fits(va, size, align, vstart, addr))
+				return va;
+
+			if (free_subtree_max_size(node->rb_right) >= length) {
+				node = node->rb_right;
+				break;
+			}
+		}
+	}
+
+	return NULL;
+}
+
+static struct vmap_area *__find_vmap_lowest_linear(unsigned long size,
+				unsigned long align, unsigned long vstart,
+				unsigned long *addr)
+{
+	struct rb_node *n;
+
+	for (n = rb_first(&free_vmap_area_root); n; n = rb_next(n)) {
+		struct vmap_area *va = rb_entry(n, struct vmap_area, rb_node);
+
+		if (free_vmap_area_fits(va, size, align, vstart, addr))
+			return va;
+	}
+
+	return NULL;
 }
 
 static void purge_vmap_area_lazy(void);
@@ -334,11 +627,10 @@ static struct vmap_area *alloc_vmap_area(unsigned long size,
 				unsigned long vstart, unsigned long vend,
 				int node, gfp_t gfp_mask)
 {
-	struct vmap_area *va;
-	struct rb_node *n;
+	struct vmap_area *va, *free, *spare;
 	unsigned long addr;
 	int purged = 0;
-	struct vmap_area *first;
+	int err;
 
 	BUG_ON(!size);
 	BUG_ON(size & ~PAGE_MASK);
@@ -349,86 +641,39 @@ static struct vmap_area *alloc_vmap_area(unsigned long size,
 	if (unlikely(!va))
 		return ERR_PTR(-ENOMEM);
 
-retry:
-	spin_lock(&vmap_area_lock);
 	/*
-	 * Invalidate cache if we have more permissive parameters.
-	 * cached_hole_size notes the largest hole noticed _below_
-	 * the vmap_area cached in free_vmap_cache: if size fits
-	 * into that hole, we want to scan from vstart to reuse
-	 * the hole instead of allocating above free_vmap_cache.
-	 * Note that __free_vmap_area may update free_vmap_cache
-	 * without updating cached_hole_size or cached_align.
+	 * Make sure a node is at hand in case the hole has to be split,
+	 * so that we do not need to allocate under vmap_area_lock.
 	 */
-	if (!free_vmap_cache ||
-			size < cached_hole_size ||
-			vstart < cached_vstart ||
-			align < cached_align) {
-nocache:
-		cached_hole_size = 0;
-		free_vmap_cache = NULL;
-	}
-	/* record if we encounter less permissive parameters */
-	cached_vstart = vstart;
-	cached_align = align;
-
-	/* find starting point for our search */
-	if (free_vmap_cache) {
-		first = rb_entry(free_vmap_cache, struct vmap_area, rb_node);
-		addr = ALIGN(first->va_end, align);
-		if (addr < vstart)
-			goto nocache;
-		if (addr + size - 1 < addr)
-			goto overflow;
-
-	} else {
-		addr = ALIGN(vstart, align);
-		if (addr + size - 1 < addr)
-			goto overflow;
-
-		n = vmap_area_root.rb_node;
-		first = NULL;
-
-		while (n) {
-			struct vmap_area *tmp;
-			tmp = rb_entry(n, struct vmap_area, rb_node);
-			if (tmp->va_end >= addr) {
-				first = tmp;
-				if (tmp->va_start <= addr)
-					break;
-				n = n->rb_left;
-			} else
-				n = n->rb_right;
-		}
-
-		if (!first)
-			goto found;
+	if (!this_cpu_read(vmap_split_node)) {
+		spare = kmalloc_node(sizeof(struct vmap_area),
+				gfp_mask & GFP_RECLAIM_MASK, node);
+		if (spare && this_cpu_cmpxchg(vmap_split_node, NULL, spare))
+			kfree(spare);
 	}
 
-	/* from the starting point, walk areas until a suitable hole is found */
-	while (addr + size > first->va_start && addr + size <= vend) {
-		if (addr + cached_hole_size < first->va_start)
-			cached_hole_size = first->va_start - addr;
-		addr = ALIGN(first->va_end, align);
-		if (addr + size - 1 < addr)
-			goto overflow;
+retry:
+	spin_lock(&vmap_area_lock);
 
-		if (list_is_last(&first->list, &vmap_area_list))
-			goto found;
+	free = __find_vmap_lowest_match(size, align, vstart, &addr);
+	if (align > PAGE_SIZE && (!free || addr + size > vend))
+		free = __find_vmap_lowest_linear(size, align, vstart, &addr);
+	if (!free || addr + size > vend)
+		goto overflow;
 
-		first = list_entry(first->list.next,
-				struct vmap_area, list);
+	spare = __this_cpu_xchg(vmap_split_node, NULL);
+	err = __clip_free_vmap_area(free, addr, size, &spare);
+	__this_cpu_write(vmap_split_node, spare);
+	if (unlikely(err)) {
+		spin_unlock(&vmap_area_lock);
+		kfree(va);
+		return ERR_PTR(err);
 	}
 
-found:
-	if (addr + size > vend)
-		goto overflow;
-
 	va->va_start = addr;
 	va->va_end = addr + size;
 	va->flags = 0;
 	__insert_vmap_area(va);
-	free_vmap_cache = &va->rb_node;
 	spin_unlock(&vmap_area_lock);
 
 	BUG_ON(va->va_start & (align-1));
@@ -456,24 +701,9 @@ static void __free_vmap_area(struct vmap_area *va)
 {
 	BUG_ON(RB_EMPTY_NODE(&va->rb_node));
 
-	if (free_vmap_cache) {
-		if (va->va_end < cached_vstart) {
-			free_vmap_cache = NULL;
-		} else {
-			struct vmap_area *cache;
-			cache = rb_entry(free_vmap_cache, struct vmap_area, rb_node);
-			if (va->va_start <= cache->va_start) {
-				free_vmap_cache = rb_prev(&va->rb_node);
-				/*
-				 * We don't try to update cached_hole_size or
-				 * cached_align, but it won't go very wrong.
-				 */
-			}
-		}
-	}
 	rb_erase(&va->rb_node, &vmap_area_root);
 	RB_CLEAR_NODE(&va->rb_node);
-	list_del_rcu(&va->list);
+	list_del(&va->list);
 
 	/*
 	 * Track the highest possible candidate for pcpu area
@@ -484,7 +714,7 @@ static void __free_vmap_area(struct vmap_area *va)
 	if (va->va_end > VMALLOC_START && va->va_end <= VMALLOC_END)
 		vmap_area_pcpu_hole = max(vmap_area_pcpu_hole, va->va_end);
 
-	kfree_rcu(va, rcu_head);
+	__merge_free_vmap_area(va);
 }
 
 /*
@@ -579,10 +809,10 @@ static void __purge_vmap_area_lazy(unsigned long *start, unsigned long *end,
 					int sync, int force_flush)
 {
 	static DEFINE_SPINLOCK(purge_lock);
-	LIST_HEAD(valist);
+	struct llist_node *valist = NULL;
 	struct vmap_area *va;
-	struct vmap_area *n_va;
 	int nr = 0;
+	int cpu;
 
 	/*
 	 * If sync is 0 but force_flush is 1, we'll go sync anyway but callers
@@ -598,20 +828,22 @@ static void __purge_vmap_area_lazy(unsigned long *start, unsigned long *end,
 	if (sync)
 		purge_fragmented_blocks_allcpus();
 
-	rcu_read_lock();
-	list_for_each_entry_rcu(va, &vmap_area_list, list) {
-		if (va->flags & VM_LAZY_FREE) {
+	for_each_possible_cpu(cpu) {
+		struct llist_node *node, *next;
+
+		node = llist_del_all(&per_cpu(vmap_purge_list, cpu));
+		for (; node; node = next) {
+			next = llist_next(node);
+			va = llist_entry(node, struct vmap_area, purge_list);
 			if (va->va_start < *start)
 				*start = va->va_start;
 			if (va->va_end > *end)
 				*end = va->va_end;
 			nr += (va->va_end - va->va_start) >> PAGE_SHIFT;
-			list_add_tail(&va->purge_list, &valist);
-			va->flags |= VM_LAZY_FREEING;
-			va->flags &= ~VM_LAZY_FREE;
+			node->next = valist;
+			valist = node;
 		}
 	}
-	rcu_read_unlock();
 
 	if (nr)
 		atomic_sub(nr, &vmap_lazy_nr);
@@ -620,9 +852,14 @@ static void __purge_vmap_area_lazy(unsigned long *start, unsigned long *end,
 		flush_tlb_kernel_range(*start, *end);
 
 	if (nr) {
+		struct llist_node *next;
+
 		spin_lock(&vmap_area_lock);
-		list_for_each_entry_safe(va, n_va, &valist, purge_list)
+		for (; valist; valist = next) {
+			next = llist_next(valist);
+			va = llist_entry(valist, struct vmap_area, purge_list);
 			__free_vmap_area(va);
+		}
 		spin_unlock(&vmap_area_lock);
 	}
 	spin_unlock(&purge_lock);
@@ -656,9 +893,16 @@ static void purge_vmap_area_lazy(void)
  */
 static void free_vmap_area_noflush(struct vmap_area *va)
 {
-	va->flags |= VM_LAZY_FREE;
-	atomic_add((va->va_end - va->va_start) >> PAGE_SHIFT, &vmap_lazy_nr);
-	if (unlikely(atomic_read(&vmap_lazy_nr) > lazy_max_pages()))
+	int nr_lazy;
+
+	nr_lazy = atomic_add_return((va->va_end - va->va_start) >> PAGE_SHIFT,
+				    &vmap_lazy_nr);
+
+	/* Queue on this CPU, the area stays allocated until purged */
+	llist_add(&va->purge_list, &get_cpu_var(vmap_purge_list));
+	put_cpu_var(vmap_purge_list);
+
+	if (unlikely(nr_lazy > lazy_max_pages()))
 		try_purge_vmap_area_lazy();
 }
 
@@ -1176,6 +1420,41 @@ void __init vm_area_register_early(struct vm_struct *vm, size_t align)
 	vm_area_add_early(vm);
 }
 
+/*
+ * If the allocation fails, the hole is simply never handed out, which
+ * beats oopsing this early in boot.
+ */
+static void __init vmap_init_free_area(unsigned long start, unsigned long end)
+{
+	struct vmap_area *free;
+
+	free = kzalloc(sizeof(struct vmap_area), GFP_NOWAIT);
+	if (WARN_ON_ONCE(!free))
+		return;
+	free->va_start = start;
+	free->va_end = end;
+	__insert_free_vmap_area(free);
+}
+
+/*
+ * Everything not taken by the early vm areas is a hole.  Address 0 is
+ * never handed out.
+ */
+static void __init vmap_init_free_space(void)
+{
+	unsigned long vmap_start = 1;
+	struct vmap_area *busy;
+
+	list_for_each_entry(busy, &vmap_area_list, list) {
+		if (busy->va_start > vmap_start)
+			vmap_init_free_area(vmap_start, busy->va_start);
+		vmap_start = busy->va_end;
+	}
+
+	if (vmap_start < ULONG_MAX)
+		vmap_init_free_area(vmap_start, ULONG_MAX);
+}
+
 void __init vmalloc_init(void)
 {
 	struct vmap_area *va;
@@ -1200,6 +1479,8 @@ void __init vmalloc_init(void)
 		__insert_vmap_area(va);
 	}
 
+	vmap_init_free_space();
+
 	vmap_area_pcpu_hole = VMALLOC_END;
 
 	vmap_initialized = true;
@@ -2350,7 +2631,7 @@ struct vm_struct **pcpu_get_vm_areas(const unsigned long *offsets,
 {
 	const unsigned long vmalloc_start = ALIGN(VMALLOC_START, align);
 	const unsigned long vmalloc_end = VMALLOC_END & ~(align - 1);
-	struct vmap_area **vas, *prev, *next;
+	struct vmap_area **vas, **spares, *prev, *next;
 	struct vm_struct **vms;
 	int area, area2, last_area, term_area;
 	unsigned long base, start, end, last_end;
@@ -2390,13 +2671,16 @@ struct vm_struct **pcpu_get_vm_areas(const unsigned long *offsets,
 
 	vms = kcalloc(nr_vms, sizeof(vms[0]), GFP_KERNEL);
 	vas = kcalloc(nr_vms, sizeof(vas[0]), GFP_KERNEL);
-	if (!vas || !vms)
+	spares = kcalloc(nr_vms, sizeof(spares[0]), GFP_KERNEL);
+	if (!vas || !vms || !spares)
 		goto err_free2;
 
+	/* each area may split a hole in two */
 	for (area = 0; area < nr_vms; area++) {
 		vas[area] = kzalloc(sizeof(struct vmap_area), GFP_KERNEL);
 		vms[area] = kzalloc(sizeof(struct vm_struct), GFP_KERNEL);
-		if (!vas[area] || !vms[area])
+		spares[area] = kzalloc(sizeof(struct vmap_area), GFP_KERNEL);
+		if (!vas[area] || !vms[area] || !spares[area])
 			goto err_free;
 	}
 retry:
@@ -2472,6 +2756,8 @@ found:
 
 		va->va_start = base + offsets[area];
 		va->va_end = va->va_start + sizes[area];
+		__clip_free_vmap_area(__find_free_vmap_area(va->va_start),
+				      va->va_start, sizes[area], &spares[area]);
 		__insert_vmap_area(va);
 	}
 
@@ -2484,6 +2770,9 @@ found:
 		insert_vmalloc_vm(vms[area], vas[area], VM_ALLOC,
 				  pcpu_get_vm_areas);
 
+	for (area = 0; area < nr_vms; area++)
+		kfree(spares[area]);
+	kfree(spares);
 	kfree(vas);
 	return vms;
 
@@ -2491,8 +2780,10 @@ err_free:
 	for (area = 0; area < nr_vms; area++) {
 		kfree(vas[area]);
 		kfree(vms[area]);
+		kfree(spares[area]);
 	}
 err_free2:
+	kfree(spares);
 	kfree(vas);
 	kfree(vms);
 	return NULL;
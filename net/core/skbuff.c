@@ -288,6 +288,89 @@ nodata:
 }
 EXPORT_SYMBOL(__alloc_skb);
 
+static void __build_skb_around(struct sk_buff *skb, void *data,
+			       unsigned int frag_size)
+{
+	struct skb_shared_info *shinfo;
+	unsigned int size = frag_size ? : ksize(data);
+
+	size -= SKB_DATA_ALIGN(sizeof(struct skb_shared_info));
+
+	memset(skb, 0, offsetof(struct sk_buff, tail));
+	skb->truesize = SKB_TRUESIZE(size);
+	skb->head_frag = frag_size != 0;
+	atomic_set(&skb->users, 1);
+	skb->head = data;
+	skb->data = data;
+	skb_reset_tail_pointer(skb);
+	skb->end = skb->tail + size;
+#ifdef NET_SKBUFF_DATA_USES_OFFSET
+	skb->mac_header = ~0U;
+#endif
+
+	/* make sure we initialize shinfo sequentially */
+	shinfo = skb_shinfo(skb);
+	memset(shinfo, 0, offsetof(struct skb_shared_info, dataref));
+	atomic_set(&shinfo->dataref, 1);
+	kmemcheck_annotate_variable(shinfo->destructor_arg);
+}
+
+/*
+ * Per cpu cache of sk_buff heads for NAPI context.  The heads of buffers
+ * consumed by napi_consume_skb() are kept here and handed out again by
+ * napi_build_skb(); the cache is refilled from, and drained back to,
+ * skbuff_head_cache in bulk.  Only used from softirq context.
+ */
+#define NAPI_SKB_CACHE_SIZE	64
+#define NAPI_SKB_CACHE_BULK	16
+#define NAPI_SKB_CACHE_HALF	(NAPI_SKB_CACHE_SIZE / 2)
+
+struct napi_alloc_cache {
+	unsigned int skb_count;
+	void *skb_cache[NAPI_SKB_CACHE_SIZE];
+};
+
+static DEFINE_PER_CPU(struct napi_alloc_cache, napi_alloc_cache);
+
+static struct sk_buff *napi_skb_cache_get(void)
+{
+	struct napi_alloc_cache *nc = &__get_cpu_var(napi_alloc_cache);
+
+	if (unlikely(!nc->skb_count))
+		nc->skb_count = kmem_cache_alloc_bulk(skbuff_head_cache,
+						      GFP_ATOMIC,
+						      NAPI_SKB_CACHE_BULK,
+						      nc->skb_cache);
+	if (unlikely(!nc->skb_count))
+		return NULL;
+
+	return nc->skb_cache[--nc->skb_count];
+}
+
+static void napi_skb_cache_put(struct sk_buff *skb)
+{
+	struct napi_alloc_cache *nc = &__get_cpu_var(napi_alloc_cache);
+
+	nc->skb_cache[nc->skb_count++] = skb;
+	if (unlikely(nc->skb_count == NAPI_SKB_CACHE_SIZE)) {
+		kmem_cache_free_bulk(skbuff_head_cache, NAPI_SKB_CACHE_HALF,
+				     nc->skb_cache + NAPI_SKB_CACHE_HALF);
+		nc->skb_count = NAPI_SKB_CACHE_HALF;
+	}
+}
+
+/* Give the cached heads back to the slab at the end of a NAPI run */
+void __kfree_skb_flush(void)
+{
+	struct napi_alloc_cache *nc = &__get_cpu_var(napi_alloc_cache);
+
+	if (nc->skb_count) {
+		kmem_cache_free_bulk(skbuff_head_cache, nc->skb_count,
+				     nc->skb_cache);
+		nc->skb_count = 0;
+	}
+}
+
 /**
  * build_skb - build a network buffer
  * @data: data buffer provided by caller
@@ -307,37 +390,38 @@ EXPORT_SYMBOL(__alloc_skb);
  */
 struct sk_buff *build_skb(void *data, unsigned int frag_size)
 {
-	struct skb_shared_info *shinfo;
 	struct sk_buff *skb;
-	unsigned int size = frag_size ? : ksize(data);
 
 	skb = kmem_cache_alloc(skbuff_head_cache, GFP_ATOMIC);
 	if (!skb)
 		return NULL;
 
-	size -= SKB_DATA_ALIGN(sizeof(struct skb_shared_info));
+	__build_skb_around(skb, data, frag_size);
+	return skb;
+}
+EXPORT_SYMBOL(build_skb);
 
-	memset(skb, 0, offsetof(struct sk_buff, tail));
-	skb->truesize = SKB_TRUESIZE(size);
-	skb->head_frag = frag_size != 0;
-	atomic_set(&skb->users, 1);
-	skb->head = data;
-	skb->data = data;
-	skb_reset_tail_pointer(skb);
-	skb->end = skb->tail + size;
-#ifdef NET_SKBUFF_DATA_USES_OFFSET
-	skb->mac_header = ~0U;
-#endif
+/**
+ * napi_build_skb - build a network buffer from NAPI context
+ * @data: data buffer provided by caller
+ * @frag_size: size of fragment, or 0 if head was kmalloced
+ *
+ * Same as build_skb(), for use from a driver's NAPI poll routine only.
+ * The &sk_buff comes from a per cpu cache that is refilled in bulk, and
+ * that napi_consume_skb() feeds with the buffers of completed transmits.
+ */
+struct sk_buff *napi_build_skb(void *data, unsigned int frag_size)
+{
+	struct sk_buff *skb;
 
-	/* make sure we initialize shinfo sequentially */
-	shinfo = skb_shinfo(skb);
-	memset(shinfo, 0, offsetof(struct skb_shared_info, dataref));
-	atomic_set(&shinfo->dataref, 1);
-	kmemcheck_annotate_variable(shinfo->destructor_arg);
+	skb = napi_skb_cache_get();
+	if (!skb)
+		return NULL;
 
+	__build_skb_around(skb, data, frag_size);
 	return skb;
 }
-EXPORT_SYMBOL(build_skb);
+EXPORT_SYMBOL(napi_build_skb);
 
 struct netdev_alloc_cache {
 	struct page *page;
@@ -641,6 +725,55 @@ void consume_skb(struct sk_buff *skb)
 }
 EXPORT_SYMBOL(consume_skb);
 
+/*
+ * Free an sk_buff from NAPI context, keeping its head in the per cpu
+ * cache.  Fast clones go back to their own cache the usual way.
+ */
+void __kfree_skb_defer(struct sk_buff *skb)
+{
+	if (skb->fclone != SKB_FCLONE_UNAVAILABLE) {
+		__kfree_skb(skb);
+		return;
+	}
+	skb_release_all(skb);
+	napi_skb_cache_put(skb);
+}
+
+/* An skb whose head was stolen by GRO has no state left to release */
+void napi_skb_free_stolen_head(struct sk_buff *skb)
+{
+	napi_skb_cache_put(skb);
+}
+
+/**
+ *	napi_consume_skb - free an skbuff from NAPI context
+ *	@skb: buffer to free
+ *	@budget: budget of the NAPI poll routine calling us
+ *
+ *	Functions like consume_skb(), for the transmit completion code of a
+ *	driver's NAPI poll routine.  The freed &sk_buff is recycled for the
+ *	next napi_build_skb() on this cpu, or returned to the slab in bulk.
+ *	A zero @budget means we are called from netpoll, outside of NAPI.
+ */
+void napi_consume_skb(struct sk_buff *skb, int budget)
+{
+	if (unlikely(!skb))
+		return;
+
+	if (unlikely(!budget)) {
+		dev_kfree_skb_any(skb);
+		return;
+	}
+
+	if (likely(atomic_read(&skb->users) == 1))
+		smp_rmb();
+	else if (likely(!atomic_dec_and_test(&skb->users)))
+		return;
+	trace_consume_skb(skb);
+	__kfree_skb_defer(skb);
+}
+EXPORT_SYMBOL(napi_consume_skb);
+
 /**
  * 	skb_recycle - clean up an skb for reuse
  * 	@skb: buffer
@@ -700,6 +833,9 @@ static void __copy_skb_header(struct sk_buff *new, const struct sk_buff *old)
 	new->ooo_okay		= old->ooo_okay;
 	new->l4_rxhash		= old->l4_rxhash;
 	new->no_fcs		= old->no_fcs;
+#ifdef CONFIG_NET_RX_BUSY_POLL
+	new->napi_id		= old->napi_id;
+#endif
 #ifdef CONFIG_XFRM
 	new->sp			= secpath_get(old->sp);
 #endif
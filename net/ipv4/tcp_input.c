@@ -3576,6 +3576,33 @@ static bool tcp_process_frto(struct sock *sk, int flag)
 	return false;
 }
 
+/* Set the sk_pacing_rate to allow proper sizing of TSO packets and
+ * let packet schedulers such as sch_fq spread a flow's packets over
+ * its RTT instead of sending cwnd sized bursts.
+ *
+ * The rate is 200 % of the current rate (mss * cwnd / srtt), so that
+ * pacing does not get in the way of slow start or cwnd growth.
+ */
+static void tcp_update_pacing_rate(struct sock *sk)
+{
+	const struct tcp_sock *tp = tcp_sk(sk);
+	u64 rate;
+
+	rate = (u64)tp->mss_cache * 2 * (HZ << 3);
+
+	rate *= max(tp->snd_cwnd, tp->packets_out);
+
+	/* Correction for small srtt : minimum srtt being 8 (1 jiffy << 3),
+	 * be conservative and assume srtt = 1 (one jiffy / 8).
+	 * This also takes care of the srtt=0 case, when
+	 * tcp_rtt_estimator() was not yet called.
+	 */
+	if (tp->srtt > 8 + 2)
+		do_div(rate, tp->srtt);
+
+	sk->sk_pacing_rate = min_t(u64, rate, ~0U);
+}
+
 /* This routine deals with incoming acks, but not outgoing ones. */
 static int tcp_ack(struct sock *sk, const struct sk_buff *skb, int flag)
 {
@@ -3592,6 +3619,8 @@ static int tcp_ack(struct sock *sk, const struct sk_buff *skb, int flag)
 	int pkts_acked = 0;
 	int newly_acked_sacked = 0;
 	bool frto_cwnd = false;
+	u32 prior_cwnd = tp->snd_cwnd;
+	u32 prior_srtt = tp->srtt;
 
 	/* If the ack is older than previous acks
 	 * then we can probably ignore it.
@@ -3693,6 +3722,8 @@ static int tcp_ack(struct sock *sk, const struct sk_buff *skb, int flag)
 		if (dst)
 			dst_confirm(dst);
 	}
+	if (tp->srtt != prior_srtt || tp->snd_cwnd != prior_cwnd)
+		tcp_update_pacing_rate(sk);
 	return 1;
 
 no_queue:
@@ -156,15 +156,52 @@ static __inline__ struct fib6_node * node_alloc(void)
 	return fn;
 }
 
-static __inline__ void node_free(struct fib6_node * fn)
+static void node_free_rcu(struct rcu_head *head)
 {
+	struct fib6_node *fn = container_of(head, struct fib6_node, rcu);
+
 	kmem_cache_free(fib6_node_kmem, fn);
 }
 
+/* Lookups may still be walking through fn, see struct fib6_node */
+static __inline__ void node_free(struct fib6_node * fn)
+{
+	call_rcu(&fn->rcu, node_free_rcu);
+}
+
+static void rt6_free_pcpu(struct rt6_info *rt)
+{
+	int cpu;
+
+	if (!rt->rt6i_pcpu)
+		return;
+
+	for_each_possible_cpu(cpu) {
+		struct rt6_info *pcpu_rt = rt->rt6i_pcpu[cpu];
+
+		if (pcpu_rt)
+			dst_free(&pcpu_rt->dst);
+	}
+	kfree(rt->rt6i_pcpu);
+	rt->rt6i_pcpu = NULL;
+}
+
+static void rt6_free_rcu(struct rcu_head *head)
+{
+	struct rt6_info *rt = container_of(head, struct rt6_info, dst.rcu_head);
+
+	/*
+	 * No lookup can see rt any more, so nobody can fill in a new
+	 * per-cpu copy behind our back.
+	 */
+	rt6_free_pcpu(rt);
+	dst_free(&rt->dst);
+}
+
 static __inline__ void rt6_release(struct rt6_info *rt)
 {
 	if (atomic_dec_and_test(&rt->rt6i_ref))
-		dst_free(&rt->dst);
+		call_rcu(&rt->dst.rcu_head, rt6_free_rcu);
 }
 
 static void fib6_link_table(struct net *net, struct fib6_table *tb)
@@ -521,9 +558,9 @@ static struct fib6_node * fib6_add_1(struct fib6_node *root, void *addr,
 	ln->fn_sernum = sernum;
 
 	if (dir)
-		pn->right = ln;
+		rcu_assign_pointer(pn->right, ln);
 	else
-		pn->left  = ln;
+		rcu_assign_pointer(pn->left, ln);
 
 	return ln;
 
@@ -580,16 +617,9 @@ insert_above:
 
 		in->fn_sernum = sernum;
 
-		/* update parent pointer */
-		if (dir)
-			pn->right = in;
-		else
-			pn->left  = in;
-
 		ln->fn_bit = plen;
 
 		ln->parent = in;
-		fn->parent = in;
 
 		ln->fn_sernum = sernum;
 
@@ -600,6 +630,18 @@ insert_above:
 			in->left  = ln;
 			in->right = fn;
 		}
+
+		/*
+		 * Lookups must find fn through in from the moment in is
+		 * reachable, so link it in only once it is complete.
+		 */
+		rcu_assign_pointer(fn->parent, in);
+
+		/* update parent pointer */
+		if (dir)
+			rcu_assign_pointer(pn->right, in);
+		else
+			rcu_assign_pointer(pn->left, in);
 	} else { /* plen <= bit */
 
 		/*
@@ -619,17 +661,17 @@ insert_above:
 
 		ln->fn_sernum = sernum;
 
-		if (dir)
-			pn->right = ln;
-		else
-			pn->left  = ln;
-
 		if (addr_bit_set(&key->addr, plen))
 			ln->right = fn;
 		else
 			ln->left  = fn;
 
-		fn->parent = ln;
+		rcu_assign_pointer(fn->parent, ln);
+
+		if (dir)
+			rcu_assign_pointer(pn->right, ln);
+		else
+			rcu_assign_pointer(pn->left, ln);
 	}
 	return ln;
 }
@@ -701,8 +743,8 @@ static int fib6_add_rt2node(struct fib6_node *fn, struct rt6_info *rt,
 
 add:
 		rt->dst.rt6_next = iter;
-		*ins = rt;
 		rt->rt6i_node = fn;
+		rcu_assign_pointer(*ins, rt);
 		atomic_inc(&rt->rt6i_ref);
 		inet6_rt_notify(RTM_NEWROUTE, rt, info);
 		info->nl_net->ipv6.rt6_stats->fib_rt_entries++;
@@ -719,9 +761,9 @@ add:
 			pr_warn("NLM_F_REPLACE set, but no existing node found!\n");
 			return -ENOENT;
 		}
-		*ins = rt;
 		rt->rt6i_node = fn;
 		rt->dst.rt6_next = iter->dst.rt6_next;
+		rcu_assign_pointer(*ins, rt);
 		atomic_inc(&rt->rt6i_ref);
 		inet6_rt_notify(RTM_NEWROUTE, rt, info);
 		rt6_release(iter);
@@ -830,7 +872,7 @@ int fib6_add(struct fib6_node *root, struct rt6_info *rt, struct nl_info *info)
 
 			/* Now link new subtree to main tree */
 			sfn->parent = fn;
-			fn->subtree = sfn;
+			rcu_assign_pointer(fn->subtree, sfn);
 		} else {
 			sn = fib6_add_1(fn->subtree, &rt->rt6i_src.addr,
 					sizeof(struct in6_addr), rt->rt6i_src.plen,
@@ -846,7 +888,7 @@ int fib6_add(struct fib6_node *root, struct rt6_info *rt, struct nl_info *info)
 		}
 
 		if (!fn->leaf) {
-			fn->leaf = rt;
+			rcu_assign_pointer(fn->leaf, rt);
 			atomic_inc(&rt->rt6i_ref);
 		}
 		fn = sn;
@@ -928,7 +970,8 @@ static struct fib6_node * fib6_lookup_1(struct fib6_node *root,
 
 		dir = addr_bit_set(args->addr, fn->fn_bit);
 
-		next = dir ? fn->right : fn->left;
+		next = dir ? rcu_dereference(fn->right) :
+			     rcu_dereference(fn->left);
 
 		if (next) {
 			fn = next;
@@ -938,16 +981,21 @@ static struct fib6_node * fib6_lookup_1(struct fib6_node *root,
 	}
 
 	while (fn) {
-		if (FIB6_SUBTREE(fn) || fn->fn_flags & RTN_RTINFO) {
+		struct rt6_info *leaf = rcu_dereference(fn->leaf);
+
+		/* leaf is NULL while the node is being taken apart */
+		if (leaf && (FIB6_SUBTREE(fn) || fn->fn_flags & RTN_RTINFO)) {
 			struct rt6key *key;
 
-			key = (struct rt6key *) ((u8 *) fn->leaf +
-						 args->offset);
+			key = (struct rt6key *) ((u8 *) leaf + args->offset);
 
 			if (ipv6_prefix_equal(&key->addr, args->addr, key->plen)) {
 #ifdef CONFIG_IPV6_SUBTREES
-				if (fn->subtree)
-					fn = fib6_lookup_1(fn->subtree, args + 1);
+				struct fib6_node *subtree;
+
+				subtree = FIB6_SUBTREE_RCU(fn);
+				if (subtree)
+					fn = fib6_lookup_1(subtree, args + 1);
 #endif
 				if (!fn || fn->fn_flags & RTN_RTINFO)
 					return fn;
@@ -957,7 +1005,7 @@ static struct fib6_node * fib6_lookup_1(struct fib6_node *root,
 		if (fn->fn_flags & RTN_ROOT)
 			break;
 
-		fn = fn->parent;
+		fn = rcu_dereference(fn->parent);
 	}
 
 	return NULL;
@@ -1193,9 +1241,13 @@ static void fib6_del_route(struct fib6_node *fn, struct rt6_info **rtp,
 	net->ipv6.rt6_stats->fib_rt_entries--;
 	net->ipv6.rt6_stats->fib_discarded_routes++;
 
-	/* Reset round-robin state, if necessary */
-	if (fn->rr_ptr == rt)
-		fn->rr_ptr = NULL;
+	/*
+	 * Reset round-robin state, if necessary.  Lookups update rr_ptr
+	 * without the table lock and check rt6i_node after their store,
+	 * see rt6_select().
+	 */
+	smp_mb();
+	cmpxchg(&fn->rr_ptr, rt, NULL);
 
 	/* Adjust walkers */
 	read_lock(&fib6_walker_lock);
@@ -1715,5 +1767,6 @@ out_kmem_cache_create:
 void fib6_gc_cleanup(void)
 {
 	unregister_pernet_subsys(&fib6_net_ops);
+	rcu_barrier();	/* wait for node_free_rcu() and rt6_free_rcu() */
 	kmem_cache_destroy(fib6_node_kmem);
 }
@@ -329,6 +329,12 @@ void rt6_bind_peer(struct rt6_info *rt, int create)
 	struct inet_peer_base *base;
 	struct inet_peer *peer;
 
+	/* A per-cpu copy serves the whole prefix of its route; peers
+	 * are per destination.
+	 */
+	if (rt->rt6i_flags & RTF_PCPU)
+		return;
+
 	base = inetpeer_base_ptr(rt->_rt6i_peer);
 	if (!base)
 		return;
@@ -389,9 +395,20 @@ static bool rt6_need_strict(const struct in6_addr *daddr)
 }
 
 /*
- *	Route lookup. Any table->tb6_lock is implied.
+ *	Route lookup. Called under rcu_read_lock(), the tree and the route
+ *	lists hanging off it may change under us.
  */
 
+static struct rt6_info *rt6_node_leaf(struct net *net, struct fib6_node *fn)
+{
+	struct rt6_info *leaf = rcu_dereference(fn->leaf);
+
+	/* fn is being taken apart, or only keeps a placeholder route */
+	if (!leaf || leaf->rt6i_node != fn)
+		return net->ipv6.ip6_null_entry;
+	return leaf;
+}
+
 static inline struct rt6_info *rt6_device_match(struct net *net,
 						    struct rt6_info *rt,
 						    const struct in6_addr *saddr,
@@ -404,7 +421,7 @@ static inline struct rt6_info *rt6_device_match(struct net *net,
 	if (!oif && ipv6_addr_any(saddr))
 		goto out;
 
-	for (sprt = rt; sprt; sprt = sprt->dst.rt6_next) {
+	for (sprt = rt; sprt; sprt = rcu_dereference(sprt->dst.rt6_next)) {
 		struct net_device *dev = sprt->dst.dev;
 
 		if (oif) {
@@ -562,7 +579,7 @@ out:
 	return match;
 }
 
-static struct rt6_info *find_rr_leaf(struct fib6_node *fn,
+static struct rt6_info *find_rr_leaf(struct rt6_info *leaf,
 				     struct rt6_info *rr_head,
 				     u32 metric, int oif, int strict)
 {
@@ -571,39 +588,51 @@ static struct rt6_info *find_rr_leaf(struct fib6_node *fn,
 
 	match = NULL;
 	for (rt = rr_head; rt && rt->rt6i_metric == metric;
-	     rt = rt->dst.rt6_next)
+	     rt = rcu_dereference(rt->dst.rt6_next))
 		match = find_match(rt, oif, strict, &mpri, match);
-	for (rt = fn->leaf; rt && rt != rr_head && rt->rt6i_metric == metric;
-	     rt = rt->dst.rt6_next)
+	for (rt = leaf; rt && rt != rr_head && rt->rt6i_metric == metric;
+	     rt = rcu_dereference(rt->dst.rt6_next))
 		match = find_match(rt, oif, strict, &mpri, match);
 
 	return match;
 }
 
-static struct rt6_info *rt6_select(struct fib6_node *fn, int oif, int strict)
+static struct rt6_info *rt6_select(struct net *net, struct fib6_node *fn,
+				   int oif, int strict)
 {
-	struct rt6_info *match, *rt0;
-	struct net *net;
+	struct rt6_info *match, *rt0, *rr, *leaf;
 
-	rt0 = fn->rr_ptr;
-	if (!rt0)
-		fn->rr_ptr = rt0 = fn->leaf;
+	leaf = rt6_node_leaf(net, fn);
+	if (leaf == net->ipv6.ip6_null_entry)
+		return leaf;
 
-	match = find_rr_leaf(fn, rt0, rt0->rt6i_metric, oif, strict);
+	/* a route that left fn since it was stored is no starting point */
+	rr = rt0 = ACCESS_ONCE(fn->rr_ptr);
+	if (!rt0 || rt0->rt6i_node != fn)
+		rt0 = leaf;
+
+	match = find_rr_leaf(leaf, rt0, rt0->rt6i_metric, oif, strict);
 
 	if (!match &&
 	    (strict & RT6_LOOKUP_F_REACHABLE)) {
-		struct rt6_info *next = rt0->dst.rt6_next;
+		struct rt6_info *next = rcu_dereference(rt0->dst.rt6_next);
 
 		/* no entries matched; do round-robin */
 		if (!next || next->rt6i_metric != rt0->rt6i_metric)
-			next = fn->leaf;
+			next = leaf;
 
-		if (next != rt0)
-			fn->rr_ptr = next;
+		/*
+		 * rr_ptr is only a hint, losing a race to another lookup
+		 * is fine.  But it must never keep a route that was
+		 * unlinked from fn: fib6_del_route() clears rt6i_node
+		 * before it resets rr_ptr, so if next was unlinked in the
+		 * meantime, take our store back.
+		 */
+		if (next != rt0 && cmpxchg(&fn->rr_ptr, rr, next) == rr &&
+		    next->rt6i_node != fn)
+			cmpxchg(&fn->rr_ptr, next, NULL);
 	}
 
-	net = dev_net(rt0->dst.dev);
 	return match ? match : net->ipv6.ip6_null_entry;
 }
 
@@ -683,13 +712,14 @@ int rt6_route_rcv(struct net_device *dev, u8 *opt, int len,
 #define BACKTRACK(__net, saddr)			\
 do { \
 	if (rt == __net->ipv6.ip6_null_entry) {	\
-		struct fib6_node *pn; \
+		struct fib6_node *pn, *sn; \
 		while (1) { \
 			if (fn->fn_flags & RTN_TL_ROOT) \
 				goto out; \
-			pn = fn->parent; \
-			if (FIB6_SUBTREE(pn) && FIB6_SUBTREE(pn) != fn) \
-				fn = fib6_lookup(FIB6_SUBTREE(pn), NULL, saddr); \
+			pn = rcu_dereference(fn->parent); \
+			sn = FIB6_SUBTREE_RCU(pn); \
+			if (sn && sn != fn) \
+				fn = fib6_lookup(sn, NULL, saddr); \
 			else \
 				fn = pn; \
 			if (fn->fn_flags & RTN_RTINFO) \
@@ -705,15 +735,15 @@ static struct rt6_info *ip6_pol_route_lookup(struct net *net,
 	struct fib6_node *fn;
 	struct rt6_info *rt;
 
-	read_lock_bh(&table->tb6_lock);
+	rcu_read_lock();
 	fn = fib6_lookup(&table->tb6_root, &fl6->daddr, &fl6->saddr);
 restart:
-	rt = fn->leaf;
+	rt = rt6_node_leaf(net, fn);
 	rt = rt6_device_match(net, rt, &fl6->saddr, fl6->flowi6_oif, flags);
 	BACKTRACK(net, &fl6->saddr);
 out:
 	dst_use(&rt->dst, jiffies);
-	read_unlock_bh(&table->tb6_lock);
+	rcu_read_unlock();
 	return rt;
 
 }
@@ -851,6 +881,80 @@ static struct rt6_info *rt6_alloc_clone(struct rt6_info *ort,
 	return rt;
 }
 
+static struct rt6_info *ip6_rt_pcpu_alloc(struct rt6_info *ort)
+{
+	struct net *net = dev_net(ort->dst.dev);
+	struct rt6_info *rt;
+
+	rt = ip6_dst_alloc(net, ort->dst.dev, DST_NOCOUNT, ort->rt6i_table);
+	if (!rt)
+		return NULL;
+
+	rt->dst.input = ort->dst.input;
+	rt->dst.output = ort->dst.output;
+	rt->dst.error = ort->dst.error;
+	rt->dst.obsolete = -1;
+	dst_init_metrics(&rt->dst, dst_metrics_ptr(&ort->dst), true);
+	rt->rt6i_idev = ort->rt6i_idev;
+	if (rt->rt6i_idev)
+		in6_dev_hold(rt->rt6i_idev);
+	rt->n = neigh_clone(ort->n);
+
+	rt->rt6i_dst = ort->rt6i_dst;
+#ifdef CONFIG_IPV6_SUBTREES
+	rt->rt6i_src = ort->rt6i_src;
+#endif
+	rt->rt6i_prefsrc = ort->rt6i_prefsrc;
+	rt->rt6i_gateway = ort->rt6i_gateway;
+	rt->rt6i_metric = ort->rt6i_metric;
+	rt->rt6i_protocol = ort->rt6i_protocol;
+	rt->rt6i_table = ort->rt6i_table;
+	rt->rt6i_flags = ort->rt6i_flags | RTF_PCPU;
+	rt6_set_from(rt, ort);
+
+	return rt;
+}
+
+/*
+ * Return this cpu's copy of rt with a reference held, creating it on
+ * first use.  Called under rcu_read_lock(), which keeps rt and its
+ * slots around until rt6_free_pcpu().
+ */
+static struct rt6_info *rt6_get_pcpu_route(struct rt6_info *rt)
+{
+	struct rt6_info **slots, **p, *pcpu_rt, *prev;
+
+	slots = rcu_dereference(rt->rt6i_pcpu);
+	if (!slots) {
+		struct rt6_info **prev_slots;
+
+		slots = kcalloc(nr_cpu_ids, sizeof(*slots), GFP_ATOMIC);
+		if (!slots)
+			return NULL;
+		prev_slots = cmpxchg(&rt->rt6i_pcpu, NULL, slots);
+		if (prev_slots) {
+			kfree(slots);
+			slots = prev_slots;
+		}
+	}
+
+	/* any slot will do if we get migrated, this is only a cache */
+	p = &slots[raw_smp_processor_id()];
+	pcpu_rt = rcu_dereference(*p);
+	if (!pcpu_rt) {
+		pcpu_rt = ip6_rt_pcpu_alloc(rt);
+		if (!pcpu_rt)
+			return NULL;
+		prev = cmpxchg(p, NULL, pcpu_rt);
+		if (prev) {
+			dst_free(&pcpu_rt->dst);
+			pcpu_rt = prev;
+		}
+	}
+	dst_hold(&pcpu_rt->dst);
+	return pcpu_rt;
+}
+
 static struct rt6_info *ip6_pol_route(struct net *net, struct fib6_table *table, int oif,
 				      struct flowi6 *fl6, int flags)
 {
@@ -864,21 +968,36 @@ static struct rt6_info *ip6_pol_route(struct net *net, struct fib6_table *table,
 	strict |= flags & RT6_LOOKUP_F_IFACE;
 
 relookup:
-	read_lock_bh(&table->tb6_lock);
+	rcu_read_lock();
 
 restart_2:
 	fn = fib6_lookup(&table->tb6_root, &fl6->daddr, &fl6->saddr);
 
 restart:
-	rt = rt6_select(fn, oif, strict | reachable);
+	rt = rt6_select(net, fn, oif, strict | reachable);
 
 	BACKTRACK(net, &fl6->saddr);
 	if (rt == net->ipv6.ip6_null_entry ||
 	    rt->rt6i_flags & RTF_CACHE)
 		goto out;
 
+	/*
+	 * Routes that would only be cloned to pin them to a destination
+	 * are served from a per-cpu copy instead, without touching the
+	 * table.
+	 */
+	if ((rt->n || rt->rt6i_flags & RTF_NONEXTHOP) &&
+	    !(rt->dst.flags & DST_HOST)) {
+		nrt = rt6_get_pcpu_route(rt);
+		if (nrt) {
+			rcu_read_unlock();
+			rt = nrt;
+			goto out2;
+		}
+	}
+
 	dst_hold(&rt->dst);
-	read_unlock_bh(&table->tb6_lock);
+	rcu_read_unlock();
 
 	if (!rt->n && !(rt->rt6i_flags & RTF_NONEXTHOP))
 		nrt = rt6_alloc_cow(rt, &fl6->daddr, &fl6->saddr);
@@ -901,8 +1020,8 @@ restart:
 		goto out2;
 
 	/*
-	 * Race condition! In the gap, when table->tb6_lock was
-	 * released someone could insert this route.  Relookup.
+	 * Race condition! In the gap, when we left the RCU read side,
+	 * someone could insert this route.  Relookup.
 	 */
 	dst_release(&rt->dst);
 	goto relookup;
@@ -913,7 +1032,7 @@ out:
 		goto restart_2;
 	}
 	dst_hold(&rt->dst);
-	read_unlock_bh(&table->tb6_lock);
+	rcu_read_unlock();
 out2:
 	rt->dst.lastuse = jiffies;
 	rt->dst.__use++;
@@ -1005,7 +1124,7 @@ struct dst_entry *ip6_blackhole_route(struct net *net, struct dst_entry *dst_ori
 			in6_dev_hold(rt->rt6i_idev);
 
 		rt->rt6i_gateway = ort->rt6i_gateway;
-		rt->rt6i_flags = ort->rt6i_flags;
+		rt->rt6i_flags = ort->rt6i_flags & ~RTF_PCPU;
 		rt6_clean_expires(rt);
 		rt->rt6i_metric = 0;
 
@@ -1027,11 +1146,16 @@ struct dst_entry *ip6_blackhole_route(struct net *net, struct dst_entry *dst_ori
 
 static struct dst_entry *ip6_dst_check(struct dst_entry *dst, u32 cookie)
 {
-	struct rt6_info *rt;
+	struct rt6_info *rt, *from;
 
 	rt = (struct rt6_info *) dst;
 
-	if (rt->rt6i_node && (rt->rt6i_node->fn_sernum == cookie)) {
+	/* per-cpu copies are as good as the route they were made from */
+	from = rt;
+	if (rt->rt6i_flags & RTF_PCPU)
+		from = (struct rt6_info *) dst->from;
+
+	if (from->rt6i_node && (from->rt6i_node->fn_sernum == cookie)) {
 		if (rt->rt6i_peer_genid != rt6_peer_genid()) {
 			if (!rt6_has_peer(rt))
 				rt6_bind_peer(rt, 0);
@@ -1068,6 +1192,8 @@ static void ip6_link_failure(struct sk_buff *skb)
 
 	rt = (struct rt6_info *) skb_dst(skb);
 	if (rt) {
+		if (rt->rt6i_flags & RTF_PCPU)
+			rt = (struct rt6_info *) rt->dst.from;
 		if (rt->rt6i_flags & RTF_CACHE)
 			rt6_update_expires(rt, 0);
 		else if (rt->rt6i_node && (rt->rt6i_flags & RTF_DEFAULT))
@@ -1075,27 +1201,62 @@ static void ip6_link_failure(struct sk_buff *skb)
 	}
 }
 
-static void ip6_rt_update_pmtu(struct dst_entry *dst, struct sock *sk,
-			       struct sk_buff *skb, u32 mtu)
+static void rt6_do_update_pmtu(struct rt6_info *rt6, u32 mtu)
+{
+	struct dst_entry *dst = &rt6->dst;
+	struct net *net = dev_net(dst->dev);
+
+	rt6->rt6i_flags |= RTF_MODIFIED;
+	if (mtu < IPV6_MIN_MTU) {
+		u32 features = dst_metric(dst, RTAX_FEATURES);
+		mtu = IPV6_MIN_MTU;
+		features |= RTAX_FEATURE_ALLFRAG;
+		dst_metric_set(dst, RTAX_FEATURES, features);
+	}
+	dst_metric_set(dst, RTAX_MTU, mtu);
+	rt6_update_expires(rt6, net->ipv6.sysctl.ip6_rt_mtu_expires);
+}
+
+static void __ip6_rt_update_pmtu(struct dst_entry *dst, const struct sock *sk,
+				 const struct ipv6hdr *iph, u32 mtu)
 {
 	struct rt6_info *rt6 = (struct rt6_info*)dst;
 
 	dst_confirm(dst);
-	if (mtu < dst_mtu(dst) && rt6->rt6i_dst.plen == 128) {
-		struct net *net = dev_net(dst->dev);
-
-		rt6->rt6i_flags |= RTF_MODIFIED;
-		if (mtu < IPV6_MIN_MTU) {
-			u32 features = dst_metric(dst, RTAX_FEATURES);
-			mtu = IPV6_MIN_MTU;
-			features |= RTAX_FEATURE_ALLFRAG;
-			dst_metric_set(dst, RTAX_FEATURES, features);
-		}
-		dst_metric_set(dst, RTAX_MTU, mtu);
-		rt6_update_expires(rt6, net->ipv6.sysctl.ip6_rt_mtu_expires);
+	if (mtu >= dst_mtu(dst))
+		return;
+
+	if (rt6->rt6i_flags & RTF_PCPU) {
+		const struct in6_addr *daddr;
+		struct rt6_info *nrt;
+
+		/*
+		 * The per-cpu copy is shared by every destination behind
+		 * its route, the new mtu goes into a clone for this one.
+		 */
+		if (iph)
+			daddr = &iph->daddr;
+		else if (sk)
+			daddr = &inet6_sk(sk)->daddr;
+		else
+			return;
+
+		nrt = rt6_alloc_clone((struct rt6_info *) dst->from, daddr);
+		if (!nrt)
+			return;
+		rt6_do_update_pmtu(nrt, mtu);
+		ip6_ins_rt(nrt);
+	} else if (rt6->rt6i_dst.plen == 128) {
+		rt6_do_update_pmtu(rt6, mtu);
 	}
 }
 
+static void ip6_rt_update_pmtu(struct dst_entry *dst, struct sock *sk,
+			       struct sk_buff *skb, u32 mtu)
+{
+	__ip6_rt_update_pmtu(dst, sk, skb ? ipv6_hdr(skb) : NULL, mtu);
+}
+
 void ip6_update_pmtu(struct sk_buff *skb, struct net *net, __be32 mtu,
 		     int oif, u32 mark)
 {
@@ -1113,7 +1274,7 @@ void ip6_update_pmtu(struct sk_buff *skb, struct net *net, __be32 mtu,
 
 	dst = ip6_route_output(net, NULL, &fl6);
 	if (!dst->error)
-		ip6_rt_update_pmtu(dst, NULL, skb, ntohl(mtu));
+		__ip6_rt_update_pmtu(dst, NULL, iph, ntohl(mtu));
 	dst_release(dst);
 }
 EXPORT_SYMBOL_GPL(ip6_update_pmtu);
@@ -1781,9 +1942,13 @@ static struct rt6_info *ip6_rt_copy(struct rt6_info *ort,
 				    const struct in6_addr *dest)
 {
 	struct net *net = dev_net(ort->dst.dev);
-	struct rt6_info *rt = ip6_dst_alloc(net, ort->dst.dev, 0,
-					    ort->rt6i_table);
+	struct rt6_info *rt;
+
+	/* copies of a per-cpu copy are made from the route itself */
+	if (ort->rt6i_flags & RTF_PCPU)
+		ort = (struct rt6_info *) ort->dst.from;
 
+	rt = ip6_dst_alloc(net, ort->dst.dev, 0, ort->rt6i_table);
 	if (rt) {
 		rt->dst.input = ort->dst.input;
 		rt->dst.output = ort->dst.output;
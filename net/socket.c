@@ -104,6 +104,7 @@
 #include <linux/route.h>
 #include <linux/sockios.h>
 #include <linux/atalk.h>
+#include <net/busy_poll.h>
 
 static int sock_no_open(struct inode *irrelevant, struct file *dontcare);
 static ssize_t sock_aio_read(struct kiocb *iocb, const struct iovec *iov,
@@ -1096,13 +1097,24 @@ EXPORT_SYMBOL(sock_create_lite);
 /* No kernel lock held - perfect */
 static unsigned int sock_poll(struct file *file, poll_table *wait)
 {
+	unsigned int busy_flag = 0;
 	struct socket *sock;
 
 	/*
 	 *      We can't return errors to poll, so it's either yes or no.
 	 */
 	sock = file->private_data;
-	return sock->ops->poll(file, sock, wait);
+
+	if (sk_can_busy_loop(sock->sk)) {
+		/* this socket can poll_ll so tell the system call */
+		busy_flag = POLL_BUSY_LOOP;
+
+		/* once, only if requested by syscall */
+		if (wait && (wait->_key & POLL_BUSY_LOOP))
+			sk_busy_loop(sock->sk, 1);
+	}
+
+	return busy_flag | sock->ops->poll(file, sock, wait);
 }
 
 static int sock_mmap(struct file *file, struct vm_area_struct *vma)
@@ -2028,6 +2040,18 @@ out:
 	return err;
 }
 
+/*
+ *	sendmsg on an already looked up socket, for in-kernel async users
+ */
+
+int __sys_sendmsg_sock(struct socket *sock, struct msghdr __user *msg,
+		       unsigned int flags)
+{
+	struct msghdr msg_sys;
+
+	return __sys_sendmsg(sock, msg, &msg_sys, flags, NULL);
+}
+
 /*
  *	Linux sendmmsg interface
  */
@@ -2202,6 +2226,14 @@ out:
 	return err;
 }
 
+int __sys_recvmsg_sock(struct socket *sock, struct msghdr __user *msg,
+		       unsigned int flags)
+{
+	struct msghdr msg_sys;
+
+	return __sys_recvmsg(sock, msg, &msg_sys, flags, 0);
+}
+
 /*
  *     Linux recvmmsg interface
  */
@@ -0,0 +1,226 @@
+/*
+ *
+ * futex-hash.c
+ *
+ * hash: Stress the kernel futex hash table
+ *
+ * Every thread repeatedly does FUTEX_WAIT on its own futexes with a
+ * value that never matches, so the syscall returns right after hashing
+ * the key and taking (then dropping) the hash bucket lock.  Threads do
+ * not share futexes, so any slowdown as threads are added comes from
+ * bucket collisions and lock contention inside the kernel.
+ *
+ */
+
+#include "../perf.h"
+#include "../util/util.h"
+#include "../util/parse-options.h"
+#include "../builtin.h"
+#include "bench.h"
+#include "futex.h"
+
+#include <pthread.h>
+#include <signal.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <unistd.h>
+#include <sys/time.h>
+
+static unsigned int nthreads;
+static unsigned int nsecs = 10;
+/* amount of futexes per thread */
+static unsigned int nfutexes = 1024;
+static bool fshared = false;
+
+static volatile int done;
+static int futex_flag;
+
+static pthread_mutex_t thread_lock;
+static pthread_cond_t thread_parent, thread_worker;
+static unsigned int threads_starting;
+
+struct worker {
+	int tid;
+	u_int32_t *futex;
+	pthread_t thread;
+	unsigned long ops;
+};
+
+static const struct option options[] = {
+	OPT_UINTEGER('t', "threads", &nthreads,
+		     "Specify amount of threads (default: number of CPUs)"),
+	OPT_UINTEGER('r', "runtime", &nsecs,
+		     "Specify runtime (in seconds)"),
+	OPT_UINTEGER('f', "futexes", &nfutexes,
+		     "Specify amount of futexes per thread"),
+	OPT_BOOLEAN('S', "shared", &fshared,
+		    "Use shared futexes instead of private ones"),
+	OPT_END()
+};
+
+static const char * const bench_futex_hash_usage[] = {
+	"perf bench futex hash <options>",
+	NULL
+};
+
+static void *workerfn(void *arg)
+{
+	struct worker *w = arg;
+	unsigned int i;
+	int ret;
+
+	pthread_mutex_lock(&thread_lock);
+	threads_starting--;
+	if (!threads_starting)
+		pthread_cond_signal(&thread_parent);
+	pthread_cond_wait(&thread_worker, &thread_lock);
+	pthread_mutex_unlock(&thread_lock);
+
+	while (!done) {
+		for (i = 0; i < nfutexes; i++, w->ops++) {
+			/*
+			 * We want the futex calls to fail in order to
+			 * stress the hashing of uaddr and not measure
+			 * other steps, such as internal waitqueue
+			 * handling, thus enlarging the critical region
+			 * protected by hb->lock.
+			 */
+			ret = futex_wait(&w->futex[i], 1234, NULL, futex_flag);
+			if (ret < 0 && errno != EAGAIN && errno != EWOULDBLOCK) {
+				fprintf(stderr, "futex_wait: %s\n",
+					strerror(errno));
+				exit(1);
+			}
+		}
+	}
+
+	return NULL;
+}
+
+static void toggle_done(int sig __used)
+{
+	done = 1;
+}
+
+int bench_futex_hash(int argc, const char **argv,
+		     const char *prefix __used)
+{
+	struct worker *worker;
+	struct timeval start, stop, runtime;
+	unsigned long total = 0, min_ops = ~0UL, max_ops = 0;
+	unsigned int i, j;
+	double secs;
+
+	argc = parse_options(argc, argv, options,
+			     bench_futex_hash_usage, 0);
+	if (argc) {
+		usage_with_options(bench_futex_hash_usage, options);
+		exit(EXIT_FAILURE);
+	}
+
+	if (!nthreads)
+		nthreads = sysconf(_SC_NPROCESSORS_ONLN);
+	if (!nfutexes)
+		nfutexes = 1;
+
+	worker = calloc(nthreads, sizeof(*worker));
+	if (!worker)
+		die("calloc");
+
+	if (!fshared)
+		futex_flag = FUTEX_PRIVATE_FLAG;
+
+	signal(SIGINT, toggle_done);
+	signal(SIGALRM, toggle_done);
+
+	if (bench_format == BENCH_FORMAT_DEFAULT)
+		printf("# %u threads operating on %u %s futexes each "
+		       "for %u secs.\n\n", nthreads, nfutexes,
+		       fshared ? "shared" : "private", nsecs);
+
+	pthread_mutex_init(&thread_lock, NULL);
+	pthread_cond_init(&thread_parent, NULL);
+	pthread_cond_init(&thread_worker, NULL);
+
+	threads_starting = nthreads;
+	for (i = 0; i < nthreads; i++) {
+		worker[i].tid = i;
+		worker[i].futex = calloc(nfutexes, sizeof(*worker[i].futex));
+		if (!worker[i].futex)
+			die("calloc");
+
+		if (pthread_create(&worker[i].thread, NULL, workerfn,
+				   &worker[i]))
+			die("pthread_create");
+	}
+
+	pthread_mutex_lock(&thread_lock);
+	while (threads_starting)
+		pthread_cond_wait(&thread_parent, &thread_lock);
+	pthread_cond_broadcast(&thread_worker);
+	pthread_mutex_unlock(&thread_lock);
+
+	gettimeofday(&start, NULL);
+	alarm(nsecs);
+	while (!done)
+		pause();
+	gettimeofday(&stop, NULL);
+	timersub(&stop, &start, &runtime);
+
+	for (i = 0; i < nthreads; i++) {
+		if (pthread_join(worker[i].thread, NULL))
+			die("pthread_join");
+	}
+
+	secs = runtime.tv_sec + runtime.tv_usec / 1000000.0;
+
+	for (i = 0; i < nthreads; i++) {
+		total += worker[i].ops;
+		if (worker[i].ops < min_ops)
+			min_ops = worker[i].ops;
+		if (worker[i].ops > max_ops)
+			max_ops = worker[i].ops;
+	}
+
+	switch (bench_format) {
+	case BENCH_FORMAT_DEFAULT:
+		for (j = 0; j < nthreads; j++)
+			printf(" [thread %3u] futexes: %p ... %p: %lu ops/sec\n",
+			       worker[j].tid, worker[j].futex,
+			       &worker[j].futex[nfutexes - 1],
+			       (unsigned long)(worker[j].ops / secs));
+
+		printf("\n %14s: %lu.%03lu [sec]\n", "Total time",
+		       runtime.tv_sec,
+		       (unsigned long)(runtime.tv_usec / 1000));
+		printf(" %14lu ops/sec (total)\n", (unsigned long)(total / secs));
+		printf(" %14lu ops/sec (per thread, avg)\n",
+		       (unsigned long)(total / nthreads / secs));
+		printf(" %14lu ops/sec (per thread, min)\n",
+		       (unsigned long)(min_ops / secs));
+		printf(" %14lu ops/sec (per thread, max)\n",
+		       (unsigned long)(max_ops / secs));
+		break;
+
+	case BENCH_FORMAT_SIMPLE:
+		printf("%lu\n", (unsigned long)(total / secs));
+		break;
+
+	default:
+		/* reaching here is something disaster */
+		fprintf(stderr, "Unknown format:%d\n", bench_format);
+		exit(1);
+		break;
+	}
+
+	for (i = 0; i < nthreads; i++)
+		free(worker[i].futex);
+	free(worker);
+	pthread_cond_destroy(&thread_parent);
+	pthread_cond_destroy(&thread_worker);
+	pthread_mutex_destroy(&thread_lock);
+
+	return 0;
+}
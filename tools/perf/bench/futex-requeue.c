@@ -0,0 +1,216 @@
+/*
+ *
+ * futex-requeue.c
+ *
+ * requeue: Measure FUTEX_CMP_REQUEUE latency
+ *
+ * A number of threads block on one futex and the main thread moves them
+ * over to a second futex, a few at a time, timing how long it takes to
+ * requeue them all.  This takes both hash bucket locks on every call.
+ *
+ */
+
+#include "../perf.h"
+#include "../util/util.h"
+#include "../util/parse-options.h"
+#include "../builtin.h"
+#include "bench.h"
+#include "futex.h"
+
+#include <pthread.h>
+#include <signal.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <unistd.h>
+#include <sys/time.h>
+
+static u_int32_t futex1 = 0, futex2 = 0;
+
+/*
+ * How many tasks to requeue at a time.
+ * Default to 1 in order to make the kernel work more.
+ */
+static unsigned int nrequeue = 1;
+
+static unsigned int nthreads;
+static unsigned int nruns = 10;
+static bool fshared = false;
+static int futex_flag;
+
+static pthread_mutex_t thread_lock;
+static pthread_cond_t thread_parent, thread_worker;
+static unsigned int threads_starting;
+
+static const struct option options[] = {
+	OPT_UINTEGER('t', "threads", &nthreads,
+		     "Specify amount of threads (default: number of CPUs)"),
+	OPT_UINTEGER('q', "nrequeue", &nrequeue,
+		     "Specify amount of threads to requeue at once"),
+	OPT_UINTEGER('r', "runs", &nruns,
+		     "Specify amount of runs"),
+	OPT_BOOLEAN('S', "shared", &fshared,
+		    "Use shared futexes instead of private ones"),
+	OPT_END()
+};
+
+static const char * const bench_futex_requeue_usage[] = {
+	"perf bench futex requeue <options>",
+	NULL
+};
+
+static void *workerfn(void *arg __used)
+{
+	pthread_mutex_lock(&thread_lock);
+	threads_starting--;
+	if (!threads_starting)
+		pthread_cond_signal(&thread_parent);
+	pthread_cond_wait(&thread_worker, &thread_lock);
+	pthread_mutex_unlock(&thread_lock);
+
+	/* requeued waiters return from here once woken on futex2 */
+	futex_wait(&futex1, 0, NULL, futex_flag);
+	return NULL;
+}
+
+static void block_threads(pthread_t *w)
+{
+	unsigned int i;
+
+	threads_starting = nthreads;
+
+	/* create and block all threads */
+	for (i = 0; i < nthreads; i++) {
+		if (pthread_create(&w[i], NULL, workerfn, NULL))
+			die("pthread_create");
+	}
+}
+
+int bench_futex_requeue(int argc, const char **argv,
+			const char *prefix __used)
+{
+	pthread_t *worker;
+	struct timeval start, end, runtime;
+	unsigned long long total_usec = 0, min_usec = ~0ULL, max_usec = 0;
+	unsigned int j, run;
+
+	argc = parse_options(argc, argv, options,
+			     bench_futex_requeue_usage, 0);
+	if (argc) {
+		usage_with_options(bench_futex_requeue_usage, options);
+		exit(EXIT_FAILURE);
+	}
+
+	if (!nthreads)
+		nthreads = sysconf(_SC_NPROCESSORS_ONLN);
+	if (!nrequeue || nrequeue > nthreads)
+		nrequeue = nthreads;
+	if (!nruns)
+		nruns = 1;
+
+	worker = calloc(nthreads, sizeof(*worker));
+	if (!worker)
+		die("calloc");
+
+	if (!fshared)
+		futex_flag = FUTEX_PRIVATE_FLAG;
+
+	if (bench_format == BENCH_FORMAT_DEFAULT)
+		printf("# %u threads requeuing %u at a time from "
+		       "%s futex %p to %p, %u runs.\n\n", nthreads, nrequeue,
+		       fshared ? "shared" : "private", &futex1, &futex2, nruns);
+
+	pthread_mutex_init(&thread_lock, NULL);
+	pthread_cond_init(&thread_parent, NULL);
+	pthread_cond_init(&thread_worker, NULL);
+
+	for (run = 0; run < nruns; run++) {
+		unsigned long long usec;
+		unsigned int nrequeued = 0, nwoken = 0;
+		int ret;
+
+		/* create, launch & block all threads */
+		block_threads(worker);
+
+		/* make sure all threads are already blocked */
+		pthread_mutex_lock(&thread_lock);
+		while (threads_starting)
+			pthread_cond_wait(&thread_parent, &thread_lock);
+		pthread_cond_broadcast(&thread_worker);
+		pthread_mutex_unlock(&thread_lock);
+
+		usleep(100000);
+
+		/* ok, all threads are blocked, start requeueing */
+		gettimeofday(&start, NULL);
+		while (nrequeued < nthreads) {
+			/*
+			 * Do not wakeup any tasks blocked on futex1,
+			 * only requeue them onto futex2.
+			 */
+			ret = futex_cmp_requeue(&futex1, 0, &futex2, 0,
+						nrequeue, futex_flag);
+			if (ret < 0)
+				die("futex_cmp_requeue");
+			if (!ret)
+				break;
+			nrequeued += ret;
+		}
+		gettimeofday(&end, NULL);
+		timersub(&end, &start, &runtime);
+
+		usec = runtime.tv_sec * 1000000ULL + runtime.tv_usec;
+		total_usec += usec;
+		if (usec < min_usec)
+			min_usec = usec;
+		if (usec > max_usec)
+			max_usec = usec;
+
+		if (bench_format == BENCH_FORMAT_DEFAULT)
+			printf(" [run %3u]: requeued %u of %u threads in %.4f ms\n",
+			       run, nrequeued, nthreads, usec / 1000.0);
+
+		/* everybody should be blocked on futex2, wake'em up */
+		while (nwoken < nthreads) {
+			ret = futex_wake(&futex2, nthreads, futex_flag);
+			/* stragglers that never made it onto futex2 */
+			ret += futex_wake(&futex1, nthreads, futex_flag);
+			nwoken += ret;
+			if (!ret)
+				usleep(1000);
+		}
+
+		for (j = 0; j < nthreads; j++) {
+			if (pthread_join(worker[j], NULL))
+				die("pthread_join");
+		}
+	}
+
+	switch (bench_format) {
+	case BENCH_FORMAT_DEFAULT:
+		printf("\n %14s: %.4f ms (min %.4f, max %.4f)\n",
+		       "Requeue time", total_usec / 1000.0 / nruns,
+		       min_usec / 1000.0, max_usec / 1000.0);
+		printf(" %14.3f usecs/thread\n",
+		       (double)total_usec / nruns / nthreads);
+		break;
+
+	case BENCH_FORMAT_SIMPLE:
+		printf("%.4f\n", total_usec / 1000.0 / nruns);
+		break;
+
+	default:
+		/* reaching here is something disaster */
+		fprintf(stderr, "Unknown format:%d\n", bench_format);
+		exit(1);
+		break;
+	}
+
+	pthread_cond_destroy(&thread_parent);
+	pthread_cond_destroy(&thread_worker);
+	pthread_mutex_destroy(&thread_lock);
+	free(worker);
+
+	return 0;
+}
@@ -0,0 +1,199 @@
+/*
+ *
+ * futex-wake.c
+ *
+ * wake: Measure FUTEX_WAKE latency
+ *
+ * A number of threads block on a single futex and the main thread wakes
+ * them up, a few at a time, timing how long it takes to wake them all.
+ * This exercises the hash bucket walk and lock hold times of the wake
+ * path.
+ *
+ */
+
+#include "../perf.h"
+#include "../util/util.h"
+#include "../util/parse-options.h"
+#include "../builtin.h"
+#include "bench.h"
+#include "futex.h"
+
+#include <pthread.h>
+#include <signal.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <unistd.h>
+#include <sys/time.h>
+
+/* all threads will block on the same futex */
+static u_int32_t futex1 = 0;
+
+/*
+ * How many wakeups to do at a time.
+ * Default to 1 in order to make the kernel work more.
+ */
+static unsigned int nwakes = 1;
+
+static unsigned int nthreads;
+static unsigned int nruns = 10;
+static bool fshared = false;
+static int futex_flag;
+
+static pthread_mutex_t thread_lock;
+static pthread_cond_t thread_parent, thread_worker;
+static unsigned int threads_starting;
+
+static const struct option options[] = {
+	OPT_UINTEGER('t', "threads", &nthreads,
+		     "Specify amount of threads (default: number of CPUs)"),
+	OPT_UINTEGER('w', "nwakes", &nwakes,
+		     "Specify amount of threads to wake at once"),
+	OPT_UINTEGER('r', "runs", &nruns,
+		     "Specify amount of runs"),
+	OPT_BOOLEAN('S', "shared", &fshared,
+		    "Use shared futexes instead of private ones"),
+	OPT_END()
+};
+
+static const char * const bench_futex_wake_usage[] = {
+	"perf bench futex wake <options>",
+	NULL
+};
+
+static void *workerfn(void *arg __used)
+{
+	pthread_mutex_lock(&thread_lock);
+	threads_starting--;
+	if (!threads_starting)
+		pthread_cond_signal(&thread_parent);
+	pthread_cond_wait(&thread_worker, &thread_lock);
+	pthread_mutex_unlock(&thread_lock);
+
+	while (1) {
+		if (!futex_wait(&futex1, 0, NULL, futex_flag))
+			break;
+	}
+
+	return NULL;
+}
+
+static void block_threads(pthread_t *w)
+{
+	unsigned int i;
+
+	threads_starting = nthreads;
+
+	/* create and block all threads */
+	for (i = 0; i < nthreads; i++) {
+		if (pthread_create(&w[i], NULL, workerfn, NULL))
+			die("pthread_create");
+	}
+}
+
+int bench_futex_wake(int argc, const char **argv,
+		     const char *prefix __used)
+{
+	pthread_t *worker;
+	struct timeval start, end, runtime;
+	unsigned long long total_usec = 0, min_usec = ~0ULL, max_usec = 0;
+	unsigned int j, run;
+
+	argc = parse_options(argc, argv, options,
+			     bench_futex_wake_usage, 0);
+	if (argc) {
+		usage_with_options(bench_futex_wake_usage, options);
+		exit(EXIT_FAILURE);
+	}
+
+	if (!nthreads)
+		nthreads = sysconf(_SC_NPROCESSORS_ONLN);
+	if (!nwakes)
+		nwakes = 1;
+	if (!nruns)
+		nruns = 1;
+
+	worker = calloc(nthreads, sizeof(*worker));
+	if (!worker)
+		die("calloc");
+
+	if (!fshared)
+		futex_flag = FUTEX_PRIVATE_FLAG;
+
+	if (bench_format == BENCH_FORMAT_DEFAULT)
+		printf("# %u threads waking up %u at a time, "
+		       "%s futex at %p, %u runs.\n\n", nthreads, nwakes,
+		       fshared ? "shared" : "private", &futex1, nruns);
+
+	pthread_mutex_init(&thread_lock, NULL);
+	pthread_cond_init(&thread_parent, NULL);
+	pthread_cond_init(&thread_worker, NULL);
+
+	for (run = 0; run < nruns; run++) {
+		unsigned long long usec;
+		unsigned int nwoken = 0;
+
+		/* create, launch & block all threads */
+		block_threads(worker);
+
+		/* make sure all threads are already blocked */
+		pthread_mutex_lock(&thread_lock);
+		while (threads_starting)
+			pthread_cond_wait(&thread_parent, &thread_lock);
+		pthread_cond_broadcast(&thread_worker);
+		pthread_mutex_unlock(&thread_lock);
+
+		usleep(100000);
+
+		/* ok, all threads are blocked, start waking folks up */
+		gettimeofday(&start, NULL);
+		while (nwoken != nthreads)
+			nwoken += futex_wake(&futex1, nwakes, futex_flag);
+		gettimeofday(&end, NULL);
+		timersub(&end, &start, &runtime);
+
+		usec = runtime.tv_sec * 1000000ULL + runtime.tv_usec;
+		total_usec += usec;
+		if (usec < min_usec)
+			min_usec = usec;
+		if (usec > max_usec)
+			max_usec = usec;
+
+		if (bench_format == BENCH_FORMAT_DEFAULT)
+			printf(" [run %3u]: woke %u of %u threads in %.4f ms\n",
+			       run, nwoken, nthreads, usec / 1000.0);
+
+		for (j = 0; j < nthreads; j++) {
+			if (pthread_join(worker[j], NULL))
+				die("pthread_join");
+		}
+	}
+
+	switch (bench_format) {
+	case BENCH_FORMAT_DEFAULT:
+		printf("\n %14s: %.4f ms (min %.4f, max %.4f)\n",
+		       "Wakeup time", total_usec / 1000.0 / nruns,
+		       min_usec / 1000.0, max_usec / 1000.0);
+		printf(" %14.3f usecs/thread\n",
+		       (double)total_usec / nruns / nthreads);
+		break;
+
+	case BENCH_FORMAT_SIMPLE:
+		printf("%.4f\n", total_usec / 1000.0 / nruns);
+		break;
+
+	default:
+		/* reaching here is something disaster */
+		fprintf(stderr, "Unknown format:%d\n", bench_format);
+		exit(1);
+		break;
+	}
+
+	pthread_cond_destroy(&thread_parent);
+	pthread_cond_destroy(&thread_worker);
+	pthread_mutex_destroy(&thread_lock);
+	free(worker);
+
+	return 0;
+}
@@ -0,0 +1,298 @@
+/*
+ *
+ * net-route.c
+ *
+ * route6: Stress IPv6 route lookups, optionally while the table changes
+ *
+ * Every thread keeps re-connecting its own UDP socket to addresses
+ * inside a prefix, and each connect() does a full output route lookup.
+ * With --churn, another thread keeps adding and deleting unrelated
+ * routes in the same table (this needs CAP_NET_ADMIN), so that the
+ * lookups run against concurrent table updates.
+ *
+ */
+
+#include "../perf.h"
+#include "../util/util.h"
+#include "../util/parse-options.h"
+#include "../builtin.h"
+#include "bench.h"
+
+#include <pthread.h>
+#include <signal.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <unistd.h>
+#include <sys/time.h>
+#include <sys/ioctl.h>
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <arpa/inet.h>
+#include <net/if.h>
+#include <net/route.h>
+
+static unsigned int nthreads;
+static unsigned int nsecs = 10;
+/* amount of destinations per thread */
+static unsigned int ndests = 64;
+static const char *prefix_str = "2001:db8::";
+static bool churn = false;
+
+static volatile int done;
+static struct in6_addr prefix;
+
+static pthread_mutex_t thread_lock;
+static pthread_cond_t thread_parent, thread_worker;
+static unsigned int threads_starting;
+
+struct worker {
+	int tid;
+	int fd;
+	pthread_t thread;
+	unsigned long ops;
+};
+
+static const struct option options[] = {
+	OPT_UINTEGER('t', "threads", &nthreads,
+		     "Specify amount of threads (default: number of CPUs)"),
+	OPT_UINTEGER('r', "runtime", &nsecs,
+		     "Specify runtime (in seconds)"),
+	OPT_UINTEGER('d', "dests", &ndests,
+		     "Specify amount of destinations per thread"),
+	OPT_STRING('p', "prefix", &prefix_str, "addr",
+		   "Specify the /64 prefix destinations are taken from"),
+	OPT_BOOLEAN('c', "churn", &churn,
+		    "Add and delete routes while looking up"),
+	OPT_END()
+};
+
+static const char * const bench_net_route6_usage[] = {
+	"perf bench net route6 <options>",
+	NULL
+};
+
+static void *workerfn(void *arg)
+{
+	struct worker *w = arg;
+	struct sockaddr_in6 sin6;
+	unsigned int i;
+
+	memset(&sin6, 0, sizeof(sin6));
+	sin6.sin6_family = AF_INET6;
+	sin6.sin6_port = htons(9);
+	sin6.sin6_addr = prefix;
+	sin6.sin6_addr.s6_addr[8] = w->tid >> 8;
+	sin6.sin6_addr.s6_addr[9] = w->tid;
+
+	pthread_mutex_lock(&thread_lock);
+	threads_starting--;
+	if (!threads_starting)
+		pthread_cond_signal(&thread_parent);
+	pthread_cond_wait(&thread_worker, &thread_lock);
+	pthread_mutex_unlock(&thread_lock);
+
+	while (!done) {
+		for (i = 0; i < ndests; i++, w->ops++) {
+			sin6.sin6_addr.s6_addr[14] = i >> 8;
+			sin6.sin6_addr.s6_addr[15] = i;
+			/*
+			 * Only the lookup is of interest: a missing or
+			 * unreachable route fails the connect, but the
+			 * table was searched all the same.
+			 */
+			if (connect(w->fd, (struct sockaddr *)&sin6,
+				    sizeof(sin6)) < 0 &&
+			    errno != ENETUNREACH && errno != EHOSTUNREACH &&
+			    errno != EACCES && errno != EINVAL) {
+				fprintf(stderr, "connect: %s\n",
+					strerror(errno));
+				exit(1);
+			}
+		}
+	}
+
+	return NULL;
+}
+
+/*
+ * Adds and deletes /64 routes next to the benchmarked prefix, which
+ * bumps the serial numbers along the lookup path every time.
+ */
+static void *churnfn(void *arg)
+{
+	unsigned long *updates = arg;
+	struct in6_rtmsg rtmsg;
+	unsigned int n = 0;
+	int fd;
+
+	fd = socket(AF_INET6, SOCK_DGRAM, 0);
+	if (fd < 0)
+		die("socket");
+
+	memset(&rtmsg, 0, sizeof(rtmsg));
+	rtmsg.rtmsg_dst = prefix;
+	rtmsg.rtmsg_dst_len = 64;
+	rtmsg.rtmsg_metric = 1;
+	rtmsg.rtmsg_flags = RTF_UP | RTF_REJECT;
+	rtmsg.rtmsg_ifindex = if_nametoindex("lo");
+
+	while (!done) {
+		/* stay clear of the /64 the workers look up */
+		rtmsg.rtmsg_dst.s6_addr[6] = 0x80 | ((n >> 8) & 0x7f);
+		rtmsg.rtmsg_dst.s6_addr[7] = n++;
+
+		if (ioctl(fd, SIOCADDRT, &rtmsg) < 0) {
+			fprintf(stderr, "SIOCADDRT: %s\n", strerror(errno));
+			exit(1);
+		}
+		if (ioctl(fd, SIOCDELRT, &rtmsg) < 0) {
+			fprintf(stderr, "SIOCDELRT: %s\n", strerror(errno));
+			exit(1);
+		}
+		*updates += 2;
+	}
+
+	close(fd);
+	return NULL;
+}
+
+static void toggle_done(int sig __used)
+{
+	done = 1;
+}
+
+int bench_net_route6(int argc, const char **argv,
+		     const char *prefix_arg __used)
+{
+	struct worker *worker;
+	struct timeval start, stop, runtime;
+	unsigned long total = 0, min_ops = ~0UL, max_ops = 0;
+	unsigned long updates = 0;
+	pthread_t churn_thread;
+	unsigned int i, j;
+	double secs;
+
+	argc = parse_options(argc, argv, options,
+			     bench_net_route6_usage, 0);
+	if (argc) {
+		usage_with_options(bench_net_route6_usage, options);
+		exit(EXIT_FAILURE);
+	}
+
+	if (inet_pton(AF_INET6, prefix_str, &prefix) != 1) {
+		fprintf(stderr, "invalid prefix: %s\n", prefix_str);
+		exit(EXIT_FAILURE);
+	}
+	memset(&prefix.s6_addr[8], 0, 8);
+
+	if (!nthreads)
+		nthreads = sysconf(_SC_NPROCESSORS_ONLN);
+	if (!ndests)
+		ndests = 1;
+
+	worker = calloc(nthreads, sizeof(*worker));
+	if (!worker)
+		die("calloc");
+
+	signal(SIGINT, toggle_done);
+	signal(SIGALRM, toggle_done);
+
+	if (bench_format == BENCH_FORMAT_DEFAULT)
+		printf("# %u threads looking up %u routes each in %s/64 "
+		       "for %u secs%s.\n\n", nthreads, ndests, prefix_str,
+		       nsecs, churn ? ", table churning" : "");
+
+	pthread_mutex_init(&thread_lock, NULL);
+	pthread_cond_init(&thread_parent, NULL);
+	pthread_cond_init(&thread_worker, NULL);
+
+	threads_starting = nthreads;
+	for (i = 0; i < nthreads; i++) {
+		worker[i].tid = i;
+		worker[i].fd = socket(AF_INET6, SOCK_DGRAM, 0);
+		if (worker[i].fd < 0)
+			die("socket");
+
+		if (pthread_create(&worker[i].thread, NULL, workerfn,
+				   &worker[i]))
+			die("pthread_create");
+	}
+
+	pthread_mutex_lock(&thread_lock);
+	while (threads_starting)
+		pthread_cond_wait(&thread_parent, &thread_lock);
+	pthread_cond_broadcast(&thread_worker);
+	pthread_mutex_unlock(&thread_lock);
+
+	if (churn && pthread_create(&churn_thread, NULL, churnfn, &updates))
+		die("pthread_create");
+
+	gettimeofday(&start, NULL);
+	alarm(nsecs);
+	while (!done)
+		pause();
+	gettimeofday(&stop, NULL);
+	timersub(&stop, &start, &runtime);
+
+	for (i = 0; i < nthreads; i++) {
+		if (pthread_join(worker[i].thread, NULL))
+			die("pthread_join");
+	}
+	if (churn && pthread_join(churn_thread, NULL))
+		die("pthread_join");
+
+	secs = runtime.tv_sec + runtime.tv_usec / 1000000.0;
+
+	for (i = 0; i < nthreads; i++) {
+		total += worker[i].ops;
+		if (worker[i].ops < min_ops)
+			min_ops = worker[i].ops;
+		if (worker[i].ops > max_ops)
+			max_ops = worker[i].ops;
+	}
+
+	switch (bench_format) {
+	case BENCH_FORMAT_DEFAULT:
+		for (j = 0; j < nthreads; j++)
+			printf(" [thread %3u] %lu lookups/sec\n",
+			       worker[j].tid,
+			       (unsigned long)(worker[j].ops / secs));
+
+		printf("\n %14s: %lu.%03lu [sec]\n", "Total time",
+		       runtime.tv_sec,
+		       (unsigned long)(runtime.tv_usec / 1000));
+		printf(" %14lu lookups/sec (total)\n",
+		       (unsigned long)(total / secs));
+		printf(" %14lu lookups/sec (per thread, avg)\n",
+		       (unsigned long)(total / nthreads / secs));
+		printf(" %14lu lookups/sec (per thread, min)\n",
+		       (unsigned long)(min_ops / secs));
+		printf(" %14lu lookups/sec (per thread, max)\n",
+		       (unsigned long)(max_ops / secs));
+		if (churn)
+			printf(" %14lu route updates/sec\n",
+			       (unsigned long)(updates / secs));
+		break;
+
+	case BENCH_FORMAT_SIMPLE:
+		printf("%lu\n", (unsigned long)(total / secs));
+		break;
+
+	default:
+		/* reaching here is something disaster */
+		fprintf(stderr, "Unknown format:%d\n", bench_format);
+		exit(1);
+		break;
+	}
+
+	for (i = 0; i < nthreads; i++)
+		close(worker[i].fd);
+	free(worker);
+	pthread_cond_destroy(&thread_parent);
+	pthread_cond_destroy(&thread_worker);
+	pthread_mutex_destroy(&thread_lock);
+
+	return 0;
+}
@@ -13,6 +13,8 @@
  * Available subsystem list:
  *  sched ... scheduler and IPC mechanism
  *  mem   ... memory access performance
+ *  futex ... futex performance
+ *  net   ... networking stack performance
  *
  */
 
@@ -61,6 +63,32 @@ static struct bench_suite mem_suites[] = {
 	  NULL             }
 };
 
+static struct bench_suite futex_suites[] = {
+	{ "hash",
+	  "Benchmark for futex hash table",
+	  bench_futex_hash },
+	{ "wake",
+	  "Benchmark for futex wake calls",
+	  bench_futex_wake },
+	{ "requeue",
+	  "Benchmark for futex requeue calls",
+	  bench_futex_requeue },
+	suite_all,
+	{ NULL,
+	  NULL,
+	  NULL                }
+};
+
+static struct bench_suite net_suites[] = {
+	{ "route6",
+	  "Benchmark for IPv6 route lookups",
+	  bench_net_route6 },
+	suite_all,
+	{ NULL,
+	  NULL,
+	  NULL                }
+};
+
 struct bench_subsys {
 	const char *name;
 	const char *summary;
@@ -74,6 +102,12 @@ static struct bench_subsys subsystems[] = {
 	{ "mem",
 	  "memory access performance",
 	  mem_suites },
+	{ "futex",
+	  "futex stressing benchmarks",
+	  futex_suites },
+	{ "net",
+	  "networking stack benchmarks",
+	  net_suites },
 	{ "all",		/* sentinel: easy for help */
 	  "all benchmark subsystem",
 	  NULL },